@@ -3,14 +3,20 @@
 #include <stdio.h>
 
 #include "zba_auth.h"
+#include "zba_boot.h"
 #include "zba_camera.h"
 #include "zba_commands.h"
 #include "zba_config.h"
+#include "zba_frame.h"
 #include "zba_i2c.h"
 #include "zba_led.h"
+#include "zba_metrics.h"
+#include "zba_mjpeg.h"
 #include "zba_pins.h"
+#include "zba_rtsp.h"
 #include "zba_sd.h"
 #include "zba_stream.h"
+#include "zba_trace.h"
 #include "zba_util.h"
 #include "zba_vision.h"
 #include "zba_web.h"
@@ -38,18 +44,95 @@ static zba_led_seg_t kTestLEDConfig[] = {
      .data_buf          = NULL},
 };
 
+static zba_err_t app_led_init()
+{
+  zba_led_strip_cfg(kTestLEDConfig, sizeof(kTestLEDConfig) / sizeof(zba_led_seg_t));
+  return zba_led_init();
+}
+
+/// Puts the LED strip back to the color it was last set to
+static zba_err_t app_restore_led()
+{
+  uint32_t color = zba_config_get_u32(ZBA_CFG_LED_COLOR);
+  if (!color) return ZBA_OK;
+
+  zba_err_t result = zba_led_strip_set_led(0, -1, color >> 24, (color >> 16) & 0xff,
+                                           (color >> 8) & 0xff, color & 0xff);
+  if (ZBA_OK != result) return result;
+  return zba_led_strip_flip();
+}
+
+static zba_err_t app_stream_init()
+{
+  return zba_stream_init(true);
+}
+
+/// Starts the camera with the saved settings
+static zba_err_t app_camera_init()
+{
+  zba_camera_set_res(zba_config_get_u32(ZBA_CFG_CAMERA_RES));
+  zba_camera_set_quality(zba_config_get_u32(ZBA_CFG_CAMERA_QUALITY));
+  zba_err_t result = zba_camera_init();
+  if (ZBA_OK != result) return result;
+  return zba_camera_set_autoexposure(zba_config_get_u32(ZBA_CFG_AUTOEXPOSE));
+}
+
+/// Boot steps, in the order they start
+typedef enum
+{
+  APP_BOOT_METRICS,
+  APP_BOOT_LED,
+  APP_BOOT_I2C,
+  APP_BOOT_TRACE,
+  APP_BOOT_CONFIG,
+  APP_BOOT_LED_COLOR,
+  APP_BOOT_AUTH,
+  APP_BOOT_STREAM,
+  APP_BOOT_FRAME,
+  APP_BOOT_CAMERA,
+  APP_BOOT_WIFI,
+  APP_BOOT_MJPEG,
+  APP_BOOT_RTSP,
+  APP_BOOT_WEB,
+  APP_BOOT_NUM_STEPS
+} app_boot_step_t;
+
+#define AFTER(x) ZBA_BOOT_AFTER(APP_BOOT_##x)
+
+/// What each subsystem needs up before it starts.
+/// Camera and WiFi are the slow ones (sensor setup, and waiting to associate), and need
+/// nothing of each other, so they get their own tasks and come up together. The serial
+/// stream is up before either, so commands work while they start.
+// clang-format off
+static const zba_boot_step_t kBootSteps[APP_BOOT_NUM_STEPS] =
+{
+  //                      Name         Init              After                                         Own task
+  [APP_BOOT_METRICS]   = {"metrics",   zba_metrics_init, 0,                                            false},
+  [APP_BOOT_LED]       = {"led",       app_led_init,     0,                                            false},
+  [APP_BOOT_I2C]       = {"i2c",       zba_i2c_init,     0,                                            false},
+  [APP_BOOT_TRACE]     = {"trace",     zba_trace_init,   AFTER(METRICS),                               false},
+  [APP_BOOT_CONFIG]    = {"config",    zba_config_init,  0,                                            false},
+  [APP_BOOT_LED_COLOR] = {"led_color", app_restore_led,  AFTER(LED) | AFTER(CONFIG),                   false},
+  [APP_BOOT_AUTH]      = {"auth",      zba_auth_init,    AFTER(CONFIG),                                false},
+  [APP_BOOT_STREAM]    = {"stream",    app_stream_init,  AFTER(CONFIG) | AFTER(AUTH),                  false},
+  [APP_BOOT_FRAME]     = {"frame",     zba_frame_init,   0,                                            false},
+  [APP_BOOT_CAMERA]    = {"camera",    app_camera_init,  AFTER(METRICS) | AFTER(I2C) | AFTER(TRACE) |
+                                                         AFTER(CONFIG) | AFTER(FRAME),                 true},
+  [APP_BOOT_WIFI]      = {"wifi",      zba_wifi_init,    AFTER(CONFIG),                                true},
+  [APP_BOOT_MJPEG]     = {"mjpeg",     zba_mjpeg_init,   AFTER(METRICS) | AFTER(CAMERA),               false},
+  [APP_BOOT_RTSP]      = {"rtsp",      zba_rtsp_init,    AFTER(CAMERA) | AFTER(WIFI),                  false},
+  [APP_BOOT_WEB]       = {"web",       zba_web_init,     AFTER(METRICS) | AFTER(WIFI) | AFTER(MJPEG),  false},
+};
+// clang-format on
+
 void app_init()
 {
   ZBA_LOG("Initializing System...");
-  zba_led_strip_cfg(kTestLEDConfig, sizeof(kTestLEDConfig) / sizeof(zba_led_seg_t));
-  zba_led_init();
-  zba_i2c_init();
-  zba_config_init();
-  zba_auth_init();
-  zba_stream_init(true);
-  zba_camera_init(ZBA_SXGA);
-  zba_wifi_init();
-  zba_web_init();
+  zba_err_t result = zba_boot_run(kBootSteps, APP_BOOT_NUM_STEPS);
+  if (ZBA_OK != result)
+  {
+    ZBA_ERR("Boot failed: 0x%X", result);
+  }
   // zba_vision_init();
   // SD conflicts with led and i2c.
   // zba_sd_init();
@@ -62,13 +145,18 @@ void app_deinit()
   zba_vision_deinit();
   zba_sd_deinit();
   zba_web_deinit();
+  zba_rtsp_deinit();
+  zba_mjpeg_deinit();
   zba_wifi_deinit();
   zba_camera_deinit();
+  zba_frame_deinit();
   zba_stream_deinit();
   zba_auth_deinit();
   zba_config_deinit();
+  zba_trace_deinit();
   zba_i2c_deinit();
   zba_led_deinit();
+  zba_metrics_deinit();
   ZBA_LOG("System Deinitialized.");
 }
 
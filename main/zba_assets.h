@@ -0,0 +1,32 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_ASSETS_H_
+#define ZEBRAL_ESP32CAM_ZBA_ASSETS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /// A web page or image built in from res/. The table is generated at build time by
+  /// tools/gen_assets.py (see main/CMakeLists.txt for the list).
+  typedef struct
+  {
+    const char* uri;           ///< Where it's served
+    const char* content_type;  ///< MIME type
+    const char* etag;          ///< Strong ETag, quoted
+    bool auth;                 ///< Needs a login
+    const uint8_t* data;       ///< Gzipped content
+    size_t len;                ///< Bytes in data
+  } zba_asset_t;
+
+  extern const zba_asset_t kAssets[];
+  extern const size_t kAssetCount;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_ASSETS_H_
@@ -8,9 +8,15 @@
 #include <esp_tls_crypto.h>
 #include <esp_wifi.h>
 #include <esp_wpa.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
 #include <nvs_flash.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/param.h>
+#include "zba_auth_digest.h"
 #include "zba_config.h"
 
 DEFINE_ZBA_MODULE(zba_auth);
@@ -24,20 +30,76 @@ DEFINE_ZBA_MODULE(zba_auth);
 // Min buffer for request headers - if we set this as a minimum for our buffer we can reuse it to
 // send our challenge as well which should be < 256 bytes.
 #define ZBA_AUTH_REQUEST_SIZE 256
+// Largest Authorization header we'll read for digest - the uri in it can be up to
+// CONFIG_HTTPD_MAX_URI_LEN (512).
+#define ZBA_AUTH_HEADER_SIZE 768
 
 #define kAUTH_REALM          "Zebral"
 #define kBASIC_REALM_STRING  "Basic realm=\"" kAUTH_REALM "\""
 #define kDIGEST_REALM_STRING "Digest realm=\"" kAUTH_REALM "\", "
 
+// Session cookies let a browser skip digest auth once it's passed it.
+// The token is hex: 8 chars of expiry (seconds of uptime), 8 of random id, then the first
+// 16 bytes of HMAC-SHA256 over those 16 chars. The key is random per boot and changes with
+// the password, so a reboot or a new password ends every session.
+#define kSESSION_COOKIE       "zba_session"
+#define ZBA_AUTH_SESSION_DATA 16
+#define ZBA_AUTH_SESSION_MAC  16
+#define ZBA_AUTH_TOKEN_LEN    (ZBA_AUTH_SESSION_DATA + ZBA_AUTH_SESSION_MAC * 2)
+#define ZBA_AUTH_KEY_LEN      32
+#define ZBA_AUTH_SHA_BLOCK    64
+
+// Digest nonces we've handed out, so we can tell made-up and replayed ones from ours.
+// Past the lifetime a nonce is stale - a client with the right password is told so, and
+// retries with a new one without asking the user again.
+#define ZBA_AUTH_MAX_NONCES 8
+#define ZBA_AUTH_NONCE_LEN  32
+// Browsers use one nonce across parallel connections, so counts arrive out of order.
+// Each nonce remembers which of the last ZBA_AUTH_NC_WINDOW counts have been used.
+#define ZBA_AUTH_NC_WINDOW 32
+
+static const int kSessionSeconds      = 60 * 60;         ///< How long a session lasts
+static const int64_t kNonceLifetimeMs = 5 * 60 * 1000;  ///< How long a nonce is good for
+
+typedef struct
+{
+  char nonce[ZBA_AUTH_NONCE_LEN + 1];  ///< Hex nonce, empty if the slot's free
+  int64_t issued;                      ///< zba_now_ms() when it went out
+  uint32_t nc;                         ///< Highest nonce count used with it, 0 if none yet
+  uint32_t nc_seen;                    ///< Bit n set if count nc - n has been used
+} zba_auth_nonce_t;
+
 typedef struct
 {
   // Buffer for our stored credentials
   uint8_t basic_buf[ZBA_AUTH_REQUEST_SIZE];
   size_t basic_len;
 
+  // Session signing key, and the mutex guarding it
+  uint8_t session_key[ZBA_AUTH_KEY_LEN];
+  SemaphoreHandle_t mutex;
+  // Set-Cookie value for the last session issued. httpd keeps a pointer to header
+  // values until the response goes, and runs one handler at a time, so one does.
+  char session_cookie[ZBA_AUTH_REQUEST_SIZE];
+
+  // Digest state, also under the mutex. HA1 only changes with the password.
+  uint8_t ha1[16];
+  char opaque[ZBA_AUTH_NONCE_LEN + 1];
+  zba_auth_nonce_t nonces[ZBA_AUTH_MAX_NONCES];
 } zba_auth_state_t;
 
-static zba_auth_state_t auth_state = {.basic_buf = {0}, .basic_len = 0};
+static zba_auth_state_t auth_state = {
+    .basic_buf      = {0},
+    .basic_len      = 0,
+    .session_key    = {0},
+    .mutex          = NULL,
+    .session_cookie = {0},
+    .ha1            = {0},
+    .opaque         = {0},
+    .nonces         = {{{0}}},
+};
+
+static zba_err_t zba_auth_digest_verify(httpd_req_t *req);
 
 void zba_md5_vector(void *src, size_t len, uint8_t *out)
 {
@@ -47,6 +109,22 @@ void zba_md5_vector(void *src, size_t len, uint8_t *out)
   esp_rom_md5_final(out, &context);
 }
 
+/// MD5 of the parts joined with ':', the way every digest hash is built.
+static void zba_auth_md5_join(const zba_auth_slice_t *parts, int count, uint8_t *out)
+{
+  md5_context_t context;
+  esp_rom_md5_init(&context);
+  for (int i = 0; i < count; ++i)
+  {
+    if (i > 0)
+    {
+      esp_rom_md5_update(&context, ":", 1);
+    }
+    esp_rom_md5_update(&context, parts[i].ptr, parts[i].len);
+  }
+  esp_rom_md5_final(out, &context);
+}
+
 zba_err_t zba_auth_init()
 {
   char credentials[kMaxPasswordLen + kMaxUserLen + 2] = {0};
@@ -69,6 +147,18 @@ zba_err_t zba_auth_init()
 
   auth_state.basic_len += 6;  // Add header length
 
+  if (NULL == (auth_state.mutex = xSemaphoreCreateMutex()))
+  {
+    ZBA_ERR("Couldn't create auth mutex");
+    result = ZBA_AUTH_INIT_FAILED;
+  }
+  else
+  {
+    memset(auth_state.nonces, 0, sizeof(auth_state.nonces));
+    zba_auth_get_opaque(auth_state.opaque);
+    zba_auth_password_changed();
+  }
+
   ZBA_SET_INIT(zba_auth, result);
   return result;
 }
@@ -77,281 +167,437 @@ zba_err_t zba_auth_deinit()
 {
   zba_err_t deinit_error = ZBA_OK;
   // ...
+  if (auth_state.mutex)
+  {
+    vSemaphoreDelete(auth_state.mutex);
+  }
   memset(&auth_state, 0, sizeof(auth_state));
   ZBA_SET_DEINIT(zba_auth, deinit_error);
   return deinit_error;
 }
 
-// Basic auth check
-zba_err_t zba_auth_basic_check_web(httpd_req_t *req)
+void zba_auth_password_changed()
 {
-  char *auth_buf = NULL;
-  size_t buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
+  char pwd[kMaxPasswordLen + 1] = {0};
+  uint8_t ha1[16];
+
+  if (!auth_state.mutex) return;
+
+  zba_config_get_device_pwd(pwd, kMaxPasswordLen);
+  zba_auth_gen_ha1(kAdminUser, kAUTH_REALM, pwd, ha1);
+  memset(pwd, 0, sizeof(pwd));
+
+  // A new key invalidates every session signed with the old one.
+  ZBA_LOCK(auth_state.mutex);
+  memcpy(auth_state.ha1, ha1, sizeof(ha1));
+  esp_fill_random(auth_state.session_key, sizeof(auth_state.session_key));
+  ZBA_UNLOCK(auth_state.mutex);
+}
+
+/// Makes a new nonce and remembers it, taking the oldest slot if they're all in use.
+static void zba_auth_issue_nonce(char *nonce)
+{
+  zba_auth_get_nonce(nonce);
 
-  if (buf_len > 1)
+  ZBA_LOCK(auth_state.mutex);
+  zba_auth_nonce_t *slot = &auth_state.nonces[0];
+  for (int i = 0; i < ZBA_AUTH_MAX_NONCES; ++i)
   {
-    auth_buf = calloc(1, buf_len);
-    if (!auth_buf)
+    zba_auth_nonce_t *entry = &auth_state.nonces[i];
+    if (entry->nonce[0] == 0)
     {
-      ZBA_ERR("Not enough memory for auth header (%d)", buf_len);
-      return ZBA_OUT_OF_MEMORY;
+      slot = entry;
+      break;
     }
-
-    if (httpd_req_get_hdr_value_str(req, "Authorization", auth_buf, buf_len) == ESP_OK)
+    if (entry->issued < slot->issued)
     {
-      if (0 == strncmp(auth_buf, (const char *)auth_state.basic_buf, auth_state.basic_len))
-      {
-        ZBA_LOG("Authentication successful.");
-        free(auth_buf);
-        return ZBA_OK;
-      }
+      slot = entry;
     }
   }
-  ZBA_LOG("Sending unauthorized request");
-  httpd_resp_set_status(req, "401 UNAUTHORIZED");
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Connection", "keep-alive");
-  httpd_resp_set_hdr(req, "WWW-Authenticate", kBASIC_REALM_STRING);
-  httpd_resp_send(req, NULL, 0);
-  free(auth_buf);
-  return ZBA_ERROR;
+  memcpy(slot->nonce, nonce, ZBA_AUTH_NONCE_LEN + 1);
+  slot->issued  = zba_now_ms();
+  slot->nc      = 0;
+  slot->nc_seen = 0;
+  ZBA_UNLOCK(auth_state.mutex);
 }
 
-// Digest auth check
-zba_err_t zba_auth_digest_check_web(httpd_req_t *req)
+/// Checks a nonce is one of ours, still fresh, and that nc hasn't been used with it.
+/// Records nc if so. Counts can come in out of order, but not more than
+/// ZBA_AUTH_NC_WINDOW behind the highest. Without qop there's no nc - pass 1 and the
+/// nonce is single-use.
+static zba_err_t zba_auth_use_nonce(const char *nonce, size_t len, uint32_t nc)
 {
-  uint8_t authHa1[16];
-  uint8_t authHa2[16];
-  uint8_t authResponse[16];
-  char nonce_req[33]  = {0};
-  char opaque_req[33] = {0};
-  char nonce[33];
-  char pwd[kMaxPasswordLen + 1] = {0};
+  zba_err_t result = ZBA_ERROR;
+  if (len != ZBA_AUTH_NONCE_LEN) return result;
 
-  char *auth_buf    = NULL;
-  char *uri         = NULL;
-  char *responseVal = NULL;
-  char *valPtr      = NULL;
-  size_t valLen     = 0;
-
-  size_t req_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-  size_t buf_len = req_len;
-  for (;;)
+  ZBA_LOCK(auth_state.mutex);
+  for (int i = 0; i < ZBA_AUTH_MAX_NONCES; ++i)
   {
-    // Go ahead and allocate enough to reuse the buffer to send the request
-    // on failed auth.
-    buf_len  = ZBA_MAX(buf_len, ZBA_AUTH_REQUEST_SIZE);
-    auth_buf = calloc(1, buf_len);
-
-    // If the request length was empty, we still want that buffer! but break now.
-    if (req_len <= 1) break;
+    zba_auth_nonce_t *entry = &auth_state.nonces[i];
+    if ((entry->nonce[0] == 0) || (0 != memcmp(entry->nonce, nonce, len))) continue;
 
-    if (!auth_buf)
+    if (zba_now_ms() - entry->issued > kNonceLifetimeMs)
     {
-      ZBA_ERR("Not enough memory for auth header (%d)", buf_len);
-      // TODO add server error response.
-      // We don't break here because we don't have the ram to generate the challenge.
-      return ZBA_OUT_OF_MEMORY;
+      ZBA_LOG("Stale nonce.");
+      entry->nonce[0] = 0;
+      result          = ZBA_AUTH_STALE_NONCE;
     }
-
-    // Bail if we can't get the auth string
-    if (httpd_req_get_hdr_value_str(req, "Authorization", auth_buf, buf_len) != ESP_OK)
+    else if (nc > entry->nc)
     {
-      break;
+      uint32_t ahead = nc - entry->nc;
+      entry->nc_seen = (ahead < ZBA_AUTH_NC_WINDOW) ? (entry->nc_seen << ahead) | 1 : 1;
+      entry->nc      = nc;
+      result         = ZBA_OK;
     }
-
-    // Oooh, this gets into the weeds a bit.
-    // Looks like we're on our own for parsing, too.
-    // For a proper server, we should have a formal language
-    // parser, or at least regexes. But for this? ....
-
-    // Only supporting admin user right now
-    if (!zba_auth_get_value(auth_buf, "username", &valPtr, &valLen)) break;
-    if (0 != strncasecmp(kAdminUser, valPtr, valLen)) break;
-
-    // Check our realm
-    if (!zba_auth_get_value(auth_buf, "realm", &valPtr, &valLen)) break;
-    if (0 != strncmp(kAUTH_REALM, valPtr, valLen)) break;
-
-    // Right now ignoring QOP
-    // {TODO} Get RFC2069 going, then do 2617
-    // if (!zba_auth_get_value(auth_buf, "qop"), &valPtr, &valLen))
-    // if (!zba_auth_get_value(auth_buf, "nc", &valPtr, &valLen)) break;
-    // if (!zba_auth_get_value(auth_buf, "cnonce", &valPtr, &valLen)) break;
-
-    // Get our password
-    zba_config_get_device_pwd(pwd, kMaxPasswordLen);
-
-    // Generate first hash
-    if (!zba_auth_gen_ha1("admin", kAUTH_REALM, pwd, authHa1)) break;
-
-    // URI may be quite large, so alloc ram for it and copy it out.
-    if (!zba_auth_get_value(auth_buf, "uri", &valPtr, &valLen)) break;
-    uri = calloc(1, valLen + 1);
-    if (!uri) break;
-    strncpy(uri, valPtr, valLen);
-    uri[valLen] = 0;
-
-    // {TODO} Right now, we only support get.
-    // Generate second hash.
-    if (!zba_auth_gen_ha2("GET", uri, authHa2)) break;
-
-    if (!zba_auth_get_value(auth_buf, "nonce", &valPtr, &valLen)) break;
-    strncpy(nonce, valPtr, valLen);
-    nonce[32] = 0;
-    // {TODO} check and see if we've issued nonce or if they just made it up.
-
-    // Gen response from hashes
-    if (!zba_auth_gen_response(authHa1, authHa2, nonce, authResponse)) break;
-
-    // Get current response
-    if (!zba_auth_get_value(auth_buf, "response", &responseVal, &valLen)) break;
-
-    // Convert each byte in the response string to binary and check against our
-    // calculated value.
-    bool responseMatch = true;
-    for (int i = 0; i < 16; ++i)
+    else if ((nc == 0) || (entry->nc - nc >= ZBA_AUTH_NC_WINDOW) ||
+             (entry->nc_seen & (1UL << (entry->nc - nc))))
     {
-      uint8_t val = zba_hex_to_byte(responseVal + i * 2);
-      if (authResponse[i] != val)
-      {
-        responseMatch = false;
-        break;
-      }
+      ZBA_ERR("Replayed nonce count %" PRIu32 " (last %" PRIu32 ")", nc, entry->nc);
     }
+    else
+    {
+      entry->nc_seen |= 1UL << (entry->nc - nc);
+      result = ZBA_OK;
+    }
+    break;
+  }
+  ZBA_UNLOCK(auth_state.mutex);
+  return result;
+}
+
+/// Writes len bytes as 2 * len lowercase hex chars, without a null.
+static void zba_auth_to_hex(const uint8_t *bytes, size_t len, char *out)
+{
+  static const char kHex[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; ++i)
+  {
+    *out++ = kHex[bytes[i] >> 4];
+    *out++ = kHex[bytes[i] & 0xf];
+  }
+}
+
+/// HMAC-SHA256 of a token's data chars, truncated to ZBA_AUTH_SESSION_MAC bytes.
+static void zba_auth_session_mac(const char *data, uint8_t *mac)
+{
+  uint8_t pad[ZBA_AUTH_SHA_BLOCK];
+  uint8_t digest[32];
+  mbedtls_sha256_context ctx;
+
+  memset(pad, 0x36, sizeof(pad));
+  ZBA_LOCK(auth_state.mutex);
+  for (int i = 0; i < ZBA_AUTH_KEY_LEN; ++i)
+  {
+    pad[i] ^= auth_state.session_key[i];
+  }
+  ZBA_UNLOCK(auth_state.mutex);
+
+  // Inner hash over (key ^ ipad) + data
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts_ret(&ctx, 0);
+  mbedtls_sha256_update_ret(&ctx, pad, sizeof(pad));
+  mbedtls_sha256_update_ret(&ctx, (const uint8_t *)data, ZBA_AUTH_SESSION_DATA);
+  mbedtls_sha256_finish_ret(&ctx, digest);
+
+  // Outer hash over (key ^ opad) + inner hash. XOR flips the ipad bytes to opad.
+  for (int i = 0; i < sizeof(pad); ++i)
+  {
+    pad[i] ^= 0x36 ^ 0x5c;
+  }
+  mbedtls_sha256_starts_ret(&ctx, 0);
+  mbedtls_sha256_update_ret(&ctx, pad, sizeof(pad));
+  mbedtls_sha256_update_ret(&ctx, digest, sizeof(digest));
+  mbedtls_sha256_finish_ret(&ctx, digest);
+  mbedtls_sha256_free(&ctx);
+
+  memcpy(mac, digest, ZBA_AUTH_SESSION_MAC);
+  memset(pad, 0, sizeof(pad));
+}
 
-    // Bail if it failed.
-    if (!responseMatch)
+/// Finds name=value in a Cookie header, returning the start of value.
+static const char *zba_auth_find_cookie(const char *cookies, const char *name)
+{
+  size_t name_len = strlen(name);
+  const char *cur = cookies;
+  while (NULL != (cur = strstr(cur, name)))
+  {
+    bool at_start = (cur == cookies) || (cur[-1] == ' ') || (cur[-1] == ';');
+    cur += name_len;
+    if (at_start && (*cur == '='))
     {
-      ZBA_ERR("Response did not match binary.");
-      break;
+      return cur + 1;
     }
+  }
+  return NULL;
+}
+
+/// True if the request carries an unexpired session cookie we signed.
+/// Runs on every authed request, so everything's on the stack.
+static bool zba_auth_session_valid(httpd_req_t *req)
+{
+  char cookies[ZBA_AUTH_REQUEST_SIZE];
+  char expected[ZBA_AUTH_SESSION_MAC * 2];
+  char expiry[9];
+  uint8_t mac[ZBA_AUTH_SESSION_MAC];
 
-    // With all that good, do any additional checks on opaque.
-    if (!zba_auth_get_value(auth_buf, "opaque", &valPtr, &valLen)) break;
-    // {TODO} validate opaque
+  if (!auth_state.mutex) return false;
 
-    ZBA_LOG("Authentication successful.");
-    free(uri);
-    free(auth_buf);
-    return ZBA_OK;
+  // A long header comes back cut short rather than failing - the session may still be in it.
+  esp_err_t res = httpd_req_get_hdr_value_str(req, "Cookie", cookies, sizeof(cookies));
+  if ((ESP_OK != res) && (ESP_ERR_HTTPD_RESULT_TRUNC != res)) return false;
+
+  const char *token = zba_auth_find_cookie(cookies, kSESSION_COOKIE);
+  if (!token || (strcspn(token, "; ") != ZBA_AUTH_TOKEN_LEN)) return false;
+
+  // Compare every char so the time taken doesn't say how much of it matched.
+  zba_auth_session_mac(token, mac);
+  zba_auth_to_hex(mac, sizeof(mac), expected);
+  uint8_t diff = 0;
+  for (int i = 0; i < sizeof(expected); ++i)
+  {
+    diff |= expected[i] ^ token[ZBA_AUTH_SESSION_DATA + i];
   }
+  if (diff != 0) return false;
 
-  // If we got here w/o returning, there was a failure.
+  // It's ours, so the expiry can be trusted.
+  memcpy(expiry, token, 8);
+  expiry[8] = 0;
+  return (zba_now() / 1000000) < strtoul(expiry, NULL, 16);
+}
+
+/// Starts a session by adding its cookie to the response.
+static void zba_auth_session_start(httpd_req_t *req)
+{
+  char token[ZBA_AUTH_TOKEN_LEN + 1];
+  uint8_t mac[ZBA_AUTH_SESSION_MAC];
+
+  if (!auth_state.mutex) return;
+
+  uint32_t expiry = (uint32_t)(zba_now() / 1000000) + kSessionSeconds;
+  snprintf(token, sizeof(token), "%08" PRIx32 "%08" PRIx32, expiry, esp_random());
+  zba_auth_session_mac(token, mac);
+  zba_auth_to_hex(mac, sizeof(mac), token + ZBA_AUTH_SESSION_DATA);
+  token[ZBA_AUTH_TOKEN_LEN] = 0;
+
+  snprintf(auth_state.session_cookie, sizeof(auth_state.session_cookie),
+           kSESSION_COOKIE "=%s; Path=/; Max-Age=%d; HttpOnly; SameSite=Strict", token,
+           kSessionSeconds);
+  httpd_resp_set_hdr(req, "Set-Cookie", auth_state.session_cookie);
+}
+
+// Basic auth check
+zba_err_t zba_auth_basic_check_web(httpd_req_t *req)
+{
+  // Anything longer than the buffer can't be our credentials anyway.
+  char auth_buf[ZBA_AUTH_REQUEST_SIZE];
+
+  if (httpd_req_get_hdr_value_str(req, "Authorization", auth_buf, sizeof(auth_buf)) == ESP_OK)
+  {
+    if (0 == strncmp(auth_buf, (const char *)auth_state.basic_buf, auth_state.basic_len))
+    {
+      ZBA_LOG("Authentication successful.");
+      return ZBA_OK;
+    }
+  }
   ZBA_LOG("Sending unauthorized request");
   httpd_resp_set_status(req, "401 UNAUTHORIZED");
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Connection", "keep-alive");
+  httpd_resp_set_hdr(req, "WWW-Authenticate", kBASIC_REALM_STRING);
+  httpd_resp_send(req, NULL, 0);
+  return ZBA_ERROR;
+}
 
-  zba_auth_get_nonce(nonce_req);
-  zba_auth_get_opaque(opaque_req);
+// Digest auth check
+zba_err_t zba_auth_digest_check_web(httpd_req_t *req)
+{
+  char auth_buf[ZBA_AUTH_REQUEST_SIZE];
 
-  //"qop=\"auth\",\n\t"  // {TODO}
-  snprintf(auth_buf, buf_len, kDIGEST_REALM_STRING " nonce=\"%s\", opaque=\"%s\"", nonce_req,
-           opaque_req);
+  if (!auth_state.mutex) return ZBA_AUTH_ERROR;
+
+  // Sessions skip the digest entirely.
+  if (zba_auth_session_valid(req))
+  {
+    return ZBA_OK;
+  }
+
+  zba_err_t result = zba_auth_digest_verify(req);
+  if (ZBA_OK == result)
+  {
+    zba_auth_session_start(req);
+  }
+  if ((ZBA_ERROR != result) && (ZBA_AUTH_STALE_NONCE != result))
+  {
+    return result;
+  }
+
+  // Failed, so challenge them.
+  ZBA_LOG("Sending unauthorized request");
+  httpd_resp_set_status(req, "401 UNAUTHORIZED");
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Connection", "keep-alive");
 
+  zba_auth_digest_challenge(auth_buf, sizeof(auth_buf), ZBA_AUTH_STALE_NONCE == result);
   httpd_resp_set_hdr(req, "WWW-Authenticate", auth_buf);
 
   httpd_resp_send(req, NULL, 0);
-
-  // clean up
-  if (uri) free(uri);
-  free(auth_buf);
   return ZBA_ERROR;
 }
 
-void zba_auth_get_nonce(char *buffer)
+zba_err_t zba_auth_digest_verify_web(httpd_req_t *req)
 {
-  uint8_t buf[16];
-  esp_fill_random(buf, 16);
-  for (int i = 0; i < 16; ++i)
+  if (!auth_state.mutex) return ZBA_AUTH_ERROR;
+
+  if (zba_auth_session_valid(req))
   {
-    sprintf(buffer + i * 2, "%02x", buf[i]);
+    return ZBA_OK;
   }
+  return zba_auth_digest_verify(req);
 }
 
-void zba_auth_get_opaque(char *buffer)
+static zba_err_t zba_auth_digest_verify(httpd_req_t *req)
 {
-  uint8_t buf[16];
-  esp_fill_random(buf, 16);
-  for (int i = 0; i < 16; ++i)
+  char header[ZBA_AUTH_HEADER_SIZE];
+
+  // Everything's read into the stack and pointed at in place - no allocation.
+  size_t len = httpd_req_get_hdr_value_len(req, "Authorization");
+  if ((len == 0) || (len >= sizeof(header))) return ZBA_ERROR;
+  if (ESP_OK != httpd_req_get_hdr_value_str(req, "Authorization", header, sizeof(header)))
   {
-    sprintf(buffer + i * 2, "%02x", buf[i]);
+    return ZBA_ERROR;
   }
+  return zba_auth_digest_verify_header(header, http_method_str(req->method), req->uri);
 }
 
-bool zba_auth_get_value(const char *buf, const char *key, char **resPtr, size_t *resLen)
+void zba_auth_digest_challenge(char *buffer, size_t len, bool stale)
 {
-  // {TODO} this should really be regex, or something more robust.
-  // At least a tokenizer.
+  char nonce[ZBA_AUTH_NONCE_LEN + 1] = {0};
+
+  zba_auth_issue_nonce(nonce);
+  // stale=true has the client retry with the new nonce rather than asking for the password.
+  snprintf(buffer, len, kDIGEST_REALM_STRING "qop=\"auth\", nonce=\"%s\", opaque=\"%s\"%s", nonce,
+           auth_state.opaque, stale ? ", stale=true" : "");
+}
+
+zba_err_t zba_auth_digest_verify_header(const char *header, const char *method, const char *uri)
+{
+  char ha1Hex[32];
+  char ha2Hex[32];
+  char ncBuf[9];
+  uint8_t authHa2[16];
+  uint8_t authResponse[16];
+  zba_auth_digest_t digest;
+  uint32_t ncVal = 1;
 
-  // Find matching string to key.
-  char *curPtr = strstr(buf, key);
-  if (!curPtr) return false;
+  if (!auth_state.mutex) return ZBA_AUTH_ERROR;
+  if (!zba_auth_parse_digest(header, strlen(header), &digest)) return ZBA_ERROR;
 
-  // Find key name in string
-  curPtr += strlen(key);
-  // Make sure it has =" for the value following it
-  if (*curPtr != '=') return false;
-  curPtr++;
-  if (*curPtr != '\"') return false;
-  curPtr++;
+  // Only supporting admin user right now
+  if (!zba_auth_slice_is(&digest.username, kAdminUser)) return ZBA_ERROR;
+  if (!zba_auth_slice_is(&digest.realm, kAUTH_REALM)) return ZBA_ERROR;
 
-  // Mark start of string
-  if (resPtr)
+  // MD5 is all we do
+  if (digest.algorithm.ptr && !zba_auth_slice_is(&digest.algorithm, "MD5")) return ZBA_ERROR;
+
+  // Opaque is the same in every challenge this boot, and should come back as-is.
+  if (!zba_auth_slice_is(&digest.opaque, auth_state.opaque)) return ZBA_ERROR;
+
+  // The digest only vouches for the uri in it, so that had better be this request.
+  if (!zba_auth_slice_is(&digest.uri, uri)) return ZBA_ERROR;
+
+  if ((digest.nonce.len != ZBA_AUTH_NONCE_LEN) || (digest.response.len != 32)) return ZBA_ERROR;
+
+  // RFC 2617 qop=auth adds the client's own nonce and a count that goes up with each
+  // request. Without it (RFC 2069) there's no count, so each nonce is good once.
+  if (digest.qop.ptr)
   {
-    *resPtr = curPtr;
+    if (!zba_auth_slice_is(&digest.qop, "auth")) return ZBA_ERROR;
+    if ((digest.nc.len != 8) || (digest.cnonce.len == 0)) return ZBA_ERROR;
+
+    memcpy(ncBuf, digest.nc.ptr, digest.nc.len);
+    ncBuf[digest.nc.len] = 0;
+    ncVal                = strtoul(ncBuf, NULL, 16);
   }
-  // If we don't have a size out value, we're done.
-  if (!resLen) return true;
 
-  // step until the end quote to find the length
-  *resLen = 0;
-  while ((*curPtr != 0) && (*curPtr != '"'))
+  // First hash is cached - it only changes with the password.
+  ZBA_LOCK(auth_state.mutex);
+  zba_auth_to_hex(auth_state.ha1, sizeof(auth_state.ha1), ha1Hex);
+  ZBA_UNLOCK(auth_state.mutex);
+
+  // Second is method:uri
+  zba_auth_slice_t ha2Parts[] = {zba_auth_slice(method), digest.uri};
+  zba_auth_md5_join(ha2Parts, 2, authHa2);
+  zba_auth_to_hex(authHa2, sizeof(authHa2), ha2Hex);
+
+  // Response is HA1:nonce:HA2, or HA1:nonce:nc:cnonce:qop:HA2 with qop.
+  zba_auth_slice_t ha1Slice = {.ptr = ha1Hex, .len = sizeof(ha1Hex)};
+  zba_auth_slice_t ha2Slice = {.ptr = ha2Hex, .len = sizeof(ha2Hex)};
+  if (digest.qop.ptr)
+  {
+    zba_auth_slice_t parts[] = {ha1Slice, digest.nonce, digest.nc, digest.cnonce, digest.qop,
+                                ha2Slice};
+    zba_auth_md5_join(parts, 6, authResponse);
+  }
+  else
   {
-    curPtr++;
-    (*resLen)++;
+    zba_auth_slice_t parts[] = {ha1Slice, digest.nonce, ha2Slice};
+    zba_auth_md5_join(parts, 3, authResponse);
   }
 
-  return true;
+  // Convert each byte in the response string to binary and check against our
+  // calculated value. All of it, so the time taken doesn't give away how much matched.
+  uint8_t diff = 0;
+  for (int i = 0; i < 16; ++i)
+  {
+    diff |= authResponse[i] ^ zba_hex_to_byte(digest.response.ptr + i * 2);
+  }
+
+  // Bail if it failed.
+  if (diff != 0)
+  {
+    ZBA_ERR("Response did not match binary.");
+    return ZBA_ERROR;
+  }
+
+  // They know the password - now make sure the nonce is ours and not a replay.
+  zba_err_t result = zba_auth_use_nonce(digest.nonce.ptr, digest.nonce.len, ncVal);
+  if (ZBA_OK == result)
+  {
+    ZBA_LOG("Authentication successful.");
+  }
+  return result;
 }
 
-bool zba_auth_gen_ha1(const char *user, const char *realm, const char *pwd, uint8_t *ha1md5)
+void zba_auth_get_nonce(char *buffer)
 {
-  char *buf = NULL;
-  memset(ha1md5, 0, 16);
-
-  size_t len = strlen(user) + strlen(realm) + strlen(pwd) + 3;
-  buf        = calloc(1, len);
-  if (!buf)
+  uint8_t buf[16];
+  esp_fill_random(buf, 16);
+  for (int i = 0; i < 16; ++i)
   {
-    ZBA_ERR("Failed allocating memory for HA1");
-    return false;
+    sprintf(buffer + i * 2, "%02x", buf[i]);
   }
+}
 
-  sprintf(buf, "%s:%s:%s", user, realm, pwd);
+void zba_auth_get_opaque(char *buffer)
+{
+  uint8_t buf[16];
+  esp_fill_random(buf, 16);
+  for (int i = 0; i < 16; ++i)
+  {
+    sprintf(buffer + i * 2, "%02x", buf[i]);
+  }
+}
 
-  zba_md5_vector(buf, len - 1, ha1md5);
-  free(buf);
+bool zba_auth_gen_ha1(const char *user, const char *realm, const char *pwd, uint8_t *ha1md5)
+{
+  zba_auth_slice_t parts[] = {zba_auth_slice(user), zba_auth_slice(realm), zba_auth_slice(pwd)};
+  zba_auth_md5_join(parts, 3, ha1md5);
   return true;
 }
 
 bool zba_auth_gen_ha2(const char *method, const char *uri, uint8_t *ha2md5)
 {
-  char *buf = NULL;
-  memset(ha2md5, 0, 16);
-
-  size_t len = strlen(method) + strlen(uri) + 2;
-  buf        = calloc(1, len);
-  if (!buf)
-  {
-    ZBA_ERR("Failed allocating memory for HA2");
-    return false;
-  }
-
-  sprintf(buf, "%s:%s", method, uri);
-  zba_md5_vector(buf, len - 1, ha2md5);
-  free(buf);
+  zba_auth_slice_t parts[] = {zba_auth_slice(method), zba_auth_slice(uri)};
+  zba_auth_md5_join(parts, 2, ha2md5);
   return true;
 }
 
@@ -12,14 +12,28 @@ extern "C"
   zba_err_t zba_auth_init();
   zba_err_t zba_auth_deinit();
   zba_err_t zba_auth_basic_check_web(httpd_req_t *req);
+  /// Passes a request with a session cookie, or a good digest - which also gets it a
+  /// session cookie so later requests skip the digest.
   zba_err_t zba_auth_digest_check_web(httpd_req_t *req);
+  /// Same check without the challenge or new session - for when the response has already
+  /// started.
+  zba_err_t zba_auth_digest_verify_web(httpd_req_t *req);
+  /// Checks the value of a Digest Authorization header for a request with this method
+  /// and uri - for servers other than httpd (RTSP). Returns ZBA_OK, ZBA_AUTH_STALE_NONCE
+  /// if the password was right but the nonce is too old, or an error.
+  zba_err_t zba_auth_digest_verify_header(const char *header, const char *method,
+                                          const char *uri);
+  /// Writes a WWW-Authenticate Digest challenge value with a new nonce. stale says the
+  /// password was right and only the nonce needs replacing.
+  void zba_auth_digest_challenge(char *buffer, size_t len, bool stale);
+  /// Call when the device password changes. Ends all sessions.
+  void zba_auth_password_changed();
 
   /// {TODO} Need to add a more serious system, but better than nothing.
   zba_err_t zba_auth_check(const char *uname, const char *pwd);
 
   void zba_auth_get_nonce(char *buffer);
   void zba_auth_get_opaque(char *buffer);
-  bool zba_auth_get_value(const char *buf, const char *key, char **resPtr, size_t *resLen);
   bool zba_auth_gen_ha1(const char *user, const char *realm, const char *pwd, uint8_t *ha1md5);
   bool zba_auth_gen_ha2(const char *method, const char *uri, uint8_t *ha2md5);
   bool zba_auth_gen_response(uint8_t *ha1, uint8_t *ha2, const char *nonce, uint8_t *responseMd5);
@@ -0,0 +1,97 @@
+#include "zba_auth_digest.h"
+#include <string.h>
+#include <strings.h>
+
+#define ZBA_AUTH_FIELD(name) {#name, sizeof(#name) - 1, offsetof(zba_auth_digest_t, name)}
+
+static const struct
+{
+  const char *key;
+  size_t key_len;
+  size_t offset;
+} kDigestFields[] = {
+    ZBA_AUTH_FIELD(username), ZBA_AUTH_FIELD(realm),  ZBA_AUTH_FIELD(nonce),
+    ZBA_AUTH_FIELD(uri),      ZBA_AUTH_FIELD(opaque), ZBA_AUTH_FIELD(response),
+    ZBA_AUTH_FIELD(qop),      ZBA_AUTH_FIELD(nc),     ZBA_AUTH_FIELD(cnonce),
+    ZBA_AUTH_FIELD(algorithm),
+};
+static const int kNumDigestFields = sizeof(kDigestFields) / sizeof(kDigestFields[0]);
+
+zba_auth_slice_t zba_auth_slice(const char *str)
+{
+  zba_auth_slice_t slice = {.ptr = str, .len = strlen(str)};
+  return slice;
+}
+
+bool zba_auth_slice_is(const zba_auth_slice_t *slice, const char *str)
+{
+  return slice->ptr && (slice->len == strlen(str)) && (0 == memcmp(slice->ptr, str, slice->len));
+}
+
+bool zba_auth_parse_digest(const char *header, size_t len, zba_auth_digest_t *digest)
+{
+  memset(digest, 0, sizeof(*digest));
+  if ((len < 7) || (0 != strncasecmp(header, "Digest ", 7))) return false;
+
+  const char *cur = header + 7;
+  const char *end = header + len;
+
+  while (cur < end)
+  {
+    if ((*cur == ' ') || (*cur == '\t') || (*cur == ','))
+    {
+      cur++;
+      continue;
+    }
+
+    // key=
+    const char *key = cur;
+    while ((cur < end) && (*cur != '=') && (*cur != ' ') && (*cur != ','))
+    {
+      cur++;
+    }
+    size_t key_len = cur - key;
+    if ((cur == end) || (*cur != '=') || (key_len == 0)) return false;
+    cur++;
+
+    // "quoted value" or token
+    zba_auth_slice_t value;
+    if ((cur < end) && (*cur == '"'))
+    {
+      value.ptr = ++cur;
+      while ((cur < end) && (*cur != '"'))
+      {
+        // Skip over whatever's escaped, it can be a quote.
+        if ((*cur == '\\') && (cur + 1 < end)) cur++;
+        cur++;
+      }
+      if (cur == end) return false;
+      value.len = cur - value.ptr;
+      cur++;
+    }
+    else
+    {
+      value.ptr = cur;
+      while ((cur < end) && (*cur != ',') && (*cur != ' ') && (*cur != '\t'))
+      {
+        cur++;
+      }
+      value.len = cur - value.ptr;
+    }
+
+    for (int i = 0; i < kNumDigestFields; ++i)
+    {
+      if ((kDigestFields[i].key_len != key_len) ||
+          (0 != strncasecmp(kDigestFields[i].key, key, key_len)))
+      {
+        continue;
+      }
+      zba_auth_slice_t *field = (zba_auth_slice_t *)((char *)digest + kDigestFields[i].offset);
+      // Giving a field twice is either broken or up to something.
+      if (field->ptr) return false;
+      *field = value;
+      break;
+    }
+  }
+  return true;
+}
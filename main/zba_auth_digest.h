@@ -0,0 +1,52 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_AUTH_DIGEST_H_
+#define ZEBRAL_ESP32CAM_ZBA_AUTH_DIGEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  // Digest Authorization header parsing for zba_auth. Plain C with no IDF dependencies,
+  // so tests/ can fuzz it on the host.
+
+  /// Part of a header - points into it, so it isn't null terminated.
+  typedef struct
+  {
+    const char *ptr;  ///< Start of the value, NULL if the field wasn't given
+    size_t len;       ///< Length of the value
+  } zba_auth_slice_t;
+
+  /// Fields of a Digest Authorization header
+  typedef struct
+  {
+    zba_auth_slice_t username;
+    zba_auth_slice_t realm;
+    zba_auth_slice_t nonce;
+    zba_auth_slice_t uri;
+    zba_auth_slice_t response;
+    zba_auth_slice_t opaque;
+    zba_auth_slice_t qop;
+    zba_auth_slice_t nc;
+    zba_auth_slice_t cnonce;
+    zba_auth_slice_t algorithm;
+  } zba_auth_digest_t;
+
+  /// Splits a Digest Authorization header into its fields in one pass. Values point into
+  /// the header, without their quotes. Fields we don't use are skipped.
+  /// header needn't be terminated - nothing past len is read.
+  bool zba_auth_parse_digest(const char *header, size_t len, zba_auth_digest_t *digest);
+
+  /// Slice of all of str
+  zba_auth_slice_t zba_auth_slice(const char *str);
+
+  /// True if the slice holds exactly str
+  bool zba_auth_slice_is(const zba_auth_slice_t *slice, const char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_AUTH_DIGEST_H_
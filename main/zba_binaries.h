@@ -1,17 +0,0 @@
-#ifndef ZEBRAL_ESP32CAM_ZBA_BINARIES_H_
-#define ZEBRAL_ESP32CAM_ZBA_BINARIES_H_
-
-#include <stdint.h>
-
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-  /// FavIcon .png file
-  extern const uint8_t favicon_16x16[801];
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "zba_boot.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <string.h>
+#include "zba_priority.h"
+
+DEFINE_ZBA_TAG;
+
+static const uint32_t kBootStackSize = 4096;  ///< Stack for steps on their own task
+
+typedef struct
+{
+  const zba_boot_step_t* steps;                   ///< Table being run
+  size_t num_steps;                               ///< Steps in the table
+  EventGroupHandle_t done;                        ///< Bit per finished step
+  zba_boot_timing_t timings[ZBA_BOOT_MAX_STEPS];  ///< Per step results
+  int64_t start_ms;                               ///< Boot started
+  int64_t done_ms;                                ///< Every step finished, 0 until then
+} zba_boot_state_t;
+
+static zba_boot_state_t boot_state = {.steps     = NULL,
+                                      .num_steps = 0,
+                                      .done      = NULL,
+                                      .timings   = {{0}},
+                                      .start_ms  = 0,
+                                      .done_ms   = 0};
+
+/// Waits for the step's dependencies, then runs it
+static void zba_boot_step(size_t index)
+{
+  const zba_boot_step_t* step = &boot_state.steps[index];
+  zba_boot_timing_t* timing   = &boot_state.timings[index];
+
+  if (step->after)
+  {
+    xEventGroupWaitBits(boot_state.done, step->after, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+
+  int64_t start_ms = zba_now_ms();
+  zba_err_t result = step->init();
+  timing->start_ms = start_ms;
+  timing->init_ms  = zba_now_ms() - start_ms;
+  timing->result   = result;
+  // Last, as it marks the timing as there for zba_boot_get_timing().
+  timing->name = step->name;
+  if (ZBA_OK != timing->result)
+  {
+    ZBA_ERR("%s failed to start: 0x%X", step->name, timing->result);
+  }
+  ZBA_LOG("%s took %lld ms", step->name, timing->init_ms);
+
+  xEventGroupSetBits(boot_state.done, ZBA_BOOT_AFTER(index));
+}
+
+static void zba_boot_task(void* arg)
+{
+  zba_boot_step((size_t)arg);
+  vTaskDelete(NULL);
+}
+
+zba_err_t zba_boot_run(const zba_boot_step_t* steps, size_t num_steps)
+{
+  size_t i;
+
+  if (num_steps > ZBA_BOOT_MAX_STEPS) return ZBA_INVALID_ARG;
+  // A step waiting on one after it would never start.
+  for (i = 0; i < num_steps; ++i)
+  {
+    if (steps[i].after >> i) return ZBA_INVALID_ARG;
+  }
+
+  if (NULL == (boot_state.done = xEventGroupCreate())) return ZBA_OUT_OF_MEMORY;
+  boot_state.steps     = steps;
+  boot_state.num_steps = num_steps;
+  boot_state.start_ms  = zba_now_ms();
+  boot_state.done_ms   = 0;
+  memset(boot_state.timings, 0, sizeof(boot_state.timings));
+
+  for (i = 0; i < num_steps; ++i)
+  {
+    if (steps[i].own_task &&
+        (pdPASS == xTaskCreate(zba_boot_task, steps[i].name, kBootStackSize, (void*)i,
+                               ZBA_BOOT_PRIORITY, NULL)))
+    {
+      continue;
+    }
+    // Inline, or couldn't get a task - still runs, just without the overlap.
+    zba_boot_step(i);
+  }
+
+  if (num_steps)
+  {
+    xEventGroupWaitBits(boot_state.done, ZBA_BOOT_AFTER(num_steps) - 1, pdFALSE, pdTRUE,
+                        portMAX_DELAY);
+  }
+  vEventGroupDelete(boot_state.done);
+  boot_state.done    = NULL;
+  boot_state.done_ms = zba_now_ms();
+
+  ZBA_LOG("Boot took %lld ms (%lld ms since power on)", boot_state.done_ms - boot_state.start_ms,
+          boot_state.done_ms);
+  return ZBA_OK;
+}
+
+bool zba_boot_get_timing(size_t index, zba_boot_timing_t* timing)
+{
+  if ((index >= boot_state.num_steps) || (NULL == boot_state.timings[index].name)) return false;
+  *timing = boot_state.timings[index];
+  return true;
+}
+
+void zba_boot_dump(zba_print_fn print, void* context)
+{
+  zba_boot_timing_t timing;
+  for (size_t i = 0; i < boot_state.num_steps; ++i)
+  {
+    if (zba_boot_get_timing(i, &timing))
+    {
+      print(context, "boot %s: at %lld ms took %lld ms result: 0x%X", timing.name,
+            timing.start_ms, timing.init_ms, timing.result);
+    }
+  }
+  print(context, "boot done at %lld ms", boot_state.done_ms);
+}
+
+void zba_boot_write_json(zba_json_t* json)
+{
+  zba_boot_timing_t timing;
+
+  zba_json_object(json, "boot");
+  zba_json_int(json, "done_ms", boot_state.done_ms);
+  zba_json_array(json, "steps");
+  for (size_t i = 0; i < boot_state.num_steps; ++i)
+  {
+    if (!zba_boot_get_timing(i, &timing)) continue;
+    zba_json_object(json, NULL);
+    zba_json_string(json, "name", timing.name);
+    zba_json_int(json, "start_ms", timing.start_ms);
+    zba_json_int(json, "init_ms", timing.init_ms);
+    zba_json_hex(json, "result", timing.result);
+    zba_json_end_object(json);
+  }
+  zba_json_end_array(json);
+  zba_json_end_object(json);
+}
@@ -0,0 +1,63 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_BOOT_H_
+#define ZEBRAL_ESP32CAM_ZBA_BOOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "zba_json.h"
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Most steps a boot can have - one event group bit each
+#define ZBA_BOOT_MAX_STEPS 24
+
+/// Bit for step index i, for zba_boot_step_t::after
+#define ZBA_BOOT_AFTER(i) (1UL << (i))
+
+  typedef zba_err_t (*zba_boot_func_t)();
+
+  /// A step in bringing the system up.
+  ///
+  /// Steps start in table order. One waits for the steps in its after mask to finish
+  /// (whether they worked or not), so those must come earlier in the table. A step with
+  /// own_task runs on a task of its own, so the steps after it don't wait on it unless
+  /// they say so - that lets slow independent steps like WiFi and the camera overlap.
+  typedef struct
+  {
+    const char* name;      ///< Shown in status
+    zba_boot_func_t init;  ///< Brings the subsystem up
+    uint32_t after;        ///< ZBA_BOOT_AFTER() bits of the steps this needs first
+    bool own_task;         ///< Runs alongside the steps after it
+  } zba_boot_step_t;
+
+  /// How a step went
+  typedef struct
+  {
+    const char* name;  ///< Step name, NULL if it never ran
+    zba_err_t result;  ///< What init returned
+    int64_t start_ms;  ///< Started, in ms since power on
+    int64_t init_ms;   ///< Time spent in init
+  } zba_boot_timing_t;
+
+  /// Runs the steps, and returns once they've all finished.
+  /// Returns ZBA_INVALID_ARG without running any if a step waits on a later one.
+  zba_err_t zba_boot_run(const zba_boot_step_t* steps, size_t num_steps);
+
+  /// Copies out the timing of step index. Returns false if there's no such step.
+  bool zba_boot_get_timing(size_t index, zba_boot_timing_t* timing);
+
+  /// Prints each step's timing, and when boot finished
+  void zba_boot_dump(zba_print_fn print, void* context);
+
+  /// Writes the timings as a "boot" object in the open JSON object
+  void zba_boot_write_json(zba_json_t* json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_BOOT_H_
@@ -1,18 +1,35 @@
 #include "zba_camera.h"
 
+#include <esp_heap_caps.h>
+#include <esp_jpg_decode.h>
 #include <esp_system.h>
+#include <img_converters.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <memory.h>
 #include <stdbool.h>
 #include <string.h>
 
+#include "zba_imgproc.h"
+#include "zba_metrics.h"
 #include "zba_pins.h"
 #include "zba_priority.h"
+#include "zba_trace.h"
 #include "zba_util.h"
 
 DEFINE_ZBA_MODULE(zba_camera);
 
+/// JPEG size history for a resolution.
+/// The camera driver allocates JPEG buffers as RAW/5, which is too small for good
+/// quality at low resolutions and wasteful at high ones. We track what frames actually
+/// come out at and size the allocation from that instead.
+typedef struct
+{
+  int quality;      ///< Quality the sizes were seen at
+  size_t peak_len;  ///< Largest frame seen at this resolution and quality
+  int frames;       ///< Frames seen at this resolution and quality
+} zba_jpeg_size_t;
+
 /// Camera state struct
 typedef struct
 {
@@ -20,17 +37,25 @@ typedef struct
   TaskHandle_t captureTask;  ///< Capture task
   bool capturing;            ///< Are we currently capturing?
 
-  int frameCount;  ///< Number of frames since starting timing
-  int accumSize;   ///< Total bytes in frames since start
-  int64_t start;   ///< Start time of current timing seg (10 frames then restarts)
+  int frameCount;  ///< Number of frames since starting fps timing
+  int64_t start;   ///< Start time of current fps timing window
 
   int64_t frameNum;  ///< Absolute frame number since init
   zba_resolution_t desired_resolution;
   zba_resolution_t resolution;
+  int quality;                           ///< JPEG quality override, 0 for per-resolution
   sensor_t* camera_sensor;               ///< Camera sensor
   zba_camera_frame_callback_t callback;  ///< image processing callback
   void* context;
-  camera_fb_t* process_frame;
+
+  zba_jpeg_size_t jpeg_sizes[ZBA_NUM_RESOLUTIONS];  ///< Learned JPEG sizes per resolution
+  framesize_t alloc_framesize;  ///< Frame size the driver buffers were allocated for
+  size_t fb_capacity;           ///< Bytes per JPEG frame buffer in current allocation
+  bool fb_resize;               ///< Buffers need reallocating on next restart
+  int fb_failures;              ///< Consecutive failed frame grabs
+
+  zba_roi_t sensor_roi;    ///< Sensor window, if sensor_roi_active
+  bool sensor_roi_active;  ///< Sensor is windowed to sensor_roi
 } zba_camera_t;
 
 int zba_framesize(zba_resolution_t res);
@@ -41,15 +66,62 @@ static zba_camera_t camera_state = {.stackSize          = 8192,
                                     .capturing          = false,
                                     .captureTask        = NULL,
                                     .frameCount         = 0,
-                                    .accumSize          = 0,
                                     .start              = 0,
                                     .frameNum           = 0,
                                     .desired_resolution = ZBA_SVGA,
                                     .resolution         = ZBA_SVGA,
+                                    .quality            = 0,
                                     .camera_sensor      = NULL,
                                     .callback           = NULL,
                                     .context            = NULL,
-                                    .process_frame      = NULL};
+                                    .jpeg_sizes         = {{0}},
+                                    .alloc_framesize    = FRAMESIZE_INVALID,
+                                    .fb_capacity        = 0,
+                                    .fb_resize          = false,
+                                    .fb_failures        = 0,
+                                    .sensor_roi         = {0},
+                                    .sensor_roi_active  = false};
+
+/// How often the fps gauge is updated
+static const float kFpsWindowSec = 1.0;
+
+static const uint32_t kFrameBytesBuckets[] = {4096,   8192,   16384,  32768,  65536, 98304,
+                                              131072, 196608, 262144, 393216, 524288};
+static const uint32_t kGrabUsecBuckets[]   = {1000,  5000,   10000,  20000,  33000, 50000,
+                                              66000, 100000, 200000, 500000, 1000000};
+
+DEFINE_ZBA_COUNTER(frames_metric, "zba_camera_frames_total", "Frames captured");
+DEFINE_ZBA_COUNTER(grab_failures_metric, "zba_camera_grab_failures_total",
+                   "Frames the driver failed to deliver (dropped)");
+DEFINE_ZBA_GAUGE(fps_metric, "zba_camera_fps", "Frames per second captured");
+DEFINE_ZBA_HISTOGRAM(frame_bytes_metric, "zba_camera_frame_bytes", "Size of captured frames",
+                     kFrameBytesBuckets);
+DEFINE_ZBA_HISTOGRAM(grab_usec_metric, "zba_camera_grab_usec",
+                     "Time spent waiting on the driver for a frame", kGrabUsecBuckets);
+
+/// Divisor the driver uses for JPEG buffers (width * height / 5 in cam_hal.c)
+static const size_t kJpegDriverDivisor = 5;
+/// Headroom over the largest frame seen, in percent
+static const size_t kJpegHeadroomPct = 125;
+/// Frames to see before trusting the learned size enough to shrink buffers
+static const int kJpegLearnFrames = 30;
+/// Consecutive failed grabs in JPEG mode before assuming the buffers overflowed
+static const int kJpegMaxFailures = 2;
+
+/// OV2640 sensor modes, passed as startX to its set_res_raw
+static const int kOv2640ModeUxga = 0;
+static const int kOv2640ModeSvga = 1;
+static const int kOv2640ModeCif  = 2;
+/// Sensor windows and outputs are kept to multiples of this
+static const uint16_t kSensorWindowAlign = 4;
+/// Software JPEG crops are aligned to the largest MCU (16x16 for 4:2:0)
+static const uint16_t kJpegMcuSize = 16;
+/// Quality (1-100) software JPEG crops are re-encoded at
+static const uint8_t kRoiJpegQuality = 80;
+/// Most bytes per pixel we allow for a re-encoded crop
+static const size_t kRoiJpegMaxBpp = 2;
+/// Quality (1-100) scaled down preview JPEGs are re-encoded at
+static const uint8_t kPreviewJpegQuality = 60;
 
 zba_err_t zba_camera_set_res(zba_resolution_t res)
 {
@@ -57,6 +129,25 @@ zba_err_t zba_camera_set_res(zba_resolution_t res)
   return ZBA_OK;
 }
 
+zba_err_t zba_camera_set_quality(int quality)
+{
+  if ((quality < 0) || (quality > 63)) return ZBA_INVALID_ARG;
+  camera_state.quality = quality;
+
+  // Takes effect now if the camera's up. Learned JPEG sizes are per quality, so the
+  // buffers adjust as frames come in.
+  if (ZBA_OK == ZBA_MODULE_INITIALIZED(zba_camera))
+  {
+    const zba_res_info_t* resInfo = zba_camera_get_resolution_info(camera_state.resolution);
+    if (resInfo && (resInfo->format == PIXFORMAT_JPEG))
+    {
+      camera_state.camera_sensor->set_quality(camera_state.camera_sensor,
+                                              zba_quality(resInfo->res));
+    }
+  }
+  return ZBA_OK;
+}
+
 zba_err_t zba_camera_set_autoexposure(bool on)
 {
   // Bail if camera not initialized
@@ -78,7 +169,7 @@ zba_resolution_t zba_camera_get_res()
 
 bool zba_camera_need_restart()
 {
-  return (camera_state.resolution != camera_state.desired_resolution);
+  return (camera_state.resolution != camera_state.desired_resolution) || camera_state.fb_resize;
 }
 
 // clang-format off
@@ -88,9 +179,9 @@ const zba_res_info_t resolution_info[] =
 {ZBA_QCIF_INTERNAL,   "QCIFI", FRAMESIZE_QCIF,  PIXFORMAT_RGB565, 0, 1, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_DRAM},
 {ZBA_VGA_INTERNAL,    "VGAI",  FRAMESIZE_VGA,   PIXFORMAT_RGB565, 0, 1, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_DRAM},
 {ZBA_SVGA_INTERNAL,   "SVGAI", FRAMESIZE_SVGA,  PIXFORMAT_RGB565, 0, 1, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_DRAM},
-{ZBA_96x96,           "96",    FRAMESIZE_96X96, PIXFORMAT_JPEG,  14, 2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
-{ZBA_QVGA,            "QVGA",  FRAMESIZE_QVGA,  PIXFORMAT_JPEG,  12, 2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
-{ZBA_QCIF,            "QCIF",  FRAMESIZE_QCIF,  PIXFORMAT_JPEG,  12, 2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
+{ZBA_96x96,           "96",    FRAMESIZE_96X96, PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
+{ZBA_QVGA,            "QVGA",  FRAMESIZE_QVGA,  PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
+{ZBA_QCIF,            "QCIF",  FRAMESIZE_QCIF,  PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
 {ZBA_VGA,             "VGA",   FRAMESIZE_VGA,   PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
 {ZBA_SVGA,            "SVGA",  FRAMESIZE_SVGA,  PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
 {ZBA_HD,              "HD",    FRAMESIZE_HD,    PIXFORMAT_JPEG,  4,  2, CAMERA_GRAB_WHEN_EMPTY,CAMERA_FB_IN_PSRAM},
@@ -147,7 +238,105 @@ int zba_quality(zba_resolution_t res)
 {
   const zba_res_info_t* resInfo = zba_camera_get_resolution_info(res);
   if (!resInfo) return 0;
-  return resInfo->quality;
+  return camera_state.quality ? camera_state.quality : resInfo->quality;
+}
+
+/// Bytes per JPEG frame buffer the driver allocates for a given frame size.
+static size_t zba_camera_jpeg_capacity(framesize_t size)
+{
+  return ((size_t)resolution[size].width * resolution[size].height) / kJpegDriverDivisor;
+}
+
+/// Bytes we want per JPEG frame buffer for a resolution.
+/// With nothing learned yet it's the driver's own size. Asking for more up front would
+/// mean a restart to shrink back once frames turn out smaller - and a glitch for
+/// whoever's watching. Frames that don't fit fail to grab, and that grows the buffers.
+static size_t zba_camera_jpeg_need(const zba_res_info_t* resInfo)
+{
+  const zba_jpeg_size_t* learned = &camera_state.jpeg_sizes[resInfo->res];
+  if ((learned->quality == zba_quality(resInfo->res)) && (learned->peak_len > 0))
+  {
+    return (learned->peak_len * kJpegHeadroomPct) / 100;
+  }
+  return zba_camera_jpeg_capacity(resInfo->frameSize);
+}
+
+/// Smallest frame size at or above the resolution whose driver buffer holds need bytes.
+/// Frame sizes are ordered by pixel count up to UXGA, which is as far as the OV2640 goes.
+static framesize_t zba_camera_alloc_framesize(const zba_res_info_t* resInfo, size_t need)
+{
+  framesize_t size = resInfo->frameSize;
+  while ((size < FRAMESIZE_UXGA) && (zba_camera_jpeg_capacity(size) < need))
+  {
+    size++;
+  }
+  return size;
+}
+
+/// Record a frame's size and flag a reallocation if the buffers are too small,
+/// or much larger than we've found we need.
+static void zba_camera_learn_jpeg(const camera_fb_t* frame)
+{
+  const zba_res_info_t* resInfo = zba_camera_get_resolution_info(camera_state.resolution);
+  if (!resInfo || (resInfo->format != PIXFORMAT_JPEG))
+  {
+    return;
+  }
+
+  zba_jpeg_size_t* learned = &camera_state.jpeg_sizes[resInfo->res];
+  if (learned->quality != zba_quality(resInfo->res))
+  {
+    learned->quality  = zba_quality(resInfo->res);
+    learned->peak_len = 0;
+    learned->frames   = 0;
+  }
+  learned->peak_len = ZBA_MAX(learned->peak_len, frame->len);
+  learned->frames++;
+
+  size_t need = zba_camera_jpeg_need(resInfo);
+  if (need > camera_state.fb_capacity)
+  {
+    // Only grow if a bigger allocation is actually available.
+    if (camera_state.alloc_framesize < FRAMESIZE_UXGA)
+    {
+      camera_state.fb_resize = true;
+    }
+  }
+  else if ((learned->frames == kJpegLearnFrames) &&
+           (zba_camera_alloc_framesize(resInfo, need) < camera_state.alloc_framesize))
+  {
+    ZBA_LOG("JPEG frames peak at %u bytes, shrinking buffers from %u", learned->peak_len,
+            camera_state.fb_capacity);
+    camera_state.fb_resize = true;
+  }
+}
+
+/// A failed grab in JPEG mode is usually an overflowed buffer (the driver drops the frame).
+/// After a couple in a row, assume we need more room.
+static void zba_camera_grab_failed()
+{
+  const zba_res_info_t* resInfo = zba_camera_get_resolution_info(camera_state.resolution);
+  if (!resInfo || (resInfo->format != PIXFORMAT_JPEG))
+  {
+    return;
+  }
+
+  camera_state.fb_failures++;
+  if ((camera_state.fb_failures >= kJpegMaxFailures) &&
+      (camera_state.alloc_framesize < FRAMESIZE_UXGA))
+  {
+    zba_jpeg_size_t* learned = &camera_state.jpeg_sizes[resInfo->res];
+    learned->quality         = zba_quality(resInfo->res);
+    learned->peak_len        = ZBA_MAX(learned->peak_len, camera_state.fb_capacity);
+    learned->frames          = 0;
+    camera_state.fb_resize   = true;
+    ZBA_LOG("JPEG grabs failing with %u byte buffers, growing.", camera_state.fb_capacity);
+  }
+}
+
+size_t zba_camera_get_fb_capacity()
+{
+  return camera_state.fb_capacity;
 }
 
 zba_err_t zba_camera_init()
@@ -163,6 +352,26 @@ zba_err_t zba_camera_init()
 
   const zba_res_info_t* resInfo = zba_camera_get_resolution_info(res);
 
+  // JPEG buffers are allocated by the driver for the configured frame size, so
+  // configure one big enough for what we expect, then drop the sensor to the one we want.
+  framesize_t alloc_size = resInfo->frameSize;
+  if (resInfo->format == PIXFORMAT_JPEG)
+  {
+    alloc_size = zba_camera_alloc_framesize(resInfo, zba_camera_jpeg_need(resInfo));
+  }
+  camera_state.alloc_framesize = alloc_size;
+  camera_state.fb_capacity =
+      (resInfo->format == PIXFORMAT_JPEG) ? zba_camera_jpeg_capacity(alloc_size) : 0;
+  camera_state.fb_resize         = false;
+  camera_state.fb_failures       = 0;
+  camera_state.sensor_roi_active = false;
+
+  zba_metrics_register(&frames_metric);
+  zba_metrics_register(&grab_failures_metric);
+  zba_metrics_register(&fps_metric);
+  zba_metrics_register(&frame_bytes_metric);
+  zba_metrics_register(&grab_usec_metric);
+
   camera_config_t config = {.pin_d0       = PIN_CAM_D0,
                             .pin_d1       = PIN_CAM_D1,
                             .pin_d2       = PIN_CAM_D2,
@@ -183,8 +392,8 @@ zba_err_t zba_camera_init()
                             .ledc_channel = LEDC_CHANNEL_0,
                             .ledc_timer   = LEDC_TIMER_0,
                             .pixel_format = resInfo->format,
-                            .frame_size   = resInfo->frameSize,
-                            .jpeg_quality = resInfo->quality,
+                            .frame_size   = alloc_size,
+                            .jpeg_quality = zba_quality(resInfo->res),
                             .fb_count     = resInfo->bufferCount,
                             .grab_mode    = resInfo->grabMode,
                             .fb_location  = resInfo->location};
@@ -203,6 +412,12 @@ zba_err_t zba_camera_init()
     init_err = ZBA_CAM_INIT_FAILED;
     zba_camera_deinit();
   }
+  else if (alloc_size != resInfo->frameSize)
+  {
+    ZBA_LOG("JPEG buffers sized for frame size %d (%u bytes)", alloc_size,
+            camera_state.fb_capacity);
+    camera_state.camera_sensor->set_framesize(camera_state.camera_sensor, resInfo->frameSize);
+  }
 
   ZBA_SET_INIT(zba_camera, init_err);
   return init_err;
@@ -213,7 +428,12 @@ zba_err_t zba_camera_set_status_default()
   return ZBA_OK;
 }
 
-zba_err_t zba_camera_dump_status()
+const camera_status_t* zba_camera_get_status()
+{
+  return camera_state.camera_sensor ? &camera_state.camera_sensor->status : NULL;
+}
+
+zba_err_t zba_camera_dump_status(zba_print_fn print, void* context)
 {
   camera_status_t* s;
   if (!camera_state.camera_sensor)
@@ -222,16 +442,19 @@ zba_err_t zba_camera_dump_status()
   }
   s = &camera_state.camera_sensor->status;
 
-  ZBA_LOG("scale: %d binning: %d", s->scale, s->binning);
-  ZBA_LOG("quality: %d bright: %d contrast: %d saturation: %d", s->quality, s->brightness,
-          s->contrast, s->saturation);
-  ZBA_LOG("sharpness: %d denoise: %d special effect: %d wb_mode: %d", s->sharpness, s->denoise,
-          s->special_effect, s->wb_mode);
-  ZBA_LOG("awb: %d awb_gain: %d aec: %d aec2: %d ae_level: %d aec_value: %d", s->awb, s->awb_gain,
-          s->aec, s->aec2, s->ae_level, s->aec_value);
-  ZBA_LOG("agc: %d agc_gain: %d gainceiling: %d bpc: %d wpc: %d raw_gma: %d lenc:%d", s->agc,
-          s->agc_gain, s->gainceiling, s->bpc, s->wpc, s->raw_gma, s->lenc);
-  ZBA_LOG("hmirror: %d vflip: %d dcw: %d colorbar: %d", s->hmirror, s->vflip, s->dcw, s->colorbar);
+  print(context, "scale: %d binning: %d", s->scale, s->binning);
+  print(context, "quality: %d bright: %d contrast: %d saturation: %d", s->quality,
+        s->brightness, s->contrast, s->saturation);
+  print(context, "sharpness: %d denoise: %d special effect: %d wb_mode: %d", s->sharpness,
+        s->denoise, s->special_effect, s->wb_mode);
+  print(context, "awb: %d awb_gain: %d aec: %d aec2: %d ae_level: %d aec_value: %d", s->awb,
+        s->awb_gain, s->aec, s->aec2, s->ae_level, s->aec_value);
+  print(context, "agc: %d agc_gain: %d gainceiling: %d bpc: %d wpc: %d raw_gma: %d lenc:%d",
+        s->agc, s->agc_gain, s->gainceiling, s->bpc, s->wpc, s->raw_gma, s->lenc);
+  print(context, "hmirror: %d vflip: %d dcw: %d colorbar: %d", s->hmirror, s->vflip, s->dcw,
+        s->colorbar);
+  print(context, "jpeg buffer: %u bytes (frame size %d) peak: %u", camera_state.fb_capacity,
+        camera_state.alloc_framesize, camera_state.jpeg_sizes[camera_state.resolution].peak_len);
   /*
     bool scale;
     bool binning;
@@ -285,76 +508,453 @@ zba_err_t zba_camera_deinit()
   return deinit_error;
 }
 
-camera_fb_t* zba_camera_capture_frame()
+zba_frame_t* zba_camera_capture_frame()
 {
   // capture a frame
-  camera_fb_t* frame;
+  camera_fb_t* fb;
+  zba_frame_t* frame;
 
   if (0 == camera_state.start)
   {
     camera_state.start      = zba_now();
     camera_state.frameCount = 0;
-    camera_state.accumSize  = 0;
   }
 
-  frame = esp_camera_fb_get();
-  if (!frame)
+  int64_t grab_start = zba_now();
+  fb                 = esp_camera_fb_get();
+  int64_t grabbed    = zba_now();
+  if (!fb)
   {
-    return frame;
+    zba_metrics_inc(&grab_failures_metric);
+    zba_camera_grab_failed();
+    return NULL;
   }
+  zba_metrics_observe(&grab_usec_metric, (uint32_t)(grabbed - grab_start));
+  camera_state.fb_failures = 0;
+  zba_camera_learn_jpeg(fb);
 
-  camera_state.process_frame = NULL;
-  if (camera_state.callback)
+  if (!(frame = zba_frame_from_driver(fb)))
   {
-    camera_state.process_frame = camera_state.callback(frame, camera_state.context);
+    esp_camera_fb_return(fb);
+    return NULL;
   }
+  frame->frame_num = ++camera_state.frameNum;
 
-  if (camera_state.process_frame)
+  if (camera_state.callback)
   {
-    // Vision can return an alternative buffer - if it does,
-    // then use our local process buffer instead and free
-    // the camera driver frame now.
-    esp_camera_fb_return(frame);
-    frame = camera_state.process_frame;
+    // Vision can hand back a frame from the pool instead - if it does,
+    // the driver frame goes back to the driver now.
+    zba_frame_t* processed = camera_state.callback(frame, camera_state.context);
+    if (processed && (processed != frame))
+    {
+      processed->frame_num = frame->frame_num;
+      zba_frame_release(frame);
+      frame = processed;
+    }
   }
 
-  camera_state.accumSize += frame->len;
   camera_state.frameCount++;
-  camera_state.frameNum++;
+  zba_metrics_inc(&frames_metric);
+  zba_metrics_observe(&frame_bytes_metric, frame->fb->len);
+
+  zba_trace_frame_captured(frame->frame_num, &frame->fb->timestamp, frame->fb->len, grab_start,
+                           grabbed, zba_now());
 
   float elapsed = zba_elapsed_sec(camera_state.start);
-  if (elapsed >= 10.0)
+  if (elapsed >= kFpsWindowSec)
   {
-    ZBA_LOG("%d frames in %f seconds = %f fps. Avg %d bytes per frame. %dx%d",
-            camera_state.frameCount, elapsed, ((float)camera_state.frameCount) / elapsed,
-            camera_state.accumSize / camera_state.frameCount, frame->width, frame->height);
-    ZBA_LOG("Stack usage: %d of %d", uxTaskGetStackHighWaterMark(camera_state.captureTask),
-            camera_state.stackSize);
-
+    zba_metrics_set(&fps_metric, ((float)camera_state.frameCount) / elapsed);
     camera_state.start      = zba_now();
     camera_state.frameCount = 0;
-    camera_state.accumSize  = 0;
   }
 
   return frame;
 }
 
-void zba_camera_release_frame(camera_fb_t* frame)
+void zba_camera_release_frame(zba_frame_t* frame)
 {
-  if (frame)
+  zba_frame_release(frame);
+}
+
+/// Clips roi to a width x height image, growing it out to multiples of align.
+/// Returns false if there's nothing left.
+static bool zba_camera_clip_roi(const zba_roi_t* roi, size_t width, size_t height,
+                                uint16_t align, zba_roi_t* clipped)
+{
+  if ((!roi) || (!roi->width) || (!roi->height) || (roi->x >= width) || (roi->y >= height))
   {
-    // Don't free our internal process buffers!
-    if (frame != camera_state.process_frame)
+    return false;
+  }
+
+  size_t x0 = roi->x - (roi->x % align);
+  size_t y0 = roi->y - (roi->y % align);
+  size_t x1 = ((size_t)roi->x + roi->width + align - 1) / align * align;
+  size_t y1 = ((size_t)roi->y + roi->height + align - 1) / align * align;
+
+  clipped->x      = x0;
+  clipped->y      = y0;
+  clipped->width  = ZBA_MIN(x1, width) - x0;
+  clipped->height = ZBA_MIN(y1, height) - y0;
+  return true;
+}
+
+zba_err_t zba_camera_set_roi(const zba_roi_t* roi)
+{
+  zba_err_t result = ZBA_MODULE_INITIALIZED(zba_camera);
+  if (result != ZBA_OK)
+  {
+    return result;
+  }
+
+  sensor_t* sensor              = camera_state.camera_sensor;
+  const zba_res_info_t* resInfo = zba_camera_get_resolution_info(camera_state.resolution);
+
+  if (!roi)
+  {
+    if (camera_state.sensor_roi_active)
     {
-      esp_camera_fb_return(frame);
+      // Setting the frame size again puts the full window back.
+      camera_state.sensor_roi_active = false;
+      sensor->set_framesize(sensor, resInfo->frameSize);
     }
+    return ZBA_OK;
+  }
+
+  // Only the OV2640 driver takes a window through set_res_raw. Raw formats are left
+  // to the software crop, since the driver keeps reporting the full frame's size.
+  if ((sensor->id.PID != OV2640_PID) || (!sensor->set_res_raw) ||
+      (resInfo->format != PIXFORMAT_JPEG) || camera_state.sensor_roi_active)
+  {
+    return ZBA_CAM_ROI_UNSUPPORTED;
+  }
+
+  size_t width  = zba_camera_get_width();
+  size_t height = zba_camera_get_height();
+  zba_roi_t clipped;
+  if (!zba_camera_clip_roi(roi, width, height, kSensorWindowAlign, &clipped))
+  {
+    return ZBA_CAM_ROI_UNSUPPORTED;
+  }
+
+  // Window coordinates are in pixels of the sensor mode the frame size runs in.
+  int mode           = kOv2640ModeUxga;
+  size_t mode_width  = 1600;
+  size_t mode_height = 1200;
+  if (resInfo->frameSize <= FRAMESIZE_CIF)
+  {
+    mode        = kOv2640ModeCif;
+    mode_width  = 400;
+    mode_height = 296;
   }
+  else if (resInfo->frameSize <= FRAMESIZE_SVGA)
+  {
+    mode        = kOv2640ModeSvga;
+    mode_width  = 800;
+    mode_height = 600;
+  }
+
+  // The driver centres the largest window with the frame's aspect ratio in the mode,
+  // then scales that to the frame. Map the ROI back through the same window.
+  size_t win_width  = mode_width;
+  size_t win_height = mode_width * height / width;
+  if (win_height > mode_height)
+  {
+    win_height = mode_height;
+    win_width  = mode_height * width / height;
+  }
+  int offset_x = (mode_width - win_width) / 2 + clipped.x * win_width / width;
+  int offset_y = (mode_height - win_height) / 2 + clipped.y * win_height / height;
+  int total_x  = clipped.width * win_width / width;
+  int total_y  = clipped.height * win_height / height;
+
+  if (0 != sensor->set_res_raw(sensor, mode, 0, 0, 0, offset_x, offset_y, total_x, total_y,
+                               clipped.width, clipped.height, false, false))
+  {
+    ZBA_ERR("Sensor rejected window %d,%d %dx%d", offset_x, offset_y, total_x, total_y);
+    sensor->set_framesize(sensor, resInfo->frameSize);
+    return ZBA_CAM_ROI_UNSUPPORTED;
+  }
+
+  ZBA_LOG("Sensor windowed to %u,%u %ux%u", clipped.x, clipped.y, clipped.width, clipped.height);
+  camera_state.sensor_roi        = clipped;
+  camera_state.sensor_roi_active = true;
+  return ZBA_OK;
+}
+
+/// Crops an RGB565 or grayscale frame into a pool frame
+static zba_frame_t* zba_camera_crop_raw(zba_frame_t* frame, const zba_roi_t* roi, size_t bpp)
+{
+  camera_fb_t* fb      = frame->fb;
+  zba_frame_t* cropped = NULL;
+  zba_roi_t clipped;
+
+  if (!zba_camera_clip_roi(roi, fb->width, fb->height, 1, &clipped)) return NULL;
+  if (!(cropped = zba_frame_pool_acquire(clipped.width * clipped.height * bpp))) return NULL;
+
+  zba_imgproc_crop(fb->buf, fb->width, bpp, clipped.x, clipped.y, clipped.width, clipped.height,
+                   cropped->fb->buf);
+  cropped->fb->width     = clipped.width;
+  cropped->fb->height    = clipped.height;
+  cropped->fb->format    = fb->format;
+  cropped->fb->timestamp = fb->timestamp;
+  return cropped;
+}
+
+/// Decoder state for cropping a JPEG
+typedef struct
+{
+  const uint8_t* input;  ///< JPEG being decoded
+  const zba_roi_t* roi;  ///< Requested ROI
+  zba_roi_t clipped;     ///< ROI clipped to the image and MCU aligned
+  uint8_t* rgb;          ///< Decoded ROI, RGB888 in the driver's (BGR) byte order
+  bool done;             ///< Decoded everything down to the bottom of the ROI
+} zba_jpeg_crop_t;
+
+static size_t zba_camera_crop_read(void* arg, size_t index, uint8_t* buf, size_t len)
+{
+  zba_jpeg_crop_t* crop = (zba_jpeg_crop_t*)arg;
+  if (buf)
+  {
+    memcpy(buf, crop->input + index, len);
+  }
+  return len;
+}
+
+static bool zba_camera_crop_write(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                                  uint8_t* data)
+{
+  zba_jpeg_crop_t* crop = (zba_jpeg_crop_t*)arg;
+  zba_roi_t* roi        = &crop->clipped;
+
+  if (!data)
+  {
+    // Start of image tells us its real size, so clip to that and allocate.
+    if ((x == 0) && (y == 0) && (!crop->rgb))
+    {
+      if (!zba_camera_clip_roi(crop->roi, w, h, kJpegMcuSize, roi)) return false;
+      size_t len = roi->width * roi->height * 3;
+      if (!(crop->rgb = heap_caps_malloc(len, MALLOC_CAP_SPIRAM)))
+      {
+        crop->rgb = malloc(len);
+      }
+      return (crop->rgb != NULL);
+    }
+    return true;
+  }
+
+  if (y >= roi->y + roi->height)
+  {
+    // Nothing more we want - stop decoding.
+    crop->done = true;
+    return false;
+  }
+
+  size_t x0 = ZBA_MAX(x, roi->x);
+  size_t x1 = ZBA_MIN(x + w, roi->x + roi->width);
+  size_t y0 = ZBA_MAX(y, roi->y);
+  size_t y1 = ZBA_MIN(y + h, roi->y + roi->height);
+  for (size_t row = y0; (x0 < x1) && (row < y1); ++row)
+  {
+    const uint8_t* src = data + ((row - y) * w + (x0 - x)) * 3;
+    uint8_t* dst       = crop->rgb + ((row - roi->y) * roi->width + (x0 - roi->x)) * 3;
+    for (size_t col = x0; col < x1; ++col, src += 3, dst += 3)
+    {
+      dst[0] = src[2];
+      dst[1] = src[1];
+      dst[2] = src[0];
+    }
+  }
+  return true;
+}
+
+static size_t zba_camera_crop_out(void* arg, size_t index, const void* data, size_t len)
+{
+  zba_frame_t* out = (zba_frame_t*)arg;
+  if (index + len > out->capacity) return 0;
+  memcpy(out->fb->buf + index, data, len);
+  out->fb->len = index + len;
+  return len;
+}
+
+/// Crops a JPEG frame into a pool frame
+static zba_frame_t* zba_camera_crop_jpeg(zba_frame_t* frame, const zba_roi_t* roi)
+{
+  camera_fb_t* fb      = frame->fb;
+  zba_frame_t* cropped = NULL;
+  zba_jpeg_crop_t crop = {.input = fb->buf, .roi = roi, .clipped = {0}, .rgb = NULL, .done = false};
+
+  // Only the ROI is kept, and decoding stops once we're past its bottom edge.
+  esp_err_t decode_err = esp_jpg_decode(fb->len, JPG_SCALE_NONE, zba_camera_crop_read,
+                                        zba_camera_crop_write, &crop);
+
+  for (;;)
+  {
+    if ((!crop.rgb) || ((ESP_OK != decode_err) && (!crop.done)))
+    {
+      ZBA_ERR("Failed decoding JPEG for crop");
+      break;
+    }
+
+    size_t pixels = crop.clipped.width * crop.clipped.height;
+    if (!(cropped = zba_frame_pool_acquire(pixels * kRoiJpegMaxBpp))) break;
+
+    cropped->fb->len = 0;
+    if (!fmt2jpg_cb(crop.rgb, pixels * 3, crop.clipped.width, crop.clipped.height,
+                    PIXFORMAT_RGB888, kRoiJpegQuality, zba_camera_crop_out, cropped))
+    {
+      ZBA_ERR("Failed encoding JPEG crop");
+      zba_frame_release(cropped);
+      cropped = NULL;
+      break;
+    }
+    cropped->fb->width     = crop.clipped.width;
+    cropped->fb->height    = crop.clipped.height;
+    cropped->fb->format    = PIXFORMAT_JPEG;
+    cropped->fb->timestamp = fb->timestamp;
+    break;
+  }
+
+  free(crop.rgb);
+  return cropped;
+}
+
+/// Decoder state for scaling a JPEG
+typedef struct
+{
+  const uint8_t* input;  ///< JPEG being decoded
+  uint8_t* rgb;          ///< Decoded image, RGB888 swapped from the decoder's BGR
+  uint16_t width;        ///< Scaled width
+  uint16_t height;       ///< Scaled height
+} zba_jpeg_scale_t;
+
+static size_t zba_camera_scale_read(void* arg, size_t index, uint8_t* buf, size_t len)
+{
+  zba_jpeg_scale_t* scale = (zba_jpeg_scale_t*)arg;
+  if (buf)
+  {
+    memcpy(buf, scale->input + index, len);
+  }
+  return len;
+}
+
+static bool zba_camera_scale_write(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                                   uint8_t* data)
+{
+  zba_jpeg_scale_t* scale = (zba_jpeg_scale_t*)arg;
+
+  if (!data)
+  {
+    // Start of image comes with the scaled size.
+    if ((x == 0) && (y == 0) && (!scale->rgb))
+    {
+      size_t len    = w * h * 3;
+      scale->width  = w;
+      scale->height = h;
+      if (!(scale->rgb = heap_caps_malloc(len, MALLOC_CAP_SPIRAM)))
+      {
+        scale->rgb = malloc(len);
+      }
+      return (scale->rgb != NULL);
+    }
+    return true;
+  }
+
+  size_t cols = ZBA_MIN(x + w, scale->width) - ZBA_MIN(x, scale->width);
+  for (size_t row = y; (row < y + h) && (row < scale->height); ++row)
+  {
+    const uint8_t* src = data + (row - y) * w * 3;
+    uint8_t* dst       = scale->rgb + (row * scale->width + x) * 3;
+    for (size_t col = 0; col < cols; ++col, src += 3, dst += 3)
+    {
+      dst[0] = src[2];
+      dst[1] = src[1];
+      dst[2] = src[0];
+    }
+  }
+  return true;
+}
+
+zba_frame_t* zba_camera_scale_frame(zba_frame_t* frame, size_t max_width)
+{
+  zba_frame_t* scaled    = NULL;
+  zba_jpeg_scale_t scale = {.input = NULL, .rgb = NULL, .width = 0, .height = 0};
+  int factor             = JPG_SCALE_NONE;
+
+  if ((!frame) || (frame->fb->format != PIXFORMAT_JPEG) || (!max_width)) return NULL;
+  if (frame->fb->width <= max_width) return zba_frame_ref(frame);
+
+  // The decoder scales by 1/2, 1/4 or 1/8 as it goes, so the full size image is never
+  // built. At 1/8 each block is just its DC coefficient and the IDCT is skipped.
+  while ((factor < JPG_SCALE_8X) && ((frame->fb->width >> factor) > max_width))
+  {
+    factor++;
+  }
+
+  scale.input          = frame->fb->buf;
+  esp_err_t decode_err = esp_jpg_decode(frame->fb->len, (jpg_scale_t)factor,
+                                        zba_camera_scale_read, zba_camera_scale_write, &scale);
+  for (;;)
+  {
+    if ((ESP_OK != decode_err) || (!scale.rgb))
+    {
+      ZBA_ERR("Failed decoding JPEG for preview");
+      break;
+    }
+
+    size_t pixels = scale.width * scale.height;
+    if (!(scaled = zba_frame_pool_acquire(pixels * kRoiJpegMaxBpp))) break;
+
+    scaled->fb->len = 0;
+    if (!fmt2jpg_cb(scale.rgb, pixels * 3, scale.width, scale.height, PIXFORMAT_RGB888,
+                    kPreviewJpegQuality, zba_camera_crop_out, scaled))
+    {
+      ZBA_ERR("Failed encoding JPEG preview");
+      zba_frame_release(scaled);
+      scaled = NULL;
+      break;
+    }
+    scaled->fb->width     = scale.width;
+    scaled->fb->height    = scale.height;
+    scaled->fb->format    = PIXFORMAT_JPEG;
+    scaled->fb->timestamp = frame->fb->timestamp;
+    scaled->frame_num     = frame->frame_num;
+    break;
+  }
+
+  free(scale.rgb);
+  return scaled;
+}
+
+zba_frame_t* zba_camera_crop_frame(zba_frame_t* frame, const zba_roi_t* roi)
+{
+  zba_frame_t* cropped = NULL;
+  if ((!frame) || (!roi)) return frame;
+
+  switch (frame->fb->format)
+  {
+    case PIXFORMAT_RGB565:
+      cropped = zba_camera_crop_raw(frame, roi, 2);
+      break;
+    case PIXFORMAT_GRAYSCALE:
+      cropped = zba_camera_crop_raw(frame, roi, 1);
+      break;
+    case PIXFORMAT_JPEG:
+      cropped = zba_camera_crop_jpeg(frame, roi);
+      break;
+    default:
+      break;
+  }
+
+  if (!cropped) return frame;
+  cropped->frame_num = frame->frame_num;
+  zba_frame_release(frame);
+  return cropped;
 }
 
 void zba_camera_capture_task()
 {
   ZBA_ERR("Camera Task running!");
-  camera_fb_t* frame = NULL;
+  zba_frame_t* frame = NULL;
   while (camera_state.capturing)
   {
     frame = zba_camera_capture_frame();
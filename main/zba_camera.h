@@ -1,6 +1,7 @@
 #ifndef ZEBRAL_ESP32CAM_ZBA_CAMERA_H_
 #define ZEBRAL_ESP32CAM_ZBA_CAMERA_H_
 #include <esp_camera.h>
+#include "zba_frame.h"
 #include "zba_util.h"
 
 #ifdef __cplusplus
@@ -21,11 +22,10 @@ extern "C"
     // Haven't had it work well yet above SVGA in RGB565,
     // and grayscale wasn't working for me either.
 
-    // This don't seem to work in JPEG
-    // {TODO} troubleshoot this...
-    // AH! when it allocates the frame size, it's doing RAW/5 in camera_hal.c.
-    // For better quality images, that simply isn't true, esp. at small sizes.
-    // So use worse quality, or change the /5 to something else closer to reality
+    // The driver sizes JPEG buffers as RAW/5 in camera_hal.c, which isn't
+    // enough for good quality at small sizes. zba_camera_init now picks the
+    // buffer allocation from JPEG sizes it has seen (see zba_camera_get_fb_capacity),
+    // so these can run at the same quality as the larger modes.
     ZBA_96x96,
     ZBA_QVGA,  // 320x240   JPEG
     ZBA_QCIF,  // 176x144   JPEG
@@ -38,11 +38,16 @@ extern "C"
     ZBA_UXGA   // 1600x1200 JPEG
   } zba_resolution_t;
 
+/// Number of entries in zba_resolution_t
+#define ZBA_NUM_RESOLUTIONS (ZBA_UXGA + 1)
+
   zba_err_t zba_camera_set_res(zba_resolution_t res);
   zba_resolution_t zba_camera_get_res();
   size_t zba_camera_get_height();
   size_t zba_camera_get_width();
   zba_err_t zba_camera_set_autoexposure(bool on);
+  /// JPEG quality, 1 (best) to 63. 0 goes back to each resolution's own.
+  zba_err_t zba_camera_set_quality(int quality);
 
   /// Resolution as defined above
   zba_err_t zba_camera_init();
@@ -50,10 +55,14 @@ extern "C"
   /// Deinitialize the camera
   zba_err_t zba_camera_deinit();
 
-  camera_fb_t* zba_camera_capture_frame();
-  void zba_camera_release_frame(camera_fb_t* frame);
+  /// Captures a frame. The caller holds a reference and must zba_camera_release_frame() it.
+  zba_frame_t* zba_camera_capture_frame();
+  /// Releases a reference to a frame (see zba_frame_release)
+  void zba_camera_release_frame(zba_frame_t* frame);
 
-  typedef camera_fb_t* (*zba_camera_frame_callback_t)(camera_fb_t* frame, void* context);
+  /// Frame callback. Return NULL or frame to pass the frame through as-is, or a frame
+  /// from zba_frame_pool_acquire() to hand out instead (the driver frame is then released).
+  typedef zba_frame_t* (*zba_camera_frame_callback_t)(zba_frame_t* frame, void* context);
 
   /// Sets a callback that's called with the frame prior to returning from zba_camera_capture_frame.
   void zba_camera_set_on_frame(zba_camera_frame_callback_t callback, void* context);
@@ -67,8 +76,41 @@ extern "C"
   /// (this will mostly be used for imaging on the chip)
   void zba_camera_capture_stop();
 
+  /// Bytes available per JPEG frame buffer in the current allocation (0 if not JPEG)
+  size_t zba_camera_get_fb_capacity();
+
+  /// Region of interest, in pixels of the current resolution
+  typedef struct
+  {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+  } zba_roi_t;
+
+  /// Windows the sensor to roi so JPEG frames come out of it already cropped.
+  /// The sensor is shared, so this crops every client's frames - only one window
+  /// can be set at a time. Pass NULL to go back to the full frame.
+  /// Not safe alongside a camera restart, so only zba_mjpeg's capture task calls it.
+  /// Returns ZBA_CAM_ROI_UNSUPPORTED if the sensor/format can't do it or a window
+  /// is already set; use zba_camera_crop_frame() instead.
+  zba_err_t zba_camera_set_roi(const zba_roi_t* roi);
+
+  /// Crops a frame on the device - RGB565 and grayscale directly, JPEG by decoding
+  /// just the ROI (MCU aligned) and re-encoding it. Returns a pool frame and releases
+  /// the original, or the original frame if it couldn't be cropped.
+  zba_frame_t* zba_camera_crop_frame(zba_frame_t* frame, const zba_roi_t* roi);
+
+  /// Makes a smaller JPEG of a frame, no wider than max_width where the decoder's 1/8
+  /// scale allows. Returns a new pool frame, or frame with a reference taken if it's
+  /// already small enough. frame isn't released. NULL if it's not a JPEG or fails.
+  zba_frame_t* zba_camera_scale_frame(zba_frame_t* frame, size_t max_width);
+
   zba_err_t zba_camera_set_status_default();
-  zba_err_t zba_camera_dump_status();
+  zba_err_t zba_camera_dump_status(zba_print_fn print, void* context);
+
+  /// Sensor settings, or NULL if there's no sensor
+  const camera_status_t* zba_camera_get_status();
 
   typedef struct
   {
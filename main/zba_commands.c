@@ -1,13 +1,24 @@
 #include "zba_commands.h"
+#include <ctype.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <memory.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "zba_auth.h"
+#include "zba_boot.h"
 #include "zba_camera.h"
 #include "zba_config.h"
 #include "zba_i2c.h"
+#include "zba_json.h"
 #include "zba_led.h"
+#include "zba_metrics.h"
+#include "zba_mjpeg.h"
+#include "zba_rtsp.h"
 #include "zba_sd.h"
 #include "zba_stream.h"
+#include "zba_trace.h"
 #include "zba_util.h"
 #include "zba_vision.h"
 #include "zba_web.h"
@@ -15,10 +26,13 @@
 
 DEFINE_ZBA_TAG;
 
+/// Receive timeouts in a row (httpd's recv_wait_timeout each) before a batch body is given up on
+static const int kBatchRecvTimeouts = 3;
+
 // {TODO} In .cpp because it uses Printable and Stream.
 
 // Function to receive commands and do something with them.
-typedef void (*command_handler)(const char *arg, zba_cmd_stream_t *cmd_stream);
+typedef zba_err_t (*command_handler)(const char *arg, zba_cmd_stream_t *cmd_stream);
 typedef void (*command_handler_web)(const char *arg, httpd_req_t *req);
 
 // Entry in our command handler list
@@ -33,32 +47,34 @@ typedef struct
 
 // clang-format off
 
-/// Commands that can be run via serial
+/// Commands that can be run via serial.
+/// Looked up by binary search on the command name - keep these in alphabetical order.
 static const command_entry_t command_handlers[] =
 {
-// Setup
-  {"logout",   zba_commands_logout,        NULL, "logout",             "Logs out of the camera"},
-  {"pwd",      zba_commands_set_device_pwd,NULL, "pwd PASSWORD",       "Sets the device password"},
-  {"reboot",   zba_commands_reboot,        NULL, "reboot",             "Reboots the device"},
+  {"autoexpose", zba_commands_autoexpose,  NULL,  "autoexpose [on|off]","Turns on/off autoexposure"},
+  {"cam",      zba_commands_camera_status, NULL,  "cam",                "Get camera status"},
+  {"dir",      zba_commands_dir,           NULL,  "dir",                "Displays files on SD card"},
+  {"fps",      zba_commands_fps,           NULL,  "fps [FPS]",          "Gets/sets the default video frame rate (0 = max)"},
+  {"gpio",     zba_commands_gpio,          NULL,  "gpio## [on|off]",    "Turns on/off gpio bits"},
+  {"ledcolor", zba_commands_ledcolor,      NULL,  "ledcolor #000000",   "Sets all LEDs to color"},
+  {"light",    zba_commands_light,         NULL,  "light [on|off]",     "Toggles the white led (front)"},
+  {"logout",   zba_commands_logout,        NULL,  "logout",             "Logs out of the camera"},
+  {"memory",   zba_commands_memory,        NULL,  "memory",             "Gets the memory usage"},
+  {"metrics",  zba_commands_metrics,       NULL,  "metrics",            "Dumps counters and histograms"},
+  {"pwd",      zba_commands_set_device_pwd,NULL,  "pwd PASSWORD",       "Sets the device password"},
+  {"quality",  zba_commands_quality,       NULL,  "quality [1-63|0]",   "Gets/sets JPEG quality (lower is better, 0 = default)"},
+  {"reboot",   zba_commands_reboot,        NULL,  "reboot",             "Reboots the device"},
+  {"res",      zba_commands_camera_res,    NULL,  "res",                "Set camera res (VGA,SVGA,HD,SXGA,UXGA)"},
   {"reset",    zba_commands_reset,         NULL,  "reset",              "Resets the device to factory"},
   {"ssid",     zba_commands_set_ssid,      NULL,  "ssid SSID",          "Sets the SSID for WiFi"},
-  {"wifi_pwd", zba_commands_set_wifi_pwd,  NULL,  "wifi_pwd PASSWORD",  "Sets the password for WiFi"},
-  {"memory",   zba_commands_memory,        NULL,  "memory",             "Gets the memory usage"},
-// These are for testing  
+  // start and stop are for testing
   {"start",    zba_commands_start,         NULL,  "start SUBSYSTEM",    "Start a subsystem"},
-  {"stop",     zba_commands_stop,          NULL,  "stop SUBSYSTEM",     "Stop a subsystem"},
-// Blinkies
-  {"light",    zba_commands_light,         NULL,  "light [on|off]",     "Toggles the white led (front)"},
-  {"dir",      zba_commands_dir,           NULL,  "dir",                "Displays files on SD card"},
-  {"cam",      zba_commands_camera_status, NULL,  "cam",                "Get camera status"},
-  {"res",      zba_commands_camera_res,    NULL,  "res",                "Set camera res (VGA,SVGA,HD,SXGA,UXGA)"},
-  {"ledcolor", zba_commands_ledcolor,      NULL,  "ledcolor #000000",   "Sets all LEDs to color"},
-  {"gpio",     zba_commands_gpio,          NULL,  "gpio## [on|off]",    "Turns on/off gpio bits"},
-  {"autoexpose", zba_commands_autoexpose,  NULL,  "autoexpose [on|off]","Turns on/off autoexposure"},
   // Special commands handled differently for web
-  {"status",   zba_commands_status,        
-               zba_commands_status_web,           "status",             "Gets the status of subsystems"}
-
+  {"status",   zba_commands_status,
+               zba_commands_status_web,           "status",             "Gets the status of subsystems"},
+  {"stop",     zba_commands_stop,          NULL,  "stop SUBSYSTEM",     "Stop a subsystem"},
+  {"trace",    zba_commands_trace,         NULL,  "trace",              "Dumps per-frame latency traces"},
+  {"wifi_pwd", zba_commands_set_wifi_pwd,  NULL,  "wifi_pwd PASSWORD",  "Sets the password for WiFi"},
 };
 const static int num_command_handlers = sizeof(command_handlers) / sizeof(command_entry_t);
 
@@ -78,6 +94,8 @@ typedef struct
 static const zba_subsystem_entry_t zba_subsystems[] =
 {
   DEFINE_ZBA_SUBSYSTEM_ENTRY(web),
+  DEFINE_ZBA_SUBSYSTEM_ENTRY(mjpeg),
+  DEFINE_ZBA_SUBSYSTEM_ENTRY(rtsp),
   DEFINE_ZBA_SUBSYSTEM_ENTRY(wifi),
   DEFINE_ZBA_SUBSYSTEM_ENTRY(camera),
   DEFINE_ZBA_SUBSYSTEM_ENTRY(led),
@@ -88,6 +106,7 @@ static const zba_subsystem_entry_t zba_subsystems[] =
 const static int num_subsystems = sizeof(zba_subsystems) / sizeof(zba_subsystem_entry_t);
 
 
+/// Alphabetical, like command_handlers
 static const command_entry_t unauthed_handlers[] = 
 {
   // This one has no space, as it may be used w/o password if there's none set.
@@ -97,16 +116,120 @@ static const command_entry_t unauthed_handlers[] =
 };
 const static int num_unauthed_handlers = sizeof(unauthed_handlers) / sizeof(command_entry_t);
 
-#define ZBA_CMD_LOG(...) ZBA_LOG(__VA_ARGS__)
-// #define ZBA_CMD_LOG(x) {cmd_stream->source->println(x);}
+/// Command output goes back to whoever ran the command - needs cmd_stream in scope.
+#define ZBA_CMD_LOG(...) zba_commands_print(cmd_stream, __VA_ARGS__)
 // clang-format on
 
 void zba_commands_stream_init(zba_cmd_stream_t *cmd_stream, int fd)
 {
   memset(&cmd_stream->buffer[0], 0, sizeof(cmd_stream->buffer));
-  cmd_stream->fd     = fd;
-  cmd_stream->bufPos = 0;
-  cmd_stream->authed = false;
+  cmd_stream->fd            = fd;
+  cmd_stream->bufPos        = 0;
+  cmd_stream->authed        = false;
+  cmd_stream->out.type      = (fd == ZBA_INVALID_FD) ? ZBA_CMD_OUT_LOG : ZBA_CMD_OUT_FD;
+  cmd_stream->out.json      = NULL;
+  cmd_stream->out.len       = 0;
+  cmd_stream->out.text      = NULL;
+  cmd_stream->out.text_size = 0;
+}
+
+void zba_commands_stream_init_web(zba_cmd_stream_t *cmd_stream, zba_json_t *json)
+{
+  zba_commands_stream_init(cmd_stream, ZBA_INVALID_FD);
+  cmd_stream->authed   = true;
+  cmd_stream->out.type = json ? ZBA_CMD_OUT_JSON : ZBA_CMD_OUT_TEXT;
+  cmd_stream->out.json = json;
+}
+
+void zba_commands_stream_init_text(zba_cmd_stream_t *cmd_stream, char *text, size_t size)
+{
+  zba_commands_stream_init_web(cmd_stream, NULL);
+  cmd_stream->out.text      = text;
+  cmd_stream->out.text_size = size;
+  text[0]                   = 0;
+}
+
+void zba_commands_flush(zba_cmd_stream_t *cmd_stream)
+{
+  zba_cmd_out_t *out = &cmd_stream->out;
+  if ((out->type != ZBA_CMD_OUT_FD) || (out->len == 0)) return;
+
+  const char *data = out->buffer;
+  while (out->len > 0)
+  {
+    ssize_t written = write(cmd_stream->fd, data, out->len);
+    if (written <= 0) break;
+    data += written;
+    out->len -= written;
+  }
+  out->len = 0;
+}
+
+/// Adds to the output buffer, flushing it to make room if it goes to an fd.
+/// Returns false if it didn't all fit.
+static bool zba_commands_out_append(zba_cmd_stream_t *cmd_stream, const char *data, size_t len)
+{
+  zba_cmd_out_t *out = &cmd_stream->out;
+  while (len > 0)
+  {
+    if ((out->len == sizeof(out->buffer)) && (out->type == ZBA_CMD_OUT_FD))
+    {
+      zba_commands_flush(cmd_stream);
+    }
+    size_t count = ZBA_MIN(len, sizeof(out->buffer) - out->len);
+    if (count == 0) return false;
+    memcpy(out->buffer + out->len, data, count);
+    out->len += count;
+    data += count;
+    len -= count;
+  }
+  return true;
+}
+
+void zba_commands_print(void *context, const char *fmt, ...)
+{
+  zba_cmd_stream_t *cmd_stream = (zba_cmd_stream_t *)context;
+  char line[ZBA_CMD_OUT_SIZE];
+  va_list args;
+
+  va_start(args, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (len < 0) return;
+  len = ZBA_MIN(len, sizeof(line) - 1);
+
+  switch (cmd_stream ? cmd_stream->out.type : ZBA_CMD_OUT_LOG)
+  {
+    case ZBA_CMD_OUT_FD:
+      zba_commands_out_append(cmd_stream, line, len);
+      zba_commands_out_append(cmd_stream, "\r\n", 2);
+      break;
+    case ZBA_CMD_OUT_JSON:
+      zba_json_string(cmd_stream->out.json, NULL, line);
+      break;
+    case ZBA_CMD_OUT_TEXT:
+      // Whole lines only, so a reply cut short still makes sense. Leaves room to terminate.
+      if (!cmd_stream->out.text)
+      {
+        if (cmd_stream->out.len + len + 1 < sizeof(cmd_stream->out.buffer))
+        {
+          zba_commands_out_append(cmd_stream, line, len);
+          zba_commands_out_append(cmd_stream, "\n", 1);
+        }
+      }
+      else if (cmd_stream->out.len + len + 1 < cmd_stream->out.text_size)
+      {
+        char *end = cmd_stream->out.text + cmd_stream->out.len;
+        memcpy(end, line, len);
+        end[len]     = '\n';
+        end[len + 1] = 0;
+        cmd_stream->out.len += len + 1;
+      }
+      break;
+    default:
+      ZBA_LOG("%s", line);
+      break;
+  }
 }
 
 void zba_commands_stream_process(zba_cmd_stream_t *cmd_stream)
@@ -150,36 +273,204 @@ void zba_commands_stream_process(zba_cmd_stream_t *cmd_stream)
   }
 }
 
+/// Length of the command name at the start of buffer. Names are letters and '_', so the
+/// name ends at the first ' ' or '=' - or digit, for gpio##.
+static size_t zba_commands_name_len(const char *buffer)
+{
+  size_t len = 0;
+  while (isalpha((unsigned char)buffer[len]) || (buffer[len] == '_'))
+  {
+    len++;
+  }
+  return len;
+}
+
+/// Finds the command that's exactly name (case insensitive) in a sorted table.
+static const command_entry_t *zba_commands_find(const command_entry_t *handlers,
+                                                int num_handlers, const char *name, size_t len)
+{
+  int low  = 0;
+  int high = num_handlers - 1;
+  while (low <= high)
+  {
+    int mid             = (low + high) / 2;
+    const char *command = handlers[mid].command;
+    int diff            = strncasecmp(name, command, len);
+    // name's a prefix of command - it sorts first
+    if ((diff == 0) && (command[len] != 0))
+    {
+      diff = -1;
+    }
+
+    if (diff == 0) return &handlers[mid];
+    if (diff < 0)
+    {
+      high = mid - 1;
+    }
+    else
+    {
+      low = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+/// Runs the command in buffer if there's one by that name
+static zba_err_t zba_commands_run(const command_entry_t *handlers, int num_handlers,
+                                  const char *buffer, zba_cmd_stream_t *cmd_stream)
+{
+  size_t len                     = zba_commands_name_len(buffer);
+  const command_entry_t *handler = zba_commands_find(handlers, num_handlers, buffer, len);
+  if (!handler) return ZBA_UNKNOWN_COMMAND;
+
+  zba_err_t result = handler->handler(buffer + len, cmd_stream);
+  ZBA_LOG("Command processed: %s (0x%X)", handler->command, result);
+  return result;
+}
+
+/// Starts a command's result object - {"command":..., "output":[... - for its output to
+/// go into. command can be NULL to leave it out.
+static void zba_commands_result_begin(zba_json_t *json, const char *command)
+{
+  zba_json_object(json, NULL);
+  if (command)
+  {
+    zba_json_string(json, "command", command);
+  }
+  zba_json_array(json, "output");
+}
+
+/// Ends the result object with ], "status":..., "error":...}
+static void zba_commands_result_end(zba_json_t *json, zba_err_t result)
+{
+  zba_json_end_array(json);
+  zba_json_string(json, "status", (ZBA_OK == result) ? "success" : "error");
+  if (ZBA_OK != result)
+  {
+    zba_json_hex(json, "error", result);
+  }
+  zba_json_end_object(json);
+}
+
 void zba_commands_process_web(const char *buffer, httpd_req_t *req)
 {
-  const command_entry_t *handlers = command_handlers;
-  int num_handlers                = num_command_handlers;
+  size_t len                     = zba_commands_name_len(buffer);
+  const command_entry_t *handler = zba_commands_find(command_handlers, num_command_handlers,
+                                                     buffer, len);
+  if (!handler)
+  {
+    ZBA_LOG("Unknown command %s.", buffer);
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown command");
+    return;
+  }
 
-  int i;
-  for (i = 0; i < num_handlers; ++i)
+  if (handler->web_handler)
+  {
+    handler->web_handler(buffer + len, req);
+    ZBA_LOG("Command processed: %s", handler->command);
+    return;
+  }
+
+  zba_json_t json;
+  zba_cmd_stream_t cmd_stream;
+  zba_json_begin(&json, req);
+  zba_commands_stream_init_web(&cmd_stream, &json);
+  zba_commands_result_begin(&json, NULL);
+  zba_err_t result = zba_commands_run(command_handlers, num_command_handlers, buffer, &cmd_stream);
+  zba_commands_result_end(&json, result);
+  zba_json_end(&json);
+}
+
+/// Runs a line of a batch and adds its result. Returns true if it failed.
+static bool zba_commands_batch_line(zba_cmd_stream_t *cmd_stream, char *line, size_t len,
+                                    bool too_long)
+{
+  char name[16];
+
+  while ((len > 0) && ((line[len - 1] == '\r') || (line[len - 1] == ' ')))
+  {
+    len--;
+  }
+  line[len] = 0;
+  while (*line == ' ')
+  {
+    line++;
+  }
+  if ((*line == 0) && !too_long) return false;
+
+  // Just the name goes back - arguments can be passwords.
+  snprintf(name, sizeof(name), "%.*s", (int)zba_commands_name_len(line), line);
+  zba_commands_result_begin(cmd_stream->out.json, name);
+
+  zba_err_t result = ZBA_INVALID_ARG;
+  if (too_long)
+  {
+    ZBA_CMD_LOG("Line too long.");
+  }
+  else
+  {
+    result = zba_commands_run(command_handlers, num_command_handlers, line, cmd_stream);
+  }
+  zba_commands_result_end(cmd_stream->out.json, result);
+  return (ZBA_OK != result);
+}
+
+void zba_commands_process_batch_web(httpd_req_t *req)
+{
+  char chunk[128];
+  char line[kSerialBufferLength + 1];
+  size_t line_len  = 0;
+  bool too_long    = false;
+  size_t remaining = req->content_len;
+  int failed       = 0;
+  int timeouts     = 0;
+  zba_json_t json;
+  zba_cmd_stream_t cmd_stream;
+
+  // Results stream out as the commands run, while the rest of the body's still coming in.
+  zba_json_begin(&json, req);
+  zba_commands_stream_init_web(&cmd_stream, &json);
+  zba_json_object(&json, NULL);
+  zba_json_array(&json, "results");
+  while (remaining > 0)
   {
-    if (0 == strncasecmp(buffer, handlers[i].command, strlen(handlers[i].command)))
+    int received = httpd_req_recv(req, chunk, ZBA_MIN(remaining, sizeof(chunk)));
+    // A client that stalls gets "complete": false rather than holding the server forever.
+    if ((received == HTTPD_SOCK_ERR_TIMEOUT) && (++timeouts < kBatchRecvTimeouts)) continue;
+    if (received <= 0) break;
+    timeouts = 0;
+    remaining -= received;
+
+    for (int i = 0; i < received; ++i)
     {
-      if (handlers[i].web_handler)
+      if (chunk[i] == '\n')
+      {
+        failed += zba_commands_batch_line(&cmd_stream, line, line_len, too_long) ? 1 : 0;
+        line_len = 0;
+        too_long = false;
+      }
+      else if (line_len < sizeof(line) - 1)
       {
-        handlers[i].web_handler(buffer + strlen(handlers[i].command), req);
+        line[line_len++] = chunk[i];
       }
       else
       {
-        handlers[i].handler(buffer + strlen(handlers[i].command), NULL);
-        // Provide response - right now, just success on everything.
-        httpd_resp_set_type(req, "text/html");
-        httpd_resp_set_hdr(req, "Content-Encoding", "utf-8");
-        httpd_resp_sendstr(req, "{\"status\":\"success\"}");
+        too_long = true;
       }
-      ZBA_CMD_LOG("Command processed: %s", handlers[i].command);
-      return;
     }
   }
-  ZBA_CMD_LOG("Unknown command %s.", buffer);
+  // The last line needn't end with a newline.
+  failed += zba_commands_batch_line(&cmd_stream, line, line_len, too_long) ? 1 : 0;
+  zba_json_end_array(&json);
+
+  // If the body got cut off, only what arrived was run.
+  zba_json_bool(&json, "complete", remaining == 0);
+  zba_json_int(&json, "failed", failed);
+  zba_json_end_object(&json);
+  zba_json_end(&json);
 }
 
-void zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream)
 {
   const command_entry_t *handlers = NULL;
   int num_handlers                = 0;
@@ -190,31 +481,32 @@ void zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream)
   handlers     = authed ? command_handlers : unauthed_handlers;
   num_handlers = authed ? num_command_handlers : num_unauthed_handlers;
 
-  int i;
-  for (i = 0; i < num_handlers; ++i)
+  zba_err_t result = zba_commands_run(handlers, num_handlers, buffer, cmd_stream);
+  if (ZBA_UNKNOWN_COMMAND == result)
   {
-    if (0 == strncasecmp(buffer, handlers[i].command, strlen(handlers[i].command)))
+    int i;
+
+    ZBA_CMD_LOG("Unknown command.");
+    ZBA_CMD_LOG("Zebral ESP32-CAM valid commands:");
+    for (i = 0; i < num_handlers; ++i)
     {
-      handlers[i].handler(buffer + strlen(handlers[i].command), cmd_stream);
-      ZBA_CMD_LOG("Command processed: %s", handlers[i].command);
-      return;
+      ZBA_CMD_LOG("%-24s - %s", handlers[i].usage, handlers[i].description);
     }
   }
 
-  ZBA_CMD_LOG("Unknown command.");
-  ZBA_CMD_LOG("Zebral ESP32-CAM valid commands:");
-  for (i = 0; i < num_handlers; ++i)
+  if (cmd_stream)
   {
-    ZBA_CMD_LOG("%-24s - %s", handlers[i].usage, handlers[i].description);
+    zba_commands_flush(cmd_stream);
   }
+  return result;
 }
 
-void zba_commands_login(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_login(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
-  if (!cmd_stream)
+  if ((!cmd_stream) || (cmd_stream->fd == ZBA_INVALID_FD))
   {
     ZBA_CMD_LOG("No command stream, should already be logged in.");
-    return;
+    return ZBA_ERROR;
   }
 
   if (arg[0] == 0)
@@ -223,52 +515,49 @@ void zba_commands_login(const char *arg, zba_cmd_stream_t *cmd_stream)
     if (cmd_stream->authed)
     {
       ZBA_CMD_LOG("Logged in. Please set a password.");
+      return ZBA_OK;
     }
-    else
-    {
-      ZBA_CMD_LOG("A password is set. Please include password with login command.");
-    }
-    return;
+    ZBA_CMD_LOG("A password is set. Please include password with login command.");
+    return ZBA_CONFIG_NOT_AUTHED;
   }
 
   if (arg[0] != ' ')
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
   if (strlen(arg) > kMaxPasswordLen)
   {
     ZBA_CMD_LOG("Password too long - Max length is 64 characters.");
+    return ZBA_INVALID_ARG;
   }
-  else
+
+  cmd_stream->authed = (ZBA_OK == zba_auth_check(kAdminUser, arg));
+  if (cmd_stream->authed)
   {
-    cmd_stream->authed = (ZBA_OK == zba_auth_check(kAdminUser, arg));
-    if (cmd_stream->authed)
-    {
-      ZBA_CMD_LOG("Logged in.");
-    }
-    else
-    {
-      ZBA_CMD_LOG("Invalid login.");
-    }
+    ZBA_CMD_LOG("Logged in.");
+    return ZBA_OK;
   }
+  ZBA_CMD_LOG("Invalid login.");
+  return ZBA_CONFIG_NOT_AUTHED;
 }
 
-void zba_commands_logout(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_logout(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
-  if (!cmd_stream)
+  if ((!cmd_stream) || (cmd_stream->fd == ZBA_INVALID_FD))
   {
     ZBA_CMD_LOG("No command stream, should already be logged in.");
-    return;
+    return ZBA_ERROR;
   }
 
   cmd_stream->authed = false;
   ZBA_CMD_LOG("Logged out.");
+  return ZBA_OK;
 }
 
-void zba_commands_status(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_status(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   int i;
   (void)arg;
@@ -295,47 +584,147 @@ void zba_commands_status(const char *arg, zba_cmd_stream_t *cmd_stream)
   {
     ZBA_CMD_LOG("%s: 0x%X", zba_subsystems[i].name, *zba_subsystems[i].init_error);
   }
+
+  zba_boot_dump(zba_commands_print, cmd_stream);
+  zba_mjpeg_dump_clients(zba_commands_print, cmd_stream);
+  zba_rtsp_dump_sessions(zba_commands_print, cmd_stream);
+  return ZBA_OK;
+}
+
+/// Writes a heap's totals as a JSON object
+static void zba_commands_heap_json(zba_json_t *json, const char *key, uint32_t caps)
+{
+  multi_heap_info_t heapInfo = {0};
+  heap_caps_get_info(&heapInfo, caps);
+  zba_json_object(json, key);
+  zba_json_uint(json, "free", heapInfo.total_free_bytes);
+  zba_json_uint(json, "allocated", heapInfo.total_allocated_bytes);
+  zba_json_uint(json, "largest", heapInfo.largest_free_block);
+  zba_json_uint(json, "min_free", heapInfo.minimum_free_bytes);
+  zba_json_end_object(json);
+}
+
+/// Writes the sensor settings as a JSON object
+static void zba_commands_camera_json(zba_json_t *json)
+{
+  const camera_status_t *s = zba_camera_get_status();
+
+  zba_json_object(json, "camera");
+  zba_json_string(json, "resolution", zba_camera_get_res_name(zba_camera_get_res()));
+  zba_json_uint(json, "width", zba_camera_get_width());
+  zba_json_uint(json, "height", zba_camera_get_height());
+  zba_json_uint(json, "fb_capacity", zba_camera_get_fb_capacity());
+  if (s)
+  {
+    zba_json_int(json, "quality", s->quality);
+    zba_json_int(json, "brightness", s->brightness);
+    zba_json_int(json, "contrast", s->contrast);
+    zba_json_int(json, "saturation", s->saturation);
+    zba_json_int(json, "sharpness", s->sharpness);
+    zba_json_int(json, "special_effect", s->special_effect);
+    zba_json_int(json, "wb_mode", s->wb_mode);
+    zba_json_bool(json, "awb", s->awb);
+    zba_json_bool(json, "awb_gain", s->awb_gain);
+    zba_json_bool(json, "aec", s->aec);
+    zba_json_bool(json, "aec2", s->aec2);
+    zba_json_int(json, "ae_level", s->ae_level);
+    zba_json_int(json, "aec_value", s->aec_value);
+    zba_json_bool(json, "agc", s->agc);
+    zba_json_int(json, "agc_gain", s->agc_gain);
+    zba_json_int(json, "gainceiling", s->gainceiling);
+    zba_json_bool(json, "hmirror", s->hmirror);
+    zba_json_bool(json, "vflip", s->vflip);
+  }
+  zba_json_end_object(json);
 }
 
 void zba_commands_status_web(const char *arg, httpd_req_t *req)
 {
-#define MAX_STAT_SIZE 1024
+  zba_json_t json;
   int i;
-  char buffer[MAX_STAT_SIZE + 1] = {0};
-  (void)arg;
 
-  // {TODO} Add more, but this is the one I want right now.
-  // LED Strip state? Do we want to transfer that? Probably at least config....
-  // Also module status like the normal status does.
-  snprintf(buffer, MAX_STAT_SIZE, "{\"resolution\":\"%s\", \"gpio\":\"0x%04X\"",
-           zba_camera_get_res_name(zba_camera_get_res()),
-           ((uint16_t)zba_i2c_aw9523_get_out_high() << 8) + zba_i2c_aw9523_get_out_low());
+  // Go ahead and dump status to our logs when this is called.
+  zba_commands_status(arg, NULL);
 
-  // Subsystem status
-  snprintf(buffer + strlen(buffer), MAX_STAT_SIZE - strlen(buffer), ",\"util\": \"0x%X\"",
-           ZBA_MODULE_INITIALIZED(zba_util));
-  snprintf(buffer + strlen(buffer), MAX_STAT_SIZE - strlen(buffer), ",\"stream\": \"0x%X\"",
-           ZBA_MODULE_INITIALIZED(zba_stream));
+  // Streamed out as it's written, so there's no limit on size.
+  zba_json_begin(&json, req);
+  zba_json_object(&json, NULL);
+  zba_json_string(&json, "resolution", zba_camera_get_res_name(zba_camera_get_res()));
+  zba_json_hex(&json, "gpio",
+               ((uint16_t)zba_i2c_aw9523_get_out_high() << 8) + zba_i2c_aw9523_get_out_low());
+  zba_json_string(&json, "ip", zba_wifi_get_ip_addr());
+  zba_json_int(&json, "uptime_ms", esp_timer_get_time() / 1000);
+  zba_json_int(&json, "video_fps", zba_config_get_video_fps());
 
+  // Subsystem status
+  zba_json_hex(&json, "util", ZBA_MODULE_INITIALIZED(zba_util));
+  zba_json_hex(&json, "stream", ZBA_MODULE_INITIALIZED(zba_stream));
   for (i = 0; i < num_subsystems; ++i)
   {
-    snprintf(buffer + strlen(buffer), MAX_STAT_SIZE - strlen(buffer), ",\"%s\": \"0x%X\"",
-             zba_subsystems[i].name, *zba_subsystems[i].init_error);
+    zba_json_hex(&json, zba_subsystems[i].name, *zba_subsystems[i].init_error);
   }
-  strncat(buffer, "}", MAX_STAT_SIZE);
 
-  // Go ahead and dump status to our logs when this is called.
-  zba_commands_status(arg, NULL);
+  zba_boot_write_json(&json);
+  zba_commands_camera_json(&json);
+
+  zba_json_object(&json, "led");
+  zba_json_bool(&json, "light", zba_led_light_is_on());
+  zba_json_uint(&json, "strip_segments", zba_led_strip_get_num_segments());
+  zba_json_end_object(&json);
+
+  zba_json_object(&json, "memory");
+  zba_commands_heap_json(&json, "internal", MALLOC_CAP_INTERNAL);
+  zba_commands_heap_json(&json, "spiram", MALLOC_CAP_SPIRAM);
+  zba_commands_heap_json(&json, "dma", MALLOC_CAP_DMA);
+  zba_json_end_object(&json);
+
+  // Video clients
+  zba_mjpeg_client_stats_t stats;
+  zba_json_array(&json, "video_clients");
+  for (i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    if (!zba_mjpeg_get_client_stats(i, &stats)) continue;
+    zba_json_object(&json, NULL);
+    zba_json_int(&json, "fd", stats.fd);
+    zba_json_bool(&json, "websocket", stats.websocket);
+    zba_json_bool(&json, "preview", stats.preview);
+    zba_json_uint(&json, "fps", stats.fps);
+    zba_json_uint(&json, "sent", stats.frames_sent);
+    zba_json_uint(&json, "dropped", stats.frames_dropped);
+    zba_json_uint(&json, "bytes", stats.bytes_sent);
+    zba_json_uint(&json, "send_ms", stats.send_ms);
+    zba_json_int(&json, "queued", stats.queued);
+    zba_json_end_object(&json);
+  }
+  zba_json_end_array(&json);
+
+  zba_rtsp_session_stats_t session;
+  zba_json_array(&json, "rtsp_sessions");
+  for (i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    if (!zba_rtsp_get_session_stats(i, &session)) continue;
+    zba_json_object(&json, NULL);
+    zba_json_int(&json, "fd", session.fd);
+    zba_json_hex(&json, "session", session.session_id);
+    zba_json_bool(&json, "playing", session.playing);
+    zba_json_bool(&json, "tcp", session.interleaved);
+    zba_json_uint(&json, "sent", session.frames_sent);
+    zba_json_uint(&json, "dropped", session.frames_dropped);
+    zba_json_end_object(&json);
+  }
+  zba_json_end_array(&json);
 
-  httpd_resp_set_type(req, "text/html");
-  httpd_resp_set_hdr(req, "Content-Encoding", "utf-8");
-  httpd_resp_sendstr(req, buffer);
+  zba_json_object(&json, "metrics");
+  zba_metrics_write_json(&json);
+  zba_json_end_object(&json);
+
+  zba_json_end_object(&json);
+  zba_json_end(&json);
 }
 
-void zba_commands_memory(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_memory(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   (void)arg;
-  (void)cmd_stream;
   multi_heap_info_t heapInfo = {0};
   heap_caps_get_info(&heapInfo, MALLOC_CAP_SPIRAM);
   ZBA_CMD_LOG("SPIRAM: free: %u allocated: %u largest: %u", heapInfo.total_free_bytes,
@@ -346,93 +735,103 @@ void zba_commands_memory(const char *arg, zba_cmd_stream_t *cmd_stream)
   heap_caps_get_info(&heapInfo, MALLOC_CAP_DMA);
   ZBA_CMD_LOG("DMA: free: %u allocated: %u largest: %u", heapInfo.total_free_bytes,
               heapInfo.total_allocated_bytes, heapInfo.largest_free_block);
+  return ZBA_OK;
 }
 
-void zba_commands_reboot(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_reboot(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   (void)arg;
   ZBA_CMD_LOG("Rebooting.");
+  // Save settings still waiting to be committed, and get the message out first.
+  zba_config_write();
+  if (cmd_stream)
+  {
+    zba_commands_flush(cmd_stream);
+  }
   // This just resets processors, not peripherals...
   // hmm.... actually want peripherals reset as well.
   // Abort doesn't appear to do that either though.
   esp_restart();
 
   // esp_system_abort("What does this button do?");
+  return ZBA_OK;
 }
 
-void zba_commands_reset(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_reset(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   (void)arg;
   ZBA_CMD_LOG("Resetting.");
-  zba_config_reset();
+  return zba_config_reset();
 }
 
-void zba_commands_set_device_pwd(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_set_device_pwd(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
   if (strlen(arg) > kMaxPasswordLen)
   {
     ZBA_CMD_LOG("Password too long - Max length is 64 characters.");
+    return ZBA_INVALID_ARG;
   }
-  else
-  {
-    ZBA_LOG("Setting password");
-    zba_config_set_device_pwd(arg);
-    ZBA_LOG("Writing config.");
-    zba_config_write();
-    ZBA_CMD_LOG("New Device Password saved.");
-  }
+
+  ZBA_LOG("Setting password");
+  zba_err_t result = zba_config_set_device_pwd(arg);
+  if (ZBA_OK != result) return result;
+  zba_auth_password_changed();
+  ZBA_LOG("Writing config.");
+  if (ZBA_OK != (result = zba_config_write())) return result;
+  ZBA_CMD_LOG("New Device Password saved.");
+  return ZBA_OK;
 }
 
-void zba_commands_set_ssid(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_set_ssid(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
   if (strlen(arg) > kMaxSSIDLen)
   {
     ZBA_CMD_LOG("SSID too long - Max length is 32 characters.");
+    return ZBA_INVALID_ARG;
   }
-  else
-  {
-    zba_config_set_ssid(arg);
-    zba_config_write();
-    ZBA_CMD_LOG("New SSID saved.");
-  }
+
+  zba_err_t result = zba_config_set_ssid(arg);
+  if ((ZBA_OK != result) || (ZBA_OK != (result = zba_config_write()))) return result;
+  ZBA_CMD_LOG("New SSID saved.");
+  return ZBA_OK;
 }
 
-void zba_commands_set_wifi_pwd(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_set_wifi_pwd(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
   if (strlen(arg) > kMaxPasswordLen)
   {
     ZBA_CMD_LOG("Password too long - Max length is 64 characters.");
+    return ZBA_INVALID_ARG;
   }
-  else
-  {
-    zba_config_set_wifi_pwd(arg);
-    zba_config_write();
-    ZBA_CMD_LOG("New WiFi Password saved.");
-  }
+
+  zba_err_t result = zba_config_set_wifi_pwd(arg);
+  if ((ZBA_OK != result) || (ZBA_OK != (result = zba_config_write()))) return result;
+  ZBA_CMD_LOG("New WiFi Password saved.");
+  return ZBA_OK;
 }
 
-void zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   zba_err_t result;
   int i;
@@ -440,7 +839,7 @@ void zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream)
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
@@ -450,18 +849,18 @@ void zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream)
     {
       if (ZBA_OK != (result = zba_subsystems[i].initFunc()))
       {
-        ZBA_ERR("Failed to initialize %s", arg);
-        return;
+        ZBA_CMD_LOG("Failed to initialize %s", arg);
+        return result;
       }
-      ZBA_LOG("Initialized %s", arg);
-
-      return;
+      ZBA_CMD_LOG("Initialized %s", arg);
+      return ZBA_OK;
     }
   }
-  ZBA_ERR("Invalid subsystem %s", arg);
+  ZBA_CMD_LOG("Invalid subsystem %s", arg);
+  return ZBA_INVALID_ARG;
 }
 
-void zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   zba_err_t result;
   int i;
@@ -469,7 +868,7 @@ void zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream)
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
@@ -479,14 +878,15 @@ void zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream)
     {
       if (ZBA_OK != (result = zba_subsystems[i].deinitFunc()))
       {
-        ZBA_ERR("Failed to deinitialize %s", arg);
-        return;
+        ZBA_CMD_LOG("Failed to deinitialize %s", arg);
+        return result;
       }
-      ZBA_LOG("Deinitialized %s", arg);
-      return;
+      ZBA_CMD_LOG("Deinitialized %s", arg);
+      return ZBA_OK;
     }
   }
-  ZBA_ERR("Invalid subsystem %s", arg);
+  ZBA_CMD_LOG("Invalid subsystem %s", arg);
+  return ZBA_INVALID_ARG;
 }
 
 bool arg_means_on(const char *arg)
@@ -515,29 +915,31 @@ bool arg_means_on(const char *arg)
   return on;
 }
 
-void zba_commands_light(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_light(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
-  zba_led_light(arg_means_on(arg));
+  return zba_led_light(arg_means_on(arg));
 }
 
-void zba_commands_autoexpose(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_autoexpose(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
-  zba_camera_set_autoexposure(arg_means_on(arg));
+  bool on = arg_means_on(arg);
+  zba_config_set_u32(ZBA_CFG_AUTOEXPOSE, on);
+  return zba_camera_set_autoexposure(on);
 }
 
-void zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   uint8_t colors[4] = {0};
   bool gotValue     = false;
@@ -547,7 +949,7 @@ void zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream)
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
@@ -567,7 +969,7 @@ void zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream)
     else
     {
       ZBA_CMD_LOG("invalid led color. Should be in format #rrggbb or #rrggbbww");
-      return;
+      return ZBA_INVALID_ARG;
     }
   }
 
@@ -588,25 +990,57 @@ void zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream)
     colors[0] = colors[1] = colors[2] = 0;
   }
 
-  zba_led_strip_set_led(0, -1, colors[0], colors[1], colors[2], colors[3]);
-  zba_led_strip_flip();
+  zba_err_t result = zba_led_strip_set_led(0, -1, colors[0], colors[1], colors[2], colors[3]);
+  if (ZBA_OK != result) return result;
+  zba_config_set_u32(ZBA_CFG_LED_COLOR, ((uint32_t)colors[0] << 24) | ((uint32_t)colors[1] << 16) |
+                                            ((uint32_t)colors[2] << 8) | colors[3]);
+  return zba_led_strip_flip();
+}
+
+zba_err_t zba_commands_dir(const char *arg, zba_cmd_stream_t *cmd_stream)
+{
+  (void)arg;
+  return zba_sd_list_files(zba_commands_print, cmd_stream);
+}
+
+zba_err_t zba_commands_camera_status(const char *arg, zba_cmd_stream_t *cmd_stream)
+{
+  (void)arg;
+  return zba_camera_dump_status(zba_commands_print, cmd_stream);
 }
 
-void zba_commands_dir(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_trace(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   (void)arg;
-  (void)cmd_stream;
-  zba_sd_list_files();
+  zba_trace_dump(zba_commands_print, cmd_stream);
+  return ZBA_OK;
 }
 
-void zba_commands_camera_status(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_metrics(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   (void)arg;
-  (void)cmd_stream;
-  zba_camera_dump_status();
+  zba_metrics_dump(zba_commands_print, cmd_stream);
+  return ZBA_OK;
+}
+
+zba_err_t zba_commands_fps(const char *arg, zba_cmd_stream_t *cmd_stream)
+{
+  int fps = 0;
+
+  if ((*arg == ' ') || (*arg == '='))
+  {
+    if ((1 != sscanf(arg + 1, "%d", &fps)) || (ZBA_OK != zba_config_set_video_fps(fps)))
+    {
+      ZBA_CMD_LOG("Frame rate must be 0 to %d.", kMaxVideoFps);
+      return ZBA_INVALID_ARG;
+    }
+  }
+  // New streams pick this up - ones already running keep their rate.
+  ZBA_CMD_LOG("Default video fps: %d", zba_config_get_video_fps());
+  return ZBA_OK;
 }
 
-void zba_commands_gpio(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_gpio(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   int pin     = 0;
   bool pin_on = false;
@@ -624,29 +1058,56 @@ void zba_commands_gpio(const char *arg, zba_cmd_stream_t *cmd_stream)
   else
   {
     ZBA_CMD_LOG("GPIO command needs pin as part of the command. e.g. gpio12=on");
-    return;
+    return ZBA_INVALID_ARG;
   }
 
   if ((*arg != ' ') && (*arg != '='))
   {
     ZBA_CMD_LOG("Command requires an argument.");
-    return;
+    return ZBA_INVALID_ARG;
   }
   arg++;
 
   pin_on = arg_means_on(arg);
 
-  zba_i2c_aw9523_set_pin(pin, pin_on);
+  return zba_i2c_aw9523_set_pin(pin, pin_on);
 }
 
-void zba_commands_camera_res(const char *arg, zba_cmd_stream_t *cmd_stream)
+zba_err_t zba_commands_camera_res(const char *arg, zba_cmd_stream_t *cmd_stream)
 {
   zba_resolution_t res = ZBA_VGA;
+  if ((*arg != ' ') && (*arg != '='))
+  {
+    ZBA_CMD_LOG("Command requires an argument.");
+    return ZBA_INVALID_ARG;
+  }
   arg++;
   const zba_res_info_t *resInfo = zba_camera_get_res_from_name(arg);
-  if (resInfo)
+  if (!resInfo)
   {
-    res = resInfo->res;
-    zba_camera_set_res(res);
+    ZBA_CMD_LOG("Unknown resolution %s", arg);
+    return ZBA_INVALID_ARG;
+  }
+  res = resInfo->res;
+  zba_config_set_u32(ZBA_CFG_CAMERA_RES, res);
+  return zba_camera_set_res(res);
+}
+
+zba_err_t zba_commands_quality(const char *arg, zba_cmd_stream_t *cmd_stream)
+{
+  int quality = 0;
+
+  if ((*arg == ' ') || (*arg == '='))
+  {
+    if ((1 != sscanf(arg + 1, "%d", &quality)) ||
+        (ZBA_OK != zba_config_set_u32(ZBA_CFG_CAMERA_QUALITY, quality)))
+    {
+      ZBA_CMD_LOG("Quality must be 1 to 63, or 0 for the default.");
+      return ZBA_INVALID_ARG;
+    }
+    zba_err_t result = zba_camera_set_quality(quality);
+    if (ZBA_OK != result) return result;
   }
+  ZBA_CMD_LOG("JPEG quality: %u", zba_config_get_u32(ZBA_CFG_CAMERA_QUALITY));
+  return ZBA_OK;
 }
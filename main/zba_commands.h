@@ -3,12 +3,38 @@
 
 #include <esp_http_server.h>
 #include "zba_config.h"
+#include "zba_json.h"
 #include "zba_util.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+
+/// Command output staged before it's written out (or all that's kept, for text)
+#define ZBA_CMD_OUT_SIZE 256
+
+  /// Where a command's output goes
+  typedef enum
+  {
+    ZBA_CMD_OUT_LOG,   ///< ESP log - nobody's waiting on it
+    ZBA_CMD_OUT_FD,    ///< Written to fd, e.g. the UART
+    ZBA_CMD_OUT_JSON,  ///< Strings in an array of a streaming JSON response
+    ZBA_CMD_OUT_TEXT,  ///< Kept in the buffer for the caller, e.g. a WebSocket reply
+  } zba_cmd_out_type_t;
+
+  /// Buffered writer for command output. Commands write lines to it with ZBA_CMD_LOG,
+  /// and it gets them back to whoever ran the command.
+  typedef struct
+  {
+    zba_cmd_out_type_t type;
+    zba_json_t *json;               ///< JSON: writer with the array open
+    char buffer[ZBA_CMD_OUT_SIZE];  ///< FD: staged output. TEXT: the output, cut short if full
+    size_t len;                     ///< Bytes in buffer (or text)
+    char *text;                     ///< TEXT: caller's buffer to use instead of buffer, if set
+    size_t text_size;               ///< Size of text
+  } zba_cmd_out_t;
+
   /// Serial stream that can issue commands
   typedef struct zba_cmd_stream
   {
@@ -16,15 +42,35 @@ extern "C"
     char buffer[kSerialBufferLength + 1];
     size_t bufPos;
     bool authed;
+    zba_cmd_out_t out;
   } zba_cmd_stream_t;
 
-  void zba_commands_status(const char *arg, zba_cmd_stream_t *cmd_stream);
+  /// Command stream for a web request - already authed, with nothing to read and output
+  /// going to the JSON writer's open array, or to the text buffer if json is NULL.
+  void zba_commands_stream_init_web(zba_cmd_stream_t *cmd_stream, zba_json_t *json);
+
+  /// Command stream for a web request with the output kept as text in the caller's
+  /// buffer, for more than fits in the stream's own. It's always terminated.
+  void zba_commands_stream_init_text(zba_cmd_stream_t *cmd_stream, char *text, size_t size);
+
+  /// printf a line to a command stream's output - to the log if cmd_stream is NULL.
+  /// A zba_print_fn, for module dump functions.
+  void zba_commands_print(void *cmd_stream, const char *fmt, ...);
+
+  /// Writes out anything staged
+  void zba_commands_flush(zba_cmd_stream_t *cmd_stream);
+
+  zba_err_t zba_commands_status(const char *arg, zba_cmd_stream_t *cmd_stream);
 
   /// Handle commands from the web
   void zba_commands_process_web(const char *buffer, httpd_req_t *req);
   void zba_commands_status_web(const char *arg, httpd_req_t *req);
 
-  void zba_commands_memory(const char *arg, zba_cmd_stream_t *cmd_stream);
+  /// Runs each line of a POST body as a command, in order, and responds with
+  /// {"results": [{"command", "status", "error"}...], "complete", "failed"}.
+  void zba_commands_process_batch_web(httpd_req_t *req);
+
+  zba_err_t zba_commands_memory(const char *arg, zba_cmd_stream_t *cmd_stream);
 
   /// Initialize a command stream
   void zba_commands_stream_init(zba_cmd_stream_t *cmd_stream, int fd);
@@ -33,45 +79,53 @@ extern "C"
   void zba_commands_stream_process(zba_cmd_stream_t *cmd_stream);
 
   /// Login to get access to other commands
-  void zba_commands_login(const char *buffer, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_login(const char *buffer, zba_cmd_stream_t *cmd_stream);
 
   /// Login to get access to other commands
-  void zba_commands_logout(const char *buffer, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_logout(const char *buffer, zba_cmd_stream_t *cmd_stream);
 
   /// Processes a command buffer and executes commands if found,
   /// or dumps list if unknown.
-  void zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream);
 
   /// Sets the SSID
-  void zba_commands_set_ssid(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_set_ssid(const char *arg, zba_cmd_stream_t *cmd_stream);
 
   /// Sets the Password
-  void zba_commands_set_wifi_pwd(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_set_wifi_pwd(const char *arg, zba_cmd_stream_t *cmd_stream);
 
   /// Sets the Device Password
-  void zba_commands_set_device_pwd(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_set_device_pwd(const char *arg, zba_cmd_stream_t *cmd_stream);
 
   /// Reboots the device
-  void zba_commands_reboot(const char *, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_reboot(const char *, zba_cmd_stream_t *cmd_stream);
 
   /// Resets to factory settings
-  void zba_commands_reset(const char *, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_reset(const char *, zba_cmd_stream_t *cmd_stream);
+
+  zba_err_t zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream);
+
+  zba_err_t zba_commands_light(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream);
+
+  zba_err_t zba_commands_gpio(const char *arg, zba_cmd_stream_t *cmd_stream);
+
+  zba_err_t zba_commands_dir(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_start(const char *arg, zba_cmd_stream_t *cmd_stream);
-  void zba_commands_stop(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_camera_status(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_light(const char *arg, zba_cmd_stream_t *cmd_stream);
-  void zba_commands_ledcolor(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_camera_res(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_gpio(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_autoexpose(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_dir(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_trace(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_camera_status(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_metrics(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_camera_res(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_fps(const char *arg, zba_cmd_stream_t *cmd_stream);
 
-  void zba_commands_autoexpose(const char *arg, zba_cmd_stream_t *cmd_stream);
+  zba_err_t zba_commands_quality(const char *arg, zba_cmd_stream_t *cmd_stream);
 #ifdef __cplusplus
 }
 #endif
@@ -2,52 +2,266 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
 
+#include <esp_timer.h>
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "zba_camera.h"
+#include "zba_priority.h"
 #include "zba_util.h"
 
 DEFINE_ZBA_MODULE(zba_config);
 
-/// System config struct def
-/// This is stored in nv ram
-/// Do not change existing entries (!)
-/// Only add to end.
+/// Setting values, by type. Strings have 2 extra bytes to ensure termination.
 typedef struct zba_config
 {
-  int wifi_timeout_sec;
   char ssid[kMaxSSIDLen + 2];            // 32+2
   char wifi_pwd[kMaxPasswordLen + 2];    // 64+2
   char device_pwd[kMaxPasswordLen + 2];  // 64+2
+  uint32_t wifi_timeout_sec;
+  uint32_t video_fps;
+  uint32_t camera_res;
+  uint32_t camera_quality;
+  uint32_t autoexpose;
+  uint32_t led_color;
 } zba_config_t;
 
+typedef enum
+{
+  ZBA_CONFIG_TYPE_BOOL,  ///< Stored as a u8
+  ZBA_CONFIG_TYPE_U32,
+  ZBA_CONFIG_TYPE_STR
+} zba_config_type_t;
+
+/// A setting in the schema
+typedef struct
+{
+  const char *name;        ///< NVS key - 15 characters at most
+  zba_config_type_t type;  ///< How it's stored
+  size_t offset;           ///< Where its value is in zba_config_t
+  uint32_t min;            ///< Smallest number - unused for strings
+  uint32_t max;            ///< Largest number, or longest string
+  uint32_t def;            ///< Default number. Strings default to empty.
+} zba_config_entry_t;
+
+#define ZBA_CONFIG_FIELD(field) offsetof(zba_config_t, field)
+
+/// Settings schema, by zba_config_key_t.
+/// NVS keys are typed, so changing a setting's type or name needs a migration
+/// (see zba_config_migrate) and a new kConfigVersion.
+// clang-format off
+static const zba_config_entry_t kConfigSchema[ZBA_CFG_NUM_KEYS] = {
+  //                          NVS key         Type                  Value                               Min  Max                      Default
+  [ZBA_CFG_SSID]           = {"ssid",         ZBA_CONFIG_TYPE_STR,  ZBA_CONFIG_FIELD(ssid),             0,   kMaxSSIDLen,             0},
+  [ZBA_CFG_WIFI_PWD]       = {"wifi_pwd",     ZBA_CONFIG_TYPE_STR,  ZBA_CONFIG_FIELD(wifi_pwd),         0,   kMaxPasswordLen,         0},
+  [ZBA_CFG_DEVICE_PWD]     = {"device_pwd",   ZBA_CONFIG_TYPE_STR,  ZBA_CONFIG_FIELD(device_pwd),       0,   kMaxPasswordLen,         0},
+  [ZBA_CFG_WIFI_TIMEOUT]   = {"wifi_timeout", ZBA_CONFIG_TYPE_U32,  ZBA_CONFIG_FIELD(wifi_timeout_sec), 1,   600,                     kWifiTimeoutSeconds},
+  [ZBA_CFG_VIDEO_FPS]      = {"video_fps",    ZBA_CONFIG_TYPE_U32,  ZBA_CONFIG_FIELD(video_fps),        0,   kMaxVideoFps,            kDefaultVideoFps},
+  [ZBA_CFG_CAMERA_RES]     = {"cam_res",      ZBA_CONFIG_TYPE_U32,  ZBA_CONFIG_FIELD(camera_res),       0,   ZBA_NUM_RESOLUTIONS - 1, ZBA_SVGA},
+  [ZBA_CFG_CAMERA_QUALITY] = {"cam_quality",  ZBA_CONFIG_TYPE_U32,  ZBA_CONFIG_FIELD(camera_quality),   0,   63,                      0},
+  [ZBA_CFG_AUTOEXPOSE]     = {"autoexpose",   ZBA_CONFIG_TYPE_BOOL, ZBA_CONFIG_FIELD(autoexpose),       0,   1,                       1},
+  [ZBA_CFG_LED_COLOR]      = {"led_color",    ZBA_CONFIG_TYPE_U32,  ZBA_CONFIG_FIELD(led_color),        0,   UINT32_MAX,              0},
+};
+// clang-format on
+
+/// Layout of what's in NVS.
+/// 1: Before the schema - strings, and video_fps as a u8. Had no version key.
+/// 2: Schema - numbers are u32.
+static const uint16_t kConfigVersion = 2;
+
+/// Changes are committed this long after the last one...
+static const int64_t kCommitDelayMs = 2000;
+/// ...but no later than this after the first, so a stream of changes still gets saved.
+static const int64_t kCommitMaxDelayMs = 10000;
+/// NVS writes block for the flash erase, so they happen on a task of their own
+/// rather than holding up the esp_timer task.
+static const char *kCommitTaskName    = "ConfigCommit";
+static const uint32_t kCommitStackSize = 3072;
+
 /// Config state
 typedef struct
 {
   nvs_handle_t nvsHandle;
   SemaphoreHandle_t configMutex;
   zba_config_t config;
+  uint32_t dirty;                   ///< Bit per key changed since the last commit
+  int64_t dirty_ms;                 ///< When the oldest uncommitted change was made
+  esp_timer_handle_t commit_timer;  ///< Wakes commit_task once changes settle
+  TaskHandle_t commit_task;         ///< Writes the changes to NVS
+  volatile bool exiting;            ///< Tells commit_task to stop
 } zba_config_state_t;
 
-// clang-format off
-#define DEFAULT_SSID {0}
-#define DEFAULT_PWD {0}
-// clang-format on
+static zba_config_state_t config_state = {.nvsHandle    = 0,
+                                          .configMutex  = NULL,
+                                          .config       = {{0}},
+                                          .dirty        = 0,
+                                          .dirty_ms     = 0,
+                                          .commit_timer = NULL,
+                                          .commit_task  = NULL,
+                                          .exiting      = false};
+
+static const char *kConfigName    = "zba";
+static const char *kConfigVersKey = "version";
 
-static zba_config_state_t config_state = {
-    .nvsHandle   = 0,
-    .configMutex = NULL,
-    .config      = {kWifiTimeoutSeconds, DEFAULT_SSID, DEFAULT_PWD, DEFAULT_PWD}};
+static void zba_config_commit_cb(void *arg);
+static void zba_config_commit_task(void *arg);
 
-static const char *kConfigName = "zba";
+static void *zba_config_value(zba_config_key_t key)
+{
+  return (uint8_t *)&config_state.config + kConfigSchema[key].offset;
+}
+
+static bool zba_config_ready()
+{
+  return (config_state.configMutex && config_state.nvsHandle);
+}
+
+static void zba_config_set_defaults()
+{
+  int key;
+
+  memset(&config_state.config, 0, sizeof(config_state.config));
+  for (key = 0; key < ZBA_CFG_NUM_KEYS; ++key)
+  {
+    if (kConfigSchema[key].type != ZBA_CONFIG_TYPE_STR)
+    {
+      *(uint32_t *)zba_config_value(key) = kConfigSchema[key].def;
+    }
+  }
+}
+
+/// Reads a setting from NVS. Missing or out of range settings keep their default.
+static void zba_config_load(zba_config_key_t key)
+{
+  const zba_config_entry_t *entry = &kConfigSchema[key];
+  esp_err_t esp_result            = ESP_OK;
+  uint32_t value                  = 0;
+  uint8_t flag                    = 0;
+  size_t len                      = entry->max + 1;
+
+  switch (entry->type)
+  {
+    case ZBA_CONFIG_TYPE_STR:
+      nvs_get_str(config_state.nvsHandle, entry->name, zba_config_value(key), &len);
+      ((char *)zba_config_value(key))[entry->max] = 0;
+      return;
+    case ZBA_CONFIG_TYPE_BOOL:
+      esp_result = nvs_get_u8(config_state.nvsHandle, entry->name, &flag);
+      value      = flag;
+      break;
+    case ZBA_CONFIG_TYPE_U32:
+      esp_result = nvs_get_u32(config_state.nvsHandle, entry->name, &value);
+      break;
+  }
+
+  if (ESP_OK != esp_result) return;
+  if ((value < entry->min) || (value > entry->max))
+  {
+    ZBA_ERR("Config %s out of range (%u), using default.", entry->name, value);
+    return;
+  }
+  *(uint32_t *)zba_config_value(key) = value;
+}
+
+/// Writes a setting to NVS (uncommitted)
+static esp_err_t zba_config_store(zba_config_key_t key)
+{
+  const zba_config_entry_t *entry = &kConfigSchema[key];
+  void *value                     = zba_config_value(key);
+
+  switch (entry->type)
+  {
+    case ZBA_CONFIG_TYPE_STR:
+      return nvs_set_str(config_state.nvsHandle, entry->name, value);
+    case ZBA_CONFIG_TYPE_BOOL:
+      return nvs_set_u8(config_state.nvsHandle, entry->name, *(uint32_t *)value ? 1 : 0);
+    case ZBA_CONFIG_TYPE_U32:
+      return nvs_set_u32(config_state.nvsHandle, entry->name, *(uint32_t *)value);
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+/// Writes the changed settings and commits. Caller holds the lock.
+static zba_err_t zba_config_flush()
+{
+  zba_err_t result = ZBA_OK;
+  uint32_t written = 0;
+  int key;
+
+  if (!config_state.dirty) return ZBA_OK;
+
+  for (key = 0; key < ZBA_CFG_NUM_KEYS; ++key)
+  {
+    if (!(config_state.dirty & (1u << key))) continue;
+    if (ESP_OK != zba_config_store(key))
+    {
+      ZBA_ERR("Error writing config %s", kConfigSchema[key].name);
+      result = ZBA_CONFIG_WRITE_FAILED;
+      continue;
+    }
+    written |= 1u << key;
+  }
+
+  // Anything that didn't make it stays dirty for the next try.
+  if (ESP_OK != nvs_commit(config_state.nvsHandle))
+  {
+    ZBA_ERR("Error committing config");
+    return ZBA_CONFIG_WRITE_FAILED;
+  }
+  config_state.dirty &= ~written;
+  ZBA_LOG("Config committed (0x%X)", written);
+  return result;
+}
+
+/// Marks a setting changed and (re)schedules the commit. Caller holds the lock.
+static void zba_config_changed(zba_config_key_t key)
+{
+  int64_t now = zba_now_ms();
+
+  if (!config_state.dirty)
+  {
+    config_state.dirty_ms = now;
+  }
+  config_state.dirty |= 1u << key;
+
+  if (!config_state.commit_timer) return;
+
+  // Each change pushes the commit back, up to kCommitMaxDelayMs after the first one.
+  int64_t delay = config_state.dirty_ms + kCommitMaxDelayMs - now;
+  delay         = (delay < kCommitDelayMs) ? delay : kCommitDelayMs;
+  delay         = (delay > 0) ? delay : 0;
+  esp_timer_stop(config_state.commit_timer);
+  esp_timer_start_once(config_state.commit_timer, delay * 1000);
+}
+
+/// Brings settings stored by older firmware up to kConfigVersion. Caller holds the lock.
+static void zba_config_migrate(uint16_t version)
+{
+  ZBA_LOG("Migrating config from version %u to %u", version, kConfigVersion);
+
+  if (version < 2)
+  {
+    // video_fps was a u8. NVS keys are typed, so replace it with the u32.
+    uint8_t fps = 0;
+    if (ESP_OK == nvs_get_u8(config_state.nvsHandle, "video_fps", &fps))
+    {
+      nvs_erase_key(config_state.nvsHandle, "video_fps");
+      config_state.config.video_fps = ZBA_MIN(fps, kMaxVideoFps);
+      config_state.dirty |= 1u << ZBA_CFG_VIDEO_FPS;
+    }
+  }
+}
 
 zba_err_t zba_config_init()
 {
   esp_err_t esp_result = ESP_OK;
   zba_err_t result     = ZBA_OK;
-  size_t len           = 0;
+  uint16_t version     = 0;
+  int key;
 
   if (config_state.configMutex == NULL)
   {
@@ -79,23 +293,52 @@ zba_err_t zba_config_init()
       break;
     }
 
-    len = kMaxSSIDLen + 1;
-    nvs_get_str(config_state.nvsHandle, "ssid", config_state.config.ssid, &len);
-
-    len = kMaxPasswordLen + 1;
-    nvs_get_str(config_state.nvsHandle, "wifi_pwd", config_state.config.wifi_pwd, &len);
+    zba_config_set_defaults();
+    for (key = 0; key < ZBA_CFG_NUM_KEYS; ++key)
+    {
+      zba_config_load(key);
+    }
 
-    len = kMaxPasswordLen + 1;
-    nvs_get_str(config_state.nvsHandle, "device_pwd", config_state.config.device_pwd, &len);
+    // Before versioning there was no version key.
+    if (ESP_OK != nvs_get_u16(config_state.nvsHandle, kConfigVersKey, &version))
+    {
+      version = 1;
+    }
+    if (version > kConfigVersion)
+    {
+      // Settings that don't fit this schema were left at their defaults.
+      ZBA_ERR("Config is from newer firmware (version %u)", version);
+    }
+    else if (version < kConfigVersion)
+    {
+      zba_config_migrate(version);
+      zba_config_flush();
+      nvs_set_u16(config_state.nvsHandle, kConfigVersKey, kConfigVersion);
+      nvs_commit(config_state.nvsHandle);
+    }
 
-    // Fields were zerod initially, but ensure termination at maxlength (we've got 2 extra bytes).
-    config_state.config.ssid[kMaxSSIDLen]           = 0;
-    config_state.config.wifi_pwd[kMaxPasswordLen]   = 0;
-    config_state.config.device_pwd[kMaxPasswordLen] = 0;
+    const esp_timer_create_args_t timer_args = {.callback = zba_config_commit_cb,
+                                                .arg      = NULL,
+                                                .name     = "zba_config"};
+    if (ESP_OK != (esp_result = esp_timer_create(&timer_args, &config_state.commit_timer)))
+    {
+      // Changes then need an explicit zba_config_write().
+      ZBA_ERR("Could not create config commit timer! ESP_ERROR: 0x%X", esp_result);
+      config_state.commit_timer = NULL;
+      break;
+    }
+    config_state.exiting = false;
+    if (pdPASS != xTaskCreate(zba_config_commit_task, kCommitTaskName, kCommitStackSize, NULL,
+                              ZBA_CONFIG_PRIORITY, &config_state.commit_task))
+    {
+      ZBA_ERR("Could not start config commit task");
+      config_state.commit_task = NULL;
+      esp_timer_delete(config_state.commit_timer);
+      config_state.commit_timer = NULL;
+    }
     break;
   }
 
-  // {TODO} Sanity check values?
   ZBA_UNLOCK(config_state.configMutex);
 
   if (result != ZBA_OK)
@@ -115,11 +358,35 @@ zba_err_t zba_config_deinit()
 {
   zba_err_t deinit_error = ZBA_OK;
 
+  // Stop the commit task first - it takes the lock to write.
+  if (config_state.commit_timer)
+  {
+    esp_timer_stop(config_state.commit_timer);
+  }
+  if (config_state.commit_task)
+  {
+    config_state.exiting = true;
+    xTaskNotifyGive(config_state.commit_task);
+    while (eTaskGetState(config_state.commit_task) != eDeleted)
+    {
+      vTaskDelay(50 / portTICK_PERIOD_MS);
+    }
+    config_state.commit_task = NULL;
+  }
+
   if (config_state.configMutex)
   {
     ZBA_LOCK(config_state.configMutex);
+    if (config_state.commit_timer)
+    {
+      esp_timer_stop(config_state.commit_timer);
+      esp_timer_delete(config_state.commit_timer);
+      config_state.commit_timer = NULL;
+    }
     if (config_state.nvsHandle)
     {
+      // Don't lose changes still waiting on the timer.
+      deinit_error = zba_config_flush();
       nvs_close(config_state.nvsHandle);
       config_state.nvsHandle = 0;
 
@@ -138,7 +405,7 @@ zba_err_t zba_config_reset()
 {
   zba_err_t result = ZBA_OK;
 
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  if (!zba_config_ready())
   {
     ZBA_ERR("Config not initialized.");
     return ZBA_CONFIG_NOT_INITIALIZED;
@@ -146,6 +413,12 @@ zba_err_t zba_config_reset()
 
   ZBA_LOCK(config_state.configMutex);
   {
+    if (config_state.commit_timer)
+    {
+      esp_timer_stop(config_state.commit_timer);
+    }
+    config_state.dirty = 0;
+
     if (ESP_OK != nvs_erase_all(config_state.nvsHandle))
     {
       result = ZBA_CONFIG_ERASE_FAILED;
@@ -153,6 +426,8 @@ zba_err_t zba_config_reset()
     }
     else
     {
+      // Keep the version, or the next boot would take the empty store for an old one.
+      nvs_set_u16(config_state.nvsHandle, kConfigVersKey, kConfigVersion);
       if (ESP_OK != nvs_commit(config_state.nvsHandle))
       {
         result = ZBA_CONFIG_ERASE_COMMIT_FAILED;
@@ -160,7 +435,7 @@ zba_err_t zba_config_reset()
       }
     }
 
-    memset(&config_state.config, 0, sizeof(config_state.config));
+    zba_config_set_defaults();
   }
   ZBA_UNLOCK(config_state.configMutex);
 
@@ -171,7 +446,7 @@ zba_err_t zba_config_write()
 {
   zba_err_t result = ZBA_OK;
 
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  if (!zba_config_ready())
   {
     ZBA_ERR("Config not initialized.");
     return ZBA_CONFIG_NOT_INITIALIZED;
@@ -179,101 +454,98 @@ zba_err_t zba_config_write()
 
   ZBA_LOCK(config_state.configMutex);
   {
-    if (ESP_OK != nvs_set_str(config_state.nvsHandle, "ssid", config_state.config.ssid))
+    if (config_state.commit_timer)
     {
-      ZBA_ERR("Error writing wifi SSID");
-      result = ZBA_CONFIG_WRITE_FAILED;
+      esp_timer_stop(config_state.commit_timer);
     }
-    if (ESP_OK != nvs_set_str(config_state.nvsHandle, "wifi_pwd", config_state.config.wifi_pwd))
-    {
-      ZBA_ERR("Error writing wifi pwd");
-      result = ZBA_CONFIG_WRITE_FAILED;
-    }
-    if (ESP_OK != nvs_set_str(config_state.nvsHandle, "device_pwd", config_state.config.device_pwd))
-    {
-      ZBA_ERR("Error writing device pwd");
-      result = ZBA_CONFIG_WRITE_FAILED;
-    }
-
-    nvs_commit(config_state.nvsHandle);
+    result = zba_config_flush();
   }
   ZBA_UNLOCK(config_state.configMutex);
   return result;
 }
 
-int zba_config_get_wifi_timeout_sec()
+/// Runs on the esp_timer task once changes have settled - just wakes the commit task.
+static void zba_config_commit_cb(void *arg)
 {
-  int timeout = 0;
-
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  (void)arg;
+  if (config_state.commit_task)
   {
-    ZBA_ERR("Config not initialized.");
-    return ZBA_CONFIG_NOT_INITIALIZED;
+    xTaskNotifyGive(config_state.commit_task);
   }
+}
 
-  ZBA_LOCK(config_state.configMutex);
+/// Writes changes when the commit timer goes off
+static void zba_config_commit_task(void *arg)
+{
+  (void)arg;
+  while (!config_state.exiting)
   {
-    timeout = config_state.config.wifi_timeout_sec;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (config_state.exiting) break;
+    zba_config_write();
   }
-  ZBA_UNLOCK(config_state.configMutex);
-  return timeout;
+  vTaskDelete(NULL);
 }
 
-zba_err_t zba_config_set_wifi_timeout_sec(int seconds)
+uint32_t zba_config_get_u32(zba_config_key_t key)
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
-  {
-    ZBA_ERR("Config not initialized.");
-    return ZBA_CONFIG_NOT_INITIALIZED;
-  }
+  uint32_t value = 0;
 
-  ZBA_LOCK(config_state.configMutex);
+  if ((key >= ZBA_CFG_NUM_KEYS) || (kConfigSchema[key].type == ZBA_CONFIG_TYPE_STR))
   {
-    config_state.config.wifi_timeout_sec = seconds;
+    return 0;
   }
-  ZBA_UNLOCK(config_state.configMutex);
-  return ZBA_OK;
-}
 
-zba_err_t zba_config_get_ssid(void *buffer, size_t maxLen)
-{
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  // Most settings have a sensible default, so use it rather than erroring.
+  if (!zba_config_ready())
   {
-    ZBA_ERR("Config not initialized.");
-    return ZBA_CONFIG_NOT_INITIALIZED;
+    return kConfigSchema[key].def;
   }
 
   ZBA_LOCK(config_state.configMutex);
   {
-    strncpy(buffer, config_state.config.ssid, ZBA_MIN(maxLen, kMaxSSIDLen));
+    value = *(uint32_t *)zba_config_value(key);
   }
   ZBA_UNLOCK(config_state.configMutex);
-  return ZBA_OK;
+  return value;
 }
 
-zba_err_t zba_config_set_ssid(const char *ssid)
+zba_err_t zba_config_set_u32(zba_config_key_t key, uint32_t value)
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  if ((key >= ZBA_CFG_NUM_KEYS) || (kConfigSchema[key].type == ZBA_CONFIG_TYPE_STR))
+  {
+    return ZBA_INVALID_ARG;
+  }
+  if (!zba_config_ready())
   {
     ZBA_ERR("Config not initialized.");
     return ZBA_CONFIG_NOT_INITIALIZED;
   }
+  if ((value < kConfigSchema[key].min) || (value > kConfigSchema[key].max))
+  {
+    return ZBA_INVALID_ARG;
+  }
 
   ZBA_LOCK(config_state.configMutex);
   {
-    memset(&config_state.config.ssid[0], 0, sizeof(config_state.config.ssid));
-    if (ssid)
+    uint32_t *current = zba_config_value(key);
+    if (*current != value)
     {
-      strncpy(config_state.config.ssid, ssid, kMaxSSIDLen);
+      *current = value;
+      zba_config_changed(key);
     }
   }
   ZBA_UNLOCK(config_state.configMutex);
   return ZBA_OK;
 }
 
-zba_err_t zba_config_get_wifi_pwd(void *buffer, size_t maxLen)
+zba_err_t zba_config_get_str(zba_config_key_t key, void *buffer, size_t maxLen)
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  if ((key >= ZBA_CFG_NUM_KEYS) || (kConfigSchema[key].type != ZBA_CONFIG_TYPE_STR))
+  {
+    return ZBA_INVALID_ARG;
+  }
+  if (!zba_config_ready())
   {
     ZBA_ERR("Config not initialized.");
     return ZBA_CONFIG_NOT_INITIALIZED;
@@ -281,66 +553,93 @@ zba_err_t zba_config_get_wifi_pwd(void *buffer, size_t maxLen)
 
   ZBA_LOCK(config_state.configMutex);
   {
-    strncpy(buffer, config_state.config.wifi_pwd, ZBA_MIN(maxLen, kMaxPasswordLen));
+    strncpy(buffer, zba_config_value(key), ZBA_MIN(maxLen, kConfigSchema[key].max));
   }
   ZBA_UNLOCK(config_state.configMutex);
   return ZBA_OK;
 }
 
-zba_err_t zba_config_set_wifi_pwd(const char *wifi_pwd)
+zba_err_t zba_config_set_str(zba_config_key_t key, const char *value)
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
+  if ((key >= ZBA_CFG_NUM_KEYS) || (kConfigSchema[key].type != ZBA_CONFIG_TYPE_STR))
+  {
+    return ZBA_INVALID_ARG;
+  }
+  if (!zba_config_ready())
   {
     ZBA_ERR("Config not initialized.");
     return ZBA_CONFIG_NOT_INITIALIZED;
   }
+  if (!value)
+  {
+    value = "";
+  }
+  if (strlen(value) > kConfigSchema[key].max)
+  {
+    return ZBA_INVALID_ARG;
+  }
 
   ZBA_LOCK(config_state.configMutex);
   {
-    memset(&config_state.config.wifi_pwd[0], 0, sizeof(config_state.config.wifi_pwd));
-
-    if (wifi_pwd)
+    char *current = zba_config_value(key);
+    if (0 != strcmp(current, value))
     {
-      strncpy(config_state.config.wifi_pwd, wifi_pwd, kMaxPasswordLen);
+      memset(current, 0, kConfigSchema[key].max + 2);
+      strcpy(current, value);
+      zba_config_changed(key);
     }
   }
   ZBA_UNLOCK(config_state.configMutex);
   return ZBA_OK;
 }
 
-zba_err_t zba_config_get_device_pwd(void *buffer, size_t maxLen)
+int zba_config_get_wifi_timeout_sec()
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
-  {
-    ZBA_ERR("Config not initialized.");
-    return ZBA_CONFIG_NOT_INITIALIZED;
-  }
+  return zba_config_get_u32(ZBA_CFG_WIFI_TIMEOUT);
+}
 
-  ZBA_LOCK(config_state.configMutex);
-  {
-    strncpy(buffer, config_state.config.device_pwd, ZBA_MIN(maxLen, kMaxPasswordLen));
-  }
-  ZBA_UNLOCK(config_state.configMutex);
-  return ZBA_OK;
+zba_err_t zba_config_set_wifi_timeout_sec(int seconds)
+{
+  return zba_config_set_u32(ZBA_CFG_WIFI_TIMEOUT, seconds);
+}
+
+zba_err_t zba_config_get_ssid(void *buffer, size_t maxLen)
+{
+  return zba_config_get_str(ZBA_CFG_SSID, buffer, maxLen);
+}
+
+zba_err_t zba_config_set_ssid(const char *ssid)
+{
+  return zba_config_set_str(ZBA_CFG_SSID, ssid);
+}
+
+zba_err_t zba_config_get_wifi_pwd(void *buffer, size_t maxLen)
+{
+  return zba_config_get_str(ZBA_CFG_WIFI_PWD, buffer, maxLen);
+}
+
+zba_err_t zba_config_set_wifi_pwd(const char *wifi_pwd)
+{
+  return zba_config_set_str(ZBA_CFG_WIFI_PWD, wifi_pwd);
+}
+
+zba_err_t zba_config_get_device_pwd(void *buffer, size_t maxLen)
+{
+  return zba_config_get_str(ZBA_CFG_DEVICE_PWD, buffer, maxLen);
 }
 
 zba_err_t zba_config_set_device_pwd(const char *device_pwd)
 {
-  if ((!config_state.configMutex) || (!config_state.nvsHandle))
-  {
-    ZBA_ERR("Config not initialized.");
-    return ZBA_CONFIG_NOT_INITIALIZED;
-  }
+  return zba_config_set_str(ZBA_CFG_DEVICE_PWD, device_pwd);
+}
 
-  ZBA_LOCK(config_state.configMutex);
-  {
-    memset(&config_state.config.device_pwd[0], 0, sizeof(config_state.config.device_pwd));
+int zba_config_get_video_fps()
+{
+  // Video can run without config - this falls back to the default rather than erroring.
+  return zba_config_get_u32(ZBA_CFG_VIDEO_FPS);
+}
 
-    if (device_pwd)
-    {
-      strncpy(config_state.config.device_pwd, device_pwd, kMaxPasswordLen);
-    }
-  }
-  ZBA_UNLOCK(config_state.configMutex);
-  return ZBA_OK;
+zba_err_t zba_config_set_video_fps(int fps)
+{
+  return zba_config_set_u32(ZBA_CFG_VIDEO_FPS, fps);
 }
@@ -18,6 +18,26 @@ extern "C"
 #define kMaxPasswordLen     64
 #define kMaxUserLen         32
 #define kSerialBufferLength 255
+/// Default frame rate cap for video streams, 0 for as fast as the camera goes
+#define kDefaultVideoFps 0
+/// Highest frame rate a stream can ask for
+#define kMaxVideoFps 60
+
+  /// Settings in the config store. The type, NVS key, range and default of each are in
+  /// the schema in zba_config.c.
+  typedef enum
+  {
+    ZBA_CFG_SSID,            ///< Network: WiFi SSID (string)
+    ZBA_CFG_WIFI_PWD,        ///< Network: WiFi password (string)
+    ZBA_CFG_DEVICE_PWD,      ///< Network: admin password (string)
+    ZBA_CFG_WIFI_TIMEOUT,    ///< Network: seconds to wait to connect
+    ZBA_CFG_VIDEO_FPS,       ///< Stream: default frame rate cap, 0 for none
+    ZBA_CFG_CAMERA_RES,      ///< Camera: zba_resolution_t
+    ZBA_CFG_CAMERA_QUALITY,  ///< Camera: JPEG quality (1-63, lower is better), 0 for per-resolution
+    ZBA_CFG_AUTOEXPOSE,      ///< Camera: auto gain and exposure (bool)
+    ZBA_CFG_LED_COLOR,       ///< LED: strip color as 0xRRGGBBWW, 0 for off
+    ZBA_CFG_NUM_KEYS
+  } zba_config_key_t;
 
   /// Init the global config
   zba_err_t zba_config_init();
@@ -30,9 +50,22 @@ extern "C"
   /// Reset all data in the config.
   zba_err_t zba_config_reset();
 
-  /// Write config
+  /// Writes changed settings to NVS now, rather than waiting for the scheduled commit.
   zba_err_t zba_config_write();
 
+  /// Gets a number or bool setting. Its default if config isn't up.
+  uint32_t zba_config_get_u32(zba_config_key_t key);
+
+  /// Sets a number or bool setting. ZBA_INVALID_ARG if it's out of range.
+  /// Changes are committed to NVS a couple of seconds after the last one.
+  zba_err_t zba_config_set_u32(zba_config_key_t key, uint32_t value);
+
+  /// Gets a string setting. Like strncpy, it's only terminated if it's shorter than maxLen.
+  zba_err_t zba_config_get_str(zba_config_key_t key, void *buffer, size_t maxLen);
+
+  /// Sets a string setting. NULL clears it. Committed like zba_config_set_u32().
+  zba_err_t zba_config_set_str(zba_config_key_t key, const char *value);
+
   int zba_config_get_wifi_timeout_sec();
 
   zba_err_t zba_config_set_wifi_timeout_sec(int seconds);
@@ -54,6 +87,12 @@ extern "C"
   /// Set the device password
   zba_err_t zba_config_set_device_pwd(const char *wifi_pwd);
 
+  /// Frame rate video streams get when they don't ask for one. 0 for uncapped.
+  int zba_config_get_video_fps();
+
+  /// Set the default video frame rate (0 to kMaxVideoFps)
+  zba_err_t zba_config_set_video_fps(int fps);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,9 +13,12 @@ extern "C"
     ZBA_ERROR = 0x8000,
     ZBA_MODULE_NOT_INITIALIZED,
     ZBA_OUT_OF_MEMORY,
+    ZBA_INVALID_ARG,
+    ZBA_UNKNOWN_COMMAND,
     ZBA_CAM_ERROR = 0x8100,
     ZBA_CAM_INIT_FAILED,
     ZBA_CAM_DEINIT_FAILED,
+    ZBA_CAM_ROI_UNSUPPORTED,
     ZBA_WIFI_ERROR = 0x8200,
     ZBA_WIFI_INIT_FAILED,
     ZBA_WIFI_NOT_CONFIGURED,
@@ -53,6 +56,21 @@ extern "C"
     ZBA_I2C_ERROR = 0x8a00,
     ZBA_I2C_INIT_ERROR,
     ZBA_I2C_DEINIT_ERROR,
+    ZBA_MJPEG_ERROR = 0x8b00,
+    ZBA_MJPEG_INIT_FAILED,
+    ZBA_MJPEG_TOO_MANY_CLIENTS,
+    ZBA_MJPEG_SEND_FAILED,
+    ZBA_RTSP_ERROR = 0x8c00,
+    ZBA_RTSP_INIT_FAILED,
+    ZBA_AUTH_ERROR = 0x8d00,
+    ZBA_AUTH_INIT_FAILED,
+    ZBA_AUTH_STALE_NONCE,
+    ZBA_PACKET_ERROR = 0x8e00,
+    ZBA_PACKET_BAD_CRC,
+    ZBA_PACKET_TOO_LONG,
+    ZBA_PACKET_UNKNOWN_TYPE,
+    ZBA_PACKET_SEND_FAILED,
+    ZBA_PACKET_NO_FRAME,
     //-----------------------
 
     //-----------------------
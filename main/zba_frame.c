@@ -0,0 +1,192 @@
+#include "zba_frame.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <string.h>
+#include "zba_util.h"
+
+DEFINE_ZBA_MODULE(zba_frame);
+
+/// Frame descriptor tables
+typedef struct
+{
+  SemaphoreHandle_t mutex;                     ///< Protects descriptors and refs
+  zba_frame_t driver[ZBA_FRAME_DRIVER_SLOTS];  ///< Descriptors for driver frames
+  zba_frame_t pool[ZBA_FRAME_POOL_SIZE];       ///< Processed frame pool
+} zba_frame_state_t;
+
+static zba_frame_state_t frame_state = {.mutex = NULL, .driver = {{0}}, .pool = {{0}}};
+
+zba_err_t zba_frame_init()
+{
+  zba_err_t result = ZBA_OK;
+  if (frame_state.mutex == NULL)
+  {
+    frame_state.mutex = xSemaphoreCreateMutex();
+  }
+  if (frame_state.mutex == NULL)
+  {
+    ZBA_ERR("Couldn't create frame mutex");
+    result = ZBA_OUT_OF_MEMORY;
+  }
+  ZBA_SET_INIT(zba_frame, result);
+  return result;
+}
+
+zba_err_t zba_frame_deinit()
+{
+  zba_err_t deinit_error = ZBA_OK;
+  if (frame_state.mutex)
+  {
+    ZBA_LOCK(frame_state.mutex);
+    for (int i = 0; i < ZBA_FRAME_POOL_SIZE; ++i)
+    {
+      zba_frame_t* frame = &frame_state.pool[i];
+      if (frame->source != ZBA_FRAME_FREE)
+      {
+        ZBA_ERR("Pool frame %d still in use at deinit", i);
+        deinit_error = ZBA_ERROR;
+        continue;
+      }
+      free(frame->pool_fb.buf);
+      memset(frame, 0, sizeof(zba_frame_t));
+    }
+    ZBA_UNLOCK(frame_state.mutex);
+
+    if (deinit_error == ZBA_OK)
+    {
+      vSemaphoreDelete(frame_state.mutex);
+      frame_state.mutex = NULL;
+    }
+  }
+  ZBA_SET_DEINIT(zba_frame, deinit_error);
+  return deinit_error;
+}
+
+zba_frame_t* zba_frame_from_driver(camera_fb_t* fb)
+{
+  zba_frame_t* frame = NULL;
+  if ((!fb) || (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_frame))) return NULL;
+
+  ZBA_LOCK(frame_state.mutex);
+  for (int i = 0; i < ZBA_FRAME_DRIVER_SLOTS; ++i)
+  {
+    if (frame_state.driver[i].source == ZBA_FRAME_FREE)
+    {
+      frame         = &frame_state.driver[i];
+      frame->fb     = fb;
+      frame->source = ZBA_FRAME_DRIVER;
+      frame->refs   = 1;
+      break;
+    }
+  }
+  ZBA_UNLOCK(frame_state.mutex);
+
+  if (!frame)
+  {
+    ZBA_ERR("Out of driver frame slots");
+  }
+  return frame;
+}
+
+zba_frame_t* zba_frame_pool_acquire(size_t len)
+{
+  zba_frame_t* frame = NULL;
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_frame)) return NULL;
+
+  ZBA_LOCK(frame_state.mutex);
+  // Prefer a free frame that's already big enough, so we don't reallocate.
+  for (int i = 0; i < ZBA_FRAME_POOL_SIZE; ++i)
+  {
+    zba_frame_t* cur = &frame_state.pool[i];
+    if (cur->source != ZBA_FRAME_FREE) continue;
+    if ((!frame) || ((cur->capacity >= len) && (frame->capacity < len)))
+    {
+      frame = cur;
+    }
+  }
+
+  if (frame)
+  {
+    if (frame->capacity < len)
+    {
+      // Processed frames go in PSRAM if we have it.
+      free(frame->pool_fb.buf);
+      frame->pool_fb.buf = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+      if (!frame->pool_fb.buf)
+      {
+        frame->pool_fb.buf = malloc(len);
+      }
+      frame->capacity = frame->pool_fb.buf ? len : 0;
+    }
+
+    if (frame->pool_fb.buf)
+    {
+      frame->fb        = &frame->pool_fb;
+      frame->fb->len   = len;
+      frame->source    = ZBA_FRAME_POOL;
+      frame->refs      = 1;
+      frame->frame_num = 0;
+    }
+    else
+    {
+      ZBA_ERR("Couldn't allocate %u bytes for pool frame", len);
+      frame = NULL;
+    }
+  }
+  ZBA_UNLOCK(frame_state.mutex);
+  return frame;
+}
+
+zba_frame_t* zba_frame_copy(const zba_frame_t* frame)
+{
+  zba_frame_t* copy = NULL;
+  if ((!frame) || (!(copy = zba_frame_pool_acquire(frame->fb->len)))) return NULL;
+
+  memcpy(copy->fb->buf, frame->fb->buf, frame->fb->len);
+  copy->fb->width     = frame->fb->width;
+  copy->fb->height    = frame->fb->height;
+  copy->fb->format    = frame->fb->format;
+  copy->fb->timestamp = frame->fb->timestamp;
+  copy->frame_num     = frame->frame_num;
+  return copy;
+}
+
+zba_frame_t* zba_frame_ref(zba_frame_t* frame)
+{
+  if (!frame) return NULL;
+  ZBA_LOCK(frame_state.mutex);
+  frame->refs++;
+  ZBA_UNLOCK(frame_state.mutex);
+  return frame;
+}
+
+void zba_frame_release(zba_frame_t* frame)
+{
+  camera_fb_t* driver_fb = NULL;
+  if (!frame) return;
+
+  ZBA_LOCK(frame_state.mutex);
+  if (frame->refs > 0)
+  {
+    frame->refs--;
+  }
+  if (frame->refs == 0)
+  {
+    if (frame->source == ZBA_FRAME_DRIVER)
+    {
+      driver_fb = frame->fb;
+    }
+    // Pool frames keep their buffer for next time.
+    frame->fb        = NULL;
+    frame->source    = ZBA_FRAME_FREE;
+    frame->frame_num = 0;
+  }
+  ZBA_UNLOCK(frame_state.mutex);
+
+  // Give the driver its buffer back outside of the lock.
+  if (driver_fb)
+  {
+    esp_camera_fb_return(driver_fb);
+  }
+}
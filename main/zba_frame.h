@@ -0,0 +1,67 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_FRAME_H_
+#define ZEBRAL_ESP32CAM_ZBA_FRAME_H_
+
+#include <esp_camera.h>
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  DECLARE_ZBA_MODULE(zba_frame);
+
+/// Number of processed frame buffers in the pool
+#define ZBA_FRAME_POOL_SIZE 3
+/// Number of driver frames we can have out at once (more than the driver's fb_count)
+#define ZBA_FRAME_DRIVER_SLOTS 4
+
+  /// Where a frame's image lives, and so how it's given back
+  typedef enum
+  {
+    ZBA_FRAME_FREE,    ///< Descriptor not in use
+    ZBA_FRAME_DRIVER,  ///< Camera driver buffer, returned with esp_camera_fb_return
+    ZBA_FRAME_POOL     ///< Processed frame buffer from our pool
+  } zba_frame_source_t;
+
+  /// Frame descriptor.
+  /// Frames are reference counted - whoever captures or acquires one holds a reference,
+  /// anyone else that wants to keep it (e.g. a second client) takes one with zba_frame_ref(),
+  /// and everyone calls zba_frame_release() when done. The image goes back to the driver
+  /// or pool when the last reference is released, so nothing is copied or overwritten
+  /// while it's still being sent.
+  typedef struct zba_frame
+  {
+    camera_fb_t* fb;            ///< Image - the driver's buffer, or pool_fb
+    zba_frame_source_t source;  ///< Where fb came from
+    uint32_t refs;              ///< References held
+    int64_t frame_num;          ///< Camera frame number
+    camera_fb_t pool_fb;        ///< Image header for pool frames
+    size_t capacity;            ///< Bytes allocated at pool_fb.buf
+  } zba_frame_t;
+
+  zba_err_t zba_frame_init();
+  zba_err_t zba_frame_deinit();
+
+  /// Wraps a driver frame buffer. Returns NULL if all driver slots are in use.
+  zba_frame_t* zba_frame_from_driver(camera_fb_t* fb);
+
+  /// Gets a pool frame with at least len bytes at fb->buf. fb->len is set to len, the caller
+  /// fills in the rest of fb. Returns NULL if the pool is exhausted or out of memory.
+  zba_frame_t* zba_frame_pool_acquire(size_t len);
+
+  /// Copies a frame into a pool frame, e.g. so a slow consumer doesn't hold on to a
+  /// driver buffer. Returns NULL if the pool is exhausted.
+  zba_frame_t* zba_frame_copy(const zba_frame_t* frame);
+
+  /// Takes another reference to a frame
+  zba_frame_t* zba_frame_ref(zba_frame_t* frame);
+
+  /// Releases a reference, giving the image back once the last one goes.
+  void zba_frame_release(zba_frame_t* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_FRAME_H_
@@ -1,323 +0,0 @@
-#include "zba_html.h"
-
-/// Main page
-const char kIndexHtml[] =
-    "<!DOCTYPE html>\n"
-    "\n"
-    "<html lang=\"en\">\n"
-    "\n"
-    "<head>\n"
-    "  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-    "  <style>\n"
-    "    body {\n"
-    "      background-color: rgb(48, 48, 48);\n"
-    "      color: rgb(200, 200, 200);\n"
-    "      margin: 0px;\n"
-    "    }\n"
-    "\n"
-    "    a:link {\n"
-    "      color: lightblue;\n"
-    "      text-decoration: none;\n"
-    "    }\n"
-    "\n"
-    "    a:visited {\n"
-    "      color: lightcyan;\n"
-    "      text-decoration: none;\n"
-    "    }\n"
-    "\n"
-    "    a:hover {\n"
-    "      color: lightcoral;\n"
-    "      text-decoration: underline;\n"
-    "    }\n"
-    "\n"
-    "    a:active {\n"
-    "      color: lightpink;\n"
-    "      text-decoration: underline;\n"
-    "    }\n"
-    "\n"
-    "    #sidebar_div {\n"
-    "      height: 100%;\n"
-    "      width: 75px;\n"
-    "      position: fixed;\n"
-    "      top: 0;\n"
-    "      left: 0;\n"
-    "      background-color: rgb(60, 20, 80);\n"
-    "      color: white;\n"
-    "      overflow-x: hidden;\n"
-    "      transition: .25s;\n"
-    "      font-size: 14px;\n"
-    "      cursor: pointer;\n"
-    "    }\n"
-    "\n"
-    "    #camera_div {\n"
-    "      padding: 0px;\n"
-    "      margin: 0px;\n"
-    "      height: 100%;\n"
-    "      transition-duration: .25s;\n"
-    "    }\n"
-    "\n"
-    "    #camera_img {\n"
-    "      padding: 0px;\n"
-    "      margin: 0px;\n"
-    "      height: 100vh;\n"
-    "      width: 100%;\n"
-    "      object-fit: contain;\n"
-    "      image-rendering: pixelated\n"
-    "    }\n"
-    "\n"
-    "    #logo {\n"
-    "      transform-style: preserve-3d;\n"
-    "      transition: transform 0.5s;\n"
-    "      margin: 8px 8px;\n"
-    "    }\n"
-    "\n"
-    "    #sidebar_ctrls {\n"
-    "      text-align: left;\n"
-    "      margin-left: 8px\n"
-    "    }\n"
-    "\n"
-    "    .centered {\n"
-    "      text-align: center;\n"
-    "    }\n"
-    "\n"
-    "    button {\n"
-    "      font-size: 18px;\n"
-    "      background-color: rgb(80, 60, 120);\n"
-    "      color: white;\n"
-    "      cursor: pointer;\n"
-    "      border-radius: 20px;\n"
-    "      transition-duration: .25s;\n"
-    "      padding: 12px 20px;\n"
-    "      margin: 8px 8px;\n"
-    "    }\n"
-    "\n"
-    "    select {\n"
-    "      font-size: 18px;\n"
-    "      background-color: rgb(80, 60, 120);\n"
-    "      color: white;\n"
-    "      margin: 8px 8px;\n"
-    "      border-radius: 24px;\n"
-    "    }\n"
-    "\n"
-    "    .center_label {\n"
-    "      text-align: center;\n"
-    "    }\n"
-    "\n"
-    "    .color_picker {\n"
-    "      text-align: center;\n"
-    "      margin: 15px 15px;\n"
-    "    }\n"
-    "\n"
-    "    button:hover {\n"
-    "      background-color: rgb(60, 20, 160);\n"
-    "    }\n"
-    "\n"
-    "    .sidebar_combo {\n"
-    "      width: 80%;\n"
-    "    }\n"
-    "\n"
-    "    .sidebar_btn {\n"
-    "      width: 80%;\n"
-    "    }\n"
-    "  </style>\n"
-    "  <title>Zebral ESP32-CAM</title>\n"
-    "  <link rel=\"ico\" type=\"image/png\" sizes=\"16x16\" href=\"favicon.png\" />\n"
-    "  <link rel=\"shortcut icon\" href=\"favicon.png\" type=\"image/png\" />\n"
-    "</head>\n"
-    "\n"
-    "<body onload=\"onInitialize()\">\n"
-    "  <!-- Side nav bar -->\n"
-    "  <div id=\"sidebar_div\">\n"
-    "    <div id=\"logo_div\"><img id=\"logo\" src=\"zebral_logo.svg\" width=\"50\" "
-    "onclick=\"toggleNav()\" /></div>\n"
-    "    <div id=\"sidebar_ctrls\">\n"
-    "      <div class=\"centered\"><a href=\"image\" download><button id=\"save_btn\" "
-    "class=\"sidebar_btn\">Save Image</button></a>\n"
-    "      </div>\n"
-    "      <div class=\"centered\"><a "
-    "href=\"https://github.com/devellison/zebral_esp32cam\"><button id=\"github_btn\"\n"
-    "            class=\"sidebar_btn\">GitHub</button></a></div>\n"
-    "      <div>\n"
-    "        <hr>\n"
-    "      </div>\n"
-    "      <div>Resolution</div>\n"
-    "      <div>\n"
-    "        <select id=\"resolution\" onChange=\"on_change_resolution();\" "
-    "class=\"sidebar_combo\" name=\"resolution\">\n"
-    "          <option value=\"QCIF\">QCIF</option>\n"
-    "          <option value=\"QVGA\">QVGA</option>\n"
-    "          <option value=\"VGA\">VGA</option>\n"
-    "          <option value=\"SVGA\">SVGA</option>\n"
-    "          <option value=\"HD\">HD</option>\n"
-    "          <option value=\"UXGA\">UXGA</option>\n"
-    "        </select>\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"autoexpose\">AutoExpose</label>\n"
-    "        <input type=\"checkbox\" id=\"autoexpose\" onChange=\"on_change_autoexpose();\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"exposure\">Exposure</label>\n"
-    "        <input type=\"range\" id=\"exposure\" onChange=\"on_change_exposure();\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"color\">LED Color</label>\n"
-    "        <input type=\"color\" id=\"ledcolor\" onChange=\"on_change_leds();\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"pin0\">Pin 0</label>\n"
-    "        <input type=\"checkbox\" id=\"pin0\" onChange=\"on_change_gpio(0);\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"pin8\">Pin 8</label>\n"
-    "        <input type=\"checkbox\" id=\"pin8\" onChange=\"on_change_gpio(8);\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"pin9\">Pin 9</label>\n"
-    "        <input type=\"checkbox\" id=\"pin9\" onChange=\"on_change_gpio(9);\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"pin10\">Pin 10</label>\n"
-    "        <input type=\"checkbox\" id=\"pin10\" onChange=\"on_change_gpio(10);\">\n"
-    "      </div>\n"
-    "      <div>\n"
-    "        <label for=\"pin11\">Pin 11</label>\n"
-    "        <input type=\"checkbox\" id=\"pin11\" onChange=\"on_change_gpio(11);\">\n"
-    "      </div>\n"
-    "    </div>\n"
-    "  </div>\n"
-    "  <!-- Camera image -->\n"
-    "  <div id=\"camera_div\">\n"
-    "    <image id=\"camera_img\" src=\"\" />\n"
-    "  </div>\n"
-    "  <script>\n"
-    "    var nav_shown = false;\n"
-    "    var hostname = window.location.hostname\n"
-    "    // We have to use a different port, as the server only handles one client at a time.\n"
-    "    // But there's not an easy way to say \"This host, but on another port\" in a URI.\n"
-    "    // So we rewrite the image URI on load.\n"
-    "    function onInitialize() {\n"
-    "      if (hostname) {\n"
-    "        document.getElementById('camera_img').src = 'http://' + hostname + ':81/video';\n"
-    "      }\n"
-    "      else {\n"
-    "        // For testing locally\n"
-    "        document.getElementById('camera_img').src = 'sample.bmp';\n"
-    "      }\n"
-    "\n"
-    "      document.getElementById(\"sidebar_ctrls\").hidden = true;\n"
-    "      get_resolution();\n"
-    "    }\n"
-    "\n"
-    "    // Open/shut the side nav bar\n"
-    "    function toggleNav() {\n"
-    "      if (!nav_shown) {\n"
-    "        document.getElementById(\"sidebar_div\").style.width = \"250px\";\n"
-    "        document.getElementById(\"camera_div\").style.marginLeft = \"250px\";\n"
-    "        document.getElementById(\"sidebar_ctrls\").hidden = false;\n"
-    "        document.getElementById(\"logo\").style.transform = \"rotateY(180deg)\";\n"
-    "        nav_shown = true;\n"
-    "      }\n"
-    "      else {\n"
-    "        document.getElementById(\"sidebar_div\").style.width = \"75px\";\n"
-    "        document.getElementById(\"camera_div\").style.marginLeft = \"75px\";\n"
-    "        document.getElementById(\"sidebar_ctrls\").hidden = true;\n"
-    "        document.getElementById(\"logo\").style.transform = \"rotateY(0)\";\n"
-    "        nav_shown = false;\n"
-    "      }\n"
-    "    }\n"
-    "\n"
-    "    async function get_resolution() {\n"
-    "      if (hostname == \"\") return;\n"
-    "      let response = await fetch(\"http://\" + hostname + \"/command?status\");\n"
-    "      let data = await response.json();\n"
-    "      document.getElementById(\"resolution\").value = data.resolution;\n"
-    "    }\n"
-    "    function on_change_autoexpose() {\n"
-    "      var value = document.getElementById(\"autoexpose\").checked;\n"
-    "      document.getElementById(\"exposure\").disabled = value;\n"
-    "      console.log(\"Change autoexpose to \", value);\n"
-    "      on_change_exposure();\n"
-    "    }\n"
-    "\n"
-    "    function on_change_exposure() { }\n"
-    "\n"
-    "    function on_change_leds() {\n"
-    "      var value = encodeURIComponent(document.getElementById(\"ledcolor\").value);\n"
-    "\n"
-    "      console.log(\"Change leds to \", value);\n"
-    "      var uri = \"http://\" + hostname + \"/command?ledcolor=\" + value;\n"
-    "      console.log(\"Uri is \", uri);\n"
-    "      if (hostname == \"\") return;\n"
-    "      fetch(uri, { credentials: 'include' });\n"
-    "    }\n"
-    "\n"
-    "    function on_change_gpio(pin) {\n"
-    "      var value = document.getElementById(\"pin\" + pin).checked;\n"
-    "      var uri = \"http://\" + hostname + \"/command?gpio\" + pin + \"=\" + value;\n"
-    "      console.log(\"Changing GPIO pin. URI: \", uri);\n"
-    "      if (hostname == \"\") return;\n"
-    "      fetch(uri, { credentials: 'include' });\n"
-    "    }\n"
-    "\n"
-    "    function on_change_resolution() {\n"
-    "      var select = document.getElementById(\"resolution\");\n"
-    "      if (select.selectedIndex >= 0) {\n"
-    "        var value = select.options[select.selectedIndex].value;\n"
-    "        console.log(\"Change resolution to \", value);\n"
-    "        if (hostname == \"\") return;\n"
-    "        fetch(\"http://\" + hostname + \"/command?res=\" + value, {\n"
-    "          credentials: 'include'\n"
-    "        });\n"
-    "      }\n"
-    "    }\n"
-    "\n"
-    "\n"
-    "  </script>\n"
-    "</body>\n"
-    "\n"
-    "</html>\n";
-
-const char kControlHtml[] =
-    "<html>"
-    "<head>"
-    "  <style>"
-    "    img{height:100vh;width:100%;object-fit:contain;image-rendering: pixelated;}"
-    "    body {background-color:#000000;}"
-    "  </style>"
-    "  <title>Zebral ESP32-CAM</title>"
-    "  <link rel=\"ico\" type=\"image/png\" href=\"/favicon.png\"/>"
-    "  <link rel=\"shortcut icon\" href=\"/favicon.png\" type=\"image/png\"/>"
-    "</head>"
-    "<body>"
-    "  Controls go here."
-    "</body>"
-    "</html>";
-
-const char kZebralLogo[] =
-    "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 679 "
-    "454.9\"><defs><style>.a{fill:#ff0;}.b{fill:red;}.c{fill:#ff931e;}.d{fill:lime;}.e{fill:aqua;}."
-    "f{fill:blue;}.g{fill:#93278f;}</style></defs><path class=\"a\" "
-    "d=\"M462.1,381.2,439,369.6c-6.4-3.3-12.8-6.6-19-10.1a7.8,7.8,0,0,1-3.5-3.7Q376.2,252,336,148."
-    "3a17.8,17.8,0,0,1-.3-2l8.1-3.1c20.7-7.6,28-31.3,14.9-49.1-10.4-14.2-21.3-28.2-31.6-42.5a98.2,"
-    "98.2,0,0,1-10.3-18.1c-2.3-5,0-7.6,5.3-6.5a51.8,51.8,0,0,1,13.5,4.9Q397.4,65.7,459,99.7a7.9,7."
-    "9,0,0,1,3.3,5.8q.1,135.8.1,271.5C462.4,378.1,462.2,379.2,462.1,381.2Z\" "
-    "transform=\"translate(-46 -26.8)\"/><path class=\"b\" "
-    "d=\"M342.1,383.8l-37.3,38.7L46,293.7a29.9,29.9,0,0,1,15.2-20c24.6-13.7,49.1-27.3,73.9-40.5,14."
-    "6-7.8,29.5-14.6,44.3-22,2.7-1.4,4.5-1.4,6.8,1.1q77.1,84.9,154.3,169.5A11.5,11.5,0,0,1,342.1,"
-    "383.8Z\" transform=\"translate(-46 -26.8)\"/><path class=\"c\" "
-    "d=\"M401.5,356.9c-17.4,2.3-32.7,8.8-47.1,18.7L197,203c41.1-19,82.2-36.2,124.7-51.9Z\" "
-    "transform=\"translate(-46 -26.8)\"/><path class=\"d\" "
-    "d=\"M476.4,111c26,15.7,50.2,31.9,69.5,54.2,10.9,12.6,21.3,25.6,31.9,38.4a6.4,6.4,0,0,1,1.3,7."
-    "2q-36,92.4-71.7,184.7a28,28,0,0,1-1.9,4c-9.1-3.5-18.1-7-27-10.6a4.8,4.8,0,0,1-2-3,16.8,16.8,0,"
-    "0,1-.1-3.9V111Z\" transform=\"translate(-46 -26.8)\"/><path class=\"e\" "
-    "d=\"M590.5,220.9c7.1,11.9,13.2,22.7,19.9,33.2A86.8,86.8,0,0,0,622.2,268c10.6,10.5,21.6,20.7,"
-    "32.7,31.3l-17.8,19.6c-28.2,31-56.5,62-84.6,93.1-3.3,3.6-5.8,4-10.1,2-7.3-3.5-15-6.3-23-9."
-    "6C542.9,343.6,566.4,282.9,590.5,220.9Z\" transform=\"translate(-46 -26.8)\"/><path "
-    "class=\"f\" "
-    "d=\"M711.8,384.7l-18.6,9.4c-32.2,16-64.3,31.9-96.4,48-3,1.5-4.8,1.3-7.5-.7-8.7-6.5-17.9-12.5-"
-    "27.2-18.9l101-110.8C671.8,318.4,704.5,367.5,711.8,384.7Z\" transform=\"translate(-46 "
-    "-26.8)\"/><path class=\"g\" "
-    "d=\"M718.1,397.7c8.1,14.2,9.9,28,.7,42.2-5.2,8.1-9.6,16.7-14.5,25-7.4,12.7-19.1,18-33.6,16."
-    "5a201.6,201.6,0,0,0-26.9-1c-10,.1-18.4-2.8-25.2-10-4.8-5-9.3-10.4-14.3-16.1Z\" "
-    "transform=\"translate(-46 -26.8)\"/></svg>";
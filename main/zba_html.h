@@ -1,17 +0,0 @@
-#ifndef ZEBRAL_ESP32CAM_ZBA_HTML_
-#define ZEBRAL_ESP32CAM_ZBA_HTML_
-
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-
-  extern const char kIndexHtml[];
-  extern const char kControlHtml[];
-  extern const char kZebralLogo[];
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif  // ZEBRAL_ESP32CAM_ZBA_HTML_
\ No newline at end of file
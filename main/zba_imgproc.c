@@ -1,5 +1,6 @@
 #include "zba_imgproc.h"
 #include <stdint.h>
+#include <string.h>
 
 #include "zba_util.h"
 
@@ -22,6 +23,21 @@ void zba_imgproc_rgb565_to_gray(uint16_t* input, size_t width, size_t height, ui
   }
 }
 
+void zba_imgproc_crop(const uint8_t* input, size_t width, size_t bpp, size_t x, size_t y,
+                      size_t crop_width, size_t crop_height, uint8_t* output)
+{
+  size_t src_stride  = width * bpp;
+  size_t dst_stride  = crop_width * bpp;
+  const uint8_t* src = input + y * src_stride + x * bpp;
+
+  for (size_t row = 0; row < crop_height; ++row)
+  {
+    memcpy(output, src, dst_stride);
+    output += dst_stride;
+    src += src_stride;
+  }
+}
+
 // clang-format off
 void zba_imgproc_mean_rgb565(uint16_t* input, size_t width, size_t height, uint16_t* output)
 {
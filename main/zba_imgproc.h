@@ -30,6 +30,11 @@ extern "C"
 
   void zba_imgproc_rgb565_to_gray(uint16_t* input, size_t width, size_t height, uint8_t* output);
 
+  /// Copies a crop_width x crop_height rectangle at (x, y) out of an image
+  /// with bpp bytes per pixel. Rectangle must be inside the image.
+  void zba_imgproc_crop(const uint8_t* input, size_t width, size_t bpp, size_t x, size_t y,
+                        size_t crop_width, size_t crop_height, uint8_t* output);
+
   // Convolution functions
   void zba_imgproc_mean_rgb565(uint16_t* input, size_t width, size_t height, uint16_t* output);
   void zba_imgproc_gaussian_rgb565(uint16_t* input, size_t width, size_t height, uint16_t* output);
@@ -0,0 +1,262 @@
+#include "zba_json.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Sends what's staged as a chunk
+static void zba_json_flush(zba_json_t* json)
+{
+  if ((json->len == 0) || (json->error != ESP_OK))
+  {
+    json->len = 0;
+    return;
+  }
+  if (!json->req)
+  {
+    // Building in memory. Without out the buffer's all there is, so keep what's there.
+    if ((!json->out) || (json->len > json->out_size - json->out_len))
+    {
+      json->error = ESP_ERR_NO_MEM;
+      return;
+    }
+    memcpy(json->out + json->out_len, json->buffer, json->len);
+    json->out_len += json->len;
+    json->len = 0;
+    return;
+  }
+  json->error = httpd_resp_send_chunk(json->req, json->buffer, json->len);
+  json->len   = 0;
+}
+
+static void zba_json_write(zba_json_t* json, const char* data, size_t len)
+{
+  while ((len > 0) && (json->error == ESP_OK))
+  {
+    size_t space = sizeof(json->buffer) - json->len;
+    if (space == 0)
+    {
+      zba_json_flush(json);
+      continue;
+    }
+    size_t count = (len < space) ? len : space;
+    memcpy(json->buffer + json->len, data, count);
+    json->len += count;
+    data += count;
+    len -= count;
+  }
+}
+
+static void zba_json_putc(zba_json_t* json, char c)
+{
+  if (json->len == sizeof(json->buffer))
+  {
+    zba_json_flush(json);
+  }
+  if (json->error == ESP_OK)
+  {
+    json->buffer[json->len++] = c;
+  }
+}
+
+/// Writes a quoted, escaped string
+static void zba_json_quote(zba_json_t* json, const char* str)
+{
+  static const char kHex[] = "0123456789abcdef";
+  const char* run          = str;
+
+  zba_json_putc(json, '"');
+  for (; *str; ++str)
+  {
+    unsigned char c = (unsigned char)*str;
+    if ((c >= 0x20) && (c != '"') && (c != '\\')) continue;
+
+    // Write the plain run up to here in one go, then the escape.
+    zba_json_write(json, run, str - run);
+    run = str + 1;
+    switch (c)
+    {
+      case '"':
+        zba_json_write(json, "\\\"", 2);
+        break;
+      case '\\':
+        zba_json_write(json, "\\\\", 2);
+        break;
+      case '\n':
+        zba_json_write(json, "\\n", 2);
+        break;
+      case '\r':
+        zba_json_write(json, "\\r", 2);
+        break;
+      case '\t':
+        zba_json_write(json, "\\t", 2);
+        break;
+      default:
+      {
+        char escape[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+        zba_json_write(json, escape, sizeof(escape));
+        break;
+      }
+    }
+  }
+  zba_json_write(json, run, str - run);
+  zba_json_putc(json, '"');
+}
+
+/// Writes the comma and key that go before a value
+static void zba_json_key(zba_json_t* json, const char* key)
+{
+  uint32_t bit = 1u << json->depth;
+  if (json->has_items & bit)
+  {
+    zba_json_putc(json, ',');
+  }
+  json->has_items |= bit;
+
+  if (key)
+  {
+    zba_json_quote(json, key);
+    zba_json_putc(json, ':');
+  }
+}
+
+/// Writes a value that's already formatted
+static void zba_json_raw(zba_json_t* json, const char* key, const char* value, int len)
+{
+  zba_json_key(json, key);
+  if ((len > 0) && (len < ZBA_JSON_STAGING_SIZE))
+  {
+    zba_json_write(json, value, len);
+  }
+  else
+  {
+    zba_json_write(json, "null", 4);
+  }
+}
+
+static void zba_json_open(zba_json_t* json, const char* key, char c)
+{
+  zba_json_key(json, key);
+  zba_json_putc(json, c);
+  if (json->depth + 1 >= ZBA_JSON_MAX_DEPTH)
+  {
+    json->error = ESP_ERR_INVALID_STATE;
+    return;
+  }
+  json->depth++;
+  json->has_items &= ~(1u << json->depth);
+}
+
+static void zba_json_close(zba_json_t* json, char c)
+{
+  if (json->depth > 0)
+  {
+    json->depth--;
+  }
+  zba_json_putc(json, c);
+}
+
+void zba_json_begin(zba_json_t* json, httpd_req_t* req)
+{
+  json->req       = req;
+  json->out       = NULL;
+  json->out_size  = 0;
+  json->out_len   = 0;
+  json->len       = 0;
+  json->depth     = 0;
+  json->has_items = 0;
+  json->error     = ESP_OK;
+  if (req)
+  {
+    httpd_resp_set_type(req, "application/json");
+  }
+}
+
+void zba_json_begin_buffer(zba_json_t* json, char* out, size_t size)
+{
+  zba_json_begin(json, NULL);
+  json->out      = out;
+  json->out_size = size;
+}
+
+esp_err_t zba_json_end(zba_json_t* json)
+{
+  if (!json->req)
+  {
+    if (json->out)
+    {
+      zba_json_flush(json);
+    }
+    return json->error;
+  }
+  zba_json_flush(json);
+  if (json->error == ESP_OK)
+  {
+    json->error = httpd_resp_send_chunk(json->req, NULL, 0);
+  }
+  return json->error;
+}
+
+void zba_json_object(zba_json_t* json, const char* key)
+{
+  zba_json_open(json, key, '{');
+}
+
+void zba_json_end_object(zba_json_t* json)
+{
+  zba_json_close(json, '}');
+}
+
+void zba_json_array(zba_json_t* json, const char* key)
+{
+  zba_json_open(json, key, '[');
+}
+
+void zba_json_end_array(zba_json_t* json)
+{
+  zba_json_close(json, ']');
+}
+
+void zba_json_string(zba_json_t* json, const char* key, const char* value)
+{
+  zba_json_key(json, key);
+  if (value)
+  {
+    zba_json_quote(json, value);
+  }
+  else
+  {
+    zba_json_write(json, "null", 4);
+  }
+}
+
+void zba_json_int(zba_json_t* json, const char* key, int64_t value)
+{
+  char buf[24];
+  zba_json_raw(json, key, buf, snprintf(buf, sizeof(buf), "%" PRId64, value));
+}
+
+void zba_json_uint(zba_json_t* json, const char* key, uint64_t value)
+{
+  char buf[24];
+  zba_json_raw(json, key, buf, snprintf(buf, sizeof(buf), "%" PRIu64, value));
+}
+
+void zba_json_float(zba_json_t* json, const char* key, float value)
+{
+  // JSON has no NaN or infinity.
+  char buf[32];
+  int len = isfinite(value) ? snprintf(buf, sizeof(buf), "%g", (double)value) : 0;
+  zba_json_raw(json, key, buf, len);
+}
+
+void zba_json_bool(zba_json_t* json, const char* key, bool value)
+{
+  zba_json_raw(json, key, value ? "true" : "false", value ? 4 : 5);
+}
+
+void zba_json_hex(zba_json_t* json, const char* key, uint32_t value)
+{
+  char buf[16];
+  zba_json_raw(json, key, buf, snprintf(buf, sizeof(buf), "\"0x%" PRIX32 "\"", value));
+}
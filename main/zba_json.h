@@ -0,0 +1,78 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_JSON_H_
+#define ZEBRAL_ESP32CAM_ZBA_JSON_H_
+
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Bytes staged before they go out as a chunk
+#define ZBA_JSON_STAGING_SIZE 256
+/// Deepest nesting of objects and arrays
+#define ZBA_JSON_MAX_DEPTH 16
+
+  /// Streaming JSON writer.
+  /// Output is staged in a small fixed buffer and sent as chunks of a chunked response
+  /// as it fills, so a document can be any size without building it in memory. Commas
+  /// are added as needed. The first send error sticks - everything after it is dropped
+  /// and zba_json_end() returns it.
+  ///
+  ///   zba_json_t json;
+  ///   zba_json_begin(&json, req);
+  ///   zba_json_object(&json, NULL);
+  ///   zba_json_int(&json, "answer", 42);
+  ///   zba_json_end_object(&json);
+  ///   return zba_json_end(&json);
+  ///
+  /// key is the member name inside an object, and NULL for array elements and the root.
+  typedef struct
+  {
+    httpd_req_t* req;                    ///< Response the chunks go to
+    char* out;                           ///< Or the caller's buffer they go to
+    size_t out_size;                     ///< Size of out
+    size_t out_len;                      ///< Bytes in out
+    char buffer[ZBA_JSON_STAGING_SIZE];  ///< Staged output
+    size_t len;                          ///< Bytes in buffer
+    int depth;                           ///< Open objects/arrays
+    uint32_t has_items;                  ///< Bit per depth - a value's been written there
+    esp_err_t error;                     ///< First error, ESP_OK if none
+  } zba_json_t;
+
+  /// Starts a JSON response. Sets the content type - set any other headers first.
+  /// With a NULL req the document is only built in buffer, for sending some other way -
+  /// past ZBA_JSON_STAGING_SIZE it fails with ESP_ERR_NO_MEM.
+  void zba_json_begin(zba_json_t* json, httpd_req_t* req);
+
+  /// Starts a document built in out rather than sent, for ones bigger than the staging
+  /// buffer. Past size it fails with ESP_ERR_NO_MEM. Once ended, out_len is its length.
+  void zba_json_begin_buffer(zba_json_t* json, char* out, size_t size);
+
+  /// Flushes what's left and ends the chunked response.
+  /// Returns the first error hit while writing.
+  esp_err_t zba_json_end(zba_json_t* json);
+
+  /// Opens an object or array. Close with the matching end call.
+  void zba_json_object(zba_json_t* json, const char* key);
+  void zba_json_end_object(zba_json_t* json);
+  void zba_json_array(zba_json_t* json, const char* key);
+  void zba_json_end_array(zba_json_t* json);
+
+  /// Writes a value. Strings are escaped, a NULL string is written as null.
+  void zba_json_string(zba_json_t* json, const char* key, const char* value);
+  void zba_json_int(zba_json_t* json, const char* key, int64_t value);
+  void zba_json_uint(zba_json_t* json, const char* key, uint64_t value);
+  void zba_json_float(zba_json_t* json, const char* key, float value);
+  void zba_json_bool(zba_json_t* json, const char* key, bool value);
+
+  /// Writes value as a "0x%X" string
+  void zba_json_hex(zba_json_t* json, const char* key, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_JSON_H_
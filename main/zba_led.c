@@ -4,6 +4,7 @@
 #include "driver/rmt.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "zba_metrics.h"
 #include "zba_pins.h"
 #include "zba_priority.h"
 #include "zba_sd.h"
@@ -79,6 +80,12 @@ static const char* kLEDTaskStackName   = "LEDRefresh";  ///< LED refresh task na
 static const size_t kLEDTaskStackSize  = 8192;          ///< LED task stack size
 static const size_t kLEDRefreshSpeedMS = 10;            ///< LED refresh rate
 
+static const uint32_t kRefreshUsecBuckets[] = {100, 250, 500, 1000, 2000, 5000, 10000, 50000};
+DEFINE_ZBA_HISTOGRAM(refresh_usec_metric, "zba_led_refresh_usec", "Time to write the LED strip",
+                     kRefreshUsecBuckets);
+DEFINE_ZBA_COUNTER(refresh_errors_metric, "zba_led_refresh_errors_total",
+                   "LED strip writes that failed");
+
 zba_err_t zba_led_strip_refresh();
 void led_update_task(void* context);
 
@@ -158,6 +165,9 @@ zba_err_t zba_led_init()
       break;
     }
 
+    zba_metrics_register(&refresh_usec_metric);
+    zba_metrics_register(&refresh_errors_metric);
+
     // create refresh task
     led_state.exiting = false;
     xTaskCreate(led_update_task, kLEDTaskStackName, kLEDTaskStackSize, NULL,
@@ -230,11 +240,26 @@ zba_err_t zba_led_light(bool on)
   // Right now, just set it each time. SD Module unsets it.
   zba_pin_mode(PIN_LED_WHITE, PIN_MODE_DIGITAL_OUT);
   ZBA_SET_BIT(led_state.onboard_leds, WHITE_INIT);
+  if (on)
+  {
+    ZBA_SET_BIT(led_state.onboard_leds, WHITE_ON);
+  }
+  else
+  {
+    ZBA_UNSET_BIT(led_state.onboard_leds, WHITE_ON);
+  }
 
   zba_pin_digital_write(PIN_LED_WHITE, on ? PIN_HIGH : PIN_LOW);
   return ZBA_OK;
 }
 
+bool zba_led_light_is_on()
+{
+  // The SD card shares the pin, so the light's off while it's active.
+  return (ZBA_MODULE_INITIALIZED(zba_sd) != ZBA_OK) &&
+         ZBA_TEST_BIT(led_state.onboard_leds, WHITE_INIT | WHITE_ON);
+}
+
 zba_err_t zba_led_light_blink()
 {
   led_state.onboard_leds ^= WHITE_ON;
@@ -466,7 +491,10 @@ zba_err_t zba_led_strip_get_led(const char* seg_name, int led_index, zba_led_typ
 zba_led_seg_t* zba_led_strip_get_segment(const char* seg_name);
 
 // Retrieve number of segments.
-size_t zba_led_strip_get_num_segments();
+size_t zba_led_strip_get_num_segments()
+{
+  return led_state.num_led_segments;
+}
 
 /// Once you're done setting the LEDs, call flip() to
 /// make the buffer active.
@@ -495,8 +523,6 @@ zba_err_t zba_led_strip_refresh()
   zba_err_t zba_error = ZBA_LED_WRITE_FAILED;
   size_t timeout_ms   = 100;
   int64_t elapsed;
-  static size_t counter = 0;
-  static float accum    = 0;
 
   // Bail if we don't have a new buffer yet - no point in locking or doing work.
   if (!led_state.led_buffer_dirty) return ZBA_OK;
@@ -524,15 +550,11 @@ zba_err_t zba_led_strip_refresh()
   }
   ZBA_UNLOCK(led_state.buffer_mutex);
   led_state.last_refresh = esp_timer_get_time();
-  accum += zba_elapsed_sec(start);
-  counter++;
-  if (0 == (counter % 1000))
-  {
-    ZBA_LOG("LED Refresh time: %f (accum: %f, count: %u)", accum / counter, accum, counter);
-  }
+  zba_metrics_observe(&refresh_usec_metric, (uint32_t)(led_state.last_refresh - start));
 
   if (zba_error != ZBA_OK)
   {
+    zba_metrics_inc(&refresh_errors_metric);
     ZBA_ERR("Refresh LED strip failed");
   }
   return zba_error;
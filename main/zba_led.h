@@ -21,6 +21,9 @@ extern "C"
   /// Blink the white LED on the top of the board
   zba_err_t zba_led_light_blink();
 
+  /// Is the white LED on? (as last set by zba_led_light)
+  bool zba_led_light_is_on();
+
   /// The different types of LEDs we have right now
   typedef enum zba_led_type
   {
@@ -0,0 +1,361 @@
+#include "zba_metrics.h"
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+#include "zba_util.h"
+
+DEFINE_ZBA_MODULE(zba_metrics);
+
+/// Room for a metric's name with its labels
+#define ZBA_METRICS_SERIES_LEN 96
+
+/// How often the 32 bit slots are carried into the 64 bit totals, whether they're read
+/// or not. A slot has to be caught before it goes round again - 4GB a minute is plenty.
+static const uint64_t kMetricsCarryUsec = 60 * 1000 * 1000;
+
+/// Registry state
+typedef struct
+{
+  SemaphoreHandle_t mutex;         ///< Serializes registration and updates of the totals
+  zba_metric_t* head;              ///< Registered metrics. Append only, so readers don't lock.
+  esp_timer_handle_t carry_timer;  ///< Carries the slots into the totals every minute
+} zba_metrics_state_t;
+
+static zba_metrics_state_t metrics_state = {.mutex = NULL, .head = NULL, .carry_timer = NULL};
+
+static void zba_metrics_carry_cb(void* arg);
+
+zba_err_t zba_metrics_init()
+{
+  zba_err_t result = ZBA_OK;
+  if (metrics_state.mutex == NULL)
+  {
+    metrics_state.mutex = xSemaphoreCreateMutex();
+  }
+  if (metrics_state.mutex == NULL)
+  {
+    ZBA_ERR("Couldn't create metrics mutex");
+    result = ZBA_OUT_OF_MEMORY;
+  }
+  else if (metrics_state.carry_timer == NULL)
+  {
+    const esp_timer_create_args_t timer_args = {.callback = zba_metrics_carry_cb,
+                                                .arg      = NULL,
+                                                .name     = "zba_metrics"};
+    esp_err_t esp_result = esp_timer_create(&timer_args, &metrics_state.carry_timer);
+    if (ESP_OK == esp_result)
+    {
+      esp_timer_start_periodic(metrics_state.carry_timer, kMetricsCarryUsec);
+    }
+    else
+    {
+      // Totals are still brought up to date when they're read, just not in between.
+      ZBA_ERR("Couldn't create metrics timer! ESP_ERROR: 0x%X", esp_result);
+      metrics_state.carry_timer = NULL;
+    }
+  }
+  ZBA_SET_INIT(zba_metrics, result);
+  return result;
+}
+
+zba_err_t zba_metrics_deinit()
+{
+  zba_err_t deinit_error = ZBA_OK;
+  // Metrics are static and stay registered - they keep counting across a restart.
+  if (metrics_state.carry_timer)
+  {
+    esp_timer_stop(metrics_state.carry_timer);
+    esp_timer_delete(metrics_state.carry_timer);
+    metrics_state.carry_timer = NULL;
+  }
+  if (metrics_state.mutex)
+  {
+    vSemaphoreDelete(metrics_state.mutex);
+    metrics_state.mutex = NULL;
+  }
+  ZBA_SET_DEINIT(zba_metrics, deinit_error);
+  return deinit_error;
+}
+
+zba_err_t zba_metrics_register(zba_metric_t* metric)
+{
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_metrics))
+  {
+    ZBA_ERR("Metrics not initialized, can't register %s", metric->name);
+    return ZBA_MODULE_NOT_INITIALIZED;
+  }
+
+  if ((metric->type == ZBA_METRIC_HISTOGRAM) && (metric->num_bounds > ZBA_METRIC_MAX_BUCKETS))
+  {
+    ZBA_ERR("Too many buckets in %s", metric->name);
+    return ZBA_ERROR;
+  }
+
+  ZBA_LOCK(metrics_state.mutex);
+  if (!metric->registered)
+  {
+    metric->next       = metrics_state.head;
+    metric->registered = true;
+    __atomic_store_n(&metrics_state.head, metric, __ATOMIC_RELEASE);
+  }
+  ZBA_UNLOCK(metrics_state.mutex);
+  return ZBA_OK;
+}
+
+void zba_metrics_add(zba_metric_t* metric, uint32_t amount)
+{
+  __atomic_fetch_add(&metric->values[xPortGetCoreID()][0], amount, __ATOMIC_RELAXED);
+}
+
+void zba_metrics_inc(zba_metric_t* metric)
+{
+  zba_metrics_add(metric, 1);
+}
+
+void zba_metrics_set(zba_metric_t* metric, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  __atomic_store_n(&metric->values[0][0], bits, __ATOMIC_RELAXED);
+}
+
+void zba_metrics_observe(zba_metric_t* metric, uint32_t value)
+{
+  uint32_t* values = metric->values[xPortGetCoreID()];
+  size_t bucket    = 0;
+  while ((bucket < metric->num_bounds) && (value > metric->bounds[bucket]))
+  {
+    bucket++;
+  }
+  __atomic_fetch_add(&values[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&values[metric->num_bounds + 1], value, __ATOMIC_RELAXED);
+}
+
+/// Sums one value slot across cores. Wraps at 32 bits, like the slots.
+static uint32_t zba_metrics_sum(const zba_metric_t* metric, size_t slot)
+{
+  uint32_t total = 0;
+  for (int core = 0; core < portNUM_PROCESSORS; ++core)
+  {
+    total += __atomic_load_n(&metric->values[core][slot], __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+/// Brings a counter's value or a histogram's sum up to date in its 64 bit total, and
+/// returns that. Only what the slots gained since last time is added, so a wrap in
+/// between is carried - as long as it's only the one.
+static uint64_t zba_metrics_total(zba_metric_t* metric)
+{
+  size_t slot = (metric->type == ZBA_METRIC_HISTOGRAM) ? metric->num_bounds + 1 : 0;
+
+  ZBA_LOCK(metrics_state.mutex);
+  uint32_t now   = zba_metrics_sum(metric, slot);
+  uint64_t total = metric->total + (uint32_t)(now - metric->last);
+  metric->total  = total;
+  metric->last   = now;
+  ZBA_UNLOCK(metrics_state.mutex);
+  return total;
+}
+
+/// Carries every metric's slots into its total, so none goes round unseen
+static void zba_metrics_carry_cb(void* arg)
+{
+  zba_metric_t* metric = __atomic_load_n(&metrics_state.head, __ATOMIC_ACQUIRE);
+  for (; metric; metric = metric->next)
+  {
+    if (metric->type != ZBA_METRIC_GAUGE)
+    {
+      zba_metrics_total(metric);
+    }
+  }
+}
+
+uint64_t zba_metrics_get_count(zba_metric_t* metric)
+{
+  if (metric->type != ZBA_METRIC_HISTOGRAM)
+  {
+    return zba_metrics_total(metric);
+  }
+
+  uint64_t count = 0;
+  for (size_t i = 0; i <= metric->num_bounds; ++i)
+  {
+    count += zba_metrics_sum(metric, i);
+  }
+  return count;
+}
+
+float zba_metrics_get_gauge(const zba_metric_t* metric)
+{
+  float value;
+  uint32_t bits = __atomic_load_n(&metric->values[0][0], __ATOMIC_RELAXED);
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint32_t zba_metrics_get_percentile(zba_metric_t* metric, uint32_t percentile)
+{
+  uint64_t total = zba_metrics_get_count(metric);
+  if ((metric->type != ZBA_METRIC_HISTOGRAM) || (total == 0)) return 0;
+
+  // Walk to the bucket holding the percentile and report its upper bound.
+  uint64_t target = (total * ZBA_MIN(percentile, 100) + 99) / 100;
+  uint64_t seen   = 0;
+  for (size_t i = 0; i < metric->num_bounds; ++i)
+  {
+    seen += zba_metrics_sum(metric, i);
+    if (seen >= target)
+    {
+      return metric->bounds[i];
+    }
+  }
+  // Past the last bound - best we can say is "more than that".
+  return metric->bounds[metric->num_bounds - 1];
+}
+
+/// Name of the metric with its labels, e.g. zba_frame_stage_usec{stage="grab"}
+static const char* zba_metrics_series(const zba_metric_t* metric, char* buf, size_t size)
+{
+  if (!metric->labels) return metric->name;
+  snprintf(buf, size, "%s{%s}", metric->name, metric->labels);
+  return buf;
+}
+
+void zba_metrics_dump(zba_print_fn print, void* context)
+{
+  char series[ZBA_METRICS_SERIES_LEN];
+  zba_metric_t* metric = __atomic_load_n(&metrics_state.head, __ATOMIC_ACQUIRE);
+  for (; metric; metric = metric->next)
+  {
+    const char* name = zba_metrics_series(metric, series, sizeof(series));
+    switch (metric->type)
+    {
+      case ZBA_METRIC_COUNTER:
+        print(context, "%s: %llu", name, zba_metrics_get_count(metric));
+        break;
+      case ZBA_METRIC_GAUGE:
+        print(context, "%s: %f", name, zba_metrics_get_gauge(metric));
+        break;
+      case ZBA_METRIC_HISTOGRAM:
+        print(context, "%s: count %llu sum %llu p50 %u p90 %u p99 %u", name,
+              zba_metrics_get_count(metric), zba_metrics_total(metric),
+              zba_metrics_get_percentile(metric, 50), zba_metrics_get_percentile(metric, 90),
+              zba_metrics_get_percentile(metric, 99));
+        break;
+    }
+  }
+}
+
+/// Sends one metric, with the family's HELP and TYPE first if it's the first of them.
+/// Histograms are sent a few buckets at a time so the buffer can stay small.
+static esp_err_t zba_metrics_send_metric(httpd_req_t* req, zba_metric_t* metric, bool first)
+{
+  static const char* kTypeNames[] = {"counter", "gauge", "histogram"};
+  const char* labels              = metric->labels ? metric->labels : "";
+  const char* comma               = metric->labels ? "," : "";
+  char series[ZBA_METRICS_SERIES_LEN];
+  char braced[ZBA_METRICS_SERIES_LEN] = "";
+  char buf[256];
+  int len = 0;
+  esp_err_t res;
+
+  if (metric->labels)
+  {
+    snprintf(braced, sizeof(braced), "{%s}", metric->labels);
+  }
+  if (first)
+  {
+    len = snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help,
+                   metric->name, kTypeNames[metric->type]);
+  }
+
+  switch (metric->type)
+  {
+    case ZBA_METRIC_COUNTER:
+      len += snprintf(buf + len, sizeof(buf) - len, "%s %llu\n",
+                      zba_metrics_series(metric, series, sizeof(series)),
+                      zba_metrics_get_count(metric));
+      return httpd_resp_send_chunk(req, buf, len);
+
+    case ZBA_METRIC_GAUGE:
+      len += snprintf(buf + len, sizeof(buf) - len, "%s %f\n",
+                      zba_metrics_series(metric, series, sizeof(series)),
+                      zba_metrics_get_gauge(metric));
+      return httpd_resp_send_chunk(req, buf, len);
+
+    case ZBA_METRIC_HISTOGRAM:
+      break;
+  }
+
+  if ((len > 0) && (ESP_OK != (res = httpd_resp_send_chunk(req, buf, len))))
+  {
+    return res;
+  }
+
+  // Buckets are cumulative in the exposition format.
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= metric->num_bounds; ++i)
+  {
+    cumulative += zba_metrics_sum(metric, i);
+    if (i < metric->num_bounds)
+    {
+      len = snprintf(buf, sizeof(buf), "%s_bucket{%s%sle=\"%u\"} %llu\n", metric->name, labels,
+                     comma, metric->bounds[i], cumulative);
+    }
+    else
+    {
+      len = snprintf(buf, sizeof(buf),
+                     "%s_bucket{%s%sle=\"+Inf\"} %llu\n%s_sum%s %llu\n%s_count%s %llu\n",
+                     metric->name, labels, comma, cumulative, metric->name, braced,
+                     zba_metrics_total(metric), metric->name, braced, cumulative);
+    }
+    if (ESP_OK != (res = httpd_resp_send_chunk(req, buf, len)))
+    {
+      return res;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t zba_metrics_send_web(httpd_req_t* req)
+{
+  esp_err_t res            = ESP_OK;
+  const zba_metric_t* prev = NULL;
+  zba_metric_t* metric     = __atomic_load_n(&metrics_state.head, __ATOMIC_ACQUIRE);
+  for (; metric && (res == ESP_OK); prev = metric, metric = metric->next)
+  {
+    bool first = (!prev) || (0 != strcmp(prev->name, metric->name));
+    res        = zba_metrics_send_metric(req, metric, first);
+  }
+  return res;
+}
+
+void zba_metrics_write_json(zba_json_t* json)
+{
+  char series[ZBA_METRICS_SERIES_LEN];
+  zba_metric_t* metric = __atomic_load_n(&metrics_state.head, __ATOMIC_ACQUIRE);
+  for (; metric; metric = metric->next)
+  {
+    const char* name = zba_metrics_series(metric, series, sizeof(series));
+    switch (metric->type)
+    {
+      case ZBA_METRIC_COUNTER:
+        zba_json_uint(json, name, zba_metrics_get_count(metric));
+        break;
+      case ZBA_METRIC_GAUGE:
+        zba_json_float(json, name, zba_metrics_get_gauge(metric));
+        break;
+      case ZBA_METRIC_HISTOGRAM:
+        zba_json_object(json, name);
+        zba_json_uint(json, "count", zba_metrics_get_count(metric));
+        zba_json_uint(json, "sum", zba_metrics_total(metric));
+        zba_json_uint(json, "p50", zba_metrics_get_percentile(metric, 50));
+        zba_json_uint(json, "p90", zba_metrics_get_percentile(metric, 90));
+        zba_json_uint(json, "p99", zba_metrics_get_percentile(metric, 99));
+        zba_json_end_object(json);
+        break;
+    }
+  }
+}
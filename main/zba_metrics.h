@@ -0,0 +1,113 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_METRICS_H_
+#define ZEBRAL_ESP32CAM_ZBA_METRICS_H_
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include "zba_json.h"
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  DECLARE_ZBA_MODULE(zba_metrics);
+
+/// Most buckets a histogram can have (not counting +Inf)
+#define ZBA_METRIC_MAX_BUCKETS 12
+
+  /// Kinds of metric
+  typedef enum
+  {
+    ZBA_METRIC_COUNTER,   ///< Only goes up
+    ZBA_METRIC_GAUGE,     ///< Set to a value
+    ZBA_METRIC_HISTOGRAM  ///< Counts of observations in fixed buckets, plus their sum
+  } zba_metric_type_t;
+
+  /// A metric. Modules define these statically with the DEFINE_ZBA_* macros below
+  /// and register them when they initialize.
+  ///
+  /// Metrics can share a name if their labels differ, e.g. a histogram per stage. They're
+  /// one family on /metrics, so register them one after another.
+  ///
+  /// Each core updates its own 32 bit slot with an atomic add, so updates never block
+  /// and cores don't contend. Slots are summed when the metrics are read. A counter's
+  /// value and a histogram's sum can wrap 32 bits within hours (byte counts do), so
+  /// they're carried on into 64 bit totals when read, and every minute besides.
+  typedef struct zba_metric
+  {
+    const char* name;         ///< Metric name, e.g. "zba_camera_frames_total"
+    const char* labels;       ///< Fixed labels, e.g. "stage=\"grab\"", or NULL
+    const char* help;         ///< One line description
+    zba_metric_type_t type;   ///< Counter, gauge or histogram
+    const uint32_t* bounds;   ///< Histogram bucket upper bounds, ascending
+    size_t num_bounds;        ///< Number of bounds
+    bool registered;          ///< Already in the registry?
+    struct zba_metric* next;  ///< Next registered metric
+    uint64_t total;           ///< Counter value or histogram sum, as of the last read
+    uint32_t last;            ///< The slots' 32 bit sum as of the last read
+    /// Per core values. Counter/gauge use [0]. Histograms use [0..num_bounds] for
+    /// the buckets (last is +Inf), then the sum.
+    uint32_t values[portNUM_PROCESSORS][ZBA_METRIC_MAX_BUCKETS + 2];
+  } zba_metric_t;
+
+#define DEFINE_ZBA_COUNTER(var, name, help)                                                    \
+  static zba_metric_t var = {name, NULL, help, ZBA_METRIC_COUNTER, NULL, 0, false, NULL, 0, 0, \
+                             {{0}}}
+
+#define DEFINE_ZBA_GAUGE(var, name, help) \
+  static zba_metric_t var = {name, NULL, help, ZBA_METRIC_GAUGE, NULL, 0, false, NULL, 0, 0, {{0}}}
+
+/// bounds must be a static array of ascending uint32_t upper bounds.
+#define DEFINE_ZBA_HISTOGRAM(var, name, help, bounds) \
+  DEFINE_ZBA_HISTOGRAM_LABELED(var, name, NULL, help, bounds)
+
+/// Histogram with fixed labels - one of a family sharing the name.
+#define DEFINE_ZBA_HISTOGRAM_LABELED(var, name, labels, help, bounds)                       \
+  static zba_metric_t var = {                                                               \
+      name, labels, help, ZBA_METRIC_HISTOGRAM, bounds, sizeof(bounds) / sizeof(bounds[0]), \
+      false, NULL, 0, 0, {{0}}}
+
+  zba_err_t zba_metrics_init();
+  zba_err_t zba_metrics_deinit();
+
+  /// Adds a metric to the registry. Safe to call more than once.
+  zba_err_t zba_metrics_register(zba_metric_t* metric);
+
+  /// Adds to a counter
+  void zba_metrics_add(zba_metric_t* metric, uint32_t amount);
+
+  /// Increments a counter
+  void zba_metrics_inc(zba_metric_t* metric);
+
+  /// Sets a gauge
+  void zba_metrics_set(zba_metric_t* metric, float value);
+
+  /// Adds an observation to a histogram
+  void zba_metrics_observe(zba_metric_t* metric, uint32_t value);
+
+  /// Reads a counter or the count of a histogram
+  uint64_t zba_metrics_get_count(zba_metric_t* metric);
+
+  /// Reads a gauge
+  float zba_metrics_get_gauge(const zba_metric_t* metric);
+
+  /// Estimates a percentile (0-100) of a histogram from its buckets
+  uint32_t zba_metrics_get_percentile(zba_metric_t* metric, uint32_t percentile);
+
+  /// Prints the metrics, a line each
+  void zba_metrics_dump(zba_print_fn print, void* context);
+
+  /// Sends all metrics in text exposition format in a chunked response
+  /// (doesn't end the response).
+  esp_err_t zba_metrics_send_web(httpd_req_t* req);
+
+  /// Writes all metrics as members of the open JSON object, keyed by name.
+  /// Histograms are summarized as count, sum and a few percentiles.
+  void zba_metrics_write_json(zba_json_t* json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_METRICS_H_
@@ -0,0 +1,1276 @@
+#include "zba_mjpeg.h"
+#include <errno.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zba_config.h"
+#include "zba_frame.h"
+#include "zba_metrics.h"
+#include "zba_priority.h"
+#include "zba_stream.h"
+#include "zba_trace.h"
+
+DEFINE_ZBA_MODULE(zba_mjpeg);
+
+/// A video client
+typedef struct
+{
+  int fd;                 ///< Socket, or ZBA_INVALID_FD if the slot is free
+  httpd_handle_t server;  ///< Server that owns the session
+  bool ready;             ///< Response header sent, ready for frames
+  bool failed;            ///< Send failed, waiting on httpd to close the session
+  bool closed;            ///< httpd closed the session, so we close fd
+  zba_roi_t roi;          ///< Region of interest
+  bool has_roi;           ///< Crop to roi
+  bool preview;           ///< Gets the scaled down preview rather than full frames
+  int64_t min_interval;   ///< usec between frames, 0 for every frame
+  int64_t last_queued;    ///< When a frame was last queued to it
+
+  bool websocket;                              ///< WebSocket client rather than multipart
+  uint32_t window;                             ///< Frames it can have unacked, 0 if it doesn't ack
+  uint32_t credits;                            ///< Frames it can be sent before it acks more
+  char message[ZBA_MJPEG_WS_MESSAGE_MAX + 2];  ///< Encoded message waiting to go out
+  size_t message_len;                          ///< Bytes in message, 0 if none
+  char* reply;                                 ///< Encoded text reply waiting to go out (heap)
+  size_t reply_len;                            ///< Bytes in reply
+
+  zba_frame_t* queue[ZBA_MJPEG_QUEUE_DEPTH];  ///< Frames waiting to send, oldest first
+  bool windowed[ZBA_MJPEG_QUEUE_DEPTH];       ///< Queued frame came off the sensor cropped to roi
+  int queued;                                 ///< Frames in queue
+  bool busy;                                  ///< Sending task has a frame out for this client
+  zba_mjpeg_client_stats_t stats;             ///< Stats (fd and queued filled in on request)
+
+  // Only touched by the sending task
+  zba_frame_t* frame;         ///< Frame being sent
+  bool frame_windowed;        ///< frame is already cropped to roi by the sensor window
+  uint8_t* converted;         ///< Frame converted to BMP, if it wasn't a JPEG
+  const uint8_t* payload;     ///< Image being sent
+  size_t payload_len;         ///< Bytes in payload
+  char header[160];           ///< Boundary and part header, or WebSocket header and metadata
+  size_t header_len;          ///< Bytes in header
+  size_t sent;                ///< Bytes of header + payload sent
+  int64_t send_start;         ///< When this frame started sending
+  struct timeval timestamp;   ///< Driver timestamp of this frame, for tracing
+  bool sending_message;       ///< Sending a queued message rather than a frame
+  char* reply_out;            ///< Reply being sent, freed once it's out
+} zba_mjpeg_client_t;
+
+/// The sensor window, set for a lone ROI client. Capture task only - it restarts the
+/// camera, so it's the only one that can touch the sensor safely.
+typedef struct
+{
+  int client;     ///< Client slot it was set for, -1 if none
+  zba_roi_t roi;  ///< That client's ROI
+  bool active;    ///< Sensor took it - false if it couldn't, so it isn't retried
+  int64_t since;  ///< When it last changed. Frames started before then may not match it.
+} zba_mjpeg_window_t;
+
+/// Someone else taking captured frames
+typedef struct
+{
+  zba_mjpeg_listener_t listener;  ///< Callback, or NULL if the slot is free
+  void* context;                  ///< Passed to listener
+} zba_mjpeg_listener_slot_t;
+
+/// MJPEG streaming state
+typedef struct
+{
+  SemaphoreHandle_t mutex;    ///< Protects client slots, queues and stats
+  TaskHandle_t task;          ///< Sending task
+  TaskHandle_t capture_task;  ///< Capture task
+  volatile bool exiting;      ///< Tells the tasks to exit
+  zba_mjpeg_window_t window;  ///< Sensor window
+  zba_mjpeg_client_t clients[ZBA_MJPEG_MAX_CLIENTS];
+  zba_mjpeg_listener_slot_t listeners[ZBA_MJPEG_MAX_LISTENERS];
+  int listener_count;  ///< Listeners registered
+} zba_mjpeg_state_t;
+
+static zba_mjpeg_state_t mjpeg_state = {.mutex            = NULL,
+                                        .task             = NULL,
+                                        .capture_task     = NULL,
+                                        .exiting          = false,
+                                        .window           = {.client = -1},
+                                        .clients          = {{0}},
+                                        .listeners        = {{0}},
+                                        .listener_count   = 0};
+
+static const char kMjpegHeader[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=ZEBRAL_IMAGE_CHUNK\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-cache\r\n";
+static const char kBoundary[] = "\r\n--ZEBRAL_IMAGE_CHUNK\r\n";
+
+static const char* kMjpegTaskName        = "MjpegStream";
+static const char* kMjpegCaptureTaskName = "MjpegCapture";
+static const size_t kMjpegStackSize      = 8192;
+static const int kMjpegIdleDelayMs       = 50;       ///< Wait between checks when no one's watching
+static const int kMjpegPollMs            = 20;       ///< Longest the sender waits on sockets
+static const int64_t kMjpegSendTimeout   = 5000000;  ///< usec to send a frame before dropping it
+static const uint32_t kMjpegSendMsWeight = 8;        ///< Smoothing for send_ms (1/weight per frame)
+
+static const uint32_t kSendUsecBuckets[] = {1000,  5000,   10000,  20000,  33000,  50000,
+                                            66000, 100000, 200000, 500000, 1000000};
+DEFINE_ZBA_COUNTER(frames_sent_metric, "zba_mjpeg_frames_sent_total",
+                   "Frames sent to video clients");
+DEFINE_ZBA_COUNTER(bytes_sent_metric, "zba_mjpeg_bytes_sent_total", "Bytes sent to video clients");
+DEFINE_ZBA_COUNTER(frames_dropped_metric, "zba_mjpeg_frames_dropped_total",
+                   "Frames skipped for video clients that were behind");
+DEFINE_ZBA_COUNTER(send_errors_metric, "zba_mjpeg_send_errors_total",
+                   "Video clients dropped on a failed or timed out send");
+DEFINE_ZBA_HISTOGRAM(send_usec_metric, "zba_mjpeg_send_usec",
+                     "Time to send a frame to a video client", kSendUsecBuckets);
+DEFINE_ZBA_HISTOGRAM(preview_usec_metric, "zba_mjpeg_preview_usec",
+                     "Time to scale a frame down for the preview stream", kSendUsecBuckets);
+
+static void zba_mjpeg_task(void* context);
+static void zba_mjpeg_capture_task(void* context);
+
+static void zba_mjpeg_reset_client(zba_mjpeg_client_t* client)
+{
+  memset(client, 0, sizeof(zba_mjpeg_client_t));
+  client->fd = ZBA_INVALID_FD;
+}
+
+/// When the sensor started a frame, in zba_now() usec
+static int64_t zba_mjpeg_frame_start(const zba_frame_t* frame)
+{
+  return ((int64_t)frame->fb->timestamp.tv_sec * 1000000LL) + frame->fb->timestamp.tv_usec;
+}
+
+zba_err_t zba_mjpeg_init()
+{
+  zba_err_t init_error = ZBA_OK;
+  for (;;)
+  {
+    for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+    {
+      zba_mjpeg_reset_client(&mjpeg_state.clients[i]);
+    }
+
+    if (NULL == (mjpeg_state.mutex = xSemaphoreCreateMutex()))
+    {
+      ZBA_ERR("Couldn't create mjpeg mutex");
+      init_error = ZBA_MJPEG_INIT_FAILED;
+      break;
+    }
+
+    zba_metrics_register(&frames_sent_metric);
+    zba_metrics_register(&bytes_sent_metric);
+    zba_metrics_register(&frames_dropped_metric);
+    zba_metrics_register(&send_errors_metric);
+    zba_metrics_register(&send_usec_metric);
+    zba_metrics_register(&preview_usec_metric);
+
+    memset(mjpeg_state.listeners, 0, sizeof(mjpeg_state.listeners));
+    mjpeg_state.listener_count = 0;
+    mjpeg_state.exiting        = false;
+    mjpeg_state.window.client  = -1;
+    mjpeg_state.window.active  = false;
+    if (pdPASS != xTaskCreate(zba_mjpeg_task, kMjpegTaskName, kMjpegStackSize, NULL,
+                              ZBA_MJPEG_PRIORITY, &mjpeg_state.task))
+    {
+      ZBA_ERR("Couldn't start mjpeg task");
+      mjpeg_state.task = NULL;
+      init_error       = ZBA_MJPEG_INIT_FAILED;
+      break;
+    }
+    if (pdPASS != xTaskCreate(zba_mjpeg_capture_task, kMjpegCaptureTaskName, kMjpegStackSize,
+                              NULL, ZBA_MJPEG_PRIORITY, &mjpeg_state.capture_task))
+    {
+      ZBA_ERR("Couldn't start mjpeg capture task");
+      mjpeg_state.capture_task = NULL;
+      init_error               = ZBA_MJPEG_INIT_FAILED;
+      break;
+    }
+    break;
+  }
+
+  ZBA_SET_INIT(zba_mjpeg, init_error);
+  if (ZBA_OK != init_error)
+  {
+    zba_mjpeg_deinit();
+  }
+  return init_error;
+}
+
+zba_err_t zba_mjpeg_deinit()
+{
+  zba_err_t deinit_error = ZBA_OK;
+
+  mjpeg_state.exiting = true;
+  if (mjpeg_state.capture_task)
+  {
+    while (eTaskGetState(mjpeg_state.capture_task) != eDeleted)
+    {
+      vTaskDelay(50 / portTICK_PERIOD_MS);
+    }
+    mjpeg_state.capture_task = NULL;
+  }
+  if (mjpeg_state.task)
+  {
+    while (eTaskGetState(mjpeg_state.task) != eDeleted)
+    {
+      vTaskDelay(50 / portTICK_PERIOD_MS);
+    }
+    mjpeg_state.task = NULL;
+  }
+
+  if (mjpeg_state.mutex)
+  {
+    vSemaphoreDelete(mjpeg_state.mutex);
+    mjpeg_state.mutex = NULL;
+  }
+
+  ZBA_SET_DEINIT(zba_mjpeg, deinit_error);
+  return deinit_error;
+}
+
+/// Wakes the capture task early, when a client might be due a frame sooner
+static void zba_mjpeg_wake_capture()
+{
+  if (mjpeg_state.capture_task)
+  {
+    xTaskNotifyGive(mjpeg_state.capture_task);
+  }
+}
+
+/// Sets a client's frame rate cap. Previews are always capped. Call with the mutex held.
+static void zba_mjpeg_set_fps(zba_mjpeg_client_t* client, uint32_t fps)
+{
+  if (client->preview && ((!fps) || (fps > ZBA_MJPEG_PREVIEW_FPS)))
+  {
+    fps = ZBA_MJPEG_PREVIEW_FPS;
+  }
+  client->stats.fps    = fps;
+  client->min_interval = fps ? (1000000 / fps) : 0;
+}
+
+/// Claims a free client slot for fd and sets it up with opts. Returns NULL if there
+/// isn't a free slot.
+static zba_mjpeg_client_t* zba_mjpeg_claim_client(httpd_req_t* req, int fd,
+                                                  const zba_mjpeg_stream_opts_t* opts)
+{
+  zba_mjpeg_client_t* client = NULL;
+  uint32_t fps               = (opts && opts->fps) ? opts->fps : zba_config_get_video_fps();
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    if (mjpeg_state.clients[i].fd == ZBA_INVALID_FD)
+    {
+      client         = &mjpeg_state.clients[i];
+      client->fd     = fd;
+      client->server = req->handle;
+      client->ready  = false;
+      if (opts && opts->preview)
+      {
+        // Previews are scaled from the full frame, so they can't have a window.
+        client->preview = true;
+      }
+      else if (opts && opts->has_roi)
+      {
+        client->has_roi = true;
+        client->roi     = opts->roi;
+      }
+      zba_mjpeg_set_fps(client, fps);
+      break;
+    }
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  return client;
+}
+
+/// Marks a claimed client ready for frames
+static void zba_mjpeg_ready_client(zba_mjpeg_client_t* client)
+{
+  // Each frame goes out in one write, so push the tail of it out rather than
+  // waiting on the last ack.
+  int nodelay = 1;
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  client->ready = true;
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  zba_mjpeg_wake_capture();
+}
+
+/// Finds the client on fd. Call with the mutex held.
+static zba_mjpeg_client_t* zba_mjpeg_find_client(int fd)
+{
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if ((client->fd == fd) && client->ready && (!client->closed))
+    {
+      return client;
+    }
+  }
+  return NULL;
+}
+
+/// Writes a WebSocket frame header (server frames aren't masked). Returns its length.
+static size_t zba_mjpeg_ws_header(char* out, httpd_ws_type_t type, size_t len)
+{
+  uint8_t* p = (uint8_t*)out;
+  p[0]       = 0x80 | type;  // FIN
+  if (len < 126)
+  {
+    p[1] = (uint8_t)len;
+    return 2;
+  }
+  if (len <= UINT16_MAX)
+  {
+    p[1] = 126;
+    p[2] = (uint8_t)(len >> 8);
+    p[3] = (uint8_t)len;
+    return 4;
+  }
+  p[1] = 127;
+  for (int i = 0; i < 8; ++i)
+  {
+    p[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+  }
+  return 10;
+}
+
+zba_err_t zba_mjpeg_add_client(httpd_req_t* req, const zba_mjpeg_stream_opts_t* opts)
+{
+  zba_mjpeg_client_t* client = NULL;
+  int fd                     = httpd_req_to_sockfd(req);
+
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_mjpeg)) return ZBA_MODULE_NOT_INITIALIZED;
+  if (fd < 0) return ZBA_MJPEG_ERROR;
+
+  // Claim a slot first, so we don't send a 200 to someone we can't serve.
+  if (NULL == (client = zba_mjpeg_claim_client(req, fd, opts)))
+  {
+    return ZBA_MJPEG_TOO_MANY_CLIENTS;
+  }
+
+  // Only advertise a frame rate when there's a cap to hold it to.
+  char header[sizeof(kMjpegHeader) + 32];
+  int len = snprintf(header, sizeof(header), "%s", kMjpegHeader);
+  if (client->stats.fps)
+  {
+    len += snprintf(header + len, sizeof(header) - len, "X-Framerate: %u\r\n", client->stats.fps);
+  }
+  len += snprintf(header + len, sizeof(header) - len, "\r\n");
+
+  if (httpd_send(req, header, len) != len)
+  {
+    ZBA_ERR("Failed sending mjpeg header");
+    ZBA_LOCK(mjpeg_state.mutex);
+    zba_mjpeg_reset_client(client);
+    ZBA_UNLOCK(mjpeg_state.mutex);
+    return ZBA_MJPEG_SEND_FAILED;
+  }
+
+  zba_mjpeg_ready_client(client);
+  ZBA_LOG("Video client %d added (%u fps)", fd, client->stats.fps);
+  return ZBA_OK;
+}
+
+zba_err_t zba_mjpeg_add_ws_client(httpd_req_t* req, const zba_mjpeg_stream_opts_t* opts)
+{
+  zba_mjpeg_client_t* client = NULL;
+  int fd                     = httpd_req_to_sockfd(req);
+
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_mjpeg)) return ZBA_MODULE_NOT_INITIALIZED;
+  if (fd < 0) return ZBA_MJPEG_ERROR;
+  if (NULL == (client = zba_mjpeg_claim_client(req, fd, opts)))
+  {
+    return ZBA_MJPEG_TOO_MANY_CLIENTS;
+  }
+
+  // Handshake's done, so there's no header to send.
+  ZBA_LOCK(mjpeg_state.mutex);
+  client->websocket = true;
+  client->window    = ZBA_MJPEG_WS_WINDOW;
+  client->credits   = ZBA_MJPEG_WS_WINDOW;
+  ZBA_UNLOCK(mjpeg_state.mutex);
+
+  zba_mjpeg_ready_client(client);
+  ZBA_LOG("WebSocket video client %d added (%u fps)", fd, client->stats.fps);
+  return ZBA_OK;
+}
+
+void zba_mjpeg_ws_ack(int fd, uint32_t frames)
+{
+  if (!mjpeg_state.mutex) return;
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_t* client = zba_mjpeg_find_client(fd);
+  if (client && client->window)
+  {
+    client->credits = ZBA_MIN(client->credits + frames, client->window);
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  zba_mjpeg_wake_capture();
+}
+
+void zba_mjpeg_ws_set_window(int fd, uint32_t frames)
+{
+  if (!mjpeg_state.mutex) return;
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_t* client = zba_mjpeg_find_client(fd);
+  if (client)
+  {
+    client->window  = frames;
+    client->credits = frames;
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  zba_mjpeg_wake_capture();
+}
+
+void zba_mjpeg_ws_set_rate(int fd, uint32_t fps)
+{
+  if (!mjpeg_state.mutex) return;
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_t* client = zba_mjpeg_find_client(fd);
+  if (client)
+  {
+    zba_mjpeg_set_fps(client, fps);
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  zba_mjpeg_wake_capture();
+}
+
+zba_err_t zba_mjpeg_ws_send(int fd, httpd_ws_type_t type, const char* payload, size_t len)
+{
+  zba_err_t result = ZBA_MJPEG_SEND_FAILED;
+  char* reply      = NULL;
+  size_t reply_len = 0;
+  if (!mjpeg_state.mutex) return ZBA_MODULE_NOT_INITIALIZED;
+
+  if (type == HTTPD_WS_TYPE_TEXT)
+  {
+    // Replies (command output) can be too big to keep a buffer per client for.
+    if (len > ZBA_MJPEG_WS_REPLY_MAX) return ZBA_MJPEG_SEND_FAILED;
+    if (NULL == (reply = malloc(len + 4))) return ZBA_OUT_OF_MEMORY;
+    reply_len = zba_mjpeg_ws_header(reply, type, len);
+    memcpy(reply + reply_len, payload, len);
+    reply_len += len;
+  }
+  else if (len > ZBA_MJPEG_WS_MESSAGE_MAX)
+  {
+    return ZBA_MJPEG_SEND_FAILED;
+  }
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_t* client = zba_mjpeg_find_client(fd);
+  if (client && client->websocket && reply && (!client->reply))
+  {
+    client->reply     = reply;
+    client->reply_len = reply_len;
+    reply             = NULL;
+    result            = ZBA_OK;
+  }
+  else if (client && client->websocket && (type != HTTPD_WS_TYPE_TEXT) && (!client->message_len))
+  {
+    size_t header_len = zba_mjpeg_ws_header(client->message, type, len);
+    memcpy(client->message + header_len, payload, len);
+    client->message_len = header_len + len;
+    result              = ZBA_OK;
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  free(reply);
+
+  if (ZBA_OK == result)
+  {
+    xTaskNotifyGive(mjpeg_state.task);
+  }
+  return result;
+}
+
+void zba_mjpeg_on_close(httpd_handle_t server, int fd)
+{
+  bool ours = false;
+  (void)server;
+
+  if (mjpeg_state.mutex)
+  {
+    ZBA_LOCK(mjpeg_state.mutex);
+    for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+    {
+      zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+      if ((client->fd == fd) && (!client->closed))
+      {
+        client->closed = true;
+        ours           = true;
+        break;
+      }
+    }
+    ZBA_UNLOCK(mjpeg_state.mutex);
+  }
+
+  // The streaming task may be mid-send on ours. Leave the fd open until it's done,
+  // so the number can't be reused underneath it.
+  if (!ours)
+  {
+    close(fd);
+  }
+}
+
+zba_err_t zba_mjpeg_add_listener(zba_mjpeg_listener_t listener, void* context)
+{
+  zba_err_t result = ZBA_MJPEG_TOO_MANY_CLIENTS;
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_mjpeg)) return ZBA_MODULE_NOT_INITIALIZED;
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  for (int i = 0; i < ZBA_MJPEG_MAX_LISTENERS; ++i)
+  {
+    zba_mjpeg_listener_slot_t* slot = &mjpeg_state.listeners[i];
+    if (!slot->listener)
+    {
+      slot->listener = listener;
+      slot->context  = context;
+      mjpeg_state.listener_count++;
+      result = ZBA_OK;
+      break;
+    }
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  zba_mjpeg_wake_capture();
+  return result;
+}
+
+void zba_mjpeg_remove_listener(zba_mjpeg_listener_t listener, void* context)
+{
+  if (!mjpeg_state.mutex) return;
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  for (int i = 0; i < ZBA_MJPEG_MAX_LISTENERS; ++i)
+  {
+    zba_mjpeg_listener_slot_t* slot = &mjpeg_state.listeners[i];
+    if ((slot->listener == listener) && (slot->context == context))
+    {
+      slot->listener = NULL;
+      slot->context  = NULL;
+      mjpeg_state.listener_count--;
+      break;
+    }
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+}
+
+/// A zba_mjpeg_grab_frame() waiting on the capture
+typedef struct
+{
+  SemaphoreHandle_t done;  ///< Given once frame is set
+  int64_t after;           ///< Only frames the sensor started after this (usec) will do
+  zba_frame_t* frame;      ///< Reference to the frame, NULL until there is one
+} zba_mjpeg_grab_t;
+
+/// Listener for zba_mjpeg_grab_frame(). Takes the first fresh frame.
+static void zba_mjpeg_grab_listener(zba_frame_t* frame, void* context)
+{
+  zba_mjpeg_grab_t* grab = (zba_mjpeg_grab_t*)context;
+  // Frames from before the request may have sat in the driver a while.
+  if (grab->frame || (zba_mjpeg_frame_start(frame) < grab->after)) return;
+  grab->frame = zba_frame_ref(frame);
+  xSemaphoreGive(grab->done);
+}
+
+zba_frame_t* zba_mjpeg_grab_frame(uint32_t timeout_ms)
+{
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_mjpeg))
+  {
+    // Nobody's streaming, so the camera's free.
+    return zba_camera_capture_frame();
+  }
+
+  zba_mjpeg_grab_t grab = {.done = xSemaphoreCreateBinary(), .after = zba_now(), .frame = NULL};
+  if (!grab.done) return NULL;
+  if (ZBA_OK == zba_mjpeg_add_listener(zba_mjpeg_grab_listener, &grab))
+  {
+    xSemaphoreTake(grab.done, pdMS_TO_TICKS(timeout_ms));
+    // Once this returns the listener's done with grab, frame or not.
+    zba_mjpeg_remove_listener(zba_mjpeg_grab_listener, &grab);
+  }
+  vSemaphoreDelete(grab.done);
+
+  // Don't keep one of the driver's few buffers from the streams while it's sent.
+  if (grab.frame && (grab.frame->source == ZBA_FRAME_DRIVER))
+  {
+    zba_frame_t* copy = zba_frame_copy(grab.frame);
+    if (copy)
+    {
+      zba_frame_release(grab.frame);
+      grab.frame = copy;
+    }
+  }
+  return grab.frame;
+}
+
+bool zba_mjpeg_get_client_stats(int index, zba_mjpeg_client_stats_t* stats)
+{
+  bool found = false;
+  if ((index < 0) || (index >= ZBA_MJPEG_MAX_CLIENTS) || (!mjpeg_state.mutex)) return false;
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_t* client = &mjpeg_state.clients[index];
+  if ((client->fd != ZBA_INVALID_FD) && client->ready)
+  {
+    *stats           = client->stats;
+    stats->fd        = client->fd;
+    stats->queued    = client->queued;
+    stats->websocket = client->websocket;
+    stats->preview   = client->preview;
+    found            = true;
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+  return found;
+}
+
+void zba_mjpeg_dump_clients(zba_print_fn print, void* context)
+{
+  zba_mjpeg_client_stats_t stats;
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    if (zba_mjpeg_get_client_stats(i, &stats))
+    {
+      print(context, "video %d: sent: %u dropped: %u bytes: %llu send: %ums queued: %d", stats.fd,
+            stats.frames_sent, stats.frames_dropped, stats.bytes_sent, stats.send_ms,
+            stats.queued);
+    }
+  }
+}
+
+/// Client is connected and wants frames. Call with the mutex held.
+static bool zba_mjpeg_client_live(const zba_mjpeg_client_t* client)
+{
+  return (client->fd != ZBA_INVALID_FD) && client->ready && (!client->failed) &&
+         (!client->closed);
+}
+
+/// Client's rate cap lets it have a frame now. Call with the mutex held.
+static bool zba_mjpeg_client_due(const zba_mjpeg_client_t* client, int64_t now)
+{
+  return (!client->min_interval) || (now - client->last_queued >= client->min_interval);
+}
+
+/// When a client next wants a new frame - now if its rate cap allows one, or never
+/// (INT64_MAX) while it's out of credit and waiting to ack. Call with the mutex held.
+static int64_t zba_mjpeg_client_next_due(const zba_mjpeg_client_t* client, int64_t now)
+{
+  if (client->websocket && client->window && !client->credits) return INT64_MAX;
+  if (zba_mjpeg_client_due(client, now)) return now;
+  return client->last_queued + client->min_interval;
+}
+
+/// Takes the oldest frame off a client's queue, and whether the sensor window already
+/// cropped it (windowed may be NULL). Call with the mutex held.
+static zba_frame_t* zba_mjpeg_pop_queued(zba_mjpeg_client_t* client, bool* windowed)
+{
+  zba_frame_t* frame = client->queue[0];
+  if (!client->queued) return NULL;
+  if (windowed)
+  {
+    *windowed = client->windowed[0];
+  }
+  client->queued--;
+  memmove(&client->queue[0], &client->queue[1], client->queued * sizeof(zba_frame_t*));
+  memmove(&client->windowed[0], &client->windowed[1], client->queued * sizeof(bool));
+  client->queue[client->queued]    = NULL;
+  client->windowed[client->queued] = false;
+  return frame;
+}
+
+/// Drops the oldest frame in a client's queue. Call with the mutex held.
+static void zba_mjpeg_drop_queued(zba_mjpeg_client_t* client)
+{
+  zba_frame_release(zba_mjpeg_pop_queued(client, NULL));
+}
+
+/// Client has a frame or message part way out. Sending task only.
+static bool zba_mjpeg_sending(const zba_mjpeg_client_t* client)
+{
+  return client->payload || client->sending_message;
+}
+
+/// Drops the frame or message a client is sending, if any. Sending task only.
+static void zba_mjpeg_release_payload(zba_mjpeg_client_t* client)
+{
+  if (client->frame)
+  {
+    zba_frame_release(client->frame);
+    client->frame = NULL;
+  }
+  if (client->converted)
+  {
+    free(client->converted);
+    client->converted = NULL;
+  }
+  if (client->reply_out)
+  {
+    free(client->reply_out);
+    client->reply_out = NULL;
+  }
+  client->payload         = NULL;
+  client->payload_len     = 0;
+  client->sending_message = false;
+}
+
+/// Gives up on a client after a failed send. httpd closes the session. Sending task only.
+static void zba_mjpeg_fail_client(zba_mjpeg_client_t* client)
+{
+  ZBA_LOG("Dropping video client %d", client->fd);
+  zba_metrics_inc(&send_errors_metric);
+  zba_mjpeg_release_payload(client);
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  while (client->queued)
+  {
+    zba_mjpeg_drop_queued(client);
+  }
+  client->busy   = false;
+  client->failed = true;
+  if (!client->closed)
+  {
+    httpd_sess_trigger_close(client->server, client->fd);
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+}
+
+/// Finishes the frame a client was sending. Sending task only.
+static void zba_mjpeg_finish_frame(zba_mjpeg_client_t* client)
+{
+  size_t total       = client->header_len + client->payload_len;
+  uint32_t send_usec = (uint32_t)(zba_now() - client->send_start);
+  zba_mjpeg_release_payload(client);
+
+  // Streaming sessions never make another request, so keep them fresh in httpd's LRU.
+  // Otherwise they'd be the first to go when a page load needs a socket.
+  httpd_sess_update_lru_counter(client->server, client->fd);
+
+  zba_metrics_inc(&frames_sent_metric);
+  zba_metrics_add(&bytes_sent_metric, total);
+  zba_metrics_observe(&send_usec_metric, send_usec);
+  zba_trace_frame_send_end(&client->timestamp);
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  zba_mjpeg_client_stats_t* stats = &client->stats;
+  if (stats->frames_sent)
+  {
+    stats->send_ms =
+        (stats->send_ms * (kMjpegSendMsWeight - 1) + send_usec / 1000) / kMjpegSendMsWeight;
+  }
+  else
+  {
+    stats->send_ms = send_usec / 1000;
+  }
+  stats->frames_sent++;
+  stats->bytes_sent += total;
+  client->busy = false;
+  ZBA_UNLOCK(mjpeg_state.mutex);
+}
+
+/// Queues a frame to every client and hands it to the listeners. When a client's queue
+/// is full the oldest frame goes, so slow clients skip frames rather than fall behind.
+/// Preview clients get preview instead, and are skipped this round if there isn't one.
+/// now is when the capture task decided who was due, so the same clients count as due
+/// here. A frame from a windowed sensor only goes to the client it's windowed for - anyone
+/// who turned up since gets the next one. Capture task only, with the mutex held.
+static void zba_mjpeg_queue_frame(zba_frame_t* frame, zba_frame_t* preview, int64_t now)
+{
+  zba_frame_t* copy                = NULL;
+  const zba_mjpeg_window_t* window = &mjpeg_state.window;
+  for (int i = 0; i < ZBA_MJPEG_MAX_LISTENERS; ++i)
+  {
+    zba_mjpeg_listener_slot_t* slot = &mjpeg_state.listeners[i];
+    if (slot->listener && !window->active)
+    {
+      slot->listener(frame, slot->context);
+    }
+  }
+
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if (!zba_mjpeg_client_live(client)) continue;
+    bool windowed = window->active && (window->client == i);
+    if (window->active && !windowed) continue;
+
+    if (!zba_mjpeg_client_due(client, now)) continue;
+    // Never the full frame - that's what the sub-stream is there to avoid.
+    if (client->preview && !preview) continue;
+
+    bool replace = (client->queued == ZBA_MJPEG_QUEUE_DEPTH);
+    if (client->websocket)
+    {
+      // WebSocket clients set their own pace.
+      if (client->window && !client->credits)
+      {
+        // Out of credit - it can have a fresher frame in place of a queued one, no more.
+        if (!client->queued) continue;
+        replace = true;
+      }
+    }
+
+    // A client still sending an older frame is behind. Give it a copy, so it
+    // doesn't pin one of the driver's few buffers while it catches up.
+    zba_frame_t* queued = client->preview ? preview : frame;
+    if (client->busy && (queued == frame) && (frame->source == ZBA_FRAME_DRIVER))
+    {
+      if (!copy)
+      {
+        copy = zba_frame_copy(frame);
+      }
+      queued = copy;
+    }
+
+    if (replace || (!queued))
+    {
+      client->stats.frames_dropped++;
+      zba_metrics_inc(&frames_dropped_metric);
+      if (!queued) continue;
+      zba_mjpeg_drop_queued(client);
+    }
+    else if (client->websocket && client->window)
+    {
+      client->credits--;
+    }
+    client->windowed[client->queued] = windowed;
+    client->queue[client->queued++]  = zba_frame_ref(queued);
+    client->last_queued              = now;
+  }
+
+  if (copy)
+  {
+    zba_frame_release(copy);
+  }
+}
+
+/// Frees closed client slots and hands idle clients their next frame.
+/// Sending task only, with the mutex held.
+static void zba_mjpeg_update_clients()
+{
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if (client->fd == ZBA_INVALID_FD) continue;
+
+    if (client->closed)
+    {
+      // The capture task takes down any window it had before the next capture.
+      ZBA_LOG("Video client %d closed", client->fd);
+      while (client->queued)
+      {
+        zba_mjpeg_drop_queued(client);
+      }
+      zba_mjpeg_release_payload(client);
+      free(client->reply);
+      close(client->fd);
+      zba_mjpeg_reset_client(client);
+      continue;
+    }
+
+    if (zba_mjpeg_client_live(client))
+    {
+      if ((!client->busy) && client->queued)
+      {
+        client->frame = zba_mjpeg_pop_queued(client, &client->frame_windowed);
+        client->busy  = true;
+      }
+
+      if (client->message_len && !zba_mjpeg_sending(client))
+      {
+        // Messages go out between frames, header only.
+        memcpy(client->header, client->message, client->message_len);
+        client->header_len      = client->message_len;
+        client->message_len     = 0;
+        client->sent            = 0;
+        client->send_start      = zba_now();
+        client->sending_message = true;
+      }
+      else if (client->reply && !zba_mjpeg_sending(client))
+      {
+        // Replies are too big for header, so they go as the payload.
+        client->reply_out       = client->reply;
+        client->payload         = (const uint8_t*)client->reply;
+        client->payload_len     = client->reply_len;
+        client->reply           = NULL;
+        client->reply_len       = 0;
+        client->header_len      = 0;
+        client->sent            = 0;
+        client->send_start      = zba_now();
+        client->sending_message = true;
+      }
+    }
+  }
+}
+
+/// Windows the sensor for a lone ROI client, and takes the window down once there's
+/// anyone else. The window crops every frame, listeners' too, so it's only used with a
+/// single viewer. Capture task only, between captures.
+static void zba_mjpeg_update_window()
+{
+  zba_mjpeg_window_t* window = &mjpeg_state.window;
+  int want                   = -1;
+  int active                 = 0;
+  zba_roi_t roi              = {0};
+
+  ZBA_LOCK(mjpeg_state.mutex);
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if (!zba_mjpeg_client_live(client)) continue;
+    want = client->has_roi ? i : -1;
+    roi  = client->roi;
+    active++;
+  }
+  if ((active != 1) || mjpeg_state.listener_count)
+  {
+    want = -1;
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+
+  // A new client in the same slot with the same ROI can keep the window.
+  if ((window->client >= 0) &&
+      ((want != window->client) || memcmp(&roi, &window->roi, sizeof(roi))))
+  {
+    if (window->active)
+    {
+      zba_camera_set_roi(NULL);
+      window->since = zba_now();
+    }
+    window->client = -1;
+    window->active = false;
+  }
+  if ((want >= 0) && (window->client < 0))
+  {
+    window->client = want;
+    window->roi    = roi;
+    window->active = (ZBA_OK == zba_camera_set_roi(&roi));
+    window->since  = zba_now();
+  }
+}
+
+static void zba_mjpeg_put32(uint8_t* p, uint32_t value)
+{
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+/// Builds a WebSocket client's message header - frame header, then the metadata
+/// described at ZBA_MJPEG_WS_META_LEN. Sending task only.
+static void zba_mjpeg_ws_frame_header(zba_mjpeg_client_t* client, int64_t frame_num, bool jpeg)
+{
+  size_t ws_len = zba_mjpeg_ws_header(client->header, HTTPD_WS_TYPE_BINARY,
+                                      ZBA_MJPEG_WS_META_LEN + client->payload_len);
+  uint8_t* meta = (uint8_t*)client->header + ws_len;
+  meta[0]       = 'Z';
+  meta[1]       = 'F';
+  meta[2]       = 1;
+  meta[3]       = jpeg ? 0 : 1;
+  zba_mjpeg_put32(meta + 4, (uint32_t)frame_num);
+  zba_mjpeg_put32(meta + 8, (uint32_t)client->timestamp.tv_sec);
+  zba_mjpeg_put32(meta + 12, (uint32_t)client->timestamp.tv_usec);
+  zba_mjpeg_put32(meta + 16, (uint32_t)client->payload_len);
+  client->header_len = ws_len + ZBA_MJPEG_WS_META_LEN;
+}
+
+/// Gets a client's new frame ready to send - crops or converts it as needed
+/// and builds its part header. Sending task only.
+static void zba_mjpeg_start_frame(zba_mjpeg_client_t* client)
+{
+  if (client->has_roi && !client->frame_windowed)
+  {
+    client->frame = zba_camera_crop_frame(client->frame, &client->roi);
+  }
+
+  camera_fb_t* fb     = client->frame->fb;
+  int64_t frame_num   = client->frame->frame_num;
+  bool jpeg           = (fb->format == PIXFORMAT_JPEG);
+  const char* type    = "image/jpeg";
+  client->timestamp   = fb->timestamp;
+  client->payload     = fb->buf;
+  client->payload_len = fb->len;
+  client->sent        = 0;
+  client->send_start  = zba_now();
+  if (!jpeg)
+  {
+    // Try converting non-jpegs to bitmaps, and give the frame back now.
+    size_t bmp_len = 0;
+    type           = "image/x-windows-bmp";
+    if (!frame2bmp(fb, &client->converted, &bmp_len))
+    {
+      ZBA_ERR("Failed converting frame to bitmap");
+      zba_mjpeg_release_payload(client);
+      ZBA_LOCK(mjpeg_state.mutex);
+      client->busy = false;
+      ZBA_UNLOCK(mjpeg_state.mutex);
+      return;
+    }
+    client->payload     = client->converted;
+    client->payload_len = bmp_len;
+    zba_frame_release(client->frame);
+    client->frame = NULL;
+  }
+
+  if (client->websocket)
+  {
+    zba_mjpeg_ws_frame_header(client, frame_num, jpeg);
+  }
+  else
+  {
+    client->header_len =
+        snprintf(client->header, sizeof(client->header),
+                 "%sContent-Type: %s\r\nContent-Length: %u\r\nX-Timestamp: %ld.%06ld\r\n\r\n",
+                 kBoundary, type, client->payload_len, client->timestamp.tv_sec,
+                 client->timestamp.tv_usec);
+  }
+  zba_trace_frame_send_start(&client->timestamp);
+}
+
+/// Sends as much of the current frame as a client's socket will take without blocking.
+/// Boundary/part header and image go out in one gathered write, so small frames
+/// cost one call and usually one segment instead of three. It's MSG_DONTWAIT rather
+/// than a non-blocking socket since httpd still reads WebSocket clients' sockets.
+static void zba_mjpeg_send_some(zba_mjpeg_client_t* client)
+{
+  size_t total = client->header_len + client->payload_len;
+  while (client->sent < total)
+  {
+    struct iovec iov[2];
+    int iov_count = 0;
+    if (client->sent < client->header_len)
+    {
+      iov[iov_count].iov_base = client->header + client->sent;
+      iov[iov_count].iov_len  = client->header_len - client->sent;
+      iov_count++;
+    }
+    size_t payload_sent = ZBA_MAX(client->sent, client->header_len) - client->header_len;
+    if (payload_sent < client->payload_len)
+    {
+      iov[iov_count].iov_base = (void*)(client->payload + payload_sent);
+      iov[iov_count].iov_len  = client->payload_len - payload_sent;
+      iov_count++;
+    }
+
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_count};
+    ssize_t written   = lwip_sendmsg(client->fd, &msg, MSG_DONTWAIT);
+    if (written < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+      {
+        zba_mjpeg_fail_client(client);
+      }
+      return;
+    }
+    client->sent += written;
+  }
+
+  if (client->sending_message)
+  {
+    // Only a reply has a payload, and it's the reply's own.
+    if (client->reply_out)
+    {
+      free(client->reply_out);
+      client->reply_out   = NULL;
+      client->payload     = NULL;
+      client->payload_len = 0;
+    }
+    client->sending_message = false;
+    return;
+  }
+  zba_mjpeg_finish_frame(client);
+}
+
+/// Waits up to kMjpegPollMs for sockets with a frame to send to become writable and
+/// sends what they'll take. Returns false if nobody had anything to send.
+/// Clients that can't take a frame within kMjpegSendTimeout are dropped.
+static bool zba_mjpeg_send_frames()
+{
+  fd_set writable;
+  int max_fd             = -1;
+  struct timeval timeout = {.tv_sec = 0, .tv_usec = kMjpegPollMs * 1000};
+  int64_t now            = zba_now();
+
+  FD_ZERO(&writable);
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if (!zba_mjpeg_sending(client)) continue;
+    if (now - client->send_start > kMjpegSendTimeout)
+    {
+      zba_mjpeg_fail_client(client);
+      continue;
+    }
+    FD_SET(client->fd, &writable);
+    if (client->fd > max_fd) max_fd = client->fd;
+  }
+  if (max_fd < 0) return false;
+
+  if (select(max_fd + 1, NULL, &writable, NULL, &timeout) <= 0) return true;
+
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    if (zba_mjpeg_sending(client) && FD_ISSET(client->fd, &writable))
+    {
+      zba_mjpeg_send_some(client);
+    }
+  }
+  return true;
+}
+
+/// Sending task - writes queued frames to every client
+static void zba_mjpeg_task(void* context)
+{
+  ZBA_LOG("Entering mjpeg task.");
+  (void)context;
+
+  while (!mjpeg_state.exiting)
+  {
+    ZBA_LOCK(mjpeg_state.mutex);
+    zba_mjpeg_update_clients();
+    ZBA_UNLOCK(mjpeg_state.mutex);
+
+    // Slots with a frame out can't be freed until we're done with them (see
+    // zba_mjpeg_on_close), so the sending itself doesn't need the lock.
+    for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+    {
+      zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+      if (client->frame && !zba_mjpeg_sending(client))
+      {
+        zba_mjpeg_start_frame(client);
+      }
+    }
+
+    if (!zba_mjpeg_send_frames())
+    {
+      // Nothing to send - wait for the capture task to queue something.
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kMjpegIdleDelayMs));
+    }
+  }
+
+  // Close the sessions httpd is done with. Anything else is still httpd's to close,
+  // and zba_mjpeg_on_close will just close it once we're gone.
+  ZBA_LOCK(mjpeg_state.mutex);
+  for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+  {
+    zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+    while (client->queued)
+    {
+      zba_mjpeg_drop_queued(client);
+    }
+    zba_mjpeg_release_payload(client);
+    free(client->reply);
+    if ((client->fd != ZBA_INVALID_FD) && client->closed)
+    {
+      close(client->fd);
+    }
+    zba_mjpeg_reset_client(client);
+  }
+  ZBA_UNLOCK(mjpeg_state.mutex);
+
+  ZBA_LOG("Exiting mjpeg task");
+  vTaskDelete(mjpeg_state.task);
+}
+
+/// Capture task - grabs frames while anyone's watching and queues them to each client
+/// and listener
+static void zba_mjpeg_capture_task(void* context)
+{
+  ZBA_LOG("Entering mjpeg capture task.");
+  (void)context;
+
+  while (!mjpeg_state.exiting)
+  {
+    // Listeners take every frame. Clients say when they next want one.
+    ZBA_LOCK(mjpeg_state.mutex);
+    int active        = mjpeg_state.listener_count;
+    bool want_preview = false;
+    int64_t now       = zba_now();
+    int64_t next_due  = active ? now : INT64_MAX;
+    for (int i = 0; i < ZBA_MJPEG_MAX_CLIENTS; ++i)
+    {
+      zba_mjpeg_client_t* client = &mjpeg_state.clients[i];
+      if (!zba_mjpeg_client_live(client)) continue;
+      int64_t due = zba_mjpeg_client_next_due(client, now);
+      next_due    = ZBA_MIN(next_due, due);
+      if (client->preview && (due <= now))
+      {
+        want_preview = true;
+      }
+      active++;
+    }
+    ZBA_UNLOCK(mjpeg_state.mutex);
+
+    if (next_due > now)
+    {
+      // Nobody's due a frame yet, so don't capture one just to drop it. Sleep until
+      // someone is - new clients, acks and rate changes wake us sooner.
+      int64_t wait_ms = kMjpegIdleDelayMs;
+      if (next_due - now < wait_ms * 1000)
+      {
+        wait_ms = (next_due - now + 999) / 1000;
+      }
+      TickType_t ticks = pdMS_TO_TICKS(wait_ms);
+      ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+      continue;
+    }
+
+    // check for res change.
+    if (zba_camera_need_restart())
+    {
+      zba_camera_deinit();
+      zba_camera_init();
+      // Restarting the camera dropped any window.
+      mjpeg_state.window.client = -1;
+      mjpeg_state.window.active = false;
+      mjpeg_state.window.since  = zba_now();
+      continue;
+    }
+
+    zba_mjpeg_update_window();
+
+    zba_frame_t* frame = zba_camera_capture_frame();
+    if (!frame)
+    {
+      ZBA_LOG("Failed to get frame.");
+      vTaskDelay(5);
+      continue;
+    }
+    if (zba_mjpeg_frame_start(frame) < mjpeg_state.window.since)
+    {
+      // Started before the window changed, so it's cropped for the old one (or isn't).
+      zba_camera_release_frame(frame);
+      continue;
+    }
+
+    // Scale the preview once for every preview client, and only when one's due, so
+    // the decode and encode run at the preview rate rather than the capture rate.
+    zba_frame_t* preview = NULL;
+    if (want_preview)
+    {
+      int64_t start = zba_now();
+      preview       = zba_camera_scale_frame(frame, ZBA_MJPEG_PREVIEW_WIDTH);
+      zba_metrics_observe(&preview_usec_metric, (uint32_t)(zba_now() - start));
+    }
+
+    // Clients and listeners hold their own references, so the capture one can go now.
+    ZBA_LOCK(mjpeg_state.mutex);
+    zba_mjpeg_queue_frame(frame, preview, now);
+    ZBA_UNLOCK(mjpeg_state.mutex);
+    zba_frame_release(preview);
+    zba_camera_release_frame(frame);
+    xTaskNotifyGive(mjpeg_state.task);
+  }
+
+  if (mjpeg_state.window.active)
+  {
+    zba_camera_set_roi(NULL);
+    mjpeg_state.window.active = false;
+  }
+  mjpeg_state.window.client = -1;
+  ZBA_LOG("Exiting mjpeg capture task");
+  vTaskDelete(mjpeg_state.capture_task);
+}
@@ -0,0 +1,135 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_MJPEG_H_
+#define ZEBRAL_ESP32CAM_ZBA_MJPEG_H_
+
+#include <esp_http_server.h>
+#include "zba_camera.h"
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  DECLARE_ZBA_MODULE(zba_mjpeg);
+
+/// Most simultaneous video clients
+#define ZBA_MJPEG_MAX_CLIENTS 4
+/// Frames a client can have waiting behind the one it's sending (1-2). When it's
+/// full the oldest is dropped, so a slow client skips frames instead of lagging.
+#define ZBA_MJPEG_QUEUE_DEPTH 1
+/// Most frame listeners (other streamers and one-off grabs sharing the capture)
+#define ZBA_MJPEG_MAX_LISTENERS 4
+/// Frames a WebSocket client can have unacked until it says otherwise
+#define ZBA_MJPEG_WS_WINDOW 2
+/// Longest control message that can be queued to a WebSocket client (pongs)
+#define ZBA_MJPEG_WS_MESSAGE_MAX 125
+/// Longest text reply that can be queued to a WebSocket client
+#define ZBA_MJPEG_WS_REPLY_MAX 1536
+/// Bytes of metadata in front of the image in each WebSocket frame message. Big-endian:
+///   0  'Z' 'F'
+///   2  version (1)
+///   3  format (0 JPEG, 1 BMP)
+///   4  frame number
+///   8  timestamp seconds
+///   12 timestamp microseconds
+///   16 image bytes
+#define ZBA_MJPEG_WS_META_LEN 20
+/// Widest preview sub-stream frame. The decoder only scales by 1/2, 1/4 or 1/8, so
+/// it can be under this - or over it for sensor resolutions past 8x.
+#define ZBA_MJPEG_PREVIEW_WIDTH 320
+/// Most frames a second a preview client gets
+#define ZBA_MJPEG_PREVIEW_FPS 5
+
+  /// How a client wants its stream
+  typedef struct
+  {
+    bool has_roi;   ///< Crop to roi
+    zba_roi_t roi;  ///< Region of interest
+    bool preview;   ///< Low res preview sub-stream, rate capped (ignores roi)
+    uint32_t fps;   ///< Frame rate cap, 0 for the config default (zba_config_get_video_fps)
+  } zba_mjpeg_stream_opts_t;
+
+  /// Per-client stats
+  typedef struct
+  {
+    int fd;                   ///< Client socket
+    uint32_t frames_sent;     ///< Frames sent
+    uint32_t frames_dropped;  ///< Frames skipped because the client was behind
+    uint64_t bytes_sent;      ///< Bytes sent
+    uint32_t send_ms;         ///< Smoothed time to send a frame - once frames are bigger than
+                              ///< the socket's send buffer this is mostly round trips (RTT)
+    int queued;               ///< Frames waiting to send
+    bool websocket;           ///< Watching over /ws/video rather than /video
+    bool preview;             ///< Watching the preview sub-stream
+    uint32_t fps;             ///< Frame rate cap, 0 if uncapped
+  } zba_mjpeg_client_stats_t;
+
+  /// Gets each captured frame. Called from the capture task with the streaming lock
+  /// held, so take a reference with zba_frame_ref() and hand it off rather than work on it.
+  typedef void (*zba_mjpeg_listener_t)(zba_frame_t* frame, void* context);
+
+  /// Starts the streaming tasks.
+  /// Video clients are handed off from httpd and served from one sending task, so a
+  /// viewer doesn't tie up an httpd worker and several can watch at once. A separate
+  /// capture task queues frames to each client, so a slow one can't hold up the rest.
+  /// Captures are timed to the clients' frame rate caps - when nobody's due a frame the
+  /// capture task sleeps rather than capturing one to throw away.
+  zba_err_t zba_mjpeg_init();
+  zba_err_t zba_mjpeg_deinit();
+
+  /// Takes over a /video request's socket. Sends the response header and queues the
+  /// client for frames. httpd keeps owning the session, so its close_fn must call
+  /// zba_mjpeg_on_close(). opts may be NULL for the full frame.
+  zba_err_t zba_mjpeg_add_client(httpd_req_t* req, const zba_mjpeg_stream_opts_t* opts);
+
+  /// Takes over a /ws/video socket once httpd has done the handshake. Frames go out as
+  /// binary messages, ZBA_MJPEG_WS_META_LEN bytes of metadata then the image, and no
+  /// more than ZBA_MJPEG_WS_WINDOW unacked. httpd keeps reading the socket, and hands
+  /// messages from the client back here with the calls below.
+  zba_err_t zba_mjpeg_add_ws_client(httpd_req_t* req, const zba_mjpeg_stream_opts_t* opts);
+
+  /// A WebSocket client is done with this many frames, so it can be sent that many more
+  void zba_mjpeg_ws_ack(int fd, uint32_t frames);
+
+  /// Sets how many frames a WebSocket client can have unacked. 0 turns acks off, and it
+  /// gets frames as fast as it takes them, like an MJPEG client.
+  void zba_mjpeg_ws_set_window(int fd, uint32_t frames);
+
+  /// Caps a WebSocket client's frame rate. 0 for every frame (or ZBA_MJPEG_PREVIEW_FPS
+  /// for previews).
+  void zba_mjpeg_ws_set_rate(int fd, uint32_t fps);
+
+  /// Queues a message to a WebSocket client - text up to ZBA_MJPEG_WS_REPLY_MAX, anything
+  /// else up to ZBA_MJPEG_WS_MESSAGE_MAX. It goes out between frames, since only the
+  /// streaming task writes to the socket. One of each can wait at a time.
+  zba_err_t zba_mjpeg_ws_send(int fd, httpd_ws_type_t type, const char* payload, size_t len);
+
+  /// Adds a frame listener, so other streamers share the capture instead of fighting
+  /// over the camera. Frames are captured while there are clients or listeners.
+  zba_err_t zba_mjpeg_add_listener(zba_mjpeg_listener_t listener, void* context);
+
+  /// Removes a listener. It won't be called again once this returns.
+  void zba_mjpeg_remove_listener(zba_mjpeg_listener_t listener, void* context);
+
+  /// Gets the next frame the sensor starts after this call, from the shared capture -
+  /// for one-off grabs (/image, serial frame pulls) that mustn't touch the camera while
+  /// it's streaming. Waits up to timeout_ms. Captures directly if streaming isn't up.
+  /// Returns NULL if there's no frame in time; release the frame with zba_frame_release().
+  zba_frame_t* zba_mjpeg_grab_frame(uint32_t timeout_ms);
+
+  /// Gets stats for client slot index (0 to ZBA_MJPEG_MAX_CLIENTS-1).
+  /// Returns false if there's no client in that slot.
+  bool zba_mjpeg_get_client_stats(int index, zba_mjpeg_client_stats_t* stats);
+
+  /// Logs per-client stats
+  void zba_mjpeg_dump_clients(zba_print_fn print, void* context);
+
+  /// Session close hook for httpd. Closes fd now if it isn't one of ours, otherwise
+  /// the streaming task closes it once it's done with it.
+  void zba_mjpeg_on_close(httpd_handle_t server, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_MJPEG_H_
@@ -0,0 +1,287 @@
+#include "zba_packet.h"
+#include <driver/uart.h>
+#include <esp_rom_crc.h>
+#include <string.h>
+#include <unistd.h>
+#include "zba_camera.h"
+#include "zba_mjpeg.h"
+
+DEFINE_ZBA_TAG;
+
+static const int64_t kPacketTimeoutMs = 500;      ///< Longest a packet can take to arrive
+static const uint32_t kMinBaud        = 9600;     ///< Slowest rate BAUD accepts
+static const uint32_t kMaxBaud        = 3000000;  ///< Fastest rate BAUD accepts
+static const uint32_t kFrameWaitMs    = 2000;     ///< Longest FRAME waits on the capture
+
+/// Replies are built here and go out in one write. Only the stream reader task sends.
+static uint8_t packet_tx[ZBA_PACKET_HEADER_SIZE + ZBA_PACKET_MAX_PAYLOAD + ZBA_PACKET_CRC_SIZE];
+/// Command output for a reply - what's left of a payload after the result
+static char packet_text[ZBA_PACKET_MAX_PAYLOAD - sizeof(uint32_t)];
+
+static uint16_t zba_packet_get16(const uint8_t *data)
+{
+  return (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+}
+
+static uint32_t zba_packet_get32(const uint8_t *data)
+{
+  return (uint32_t)zba_packet_get16(data) | ((uint32_t)zba_packet_get16(data + 2) << 16);
+}
+
+static void zba_packet_put16(uint8_t *data, uint16_t value)
+{
+  data[0] = value & 0xff;
+  data[1] = value >> 8;
+}
+
+static void zba_packet_put32(uint8_t *data, uint32_t value)
+{
+  zba_packet_put16(data, value & 0xffff);
+  zba_packet_put16(data + 2, value >> 16);
+}
+
+/// CRC of a packet in buffer - type through payload
+static uint32_t zba_packet_crc(const uint8_t *packet, size_t payload_len)
+{
+  return esp_rom_crc32_le(0, packet + 2, ZBA_PACKET_HEADER_SIZE - 2 + payload_len);
+}
+
+/// Sends a packet. The payload is head then data, so a reply's fields and bulk data
+/// don't have to be put together first.
+static zba_err_t zba_packet_send(int fd, uint8_t type, uint16_t id, const void *head,
+                                 size_t head_len, const void *data, size_t len)
+{
+  size_t payload_len = head_len + len;
+  if (payload_len > ZBA_PACKET_MAX_PAYLOAD) return ZBA_PACKET_TOO_LONG;
+
+  packet_tx[0] = ZBA_PACKET_SYNC0;
+  packet_tx[1] = ZBA_PACKET_SYNC1;
+  packet_tx[2] = type;
+  zba_packet_put16(packet_tx + 3, id);
+  zba_packet_put16(packet_tx + 5, payload_len);
+  if (head_len) memcpy(packet_tx + ZBA_PACKET_HEADER_SIZE, head, head_len);
+  if (len) memcpy(packet_tx + ZBA_PACKET_HEADER_SIZE + head_len, data, len);
+  zba_packet_put32(packet_tx + ZBA_PACKET_HEADER_SIZE + payload_len,
+                   zba_packet_crc(packet_tx, payload_len));
+
+  // The UART's shared with the log, and the VFS holds its lock for the whole of a write -
+  // so one write keeps log lines from landing in the middle of the packet.
+  const uint8_t *out = packet_tx;
+  size_t remaining   = ZBA_PACKET_HEADER_SIZE + payload_len + ZBA_PACKET_CRC_SIZE;
+  while (remaining > 0)
+  {
+    ssize_t written = write(fd, out, remaining);
+    if (written <= 0) return ZBA_PACKET_SEND_FAILED;
+    out += written;
+    remaining -= written;
+  }
+  return ZBA_OK;
+}
+
+bool zba_packet_is_start(uint8_t first_byte)
+{
+  return (first_byte == ZBA_PACKET_SYNC0);
+}
+
+size_t zba_packet_parse(zba_packet_parser_t *parser, const uint8_t *data, size_t len)
+{
+  static const uint8_t kSync[] = {ZBA_PACKET_SYNC0, ZBA_PACKET_SYNC1};
+  size_t used                  = 0;
+
+  while ((used < len) && (parser->state != ZBA_PACKET_READY))
+  {
+    if (parser->state == ZBA_PACKET_SKIPPING)
+    {
+      size_t count = ZBA_MIN(parser->remaining, len - used);
+      used += count;
+      parser->remaining -= count;
+      if (parser->remaining == 0)
+      {
+        parser->state = ZBA_PACKET_READY;
+      }
+      continue;
+    }
+
+    if (parser->state == ZBA_PACKET_IDLE)
+    {
+      parser->state    = ZBA_PACKET_READING;
+      parser->pos      = 0;
+      parser->start_ms = zba_now_ms();
+    }
+
+    // Header a byte at a time, checking the sync bytes so text isn't swallowed.
+    if (parser->pos < ZBA_PACKET_HEADER_SIZE)
+    {
+      if ((parser->pos < sizeof(kSync)) && (data[used] != kSync[parser->pos]))
+      {
+        parser->state = ZBA_PACKET_IDLE;
+        break;
+      }
+      parser->raw[parser->pos++] = data[used++];
+
+      if (parser->pos == ZBA_PACKET_HEADER_SIZE)
+      {
+        size_t payload_len = zba_packet_get16(parser->raw + 5);
+        if (payload_len > ZBA_PACKET_RX_SIZE)
+        {
+          // Skipped rather than dropped, so the payload isn't taken for text.
+          parser->state     = ZBA_PACKET_SKIPPING;
+          parser->remaining = payload_len + ZBA_PACKET_CRC_SIZE;
+        }
+      }
+      continue;
+    }
+
+    // Then the payload and CRC in bulk.
+    size_t need  = ZBA_PACKET_HEADER_SIZE + zba_packet_get16(parser->raw + 5) +
+                  ZBA_PACKET_CRC_SIZE - parser->pos;
+    size_t count = ZBA_MIN(need, len - used);
+    memcpy(parser->raw + parser->pos, data + used, count);
+    parser->pos += count;
+    used += count;
+    if (count == need)
+    {
+      parser->state = ZBA_PACKET_READY;
+    }
+  }
+  return used;
+}
+
+void zba_packet_expire(zba_packet_parser_t *parser)
+{
+  if ((parser->state == ZBA_PACKET_READING) || (parser->state == ZBA_PACKET_SKIPPING))
+  {
+    if (zba_now_ms() - parser->start_ms > kPacketTimeoutMs)
+    {
+      ZBA_ERR("Packet timed out after %u bytes.", parser->pos);
+      parser->state = ZBA_PACKET_IDLE;
+    }
+  }
+}
+
+/// Runs a text command, with its output going in the reply rather than on the stream
+static zba_err_t zba_packet_command(int fd, uint16_t id, const uint8_t *payload, size_t len,
+                                    zba_cmd_stream_t *cmd_stream)
+{
+  uint8_t head[4];
+  zba_cmd_stream_t reply_stream;
+  if (len >= sizeof(cmd_stream->buffer)) return ZBA_PACKET_TOO_LONG;
+
+  // Output goes to a stream of its own, with room for as much as a reply holds. It's the
+  // serial stream otherwise - logged in (or out) as that is, and logins carry back to it.
+  zba_commands_stream_init_text(&reply_stream, packet_text, sizeof(packet_text));
+  reply_stream.fd     = cmd_stream->fd;
+  reply_stream.authed = cmd_stream->authed;
+  memcpy(reply_stream.buffer, payload, len);
+  reply_stream.buffer[len] = 0;
+
+  zba_err_t result   = zba_commands_process(reply_stream.buffer, &reply_stream);
+  cmd_stream->authed = reply_stream.authed;
+  zba_packet_put32(head, result);
+  return zba_packet_send(fd, ZBA_PACKET_COMMAND | ZBA_PACKET_REPLY, id, head, sizeof(head),
+                         packet_text, reply_stream.out.len);
+}
+
+/// Sends the next frame from the shared capture - its size, then the image in pieces
+static zba_err_t zba_packet_frame(int fd, uint16_t id, zba_cmd_stream_t *cmd_stream)
+{
+  uint8_t info[9];
+  uint8_t head[4];
+  size_t offset;
+  size_t count;
+
+  if (!cmd_stream->authed) return ZBA_CONFIG_NOT_AUTHED;
+
+  // Streams own the camera, so this takes a frame from their capture.
+  zba_frame_t *frame = zba_mjpeg_grab_frame(kFrameWaitMs);
+  if (!frame) return ZBA_PACKET_NO_FRAME;
+
+  camera_fb_t *fb = frame->fb;
+  zba_packet_put32(info, fb->len);
+  zba_packet_put16(info + 4, fb->width);
+  zba_packet_put16(info + 6, fb->height);
+  info[8] = fb->format;
+  zba_err_t result =
+      zba_packet_send(fd, ZBA_PACKET_FRAME | ZBA_PACKET_REPLY, id, info, sizeof(info), NULL, 0);
+
+  for (offset = 0; (ZBA_OK == result) && (offset < fb->len); offset += count)
+  {
+    count = ZBA_MIN(fb->len - offset, ZBA_PACKET_MAX_PAYLOAD - sizeof(head));
+    zba_packet_put32(head, offset);
+    result = zba_packet_send(fd, ZBA_PACKET_FRAME_DATA, id, head, sizeof(head), fb->buf + offset,
+                             count);
+  }
+
+  zba_frame_release(frame);
+  return result;
+}
+
+/// Changes the baud rate, once the reply's gone out at the old one
+static zba_err_t zba_packet_baud(int fd, uint16_t id, const uint8_t *payload, size_t len,
+                                 zba_cmd_stream_t *cmd_stream)
+{
+  if (!cmd_stream->authed) return ZBA_CONFIG_NOT_AUTHED;
+  if (len != sizeof(uint32_t)) return ZBA_INVALID_ARG;
+
+  uint32_t baud = zba_packet_get32(payload);
+  if ((baud < kMinBaud) || (baud > kMaxBaud)) return ZBA_INVALID_ARG;
+
+  zba_err_t result =
+      zba_packet_send(fd, ZBA_PACKET_BAUD | ZBA_PACKET_REPLY, id, payload, len, NULL, 0);
+  if (ZBA_OK != result) return result;
+
+  fsync(fd);
+  if (ESP_OK != uart_set_baudrate(UART_NUM_0, baud)) return ZBA_UTIL_UART_ERROR;
+  ZBA_LOG("Serial now at %u baud.", baud);
+  return ZBA_OK;
+}
+
+void zba_packet_handle(zba_packet_parser_t *parser, int fd, zba_cmd_stream_t *cmd_stream)
+{
+  uint8_t type     = parser->raw[2];
+  uint16_t id      = zba_packet_get16(parser->raw + 3);
+  size_t len       = zba_packet_get16(parser->raw + 5);
+  uint8_t *payload = parser->raw + ZBA_PACKET_HEADER_SIZE;
+  zba_err_t result = ZBA_OK;
+
+  parser->state = ZBA_PACKET_IDLE;
+
+  if (len > ZBA_PACKET_RX_SIZE)
+  {
+    result = ZBA_PACKET_TOO_LONG;
+  }
+  else if (zba_packet_get32(payload + len) != zba_packet_crc(parser->raw, len))
+  {
+    result = ZBA_PACKET_BAD_CRC;
+  }
+  else
+  {
+    switch (type)
+    {
+      case ZBA_PACKET_PING:
+        result =
+            zba_packet_send(fd, ZBA_PACKET_PING | ZBA_PACKET_REPLY, id, payload, len, NULL, 0);
+        break;
+      case ZBA_PACKET_COMMAND:
+        result = zba_packet_command(fd, id, payload, len, cmd_stream);
+        break;
+      case ZBA_PACKET_FRAME:
+        result = zba_packet_frame(fd, id, cmd_stream);
+        break;
+      case ZBA_PACKET_BAUD:
+        result = zba_packet_baud(fd, id, payload, len, cmd_stream);
+        break;
+      default:
+        result = ZBA_PACKET_UNKNOWN_TYPE;
+        break;
+    }
+  }
+
+  if (ZBA_OK != result)
+  {
+    uint8_t error[4];
+    ZBA_ERR("Packet 0x%02X (id %u) failed: 0x%X", type, id, result);
+    zba_packet_put32(error, result);
+    zba_packet_send(fd, ZBA_PACKET_ERR, id, error, sizeof(error), NULL, 0);
+  }
+}
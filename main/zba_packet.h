@@ -0,0 +1,86 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_PACKET_H_
+#define ZEBRAL_ESP32CAM_ZBA_PACKET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "zba_commands.h"
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Binary packets on the serial stream, alongside text commands.
+///
+/// A packet is, little-endian:
+///   sync     2  0xA5 0x5A
+///   type     1  zba_packet_type_t
+///   id       2  request id - replies carry the id of their request
+///   len      2  payload bytes
+///   payload  len
+///   crc      4  CRC-32 (zlib's) of type through payload
+///
+/// 0xA5 can't start a text command, so a packet can follow any complete line.
+/// tools/zba_serial.py is the host side.
+#define ZBA_PACKET_SYNC0       0xA5
+#define ZBA_PACKET_SYNC1       0x5A
+#define ZBA_PACKET_HEADER_SIZE 7
+#define ZBA_PACKET_CRC_SIZE    4
+/// Largest payload sent. Frames go out in pieces this size.
+#define ZBA_PACKET_MAX_PAYLOAD 2048
+/// Largest payload received - requests are small
+#define ZBA_PACKET_RX_SIZE kSerialBufferLength
+
+  typedef enum
+  {
+    ZBA_PACKET_PING    = 0x01,  ///< Any payload, echoed back
+    ZBA_PACKET_COMMAND = 0x02,  ///< Text command. Reply: u32 result, then the output text
+    ZBA_PACKET_FRAME   = 0x03,  ///< Reply: u32 size, u16 w, u16 h, u8 format, then FRAME_DATA
+    ZBA_PACKET_BAUD    = 0x04,  ///< u32 baud rate. Switches after the reply's gone out.
+
+    ZBA_PACKET_REPLY      = 0x80,  ///< Set in the type of replies
+    ZBA_PACKET_FRAME_DATA = 0x85,  ///< u32 offset, then a piece of the frame
+    ZBA_PACKET_ERR        = 0xFF   ///< u32 zba_err_t - the request failed
+  } zba_packet_type_t;
+
+  typedef enum
+  {
+    ZBA_PACKET_IDLE,      ///< Waiting for a packet
+    ZBA_PACKET_READING,   ///< Part way through one
+    ZBA_PACKET_SKIPPING,  ///< Dropping a payload too big to take
+    ZBA_PACKET_READY      ///< Whole packet in raw, for zba_packet_handle()
+  } zba_packet_state_t;
+
+  /// Reassembles packets from the serial stream
+  typedef struct
+  {
+    zba_packet_state_t state;
+    uint8_t raw[ZBA_PACKET_HEADER_SIZE + ZBA_PACKET_RX_SIZE + ZBA_PACKET_CRC_SIZE];
+    size_t pos;        ///< Bytes in raw
+    size_t remaining;  ///< SKIPPING: bytes left to drop
+    int64_t start_ms;  ///< When the packet started arriving
+  } zba_packet_parser_t;
+
+  /// True if data starts a packet, rather than a text line
+  bool zba_packet_is_start(uint8_t first_byte);
+
+  /// Feeds received bytes to the parser. Stops at the end of a packet, so check
+  /// parser->state for ZBA_PACKET_READY after each call.
+  /// Returns the bytes used. A bad header returns the parser to idle without using
+  /// the byte that broke it.
+  size_t zba_packet_parse(zba_packet_parser_t* parser, const uint8_t* data, size_t len);
+
+  /// Drops a packet that's been arriving for too long - the rest isn't coming.
+  void zba_packet_expire(zba_packet_parser_t* parser);
+
+  /// Answers a ready packet on fd and resets the parser.
+  /// Commands run on cmd_stream, and frames and baud changes need it logged in.
+  void zba_packet_handle(zba_packet_parser_t* parser, int fd, zba_cmd_stream_t* cmd_stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_PACKET_H_
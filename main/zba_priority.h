@@ -3,8 +3,11 @@
 
 // Priorities for the various tasks if we want them to play well together
 // Higher values are higher priority
+#define ZBA_BOOT_PRIORITY           (tskIDLE_PRIORITY + 1)
+#define ZBA_CONFIG_PRIORITY         (tskIDLE_PRIORITY + 1)
 #define ZBA_STREAM_PRIORITY         (tskIDLE_PRIORITY + 2)
 #define ZBA_HTTPD_PRIORITY          (tskIDLE_PRIORITY + 3)
+#define ZBA_MJPEG_PRIORITY          (tskIDLE_PRIORITY + 3)
 #define ZBA_RTSP_PRIORITY           (tskIDLE_PRIORITY + 4)
 #define ZBA_LED_UPDATE_PRIORITY     (tskIDLE_PRIORITY + 5)
 #define ZBA_CAMERA_LOC_CAP_PRIORITY (tskIDLE_PRIORITY + 6)
@@ -0,0 +1,225 @@
+#include "zba_rtp_jpeg.h"
+#include <string.h>
+
+static const size_t kQTableLen      = 64;    ///< 8-bit precision table
+static const uint8_t kDynamicQ      = 255;   ///< Q that means the tables are in-band
+static const uint8_t kRestartType   = 64;    ///< Added to the type when there are restarts
+static const uint16_t kMaxDimension = 2040;  ///< Width and height go in as 8-pixel units
+
+// JPEG markers
+static const uint8_t kMarkerSOI  = 0xd8;
+static const uint8_t kMarkerEOI  = 0xd9;
+static const uint8_t kMarkerSOF0 = 0xc0;
+static const uint8_t kMarkerSOF1 = 0xc1;
+static const uint8_t kMarkerDQT  = 0xdb;
+static const uint8_t kMarkerDRI  = 0xdd;
+static const uint8_t kMarkerSOS  = 0xda;
+
+static uint16_t zba_rtp_read16(const uint8_t* p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/// Reads the frame header - size and sampling. Only 3-component YCbCr with 2x1 or 2x2
+/// luma and 1x1 chroma fits an RTP/JPEG type.
+static bool zba_rtp_jpeg_parse_sof(const uint8_t* seg, size_t seg_len, zba_rtp_jpeg_t* out)
+{
+  if (seg_len < 15) return false;
+  if (seg[0] != 8) return false;  // precision
+  out->height = zba_rtp_read16(seg + 1);
+  out->width  = zba_rtp_read16(seg + 3);
+  if (seg[5] != 3) return false;  // components
+
+  uint8_t luma = seg[7];
+  if ((seg[10] != 0x11) || (seg[13] != 0x11)) return false;
+  if (luma == 0x21)
+  {
+    out->type = 0;
+  }
+  else if (luma == 0x22)
+  {
+    out->type = 1;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+/// Picks up the 8-bit tables in a DQT segment. One segment can hold several.
+static bool zba_rtp_jpeg_parse_dqt(const uint8_t* seg, size_t seg_len, zba_rtp_jpeg_t* out)
+{
+  while (seg_len > 0)
+  {
+    uint8_t precision = seg[0] >> 4;
+    uint8_t id        = seg[0] & 0x0f;
+    if ((precision != 0) || (id > 1) || (seg_len < 1 + kQTableLen)) return false;
+    if (!out->qtables[id])
+    {
+      out->qtable_count++;
+    }
+    out->qtables[id] = seg + 1;
+    seg += 1 + kQTableLen;
+    seg_len -= 1 + kQTableLen;
+  }
+  return true;
+}
+
+bool zba_rtp_jpeg_parse(const uint8_t* jpeg, size_t len, zba_rtp_jpeg_t* out)
+{
+  bool have_sof = false;
+  size_t pos    = 2;
+
+  memset(out, 0, sizeof(zba_rtp_jpeg_t));
+  if ((len < 4) || (jpeg[0] != 0xff) || (jpeg[1] != kMarkerSOI)) return false;
+
+  while (pos + 4 <= len)
+  {
+    if (jpeg[pos] != 0xff) return false;
+    uint8_t marker = jpeg[pos + 1];
+    if (marker == 0xff)
+    {
+      // Fill byte
+      pos++;
+      continue;
+    }
+
+    size_t seg_len = zba_rtp_read16(jpeg + pos + 2);
+    if ((seg_len < 2) || (pos + 2 + seg_len > len)) return false;
+    const uint8_t* seg = jpeg + pos + 4;
+    seg_len -= 2;
+
+    if ((marker == kMarkerSOF0) || (marker == kMarkerSOF1))
+    {
+      if (!zba_rtp_jpeg_parse_sof(seg, seg_len, out)) return false;
+      have_sof = true;
+    }
+    else if ((marker >= 0xc2) && (marker <= 0xcf) && (marker != 0xc4) && (marker != 0xc8) &&
+             (marker != 0xcc))
+    {
+      // Progressive, lossless or arithmetic coded
+      return false;
+    }
+    else if (marker == kMarkerDQT)
+    {
+      if (!zba_rtp_jpeg_parse_dqt(seg, seg_len, out)) return false;
+    }
+    else if (marker == kMarkerDRI)
+    {
+      if (seg_len < 2) return false;
+      out->restart_interval = zba_rtp_read16(seg);
+    }
+    else if (marker == kMarkerSOS)
+    {
+      out->scan = seg + seg_len;
+      break;
+    }
+    pos += 2 + seg_len + 2;
+  }
+
+  if ((!have_sof) || (!out->scan) || (!out->qtable_count)) return false;
+  if ((out->width == 0) || (out->height == 0) || (out->width > kMaxDimension) ||
+      (out->height > kMaxDimension))
+  {
+    return false;
+  }
+
+  // The receiver rebuilds the headers, so the scan stops at EOI. The driver can
+  // leave padding after it, so look back for it rather than assume the last 2 bytes.
+  size_t scan_len = (jpeg + len) - out->scan;
+  while ((scan_len >= 2) &&
+         !((out->scan[scan_len - 2] == 0xff) && (out->scan[scan_len - 1] == kMarkerEOI)))
+  {
+    scan_len--;
+  }
+  if (scan_len < 2) return false;
+  out->scan_len = scan_len - 2;
+
+  if (out->restart_interval)
+  {
+    out->type += kRestartType;
+  }
+  return true;
+}
+
+bool zba_rtp_jpeg_send(const zba_rtp_jpeg_t* jpeg, uint16_t* seq, uint32_t timestamp,
+                       uint32_t ssrc, size_t max_packet, zba_rtp_send_t send, void* context)
+{
+  uint8_t buffer[ZBA_RTP_HEADROOM + ZBA_RTP_MAX_PACKET];
+  uint8_t* packet = buffer + ZBA_RTP_HEADROOM;
+  size_t offset   = 0;
+
+  if (max_packet > ZBA_RTP_MAX_PACKET) max_packet = ZBA_RTP_MAX_PACKET;
+
+  // Duplicate the luma table if there's only one - the receiver expects two.
+  const uint8_t* luma   = jpeg->qtables[0] ? jpeg->qtables[0] : jpeg->qtables[1];
+  const uint8_t* chroma = jpeg->qtables[1] ? jpeg->qtables[1] : luma;
+
+  while (offset < jpeg->scan_len)
+  {
+    uint8_t* p = packet;
+
+    // RTP header - V=2, no padding/extension/CSRCs
+    *p++ = 0x80;
+    *p++ = ZBA_RTP_JPEG_PAYLOAD_TYPE;  // marker bit set below on the last packet
+    *p++ = (uint8_t)(*seq >> 8);
+    *p++ = (uint8_t)(*seq);
+    *p++ = (uint8_t)(timestamp >> 24);
+    *p++ = (uint8_t)(timestamp >> 16);
+    *p++ = (uint8_t)(timestamp >> 8);
+    *p++ = (uint8_t)(timestamp);
+    *p++ = (uint8_t)(ssrc >> 24);
+    *p++ = (uint8_t)(ssrc >> 16);
+    *p++ = (uint8_t)(ssrc >> 8);
+    *p++ = (uint8_t)(ssrc);
+
+    // JPEG header
+    *p++ = 0;  // type-specific
+    *p++ = (uint8_t)(offset >> 16);
+    *p++ = (uint8_t)(offset >> 8);
+    *p++ = (uint8_t)(offset);
+    *p++ = jpeg->type;
+    *p++ = kDynamicQ;
+    *p++ = (uint8_t)(jpeg->width / 8);
+    *p++ = (uint8_t)(jpeg->height / 8);
+
+    if (jpeg->restart_interval)
+    {
+      // F and L set with a count of 0x3fff - we don't split on restart markers.
+      *p++ = (uint8_t)(jpeg->restart_interval >> 8);
+      *p++ = (uint8_t)(jpeg->restart_interval);
+      *p++ = 0xff;
+      *p++ = 0xff;
+    }
+
+    if (offset == 0)
+    {
+      *p++ = 0;  // MBZ
+      *p++ = 0;  // 8-bit tables
+      *p++ = (uint8_t)((kQTableLen * 2) >> 8);
+      *p++ = (uint8_t)(kQTableLen * 2);
+      memcpy(p, luma, kQTableLen);
+      p += kQTableLen;
+      memcpy(p, chroma, kQTableLen);
+      p += kQTableLen;
+    }
+
+    size_t header_len = p - packet;
+    size_t chunk      = jpeg->scan_len - offset;
+    if (chunk > max_packet - header_len)
+    {
+      chunk = max_packet - header_len;
+    }
+    memcpy(p, jpeg->scan + offset, chunk);
+    offset += chunk;
+    if (offset == jpeg->scan_len)
+    {
+      packet[1] |= 0x80;
+    }
+
+    (*seq)++;
+    if (!send(packet, header_len + chunk, context)) return false;
+  }
+  return true;
+}
@@ -0,0 +1,56 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_RTP_JPEG_H_
+#define ZEBRAL_ESP32CAM_ZBA_RTP_JPEG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// RTP/JPEG (RFC 2435) packetizer. Plain C with no IDF dependencies.
+
+/// RTP payload type for JPEG
+#define ZBA_RTP_JPEG_PAYLOAD_TYPE 26
+/// RTP clock rate for video
+#define ZBA_RTP_CLOCK_RATE 90000
+/// Largest RTP packet we build - keeps a packet in one ethernet frame
+#define ZBA_RTP_MAX_PACKET 1400
+/// Bytes free in front of each packet for the sender (RTSP interleaved framing)
+#define ZBA_RTP_HEADROOM 4
+
+  /// The parts of a baseline JPEG that go into RTP/JPEG packets
+  typedef struct
+  {
+    uint16_t width;             ///< Pixels
+    uint16_t height;            ///< Pixels
+    uint8_t type;               ///< RFC 2435 type: 0 for 4:2:2, 1 for 4:2:0, +64 with restarts
+    uint16_t restart_interval;  ///< MCUs between restart markers, 0 if none
+    const uint8_t* qtables[2];  ///< 64-byte luma and chroma quantization tables (zigzag order)
+    int qtable_count;           ///< Tables found (1 or 2)
+    const uint8_t* scan;        ///< Entropy coded data, from after SOS up to EOI
+    size_t scan_len;            ///< Bytes in scan
+  } zba_rtp_jpeg_t;
+
+  /// Called with each packet. packet has ZBA_RTP_HEADROOM writable bytes before it.
+  /// Return false to stop sending the frame.
+  typedef bool (*zba_rtp_send_t)(uint8_t* packet, size_t len, void* context);
+
+  /// Finds what RTP/JPEG needs in a JPEG. Nothing is copied, so jpeg has to outlive out.
+  /// Returns false for JPEGs that RTP/JPEG can't carry (progressive, 16-bit tables,
+  /// odd sampling or bigger than 2040 pixels).
+  bool zba_rtp_jpeg_parse(const uint8_t* jpeg, size_t len, zba_rtp_jpeg_t* out);
+
+  /// Splits a parsed JPEG into RTP packets of up to max_packet bytes and passes each
+  /// to send. Tables go in-band in the first packet (Q=255), the marker bit is set on
+  /// the last. seq is advanced for each packet. Returns false if send stopped early.
+  bool zba_rtp_jpeg_send(const zba_rtp_jpeg_t* jpeg, uint16_t* seq, uint32_t timestamp,
+                         uint32_t ssrc, size_t max_packet, zba_rtp_send_t send, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_RTP_JPEG_H_
@@ -0,0 +1,856 @@
+#include "zba_rtsp.h"
+#include <errno.h>
+#include <esp_random.h>
+#include <fcntl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include <stdio.h>
+#include <string.h>
+#include "zba_auth.h"
+#include "zba_frame.h"
+#include "zba_metrics.h"
+#include "zba_mjpeg.h"
+#include "zba_priority.h"
+#include "zba_rtp_jpeg.h"
+#include "zba_stream.h"
+
+DEFINE_ZBA_MODULE(zba_rtsp);
+
+#define ZBA_RTSP_REQUEST_MAX 1024
+
+/// An RTSP connection and the one media session it controls
+typedef struct
+{
+  int fd;                                  ///< RTSP connection, or ZBA_INVALID_FD if free
+  char request[ZBA_RTSP_REQUEST_MAX + 1];  ///< Request being read, null terminated
+  size_t request_len;                      ///< Bytes in request
+  size_t skip;                             ///< Bytes to throw away (interleaved RTCP, bodies)
+  bool close;                              ///< Close once the current response is out
+  int64_t last_request;                    ///< zba_now_ms() of the last request, for the timeout
+
+  uint32_t session_id;          ///< Set by SETUP, 0 before
+  bool playing;                 ///< PLAY received, send frames
+  bool interleaved;             ///< RTP goes over the RTSP connection instead of UDP
+  uint8_t channel;              ///< Interleaved channel for RTP
+  struct sockaddr_in rtp_addr;  ///< Where UDP RTP goes
+  uint16_t seq;                 ///< Next RTP sequence number
+  uint32_t ssrc;                ///< RTP source id
+  uint32_t frames_sent;         ///< Frames sent
+  uint32_t frames_dropped;      ///< Frames cut short by a full send buffer
+
+  /// Rest of an interleaved packet the socket only took part of. It has to go before
+  /// anything else on the connection, or the framing's lost.
+  uint8_t pending[ZBA_RTP_HEADROOM + ZBA_RTP_MAX_PACKET];
+  size_t pending_len;  ///< Bytes in pending
+} zba_rtsp_session_t;
+
+/// RTSP server state
+typedef struct
+{
+  SemaphoreHandle_t mutex;  ///< Protects frame
+  TaskHandle_t task;        ///< Server task
+  volatile bool exiting;    ///< Tells the task to exit
+  int listen_fd;            ///< RTSP listening socket
+  int rtp_fd;               ///< UDP socket RTP goes out on
+  int rtcp_fd;              ///< UDP socket clients send RTCP reports to
+  bool listening;           ///< Getting frames from the MJPEG capture
+  zba_frame_t* frame;       ///< Latest captured frame not sent yet
+  zba_rtsp_session_t sessions[ZBA_RTSP_MAX_SESSIONS];
+} zba_rtsp_state_t;
+
+static zba_rtsp_state_t rtsp_state = {.mutex     = NULL,
+                                      .task      = NULL,
+                                      .exiting   = false,
+                                      .listen_fd = ZBA_INVALID_FD,
+                                      .rtp_fd    = ZBA_INVALID_FD,
+                                      .rtcp_fd   = ZBA_INVALID_FD,
+                                      .listening = false,
+                                      .frame     = NULL,
+                                      .sessions  = {{0}}};
+
+static const char* kRtspTaskName           = "RtspServer";
+static const size_t kRtspStackSize         = 8192;
+static const int kRtspPollMs               = 10;     ///< Longest to wait on sockets between frames
+static const int64_t kRtspSessionTimeoutMs = 60000;  ///< Drop sessions with no requests for this
+static const int kRtspSendTimeoutMs        = 2000;   ///< Give up on a blocked response
+static const int kRtpSendRetries           = 5;      ///< Tries when lwip is out of UDP buffers
+static const char kRtspPublic[] =
+    "OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER";
+
+DEFINE_ZBA_COUNTER(frames_sent_metric, "zba_rtsp_frames_sent_total", "Frames sent over RTP");
+DEFINE_ZBA_COUNTER(bytes_sent_metric, "zba_rtsp_bytes_sent_total", "RTP bytes sent");
+DEFINE_ZBA_COUNTER(frames_dropped_metric, "zba_rtsp_frames_dropped_total",
+                   "RTP frames cut short or skipped");
+
+static void zba_rtsp_task(void* context);
+
+static void zba_rtsp_reset_session(zba_rtsp_session_t* session)
+{
+  memset(session, 0, sizeof(zba_rtsp_session_t));
+  session->fd = ZBA_INVALID_FD;
+}
+
+/// Opens a socket bound to port on any address
+static int zba_rtsp_open_socket(int type, uint16_t port)
+{
+  struct sockaddr_in addr;
+  int reuse = 1;
+  int fd    = socket(AF_INET, type, 0);
+  if (fd < 0) return ZBA_INVALID_FD;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port        = htons(port);
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+  {
+    close(fd);
+    return ZBA_INVALID_FD;
+  }
+  return fd;
+}
+
+zba_err_t zba_rtsp_init()
+{
+  zba_err_t init_error = ZBA_OK;
+  for (;;)
+  {
+    for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+    {
+      zba_rtsp_reset_session(&rtsp_state.sessions[i]);
+    }
+
+    if (NULL == (rtsp_state.mutex = xSemaphoreCreateMutex()))
+    {
+      ZBA_ERR("Couldn't create rtsp mutex");
+      init_error = ZBA_RTSP_INIT_FAILED;
+      break;
+    }
+
+    rtsp_state.listen_fd = zba_rtsp_open_socket(SOCK_STREAM, ZBA_RTSP_PORT);
+    if ((rtsp_state.listen_fd == ZBA_INVALID_FD) ||
+        (listen(rtsp_state.listen_fd, ZBA_RTSP_MAX_SESSIONS) != 0))
+    {
+      ZBA_ERR("Couldn't listen on rtsp port %d", ZBA_RTSP_PORT);
+      init_error = ZBA_RTSP_INIT_FAILED;
+      break;
+    }
+
+    rtsp_state.rtp_fd = zba_rtsp_open_socket(SOCK_DGRAM, ZBA_RTSP_RTP_PORT);
+    if (rtsp_state.rtp_fd == ZBA_INVALID_FD)
+    {
+      ZBA_ERR("Couldn't open rtp port %d", ZBA_RTSP_RTP_PORT);
+      init_error = ZBA_RTSP_INIT_FAILED;
+      break;
+    }
+    fcntl(rtsp_state.rtp_fd, F_SETFL, fcntl(rtsp_state.rtp_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Clients send receiver reports here, and some give up on a port that refuses them.
+    rtsp_state.rtcp_fd = zba_rtsp_open_socket(SOCK_DGRAM, ZBA_RTSP_RTCP_PORT);
+    if (rtsp_state.rtcp_fd == ZBA_INVALID_FD)
+    {
+      ZBA_ERR("Couldn't open rtcp port %d", ZBA_RTSP_RTCP_PORT);
+      init_error = ZBA_RTSP_INIT_FAILED;
+      break;
+    }
+
+    zba_metrics_register(&frames_sent_metric);
+    zba_metrics_register(&bytes_sent_metric);
+    zba_metrics_register(&frames_dropped_metric);
+
+    rtsp_state.exiting = false;
+    if (pdPASS != xTaskCreate(zba_rtsp_task, kRtspTaskName, kRtspStackSize, NULL,
+                              ZBA_RTSP_PRIORITY, &rtsp_state.task))
+    {
+      ZBA_ERR("Couldn't start rtsp task");
+      rtsp_state.task = NULL;
+      init_error      = ZBA_RTSP_INIT_FAILED;
+      break;
+    }
+    break;
+  }
+
+  ZBA_SET_INIT(zba_rtsp, init_error);
+  if (ZBA_OK != init_error)
+  {
+    zba_rtsp_deinit();
+  }
+  return init_error;
+}
+
+zba_err_t zba_rtsp_deinit()
+{
+  zba_err_t deinit_error = ZBA_OK;
+
+  rtsp_state.exiting = true;
+  if (rtsp_state.task)
+  {
+    while (eTaskGetState(rtsp_state.task) != eDeleted)
+    {
+      vTaskDelay(50 / portTICK_PERIOD_MS);
+    }
+    rtsp_state.task = NULL;
+  }
+
+  if (rtsp_state.listen_fd != ZBA_INVALID_FD)
+  {
+    close(rtsp_state.listen_fd);
+    rtsp_state.listen_fd = ZBA_INVALID_FD;
+  }
+  if (rtsp_state.rtp_fd != ZBA_INVALID_FD)
+  {
+    close(rtsp_state.rtp_fd);
+    rtsp_state.rtp_fd = ZBA_INVALID_FD;
+  }
+  if (rtsp_state.rtcp_fd != ZBA_INVALID_FD)
+  {
+    close(rtsp_state.rtcp_fd);
+    rtsp_state.rtcp_fd = ZBA_INVALID_FD;
+  }
+
+  if (rtsp_state.mutex)
+  {
+    vSemaphoreDelete(rtsp_state.mutex);
+    rtsp_state.mutex = NULL;
+  }
+
+  ZBA_SET_DEINIT(zba_rtsp, deinit_error);
+  return deinit_error;
+}
+
+bool zba_rtsp_get_session_stats(int index, zba_rtsp_session_stats_t* stats)
+{
+  if ((index < 0) || (index >= ZBA_RTSP_MAX_SESSIONS)) return false;
+
+  // Read without the lock - the task owns the sessions and this is just for reporting.
+  const zba_rtsp_session_t* session = &rtsp_state.sessions[index];
+  if (session->fd == ZBA_INVALID_FD) return false;
+
+  stats->fd             = session->fd;
+  stats->session_id     = session->session_id;
+  stats->playing        = session->playing;
+  stats->interleaved    = session->interleaved;
+  stats->frames_sent    = session->frames_sent;
+  stats->frames_dropped = session->frames_dropped;
+  return true;
+}
+
+void zba_rtsp_dump_sessions(zba_print_fn print, void* context)
+{
+  zba_rtsp_session_stats_t stats;
+  for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    if (!zba_rtsp_get_session_stats(i, &stats)) continue;
+    print(context, "rtsp %d: session: %08X %s %s sent: %u dropped: %u", stats.fd,
+          stats.session_id, stats.interleaved ? "tcp" : "udp", stats.playing ? "playing" : "idle",
+          stats.frames_sent, stats.frames_dropped);
+  }
+}
+
+/// Frame listener - keeps the latest frame for the task. Called from the MJPEG capture.
+static void zba_rtsp_on_frame(zba_frame_t* frame, void* context)
+{
+  (void)context;
+  ZBA_LOCK(rtsp_state.mutex);
+  if (rtsp_state.frame)
+  {
+    // Task didn't get to the last one.
+    zba_frame_release(rtsp_state.frame);
+    zba_metrics_inc(&frames_dropped_metric);
+  }
+  rtsp_state.frame = zba_frame_ref(frame);
+  ZBA_UNLOCK(rtsp_state.mutex);
+}
+
+/// Takes the waiting frame, if any
+static zba_frame_t* zba_rtsp_take_frame()
+{
+  ZBA_LOCK(rtsp_state.mutex);
+  zba_frame_t* frame = rtsp_state.frame;
+  rtsp_state.frame   = NULL;
+  ZBA_UNLOCK(rtsp_state.mutex);
+  return frame;
+}
+
+/// Starts or stops taking frames from the capture as sessions start and stop playing.
+static void zba_rtsp_update_listener()
+{
+  bool playing = false;
+  for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    playing |= rtsp_state.sessions[i].playing;
+  }
+  if (playing == rtsp_state.listening) return;
+
+  if (playing)
+  {
+    rtsp_state.listening = (ZBA_OK == zba_mjpeg_add_listener(zba_rtsp_on_frame, NULL));
+    if (!rtsp_state.listening)
+    {
+      ZBA_ERR("Couldn't get frames from the capture");
+    }
+  }
+  else
+  {
+    zba_mjpeg_remove_listener(zba_rtsp_on_frame, NULL);
+    rtsp_state.listening = false;
+    zba_frame_release(zba_rtsp_take_frame());
+  }
+}
+
+/// Sends all of buf on a blocking connection. Only for responses - frames never block.
+static bool zba_rtsp_send_all(int fd, const void* buf, size_t len)
+{
+  const uint8_t* pos = (const uint8_t*)buf;
+  while (len)
+  {
+    ssize_t written = send(fd, pos, len, 0);
+    if (written <= 0) return false;
+    pos += written;
+    len -= written;
+  }
+  return true;
+}
+
+/// Sends what's left of a part sent interleaved packet, without blocking. Returns true
+/// once it's all gone, false while the socket's still full (or it failed, setting close).
+static bool zba_rtsp_flush_pending(zba_rtsp_session_t* session)
+{
+  while (session->pending_len)
+  {
+    ssize_t written = send(session->fd, session->pending, session->pending_len, MSG_DONTWAIT);
+    if (written < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+      {
+        session->close = true;
+      }
+      return false;
+    }
+    session->pending_len -= written;
+    memmove(session->pending, session->pending + written, session->pending_len);
+  }
+  return true;
+}
+
+static void zba_rtsp_close_session(zba_rtsp_session_t* session)
+{
+  ZBA_LOG("RTSP client %d closed", session->fd);
+  close(session->fd);
+  zba_rtsp_reset_session(session);
+}
+
+/// Packet sender for zba_rtp_jpeg_send
+static bool zba_rtsp_send_packet(uint8_t* packet, size_t len, void* context)
+{
+  zba_rtsp_session_t* session = (zba_rtsp_session_t*)context;
+
+  if (session->interleaved)
+  {
+    // $, channel and length go in the headroom in front of the packet.
+    uint8_t* framed = packet - ZBA_RTP_HEADROOM;
+    framed[0]       = '$';
+    framed[1]       = session->channel;
+    framed[2]       = (uint8_t)(len >> 8);
+    framed[3]       = (uint8_t)(len);
+
+    // Never blocks, so a slow TCP client can't hold up the others or request handling.
+    // When its socket's full it loses the rest of the frame, like a slow MJPEG client.
+    size_t total    = len + ZBA_RTP_HEADROOM;
+    ssize_t written = send(session->fd, framed, total, MSG_DONTWAIT);
+    if (written < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+      {
+        session->close = true;
+      }
+      return false;
+    }
+    if (written < total)
+    {
+      // Part of the packet went, so the rest has to follow before anything else.
+      session->pending_len = total - written;
+      memcpy(session->pending, framed + written, session->pending_len);
+      return false;
+    }
+  }
+  else
+  {
+    int tries = 0;
+    while (sendto(rtsp_state.rtp_fd, packet, len, 0, (struct sockaddr*)&session->rtp_addr,
+                  sizeof(session->rtp_addr)) < 0)
+    {
+      // lwip runs out of buffers on big frames - give it a moment to drain.
+      if (((errno != ENOMEM) && (errno != EAGAIN)) || (++tries == kRtpSendRetries)) return false;
+      vTaskDelay(1);
+    }
+  }
+  zba_metrics_add(&bytes_sent_metric, len);
+  return true;
+}
+
+/// Sends a frame to every playing session
+static void zba_rtsp_send_frame(zba_frame_t* frame)
+{
+  zba_rtp_jpeg_t jpeg;
+  camera_fb_t* fb = frame->fb;
+
+  if ((fb->format != PIXFORMAT_JPEG) || !zba_rtp_jpeg_parse(fb->buf, fb->len, &jpeg))
+  {
+    ZBA_ERR("Can't send frame %lld over RTP", frame->frame_num);
+    zba_metrics_inc(&frames_dropped_metric);
+    return;
+  }
+
+  uint32_t timestamp = (uint32_t)((uint64_t)fb->timestamp.tv_sec * ZBA_RTP_CLOCK_RATE +
+                                  (uint64_t)fb->timestamp.tv_usec * ZBA_RTP_CLOCK_RATE / 1000000);
+
+  for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    zba_rtsp_session_t* session = &rtsp_state.sessions[i];
+    if (!session->playing) continue;
+
+    // A TCP client still behind on the last frame skips this one.
+    if ((!session->interleaved || zba_rtsp_flush_pending(session)) &&
+        zba_rtp_jpeg_send(&jpeg, &session->seq, timestamp, session->ssrc, ZBA_RTP_MAX_PACKET,
+                          zba_rtsp_send_packet, session))
+    {
+      session->frames_sent++;
+      zba_metrics_inc(&frames_sent_metric);
+    }
+    else
+    {
+      session->frames_dropped++;
+      zba_metrics_inc(&frames_dropped_metric);
+    }
+
+    if (session->close)
+    {
+      zba_rtsp_close_session(session);
+    }
+  }
+}
+
+/// Finds a header's value in a request. Returns false if it isn't there.
+static bool zba_rtsp_get_header(const char* request, const char* name, char* value,
+                                size_t value_len)
+{
+  size_t name_len  = strlen(name);
+  const char* line = strstr(request, "\r\n");
+  while (line && (line[2] != '\r'))
+  {
+    line += 2;
+    const char* end = strstr(line, "\r\n");
+    if (!end) break;
+    if ((strncasecmp(line, name, name_len) == 0) && (line[name_len] == ':'))
+    {
+      const char* start = line + name_len + 1;
+      while (*start == ' ')
+      {
+        start++;
+      }
+      size_t len = ZBA_MIN(end - start, value_len - 1);
+      memcpy(value, start, len);
+      value[len] = 0;
+      return true;
+    }
+    line = end;
+  }
+  return false;
+}
+
+/// Sends a response with optional extra header lines and body
+static void zba_rtsp_respond(zba_rtsp_session_t* session, const char* status, const char* cseq,
+                             const char* headers, const char* body)
+{
+  char response[1024];
+  size_t body_len = body ? strlen(body) : 0;
+  int len         = snprintf(response, sizeof(response),
+                             "RTSP/1.0 %s\r\nCSeq: %s\r\nServer: Zebral\r\n%s"
+                             "Content-Length: %u\r\n\r\n%s",
+                             status, cseq, headers ? headers : "", body_len, body ? body : "");
+  // Finish any part sent packet first, so the response doesn't land inside it.
+  if (session->pending_len &&
+      zba_rtsp_send_all(session->fd, session->pending, session->pending_len))
+  {
+    session->pending_len = 0;
+  }
+  if (session->pending_len || (len <= 0) || (len >= sizeof(response)) ||
+      !zba_rtsp_send_all(session->fd, response, len))
+  {
+    session->close = true;
+  }
+}
+
+/// Checks the request's digest Authorization against the device password, and sends
+/// a 401 with a fresh challenge if it doesn't pass. Returns true if it did.
+static bool zba_rtsp_authorized(zba_rtsp_session_t* session, const char* request,
+                                const char* method, const char* url, const char* cseq)
+{
+  char authorization[512];
+  char headers[320];
+  zba_err_t result = ZBA_ERROR;
+
+  if (zba_rtsp_get_header(request, "Authorization", authorization, sizeof(authorization)))
+  {
+    result = zba_auth_digest_verify_header(authorization, method, url);
+    if (ZBA_OK == result) return true;
+  }
+
+  int len = snprintf(headers, sizeof(headers), "WWW-Authenticate: ");
+  zba_auth_digest_challenge(headers + len, sizeof(headers) - len - 2,
+                            ZBA_AUTH_STALE_NONCE == result);
+  strcat(headers, "\r\n");
+  zba_rtsp_respond(session, "401 Unauthorized", cseq, headers, NULL);
+  return false;
+}
+
+/// DESCRIBE - one JPEG video track
+static void zba_rtsp_describe(zba_rtsp_session_t* session, const char* cseq, const char* url)
+{
+  char headers[320];
+  char sdp[256];
+  char ip[16]                = "0.0.0.0";
+  struct sockaddr_in local   = {0};
+  socklen_t local_len        = sizeof(local);
+  const char* trailing_slash = (url[strlen(url) - 1] == '/') ? "" : "/";
+
+  if (getsockname(session->fd, (struct sockaddr*)&local, &local_len) == 0)
+  {
+    inet_ntop(AF_INET, &local.sin_addr, ip, sizeof(ip));
+  }
+
+  snprintf(sdp, sizeof(sdp),
+           "v=0\r\n"
+           "o=- %u 1 IN IP4 %s\r\n"
+           "s=Zebral\r\n"
+           "c=IN IP4 0.0.0.0\r\n"
+           "t=0 0\r\n"
+           "a=control:*\r\n"
+           "m=video 0 RTP/AVP %d\r\n"
+           "a=control:track0\r\n",
+           esp_random(), ip, ZBA_RTP_JPEG_PAYLOAD_TYPE);
+  snprintf(headers, sizeof(headers), "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n",
+           url, trailing_slash);
+  zba_rtsp_respond(session, "200 OK", cseq, headers, sdp);
+}
+
+/// SETUP - picks UDP to the client's port or interleaved on this connection
+static void zba_rtsp_setup(zba_rtsp_session_t* session, const char* request, const char* cseq)
+{
+  char transport[128];
+  char headers[256];
+  const char* param = NULL;
+
+  if (!zba_rtsp_get_header(request, "Transport", transport, sizeof(transport)))
+  {
+    zba_rtsp_respond(session, "461 Unsupported Transport", cseq, NULL, NULL);
+    return;
+  }
+
+  if (!session->session_id)
+  {
+    session->session_id = esp_random() | 1;
+    session->ssrc       = esp_random();
+    session->seq        = (uint16_t)esp_random();
+  }
+
+  if (strstr(transport, "RTP/AVP/TCP"))
+  {
+    unsigned channel = 0;
+    param            = strstr(transport, "interleaved=");
+    if (param)
+    {
+      sscanf(param, "interleaved=%u", &channel);
+    }
+    session->interleaved = true;
+    session->channel     = (uint8_t)channel;
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP/TCP;unicast;interleaved=%u-%u\r\nSession: %08X;timeout=%d\r\n",
+             channel, channel + 1, session->session_id, (int)(kRtspSessionTimeoutMs / 1000));
+  }
+  else
+  {
+    unsigned port           = 0;
+    struct sockaddr_in peer = {0};
+    socklen_t peer_len      = sizeof(peer);
+    param                   = strstr(transport, "client_port=");
+    if ((!param) || (sscanf(param, "client_port=%u", &port) != 1) ||
+        (getpeername(session->fd, (struct sockaddr*)&peer, &peer_len) != 0))
+    {
+      zba_rtsp_respond(session, "461 Unsupported Transport", cseq, NULL, NULL);
+      return;
+    }
+    peer.sin_port        = htons((uint16_t)port);
+    session->rtp_addr    = peer;
+    session->interleaved = false;
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port=%d-%d;ssrc=%08X\r\n"
+             "Session: %08X;timeout=%d\r\n",
+             port, port + 1, ZBA_RTSP_RTP_PORT, ZBA_RTSP_RTCP_PORT, session->ssrc,
+             session->session_id, (int)(kRtspSessionTimeoutMs / 1000));
+  }
+  zba_rtsp_respond(session, "200 OK", cseq, headers, NULL);
+}
+
+/// Handles one complete request in session->request
+static void zba_rtsp_handle_request(zba_rtsp_session_t* session)
+{
+  char method[16];
+  char url[128];
+  char cseq[16] = "0";
+  char headers[96];
+  const char* request = session->request;
+
+  session->last_request = zba_now_ms();
+  if (sscanf(request, "%15s %127s", method, url) != 2)
+  {
+    zba_rtsp_respond(session, "400 Bad Request", cseq, NULL, NULL);
+    session->close = true;
+    return;
+  }
+  zba_rtsp_get_header(request, "CSeq", cseq, sizeof(cseq));
+  snprintf(headers, sizeof(headers), "Session: %08X\r\n", session->session_id);
+
+  // Anything that gets at the stream needs the device password.
+  if (((strcmp(method, "DESCRIBE") == 0) || (strcmp(method, "SETUP") == 0) ||
+       (strcmp(method, "PLAY") == 0)) &&
+      !zba_rtsp_authorized(session, request, method, url, cseq))
+  {
+    return;
+  }
+
+  if (strcmp(method, "OPTIONS") == 0)
+  {
+    snprintf(headers, sizeof(headers), "Public: %s\r\n", kRtspPublic);
+    zba_rtsp_respond(session, "200 OK", cseq, headers, NULL);
+  }
+  else if (strcmp(method, "DESCRIBE") == 0)
+  {
+    zba_rtsp_describe(session, cseq, url);
+  }
+  else if (strcmp(method, "SETUP") == 0)
+  {
+    zba_rtsp_setup(session, request, cseq);
+  }
+  else if ((!session->session_id) &&
+           ((strcmp(method, "PLAY") == 0) || (strcmp(method, "PAUSE") == 0)))
+  {
+    zba_rtsp_respond(session, "455 Method Not Valid in This State", cseq, NULL, NULL);
+  }
+  else if (strcmp(method, "PLAY") == 0)
+  {
+    ZBA_LOG("RTSP client %d playing over %s", session->fd, session->interleaved ? "tcp" : "udp");
+    snprintf(headers, sizeof(headers), "Session: %08X\r\nRange: npt=0.000-\r\n",
+             session->session_id);
+    zba_rtsp_respond(session, "200 OK", cseq, headers, NULL);
+    session->playing = true;
+  }
+  else if (strcmp(method, "PAUSE") == 0)
+  {
+    session->playing = false;
+    zba_rtsp_respond(session, "200 OK", cseq, headers, NULL);
+  }
+  else if (strcmp(method, "TEARDOWN") == 0)
+  {
+    session->playing = false;
+    zba_rtsp_respond(session, "200 OK", cseq, headers, NULL);
+    session->close = true;
+  }
+  else if ((strcmp(method, "GET_PARAMETER") == 0) || (strcmp(method, "SET_PARAMETER") == 0))
+  {
+    // Keep-alives
+    zba_rtsp_respond(session, "200 OK", cseq, session->session_id ? headers : NULL, NULL);
+  }
+  else
+  {
+    zba_rtsp_respond(session, "501 Not Implemented", cseq, NULL, NULL);
+  }
+}
+
+/// Reads what's waiting on a connection and handles any complete requests. Interleaved
+/// packets from the client (RTCP receiver reports) are thrown away.
+static void zba_rtsp_read_session(zba_rtsp_session_t* session)
+{
+  ssize_t got = recv(session->fd, session->request + session->request_len,
+                     ZBA_RTSP_REQUEST_MAX - session->request_len, MSG_DONTWAIT);
+  if (got <= 0)
+  {
+    if ((got == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+      session->close = true;
+    }
+    return;
+  }
+  session->request_len += got;
+
+  while (session->request_len && !session->close)
+  {
+    size_t used = 0;
+    if (session->skip)
+    {
+      used = ZBA_MIN(session->skip, session->request_len);
+      session->skip -= used;
+    }
+    else if (session->request[0] == '$')
+    {
+      if (session->request_len < 4) break;
+      session->skip =
+          4 + (((uint8_t)session->request[2] << 8) | (uint8_t)session->request[3]);
+      continue;
+    }
+    else
+    {
+      session->request[session->request_len] = 0;
+      char* end = strstr(session->request, "\r\n\r\n");
+      if (!end)
+      {
+        if (session->request_len == ZBA_RTSP_REQUEST_MAX)
+        {
+          ZBA_ERR("RTSP request too long");
+          session->close = true;
+        }
+        break;
+      }
+
+      end[2] = 0;
+      used   = end + 4 - session->request;
+      char length[16];
+      if (zba_rtsp_get_header(session->request, "Content-Length", length, sizeof(length)))
+      {
+        session->skip = strtoul(length, NULL, 10);
+      }
+      zba_rtsp_handle_request(session);
+    }
+
+    memmove(session->request, session->request + used, session->request_len - used);
+    session->request_len -= used;
+  }
+}
+
+/// Takes a new connection, if there's a free slot
+static void zba_rtsp_accept()
+{
+  struct timeval send_timeout = {.tv_sec  = kRtspSendTimeoutMs / 1000,
+                                 .tv_usec = (kRtspSendTimeoutMs % 1000) * 1000};
+  int nodelay                 = 1;
+  int fd                      = accept(rtsp_state.listen_fd, NULL, NULL);
+  if (fd < 0) return;
+
+  for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    zba_rtsp_session_t* session = &rtsp_state.sessions[i];
+    if (session->fd == ZBA_INVALID_FD)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+      session->fd           = fd;
+      session->last_request = zba_now_ms();
+      ZBA_LOG("RTSP client %d connected", fd);
+      return;
+    }
+  }
+
+  ZBA_LOG("Too many RTSP clients");
+  close(fd);
+}
+
+/// Throws away whatever's been sent to a UDP socket
+static void zba_rtsp_drain(int fd)
+{
+  uint8_t discard[64];
+  ssize_t len;
+  do
+  {
+    len = recv(fd, discard, sizeof(discard), MSG_DONTWAIT);
+  } while (len >= 0);
+}
+
+/// Server task - handles requests and sends frames to playing sessions
+static void zba_rtsp_task(void* context)
+{
+  ZBA_LOG("Entering rtsp task.");
+  (void)context;
+
+  while (!rtsp_state.exiting)
+  {
+    fd_set readable;
+    int max_fd             = ZBA_MAX(rtsp_state.listen_fd, rtsp_state.rtp_fd);
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = kRtspPollMs * 1000};
+    int64_t now            = zba_now_ms();
+
+    FD_ZERO(&readable);
+    FD_SET(rtsp_state.listen_fd, &readable);
+    FD_SET(rtsp_state.rtp_fd, &readable);
+    FD_SET(rtsp_state.rtcp_fd, &readable);
+    max_fd = ZBA_MAX(max_fd, rtsp_state.rtcp_fd);
+    for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+    {
+      zba_rtsp_session_t* session = &rtsp_state.sessions[i];
+      if (session->fd == ZBA_INVALID_FD) continue;
+      if (now - session->last_request > kRtspSessionTimeoutMs)
+      {
+        ZBA_LOG("RTSP client %d timed out", session->fd);
+        zba_rtsp_close_session(session);
+        continue;
+      }
+      FD_SET(session->fd, &readable);
+      if (session->fd > max_fd) max_fd = session->fd;
+    }
+
+    if (select(max_fd + 1, &readable, NULL, NULL, &timeout) > 0)
+    {
+      if (FD_ISSET(rtsp_state.listen_fd, &readable))
+      {
+        zba_rtsp_accept();
+      }
+      if (FD_ISSET(rtsp_state.rtp_fd, &readable))
+      {
+        // Nothing to do with anything sent to the RTP port - NAT punches and such.
+        zba_rtsp_drain(rtsp_state.rtp_fd);
+      }
+      if (FD_ISSET(rtsp_state.rtcp_fd, &readable))
+      {
+        // Receiver reports. Sessions time out on RTSP requests, not on these.
+        zba_rtsp_drain(rtsp_state.rtcp_fd);
+      }
+      for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+      {
+        zba_rtsp_session_t* session = &rtsp_state.sessions[i];
+        if ((session->fd != ZBA_INVALID_FD) && FD_ISSET(session->fd, &readable))
+        {
+          zba_rtsp_read_session(session);
+          if (session->close)
+          {
+            zba_rtsp_close_session(session);
+          }
+        }
+      }
+    }
+
+    zba_rtsp_update_listener();
+
+    zba_frame_t* frame = zba_rtsp_take_frame();
+    if (frame)
+    {
+      zba_rtsp_send_frame(frame);
+      zba_frame_release(frame);
+    }
+  }
+
+  for (int i = 0; i < ZBA_RTSP_MAX_SESSIONS; ++i)
+  {
+    zba_rtsp_session_t* session = &rtsp_state.sessions[i];
+    if (session->fd != ZBA_INVALID_FD)
+    {
+      zba_rtsp_close_session(session);
+    }
+  }
+  zba_rtsp_update_listener();
+
+  ZBA_LOG("Exiting rtsp task");
+  vTaskDelete(rtsp_state.task);
+}
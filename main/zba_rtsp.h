@@ -0,0 +1,54 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_RTSP_H_
+#define ZEBRAL_ESP32CAM_ZBA_RTSP_H_
+
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  DECLARE_ZBA_MODULE(zba_rtsp);
+
+/// RTSP listening port
+#define ZBA_RTSP_PORT 554
+/// UDP port RTP goes out from
+#define ZBA_RTSP_RTP_PORT 6970
+/// UDP port for RTCP - the one after RTP's, as SETUP replies say. Reports are drained unread.
+#define ZBA_RTSP_RTCP_PORT (ZBA_RTSP_RTP_PORT + 1)
+/// Most simultaneous RTSP sessions
+#define ZBA_RTSP_MAX_SESSIONS 2
+
+  /// Starts the RTSP server.
+  /// Serves the camera's JPEGs as RTP/JPEG (RFC 2435) over UDP, or interleaved on the
+  /// RTSP connection for clients that ask for TCP. Frames come from the MJPEG capture,
+  /// so they aren't re-encoded and RTSP and /video viewers share one capture.
+  /// DESCRIBE, SETUP and PLAY need digest auth as admin with the device password.
+  ///   ffplay rtsp://admin:<password>@<ip>/
+  ///   ffplay -rtsp_transport tcp rtsp://admin:<password>@<ip>/
+  zba_err_t zba_rtsp_init();
+  zba_err_t zba_rtsp_deinit();
+
+  /// Per-session stats
+  typedef struct
+  {
+    int fd;                   ///< RTSP connection
+    uint32_t session_id;      ///< Session id, 0 before SETUP
+    bool playing;             ///< Sending frames
+    bool interleaved;         ///< RTP over the RTSP connection rather than UDP
+    uint32_t frames_sent;     ///< Frames sent
+    uint32_t frames_dropped;  ///< Frames cut short by a full send buffer
+  } zba_rtsp_session_stats_t;
+
+  /// Gets stats for session slot index (0 to ZBA_RTSP_MAX_SESSIONS-1).
+  /// Returns false if there's no session in that slot.
+  bool zba_rtsp_get_session_stats(int index, zba_rtsp_session_stats_t* stats);
+
+  /// Logs each session
+  void zba_rtsp_dump_sessions(zba_print_fn print, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_RTSP_H_
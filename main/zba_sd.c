@@ -108,16 +108,23 @@ zba_err_t zba_sd_deinit()
   return deinit_error;
 }
 
+typedef struct
+{
+  zba_print_fn print;
+  void* context;
+} zba_sd_printer_t;
+
 bool zba_print_filename(const char* path, void* context, int depth)
 {
-  (void)context;
-  ZBA_LOG("FILE Depth(%d): %s", depth, path);
+  zba_sd_printer_t* printer = (zba_sd_printer_t*)context;
+  printer->print(printer->context, "FILE Depth(%d): %s", depth, path);
   return true;
 }
 
-zba_err_t zba_sd_list_files()
+zba_err_t zba_sd_list_files(zba_print_fn print, void* context)
 {
-  return zba_sd_enum_files(sd_state.root, zba_print_filename, NULL, true, 0);
+  zba_sd_printer_t printer = {.print = print, .context = context};
+  return zba_sd_enum_files(sd_state.root, zba_print_filename, &printer, true, 0);
 }
 
 zba_err_t zba_sd_enum_files(const char* path, zba_file_callback cb, void* context, bool recurse,
@@ -38,7 +38,8 @@ extern "C"
 
   zba_err_t zba_sd_enum_files(const char* path, zba_file_callback cb, void* context, bool recurse,
                               int curDepth);
-  zba_err_t zba_sd_list_files();
+  /// Prints every file under the root
+  zba_err_t zba_sd_list_files(zba_print_fn print, void* context);
 
 #ifdef __cplusplus
 }
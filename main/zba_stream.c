@@ -4,21 +4,29 @@
 #include <esp_vfs_dev.h>
 #include <freertos/FreeRTOS.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/errno.h>
 #include <sys/fcntl.h>
 #include <sys/select.h>
 #include <sys/unistd.h>
 #include "zba_commands.h"
+#include "zba_packet.h"
 #include "zba_priority.h"
 
 DEFINE_ZBA_MODULE(zba_stream);
 
+/// Bytes taken from the UART driver's rx ring buffer per read
+#define ZBA_STREAM_READ_SIZE 256
+
 typedef struct
 {
   int fd;  ///< File descriptor for uart
   volatile bool exiting;
+  bool discarding;  ///< Dropping input up to the next line
   zba_cmd_stream_t cmd_stream;
+  zba_packet_parser_t parser;  ///< Binary packets between the text lines
   TaskHandle_t readerTask;
+  QueueHandle_t uart_queue;  ///< UART driver events
 } stream_state_t;
 
 /// Some commands may tax this a bit.
@@ -26,8 +34,12 @@ typedef struct
 static const size_t kStreamStackSize = 8192;
 
 static const char *kStreamName     = "/dev/uart/0";
-static stream_state_t stream_state = {
-    .fd = ZBA_INVALID_FD, .cmd_stream = {0}, .readerTask = 0, .exiting = false};
+static stream_state_t stream_state = {.fd         = ZBA_INVALID_FD,
+                                      .cmd_stream = {0},
+                                      .readerTask = 0,
+                                      .uart_queue = NULL,
+                                      .discarding = false,
+                                      .exiting    = false};
 
 void stream_reader_task(void *context);
 
@@ -43,6 +55,13 @@ zba_err_t zba_stream_init(bool init_commands)
   for (;;)
   {
     ZBA_LOG("Initializing Stream");
+    if (NULL == (stream_state.uart_queue = zba_util_get_uart_queue()))
+    {
+      ZBA_ERR("No UART driver for stream");
+      result = ZBA_STREAM_INIT_FAILED;
+      break;
+    }
+
     if (ZBA_INVALID_FD == (stream_state.fd = open(kStreamName, O_RDWR)))
     {
       ZBA_ERR("Could not open stream %s", kStreamName);
@@ -58,7 +77,9 @@ zba_err_t zba_stream_init(bool init_commands)
 
     // Create reader task
     ZBA_LOG("Creating stream reader task");
-    stream_state.exiting = false;
+    stream_state.exiting      = false;
+    stream_state.discarding   = false;
+    stream_state.parser.state = ZBA_PACKET_IDLE;
     xTaskCreate(&stream_reader_task, "stream_reader_task", kStreamStackSize, &stream_state,
                 ZBA_STREAM_PRIORITY, &stream_state.readerTask);
     break;
@@ -86,8 +107,9 @@ zba_err_t zba_stream_deinit()
       stream_state.readerTask = 0;
     }
     close(stream_state.fd);
-    stream_state.fd      = ZBA_INVALID_FD;
-    stream_state.exiting = false;
+    stream_state.fd         = ZBA_INVALID_FD;
+    stream_state.exiting    = false;
+    stream_state.discarding = false;
   }
 
   ZBA_MODULE_INITIALIZED(zba_stream) =
@@ -96,48 +118,128 @@ zba_err_t zba_stream_deinit()
   return deinit_error;
 }
 
-void on_byte_read(char new_char, stream_state_t *ss)
+/// Finds the first line terminator - \r, \n or 0 - in data. NULL if there isn't one.
+static const char *stream_find_eol(const char *data, size_t len)
 {
-  // if (!ss->cmd_stream)
-  switch (new_char)
+  static const char kTerminators[] = {'\n', '\r', 0};
+  const char *eol                  = NULL;
+  size_t i;
+
+  // Each search only has to cover up to the earliest one found so far.
+  for (i = 0; i < sizeof(kTerminators); ++i)
   {
-    case 0:
-    case '\r':
-    case '\n':
-      ss->cmd_stream.buffer[ss->cmd_stream.bufPos] = 0;
-      if (ss->cmd_stream.bufPos > 0)
-      {
-        zba_commands_process(ss->cmd_stream.buffer, &ss->cmd_stream);
-        ss->cmd_stream.bufPos = 0;
-      }
-      break;
+    const char *found = memchr(data, kTerminators[i], len);
+    if (found)
+    {
+      eol = found;
+      len = found - data;
+    }
+  }
+  return eol;
+}
 
-    default:
-      ss->cmd_stream.buffer[ss->cmd_stream.bufPos] = new_char;
-      ss->cmd_stream.bufPos++;
-      if (ss->cmd_stream.bufPos >= sizeof(ss->cmd_stream.buffer) - 1)
+/// Adds part of a line to the command buffer. A line that won't fit is dropped whole -
+/// running the end of it as a command could do anything.
+static void stream_append(stream_state_t *ss, const char *data, size_t len)
+{
+  zba_cmd_stream_t *cmd_stream = &ss->cmd_stream;
+  if (ss->discarding) return;
+
+  if (cmd_stream->bufPos + len >= sizeof(cmd_stream->buffer))
+  {
+    ZBA_ERR("Stream buffer overflow! Dropping line.");
+    ss->discarding     = true;
+    cmd_stream->bufPos = 0;
+    return;
+  }
+  memcpy(cmd_stream->buffer + cmd_stream->bufPos, data, len);
+  cmd_stream->bufPos += len;
+}
+
+/// Splits a read into lines and packets, and runs each complete one. A partial line or
+/// packet waits for the rest of it.
+static void stream_on_read(stream_state_t *ss, const char *data, size_t len)
+{
+  zba_cmd_stream_t *cmd_stream = &ss->cmd_stream;
+  const char *end              = data + len;
+
+  while (data < end)
+  {
+    // A packet can only start where a line could.
+    if ((ss->parser.state != ZBA_PACKET_IDLE) ||
+        ((cmd_stream->bufPos == 0) && (!ss->discarding) && zba_packet_is_start(*data)))
+    {
+      data += zba_packet_parse(&ss->parser, (const uint8_t *)data, end - data);
+      if (ss->parser.state == ZBA_PACKET_READY)
       {
-        ZBA_LOG("Stream buffer overflow! Resetting buffer.");
-        // ss->cmd_stream.source->flush();
-        ss->cmd_stream.bufPos = 0;
+        zba_packet_handle(&ss->parser, ss->fd, cmd_stream);
       }
-      break;
+      continue;
+    }
+
+    const char *eol = stream_find_eol(data, end - data);
+    if (!eol)
+    {
+      stream_append(ss, data, end - data);
+      return;
+    }
+
+    stream_append(ss, data, eol - data);
+    if ((!ss->discarding) && (cmd_stream->bufPos > 0))
+    {
+      cmd_stream->buffer[cmd_stream->bufPos] = 0;
+      zba_commands_process(cmd_stream->buffer, cmd_stream);
+    }
+    cmd_stream->bufPos = 0;
+    ss->discarding     = false;
+    data               = eol + 1;
   }
 }
 
 void stream_reader_task(void *context)
 {
   stream_state_t *ss = (stream_state_t *)context;
-  char nextByte;
+  char data[ZBA_STREAM_READ_SIZE];
+  uart_event_t event;
+  size_t buffered;
   int amountRead;
 
   ZBA_LOG("Read task started.");
   while (!ss->exiting)
   {
-    amountRead = uart_read_bytes(UART_NUM_0, &nextByte, 1, 50 / portTICK_RATE_MS);
-    if (amountRead)
+    // The driver posts an event per burst of input, not per byte. The timeout is to
+    // check for exit and for packets that stopped part way.
+    if (!xQueueReceive(ss->uart_queue, &event, 50 / portTICK_RATE_MS))
     {
-      on_byte_read(nextByte, ss);
+      zba_packet_expire(&ss->parser);
+      continue;
+    }
+
+    switch (event.type)
+    {
+      case UART_DATA:
+        // Take all that's buffered, not just this event's bytes - the events behind it
+        // then find little or nothing left.
+        while ((ESP_OK == uart_get_buffered_data_len(UART_NUM_0, &buffered)) && (buffered > 0))
+        {
+          amountRead = uart_read_bytes(UART_NUM_0, data, ZBA_MIN(buffered, sizeof(data)), 0);
+          if (amountRead <= 0) break;
+          stream_on_read(ss, data, amountRead);
+        }
+        break;
+
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        // Input's been lost, so the line in progress can't be trusted.
+        ZBA_ERR("UART input overflow (%d), flushing.", event.type);
+        uart_flush_input(UART_NUM_0);
+        xQueueReset(ss->uart_queue);
+        ss->cmd_stream.bufPos = 0;
+        ss->discarding        = true;
+        break;
+
+      default:
+        break;
     }
   }
   ZBA_LOG("Reader task exiting.");
@@ -0,0 +1,206 @@
+#include "zba_trace.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <string.h>
+#include "zba_metrics.h"
+#include "zba_util.h"
+
+DEFINE_ZBA_MODULE(zba_trace);
+
+// Stage times go to /metrics as one histogram per stage. The per frame records only
+// go as far as the trace command - a label per frame number would never stop growing.
+static const uint32_t kStageUsecBuckets[] = {1000,  5000,   10000,  20000,  33000,  50000,
+                                             66000, 100000, 200000, 500000, 1000000};
+#define ZBA_TRACE_STAGE_HISTOGRAM(var, stage)                                              \
+  DEFINE_ZBA_HISTOGRAM_LABELED(var, "zba_frame_stage_usec", "stage=\"" stage "\"",         \
+                               "Time frames spend in each stage, from the sensor to sent", \
+                               kStageUsecBuckets)
+ZBA_TRACE_STAGE_HISTOGRAM(sensor_usec_metric, "sensor");
+ZBA_TRACE_STAGE_HISTOGRAM(grab_usec_metric, "grab");
+ZBA_TRACE_STAGE_HISTOGRAM(process_usec_metric, "process");
+ZBA_TRACE_STAGE_HISTOGRAM(queue_usec_metric, "queue");
+ZBA_TRACE_STAGE_HISTOGRAM(send_usec_metric, "send");
+ZBA_TRACE_STAGE_HISTOGRAM(total_usec_metric, "total");
+
+/// Registered together, so they're one family on /metrics
+static zba_metric_t* const kStageMetrics[] = {&sensor_usec_metric,  &grab_usec_metric,
+                                              &process_usec_metric, &queue_usec_metric,
+                                              &send_usec_metric,    &total_usec_metric};
+
+/// Trace state - ring of the most recent frames
+typedef struct
+{
+  SemaphoreHandle_t mutex;                ///< Protects the ring
+  zba_trace_t ring[ZBA_TRACE_RING_SIZE];  ///< Frame traces
+  size_t next;                            ///< Next slot to write
+  size_t count;                           ///< Valid records in ring
+} zba_trace_state_t;
+
+static zba_trace_state_t trace_state = {.mutex = NULL, .ring = {{0}}, .next = 0, .count = 0};
+
+static int64_t timeval_to_usec(const struct timeval* timestamp)
+{
+  return ((int64_t)timestamp->tv_sec * 1000000LL) + timestamp->tv_usec;
+}
+
+/// Microseconds between two stages, or -1 if either didn't happen.
+static int32_t zba_trace_stage(int64_t from, int64_t to)
+{
+  if ((from == 0) || (to == 0)) return -1;
+  return (int32_t)(to - from);
+}
+
+/// Adds a stage's time to its histogram, if the frame went through it
+static void zba_trace_observe(zba_metric_t* metric, int64_t from, int64_t to)
+{
+  int32_t usec = zba_trace_stage(from, to);
+  if (usec >= 0)
+  {
+    zba_metrics_observe(metric, usec);
+  }
+}
+
+zba_err_t zba_trace_init()
+{
+  zba_err_t result = ZBA_OK;
+  if (trace_state.mutex == NULL)
+  {
+    trace_state.mutex = xSemaphoreCreateMutex();
+  }
+
+  if (trace_state.mutex == NULL)
+  {
+    ZBA_ERR("Couldn't create trace mutex");
+    result = ZBA_OUT_OF_MEMORY;
+  }
+  else
+  {
+    ZBA_LOCK(trace_state.mutex);
+    memset(trace_state.ring, 0, sizeof(trace_state.ring));
+    trace_state.next  = 0;
+    trace_state.count = 0;
+    ZBA_UNLOCK(trace_state.mutex);
+
+    for (size_t i = 0; i < sizeof(kStageMetrics) / sizeof(kStageMetrics[0]); ++i)
+    {
+      zba_metrics_register(kStageMetrics[i]);
+    }
+  }
+
+  ZBA_SET_INIT(zba_trace, result);
+  return result;
+}
+
+zba_err_t zba_trace_deinit()
+{
+  zba_err_t deinit_error = ZBA_OK;
+  if (trace_state.mutex)
+  {
+    vSemaphoreDelete(trace_state.mutex);
+    trace_state.mutex = NULL;
+  }
+  ZBA_SET_DEINIT(zba_trace, deinit_error);
+  return deinit_error;
+}
+
+void zba_trace_frame_captured(int64_t frame_num, const struct timeval* timestamp, size_t len,
+                              int64_t grab_start, int64_t grabbed, int64_t processed)
+{
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_trace)) return;
+
+  ZBA_LOCK(trace_state.mutex);
+  zba_trace_t* trace = &trace_state.ring[trace_state.next];
+  memset(trace, 0, sizeof(zba_trace_t));
+  trace->frame_num  = frame_num;
+  trace->len        = len;
+  trace->sensor     = timeval_to_usec(timestamp);
+  trace->grab_start = grab_start;
+  trace->grabbed    = grabbed;
+  trace->processed  = processed;
+
+  trace_state.next  = (trace_state.next + 1) % ZBA_TRACE_RING_SIZE;
+  trace_state.count = ZBA_MIN(trace_state.count + 1, ZBA_TRACE_RING_SIZE);
+  ZBA_UNLOCK(trace_state.mutex);
+
+  zba_trace_observe(&sensor_usec_metric, timeval_to_usec(timestamp), grabbed);
+  zba_trace_observe(&grab_usec_metric, grab_start, grabbed);
+  zba_trace_observe(&process_usec_metric, grabbed, processed);
+}
+
+/// Finds the newest record for a frame. Must hold the mutex.
+static zba_trace_t* zba_trace_find(const struct timeval* timestamp)
+{
+  int64_t sensor = timeval_to_usec(timestamp);
+  for (size_t i = 1; i <= trace_state.count; ++i)
+  {
+    zba_trace_t* trace =
+        &trace_state.ring[(trace_state.next + ZBA_TRACE_RING_SIZE - i) % ZBA_TRACE_RING_SIZE];
+    if (trace->sensor == sensor)
+    {
+      return trace;
+    }
+  }
+  return NULL;
+}
+
+void zba_trace_frame_send_start(const struct timeval* timestamp)
+{
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_trace)) return;
+
+  ZBA_LOCK(trace_state.mutex);
+  zba_trace_t* trace = zba_trace_find(timestamp);
+  // With several clients, the first one to start sending counts.
+  if (trace && (!trace->send_start))
+  {
+    trace->send_start = zba_now();
+    zba_trace_observe(&queue_usec_metric, trace->processed, trace->send_start);
+  }
+  ZBA_UNLOCK(trace_state.mutex);
+}
+
+void zba_trace_frame_send_end(const struct timeval* timestamp)
+{
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_trace)) return;
+
+  ZBA_LOCK(trace_state.mutex);
+  zba_trace_t* trace = zba_trace_find(timestamp);
+  if (trace)
+  {
+    trace->send_end = zba_now();
+    zba_trace_observe(&send_usec_metric, trace->send_start, trace->send_end);
+    zba_trace_observe(&total_usec_metric, trace->sensor, trace->send_end);
+  }
+  ZBA_UNLOCK(trace_state.mutex);
+}
+
+bool zba_trace_get(size_t index, zba_trace_t* trace)
+{
+  bool found = false;
+  if (ZBA_OK != ZBA_MODULE_INITIALIZED(zba_trace)) return false;
+
+  ZBA_LOCK(trace_state.mutex);
+  if (index < trace_state.count)
+  {
+    size_t oldest = (trace_state.next + ZBA_TRACE_RING_SIZE - trace_state.count);
+    *trace        = trace_state.ring[(oldest + index) % ZBA_TRACE_RING_SIZE];
+    found         = true;
+  }
+  ZBA_UNLOCK(trace_state.mutex);
+  return found;
+}
+
+void zba_trace_dump(zba_print_fn print, void* context)
+{
+  zba_trace_t trace;
+  print(context, "frame      bytes   sensor   grab  process  queue   send  total (usec)");
+  for (size_t i = 0; zba_trace_get(i, &trace); ++i)
+  {
+    print(context, "%-8lld %7u %8d %6d %8d %6d %6d %6d", trace.frame_num, trace.len,
+          zba_trace_stage(trace.sensor, trace.grabbed),
+          zba_trace_stage(trace.grab_start, trace.grabbed),
+          zba_trace_stage(trace.grabbed, trace.processed),
+          zba_trace_stage(trace.processed, trace.send_start),
+          zba_trace_stage(trace.send_start, trace.send_end),
+          zba_trace_stage(trace.sensor, trace.send_end));
+  }
+}
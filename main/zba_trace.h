@@ -0,0 +1,59 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_TRACE_H_
+#define ZEBRAL_ESP32CAM_ZBA_TRACE_H_
+
+#include <sys/time.h>
+#include "zba_util.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  DECLARE_ZBA_MODULE(zba_trace);
+
+/// Number of frames kept in the trace ring
+#define ZBA_TRACE_RING_SIZE 32
+
+  /// Timing for a single frame, from the sensor to the last byte sent.
+  /// All times are esp_timer microseconds (same clock as zba_now()), 0 if the
+  /// frame never reached that stage.
+  typedef struct
+  {
+    int64_t frame_num;   ///< Camera frame number
+    size_t len;          ///< Bytes in the frame that was sent
+    int64_t sensor;      ///< Driver timestamp (start of frame from the sensor)
+    int64_t grab_start;  ///< Called esp_camera_fb_get
+    int64_t grabbed;     ///< esp_camera_fb_get returned
+    int64_t processed;   ///< Vision callback finished
+    int64_t send_start;  ///< Started sending to a client
+    int64_t send_end;    ///< Last chunk sent
+  } zba_trace_t;
+
+  zba_err_t zba_trace_init();
+  zba_err_t zba_trace_deinit();
+
+  /// Adds a frame to the ring once it's been captured and processed.
+  void zba_trace_frame_captured(int64_t frame_num, const struct timeval* timestamp, size_t len,
+                                int64_t grab_start, int64_t grabbed, int64_t processed);
+
+  /// Marks the start of sending the frame with this driver timestamp.
+  /// With several clients the first start counts.
+  void zba_trace_frame_send_start(const struct timeval* timestamp);
+
+  /// Marks the end of sending the frame with this driver timestamp.
+  /// With several clients the last end counts in the record, and each goes in the
+  /// send and total histograms.
+  void zba_trace_frame_send_end(const struct timeval* timestamp);
+
+  /// Copies out a trace record. Index 0 is the oldest.
+  /// Returns false if there's no record at that index.
+  bool zba_trace_get(size_t index, zba_trace_t* trace);
+
+  /// Prints the traces, a line per frame
+  void zba_trace_dump(zba_print_fn print, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_TRACE_H_
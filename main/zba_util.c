@@ -3,6 +3,7 @@
 #include <esp_log.h>
 
 #include <esp_timer.h>
+#include <esp_vfs_dev.h>
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -10,6 +11,11 @@
 
 DEFINE_ZBA_MODULE(zba_util);
 
+static const int kUartBufferSize = 4096;  ///< Driver rx/tx ring buffer sizes
+static const int kUartQueueSize  = 16;    ///< UART driver events waiting for the stream reader
+
+static QueueHandle_t uart_queue = NULL;
+
 zba_err_t zba_util_init()
 {
   esp_err_t esp_error;
@@ -21,7 +27,8 @@ zba_err_t zba_util_init()
                                      .stop_bits = UART_STOP_BITS_1,
                                      .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
 
-  if (ESP_OK != (esp_error = uart_driver_install(UART_NUM_0, 4096, 4096, 0, NULL, 0)))
+  if (ESP_OK != (esp_error = uart_driver_install(UART_NUM_0, kUartBufferSize, kUartBufferSize,
+                                                         kUartQueueSize, &uart_queue, 0)))
   {
     ZBA_LOG("Error installing uart driver! 0x%X", esp_error);
     init_error = ZBA_UTIL_UART_ERROR;
@@ -39,12 +46,25 @@ zba_err_t zba_util_init()
     init_error = ZBA_UTIL_UART_ERROR;
   }
 
+  // Binary packets share the UART with text, and the VFS would put a \r in front of every
+  // 0x0A byte in them. Text that wants \r\n (command output) writes it itself.
+  if (0 != esp_vfs_dev_uart_port_set_tx_line_endings(UART_NUM_0, ESP_LINE_ENDINGS_LF))
+  {
+    ZBA_LOG("Error setting UART line endings!");
+    init_error = ZBA_UTIL_UART_ERROR;
+  }
+
   // Save module initialization state.
   // For utils, we leave it as initialized as it got (it's the base level and should always work)
   ZBA_SET_INIT(zba_util, init_error);
   return init_error;
 }
 
+QueueHandle_t zba_util_get_uart_queue()
+{
+  return uart_queue;
+}
+
 float zba_elapsed_sec(int64_t start_time)
 {
   return zba_elapsed_ms(start_time) / 1000.0;
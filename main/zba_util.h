@@ -3,6 +3,7 @@
 
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -24,6 +25,10 @@ extern "C"
 
   void zba_delay_ms(uint32_t ms);
 
+  /// Where dump functions send their output - printf-style, one line per call, no newline.
+  /// Commands pass one that routes to whoever ran them.
+  typedef void (*zba_print_fn)(void *context, const char *fmt, ...);
+
   static int32_t __inline ZBA_CLAMP(int32_t min, int32_t max, int32_t val)
   {
     if (val < min) return min;
@@ -166,6 +171,10 @@ extern "C"
   /// Do any log/util initialization we need
   zba_err_t zba_util_init();
 
+  /// Event queue of the UART0 driver, NULL if it didn't install.
+  /// The stream reader is its only consumer.
+  QueueHandle_t zba_util_get_uart_queue();
+
 #ifdef __cplusplus
 }
 #endif
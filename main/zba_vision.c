@@ -10,7 +10,6 @@ typedef struct
   zba_resolution_t old_res;  ///< Resolution prior to switching to vision mode
   uint32_t tasks;            ///< Flags for what tasks vision should do
   camera_fb_t rgb565_frame;  ///< Processing buffer for color
-  camera_fb_t gray_frame;    ///< Processing buffer for grayscale
   bool first;                ///< Is this first pass? (may need buffer init for motion, etc)
   zba_resolution_t resolution;
 } vision_state_t;
@@ -24,11 +23,10 @@ typedef struct
 static vision_state_t vision_state = {.old_res      = ZBA_VGA,
                                       .tasks        = ZBA_VISION_NONE,
                                       .rgb565_frame = {0},
-                                      .gray_frame   = {0},
                                       .first        = true,
                                       .resolution   = VISION_PIXELFORMAT};
 
-camera_fb_t* zba_vision_on_frame(camera_fb_t* frame, void* context);
+zba_frame_t* zba_vision_on_frame(zba_frame_t* frame, void* context);
 
 zba_err_t zba_vision_init()
 {
@@ -60,30 +58,17 @@ zba_err_t zba_vision_init()
 
     // The esp32 driver doesn't seem to successfully handle
     // grayscale. Incoming frame buffer is too small, gets an error.
-    //
-    // if (vision_state.resolution == ZBA_SXGA_INTERNAL_GRAY)
-    // {
-    // Grayscale only, no RGB565 buffer
-    // vision_state.rgb565_frame.buf = NULL;
-    // vision_state.gray_frame.buf   = calloc(1, VISION_BUFFER_SIZE + VISION_BUFFER_SIZE / 2);
-    //}
-    // else
-
-    // allocate frame buffer and a grayscale buffer in one go
-    {
-      vision_state.rgb565_frame.buf    = calloc(1, VISION_BUFFER_SIZE + VISION_BUFFER_SIZE / 2);
-      vision_state.gray_frame.buf      = vision_state.rgb565_frame.buf + VISION_BUFFER_SIZE;
-      vision_state.rgb565_frame.width  = VISION_WIDTH;
-      vision_state.rgb565_frame.height = VISION_HEIGHT;
-      vision_state.rgb565_frame.format = PIXFORMAT_RGB565;
-      vision_state.rgb565_frame.len    = VISION_WIDTH * VISION_HEIGHT * 2;
-    }
-    vision_state.gray_frame.width  = VISION_WIDTH;
-    vision_state.gray_frame.height = VISION_HEIGHT;
-    vision_state.gray_frame.format = PIXFORMAT_GRAYSCALE;
-    vision_state.gray_frame.len    = VISION_WIDTH * VISION_HEIGHT;
+    // So we take RGB565 and convert.
 
-    if (vision_state.gray_frame.buf == NULL)
+    // Scratch buffer for color processing. Grayscale output frames come
+    // from the frame pool so they can be sent while the next one is processed.
+    vision_state.rgb565_frame.buf    = calloc(1, VISION_BUFFER_SIZE);
+    vision_state.rgb565_frame.width  = VISION_WIDTH;
+    vision_state.rgb565_frame.height = VISION_HEIGHT;
+    vision_state.rgb565_frame.format = PIXFORMAT_RGB565;
+    vision_state.rgb565_frame.len    = VISION_BUFFER_SIZE;
+
+    if (vision_state.rgb565_frame.buf == NULL)
     {
       ZBA_ERR("Couldn't allocate RAM for frame buffer!");
       return ZBA_OUT_OF_MEMORY;
@@ -111,12 +96,6 @@ zba_err_t zba_vision_deinit()
   {
     free(vision_state.rgb565_frame.buf);
     vision_state.rgb565_frame.buf = NULL;
-    vision_state.gray_frame.buf   = NULL;
-  }
-  else if (vision_state.gray_frame.buf != NULL)
-  {
-    free(vision_state.gray_frame.buf);
-    vision_state.gray_frame.buf = NULL;
   }
   ZBA_SET_DEINIT(zba_vision, deinit_error);
 
@@ -129,27 +108,24 @@ zba_err_t zba_vision_set_task(zba_vision_task_t task)
   return ZBA_OK;
 }
 
-camera_fb_t* zba_vision_on_frame(camera_fb_t* frame, void* context)
+zba_frame_t* zba_vision_on_frame(zba_frame_t* frame, void* context)
 {
   if (!frame)
   {
     ZBA_ERR("Empty frame in zba_vision_on_frame");
     return 0;
   }
-  if (!vision_state.gray_frame.buf)
+  if (!vision_state.rgb565_frame.buf)
   {
     ZBA_ERR("Empty vision buffer!");
     return 0;
   }
 
   (void)context;
-  bool can_process = false;
-
-  vision_state.gray_frame.timestamp   = frame->timestamp;
-  vision_state.rgb565_frame.timestamp = frame->timestamp;
+  camera_fb_t* fb        = frame->fb;
+  zba_frame_t* ret_frame = NULL;
 
-  camera_fb_t* ret_frame = &vision_state.gray_frame;
-  switch (frame->format)
+  switch (fb->format)
   {
     case PIXFORMAT_JPEG:
     case PIXFORMAT_RAW:
@@ -160,18 +136,22 @@ camera_fb_t* zba_vision_on_frame(camera_fb_t* frame, void* context)
     case PIXFORMAT_YUV422:
       break;
     case PIXFORMAT_RGB565:
-      zba_imgproc_rgb565_to_gray((uint16_t*)frame->buf, frame->width, frame->height,
-                                 vision_state.gray_frame.buf);
-      can_process = true;
-
+      if (!(ret_frame = zba_frame_pool_acquire(fb->width * fb->height)))
+      {
+        ZBA_ERR("No pool frame for vision output");
+        break;
+      }
+      ret_frame->fb->width     = fb->width;
+      ret_frame->fb->height    = fb->height;
+      ret_frame->fb->format    = PIXFORMAT_GRAYSCALE;
+      ret_frame->fb->timestamp = fb->timestamp;
+      zba_imgproc_rgb565_to_gray((uint16_t*)fb->buf, fb->width, fb->height, ret_frame->fb->buf);
       break;
     case PIXFORMAT_GRAYSCALE:
       // Already in grayscale? Ok, just use the camera frame.
-      can_process = true;
-      ret_frame   = frame;
+      ret_frame = frame;
       break;
   }
-  if (!can_process) return 0;
 
   // zba_vision_mean_rgb565(frame, NULL);
   // zba_vision_erode_rgb565(frame, NULL);
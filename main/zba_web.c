@@ -1,13 +1,18 @@
 // todo - wait for video task shutdown on deinit...
 #include "zba_web.h"
 #include <esp_http_server.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "zba_assets.h"
 #include "zba_auth.h"
-#include "zba_binaries.h"
 #include "zba_camera.h"
 #include "zba_commands.h"
-#include "zba_html.h"
+#include "zba_json.h"
+#include "zba_metrics.h"
+#include "zba_mjpeg.h"
 #include "zba_priority.h"
+#include "zba_trace.h"
 
 DEFINE_ZBA_MODULE(zba_web);
 
@@ -16,34 +21,59 @@ DEFINE_ZBA_MODULE(zba_web);
 /// Web module state
 typedef struct
 {
-  httpd_handle_t page_server;   ///< Each server handles a connection at a time.
-  httpd_handle_t video_server;  ///< So... need separate ones for the root pages, video, and
+  httpd_handle_t server;  ///< Pages, images, commands and video - video sessions are handed off
+                          ///< to zba_mjpeg
   volatile bool run_server;
 } zba_web_state_t;
-static zba_web_state_t web_state = {.page_server = NULL, .video_server = NULL, .run_server = false};
-
-static const char kBoundary[] = "\r\n--ZEBRAL_IMAGE_CHUNK\r\n";
-static const int kBoundaryLen = sizeof(kBoundary);
-static const int kWebStack    = 8192;
+static zba_web_state_t web_state = {.server = NULL, .run_server = false};
+
+/// Longest message taken from a /ws/video client
+#define ZBA_WEB_WS_MESSAGE_MAX 256
+/// Most command output kept for a /ws/video reply - escaped, it has to fit in
+/// ZBA_MJPEG_WS_REPLY_MAX
+#define ZBA_WEB_WS_OUTPUT_MAX 1024
+
+static const int kWebStack         = 8192;
+static const char kWsSuccess[]     = "{\"status\":\"success\"}";
+static const uint32_t kImageWaitMs = 2000;  ///< Longest /image waits on the capture
+
+/// Assets that need a login can be cached but have to be checked, the rest can be
+/// reused for a day. ETags come from the content, so a new firmware's assets don't match.
+static const char kAuthAssetCache[]   = "private, no-cache";
+static const char kPublicAssetCache[] = "public, max-age=86400";
+
+static const uint32_t kSendUsecBuckets[] = {1000,  5000,   10000,  20000,  33000,  50000,
+                                            66000, 100000, 200000, 500000, 1000000};
+DEFINE_ZBA_COUNTER(frames_sent_metric, "zba_web_frames_sent_total", "Frames sent to web clients");
+DEFINE_ZBA_COUNTER(bytes_sent_metric, "zba_web_frame_bytes_sent_total",
+                   "Frame bytes sent to web clients");
+DEFINE_ZBA_COUNTER(send_errors_metric, "zba_web_send_errors_total",
+                   "Frame sends that failed (client dropped)");
+DEFINE_ZBA_HISTOGRAM(send_usec_metric, "zba_web_send_usec", "Time to send a frame to a client",
+                     kSendUsecBuckets);
 
 /// URI handler forward declares
-esp_err_t index_handler(httpd_req_t *req);
+esp_err_t asset_handler(httpd_req_t *req);
 esp_err_t video_handler(httpd_req_t *req);
+esp_err_t ws_video_handler(httpd_req_t *req);
 esp_err_t image_handler(httpd_req_t *req);
-esp_err_t favicon_handler(httpd_req_t *req);
-esp_err_t logo_handler(httpd_req_t *req);
 esp_err_t command_handler(httpd_req_t *req);
+esp_err_t metrics_handler(httpd_req_t *req);
+esp_err_t status_handler(httpd_req_t *req);
+esp_err_t batch_handler(httpd_req_t *req);
 // clang-format off
 
 /// Table of URI handlers to set up
 static const httpd_uri_t uri_handlers[] = {
-    {.uri = "/",      .method = HTTP_GET, .handler = index_handler, .user_ctx = NULL},
     {.uri = "/command",.method=HTTP_GET, .handler = command_handler,.user_ctx = NULL},
     {.uri = "/image", .method = HTTP_GET, .handler = image_handler,.user_ctx=NULL},
-    {.uri = "/favicon.png", .method = HTTP_GET, .handler = favicon_handler,.user_ctx=NULL},
-   { .uri = "/zebral_logo.svg", .method = HTTP_GET, .handler = logo_handler, .user_ctx = NULL}
+    {.uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler,.user_ctx=NULL},
+    {.uri = "/api/status", .method = HTTP_GET, .handler = status_handler, .user_ctx = NULL},
+    {.uri = "/api/batch", .method = HTTP_POST, .handler = batch_handler, .user_ctx = NULL},
+    {.uri = "/video", .method = HTTP_GET, .handler = video_handler, .user_ctx = NULL},
+    {.uri = "/ws/video", .method = HTTP_GET, .handler = ws_video_handler, .user_ctx = NULL,
+     .is_websocket = true, .handle_ws_control_frames = true}
 };
-static const httpd_uri_t video_uri = {.uri = "/video", .method = HTTP_GET, .handler = video_handler, .user_ctx = NULL};
 
 
 
@@ -56,29 +86,34 @@ zba_err_t zba_web_init()
   httpd_config_t config   = HTTPD_DEFAULT_CONFIG();
   config.stack_size       = kWebStack;
   config.task_priority    = ZBA_HTTPD_PRIORITY;
-  config.max_uri_handlers = num_uri_handlers;
+  config.max_uri_handlers = num_uri_handlers + kAssetCount;
+  config.max_open_sockets = ZBA_WEB_MAX_OPEN_SOCKETS;
+  config.lru_purge_enable = true;
+  config.close_fn         = zba_mjpeg_on_close;  // Closes video sessions once zba_mjpeg is done
   esp_err_t esp_err;
   size_t i;
 
+  zba_metrics_register(&frames_sent_metric);
+  zba_metrics_register(&bytes_sent_metric);
+  zba_metrics_register(&send_errors_metric);
+  zba_metrics_register(&send_usec_metric);
+
   web_state.run_server = true;
-  if (ESP_OK == (esp_err = httpd_start(&web_state.page_server, &config)))
+  if (ESP_OK == (esp_err = httpd_start(&web_state.server, &config)))
   {
     // Set up all the table-defined handlers
     for (i = 0; i < num_uri_handlers; ++i)
     {
-      httpd_register_uri_handler(web_state.page_server, &uri_handlers[i]);
+      httpd_register_uri_handler(web_state.server, &uri_handlers[i]);
     }
-
-    config.server_port++;
-    config.ctrl_port++;
-    config.max_uri_handlers = 1;
-    if (ESP_OK == (esp_err = httpd_start(&web_state.video_server, &config)))
+    // And the built in pages and images
+    for (i = 0; i < kAssetCount; ++i)
     {
-      httpd_register_uri_handler(web_state.video_server, &video_uri);
-    }
-    else
-    {
-      ZBA_ERR("Error registering video server.");
+      httpd_uri_t asset_uri = {.uri      = kAssets[i].uri,
+                               .method   = HTTP_GET,
+                               .handler  = asset_handler,
+                               .user_ctx = (void *)&kAssets[i]};
+      httpd_register_uri_handler(web_state.server, &asset_uri);
     }
   }
   else
@@ -106,25 +141,22 @@ zba_err_t zba_web_deinit()
   if (web_state.run_server)
   {
     web_state.run_server = false;
-    if (web_state.page_server != NULL)
+    if (web_state.server != NULL)
     {
       for (i = 0; i < num_uri_handlers; ++i)
       {
-        httpd_unregister_uri_handler(web_state.page_server, uri_handlers[i].uri,
+        httpd_unregister_uri_handler(web_state.server, uri_handlers[i].uri,
                                      uri_handlers[i].method);
       }
-      if (ESP_OK != httpd_stop(web_state.page_server))
+      for (i = 0; i < kAssetCount; ++i)
       {
-        deinit_error = ZBA_WEB_DEINIT_FAILED;
+        httpd_unregister_uri_handler(web_state.server, kAssets[i].uri, HTTP_GET);
       }
-    }
-    if (web_state.video_server != NULL)
-    {
-      httpd_unregister_uri_handler(web_state.video_server, video_uri.uri, video_uri.method);
-      if (ESP_OK != httpd_stop(web_state.video_server))
+      if (ESP_OK != httpd_stop(web_state.server))
       {
         deinit_error = ZBA_WEB_DEINIT_FAILED;
       }
+      web_state.server = NULL;
     }
   }
 
@@ -135,17 +167,42 @@ zba_err_t zba_web_deinit()
   return deinit_error;
 }
 
-esp_err_t index_handler(httpd_req_t *req)
+/// True if the request's If-None-Match has etag (or is *)
+static bool etag_matches(httpd_req_t *req, const char *etag)
 {
+  char if_none_match[128] = {0};
+  if (ESP_OK != httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match,
+                                            sizeof(if_none_match)))
+  {
+    return false;
+  }
+  // A list of tags, maybe weak (W/"...") - a weak match is fine for a GET.
+  return (NULL != strstr(if_none_match, etag)) || (0 == strcmp(if_none_match, "*"));
+}
+
+/// Serves a built in asset (user_ctx is its zba_asset_t). They're stored gzipped, so
+/// they go out as they are, and a browser with the current one gets a 304 instead.
+esp_err_t asset_handler(httpd_req_t *req)
+{
+  const zba_asset_t *asset = (const zba_asset_t *)req->user_ctx;
+
   // Check authorization. Bail if not authorized.
-  if (ZBA_OK != zba_auth_digest_check_web(req))
+  if (asset->auth && (ZBA_OK != zba_auth_digest_check_web(req)))
   {
     return ESP_OK;
   }
 
-  httpd_resp_set_type(req, "text/html");
-  httpd_resp_set_hdr(req, "Content-Encoding", "utf-8");
-  return httpd_resp_sendstr(req, kIndexHtml);
+  httpd_resp_set_hdr(req, "ETag", asset->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", asset->auth ? kAuthAssetCache : kPublicAssetCache);
+  if (etag_matches(req, asset->etag))
+  {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  httpd_resp_set_type(req, asset->content_type);
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char *)asset->data, asset->len);
 }
 
 esp_err_t command_handler(httpd_req_t *req)
@@ -166,75 +223,98 @@ esp_err_t command_handler(httpd_req_t *req)
   return ESP_OK;
 }
 
-esp_err_t send_and_release_image_chunked(httpd_req_t *req, camera_fb_t **framePtr)
+esp_err_t metrics_handler(httpd_req_t *req)
 {
-  char buf[128]      = {0};
-  size_t bufLen      = 0;
-  esp_err_t res      = ESP_OK;
-  camera_fb_t *frame = (*framePtr);
-  if (!frame) return ESP_FAIL;
-
-  if (frame->format == PIXFORMAT_JPEG)
+  // Check authorization. Bail if not authorized.
+  if (ZBA_OK != zba_auth_digest_check_web(req))
   {
-    bufLen =
-        snprintf(buf, sizeof(buf),
-                 "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %ld.%06ld\r\n\r\n",
-                 frame->len, frame->timestamp.tv_sec, frame->timestamp.tv_usec);
+    return ESP_OK;
+  }
 
-    if (ESP_OK == (res = httpd_resp_send_chunk(req, buf, bufLen)))
-    {
-      res = httpd_resp_send_chunk(req, (const char *)frame->buf, frame->len);
-    }
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  esp_err_t res = zba_metrics_send_web(req);
+  if (ESP_OK == res)
+  {
+    // Zero length chunk ends the response
+    res = httpd_resp_send_chunk(req, NULL, 0);
   }
-  else
+  return res;
+}
+
+esp_err_t status_handler(httpd_req_t *req)
+{
+  // Check authorization. Bail if not authorized.
+  if (ZBA_OK != zba_auth_digest_check_web(req))
   {
-    // Try converting non-jpegs to bitmaps
-    uint8_t *bmp             = NULL;
-    size_t bmp_len           = 0;
-    struct timeval timestamp = frame->timestamp;
-    bool converted           = frame2bmp(frame, &bmp, &bmp_len);
+    return ESP_OK;
+  }
 
-    // Release frame now, since sending will take a bit.
-    zba_camera_release_frame(frame);
-    *framePtr = NULL;
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  zba_commands_status_web(NULL, req);
+  return ESP_OK;
+}
 
-    if (!converted)
-    {
-      ZBA_ERR("Failed converting frame to bitmap");
-      res = ESP_FAIL;
-    }
-    else
-    {
-      bufLen = snprintf(buf, sizeof(buf),
-                        "Content-Type: image/x-windows-bmp\r\nContent-Length: %u\r\nX-Timestamp: "
-                        "%ld.%06ld\r\n\r\n",
-                        bmp_len, timestamp.tv_sec, timestamp.tv_usec);
+esp_err_t batch_handler(httpd_req_t *req)
+{
+  // One auth check covers every command in the batch.
+  if (ZBA_OK != zba_auth_digest_check_web(req))
+  {
+    return ESP_OK;
+  }
 
-      if (ESP_OK == (res = httpd_resp_send_chunk(req, buf, bufLen)))
-      {
-        res = httpd_resp_send_chunk(req, (const char *)bmp, bmp_len);
-      }
-    }
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  zba_commands_process_batch_web(req);
+  return ESP_OK;
+}
 
-    if (bmp)
-    {
-      free(bmp);
-    }
-  }
+/// Reads roi=x,y,w,h from the query string. Returns false if there isn't a valid one.
+bool get_roi_param(httpd_req_t *req, zba_roi_t *roi)
+{
+  char query[64] = {0};
+  char value[32] = {0};
+  unsigned int x, y, w, h;
 
-  if (frame)
+  if ((ESP_OK != httpd_req_get_url_query_str(req, query, sizeof(query))) ||
+      (ESP_OK != httpd_query_key_value(query, "roi", value, sizeof(value))) ||
+      (4 != sscanf(value, "%u,%u,%u,%u", &x, &y, &w, &h)) || (!w) || (!h))
   {
-    zba_camera_release_frame(frame);
-    *framePtr = NULL;
+    return false;
   }
 
-  return res;
+  roi->x      = ZBA_MIN(x, UINT16_MAX);
+  roi->y      = ZBA_MIN(y, UINT16_MAX);
+  roi->width  = ZBA_MIN(w, UINT16_MAX);
+  roi->height = ZBA_MIN(h, UINT16_MAX);
+  return true;
+}
+
+/// Reads the stream options from the query string - roi=x,y,w,h, sub=1 for the low
+/// res preview stream and fps=n to cap the frame rate.
+static void get_stream_opts(httpd_req_t *req, zba_mjpeg_stream_opts_t *opts)
+{
+  char query[64] = {0};
+  char value[8]  = {0};
+  unsigned fps   = 0;
+
+  memset(opts, 0, sizeof(zba_mjpeg_stream_opts_t));
+  opts->has_roi = get_roi_param(req, &opts->roi);
+  if (ESP_OK != httpd_req_get_url_query_str(req, query, sizeof(query))) return;
+
+  if (ESP_OK == httpd_query_key_value(query, "sub", value, sizeof(value)))
+  {
+    opts->preview = (0 == strcmp(value, "1"));
+  }
+  if ((ESP_OK == httpd_query_key_value(query, "fps", value, sizeof(value))) &&
+      (1 == sscanf(value, "%u", &fps)))
+  {
+    opts->fps = ZBA_MIN(fps, kMaxVideoFps);
+  }
 }
 
 esp_err_t video_handler(httpd_req_t *req)
 {
-  camera_fb_t *frame = NULL;
-  esp_err_t res      = ESP_OK;
+  zba_mjpeg_stream_opts_t opts;
+  zba_err_t result;
 
   // Check authorization. Bail if not authorized.
   // zba_auth_basic_check_web challenges the client, so next request may be authenticated.
@@ -244,78 +324,171 @@ esp_err_t video_handler(httpd_req_t *req)
     return ESP_OK;
   }
 
-  httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=ZEBRAL_IMAGE_CHUNK");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "30");
+  // Hand the socket to the streaming task, which sends frames to every viewer from
+  // one loop. This returns right away so the server can take more viewers.
+  get_stream_opts(req, &opts);
+  result = zba_mjpeg_add_client(req, &opts);
+  switch (result)
+  {
+    case ZBA_OK:
+      return ESP_OK;
+    case ZBA_MJPEG_TOO_MANY_CLIENTS:
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      return httpd_resp_sendstr(req, "Too many viewers");
+    case ZBA_MJPEG_SEND_FAILED:
+      // Response already started, just drop the connection.
+      return ESP_FAIL;
+    default:
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+  }
+}
+
+/// Runs a command from a WebSocket client and replies with its result and output.
+static esp_err_t ws_video_command(int fd, const char *text)
+{
+  zba_cmd_stream_t cmd_stream;
+  zba_json_t json;
+
+  // Output and reply are too big for httpd's stack. One allocation holds both.
+  char *buffer = malloc(ZBA_WEB_WS_OUTPUT_MAX + ZBA_MJPEG_WS_REPLY_MAX);
+  if (!buffer) return ESP_OK;
+  char *reply = buffer + ZBA_WEB_WS_OUTPUT_MAX;
+
+  zba_commands_stream_init_text(&cmd_stream, buffer, ZBA_WEB_WS_OUTPUT_MAX);
+  zba_err_t result = zba_commands_process(text, &cmd_stream);
 
-  int retries = 0;
-  while (web_state.run_server)
+  // A reply is a single frame. If the output won't fit, leave it off.
+  const char *output = buffer;
+  for (;;)
   {
-    // check for res change.
-    if (zba_camera_need_restart())
+    zba_json_begin_buffer(&json, reply, ZBA_MJPEG_WS_REPLY_MAX);
+    zba_json_object(&json, NULL);
+    zba_json_string(&json, "status", (ZBA_OK == result) ? "success" : "error");
+    if (ZBA_OK != result)
     {
-      zba_camera_deinit();
-      zba_camera_init();
+      zba_json_hex(&json, "error", result);
     }
-
-    // Retry up to 3 consecutive times if we fail to get a frame.
-    frame = zba_camera_capture_frame();
-    if (!frame)
+    if (output)
     {
-      ZBA_LOG("Failed to get frame. Retry: %d", retries);
-      retries++;
-      if (retries >= 3)
-      {
-        res = ESP_FAIL;
-        break;
-      }
-      continue;
+      zba_json_string(&json, "output", output);
     }
-    retries = 0;
+    zba_json_end_object(&json);
+    if ((ESP_OK == zba_json_end(&json)) || (!output)) break;
+    output = NULL;
+  }
 
-    // Send chunk boundary
-    if (ESP_OK != (res = httpd_resp_send_chunk(req, kBoundary, kBoundaryLen)))
+  // Replies can be dropped if the last hasn't gone yet - the client isn't waiting on them.
+  if (ESP_OK == json.error)
+  {
+    zba_mjpeg_ws_send(fd, HTTPD_WS_TYPE_TEXT, reply, json.out_len);
+  }
+  free(buffer);
+  return ESP_OK;
+}
+
+/// Handles a text message from a /ws/video client:
+///   ack [n]     - done with n frames (default 1), send that many more
+///   window <n>  - frames it can have unacked, 0 to stop acking
+///   rate <fps>  - most frames a second, 0 for every frame
+/// Anything else runs as a command, as with /command.
+static esp_err_t ws_video_text(httpd_req_t *req, const char *text)
+{
+  int fd         = httpd_req_to_sockfd(req);
+  unsigned value = 1;
+
+  if ((0 == strcmp(text, "ack")) || (1 == sscanf(text, "ack %u", &value)))
+  {
+    // Acks come with every frame, so they don't get a reply.
+    zba_mjpeg_ws_ack(fd, value);
+    return ESP_OK;
+  }
+
+  if (1 == sscanf(text, "window %u", &value))
+  {
+    zba_mjpeg_ws_set_window(fd, value);
+  }
+  else if (1 == sscanf(text, "rate %u", &value))
+  {
+    zba_mjpeg_ws_set_rate(fd, value);
+  }
+  else
+  {
+    ZBA_LOG("Got ws command: %s", text);
+    return ws_video_command(fd, text);
+  }
+
+  // Replies can be dropped if the last hasn't gone yet - the client isn't waiting on them.
+  zba_mjpeg_ws_send(fd, HTTPD_WS_TYPE_TEXT, kWsSuccess, sizeof(kWsSuccess) - 1);
+  return ESP_OK;
+}
+
+esp_err_t ws_video_handler(httpd_req_t *req)
+{
+  char payload[ZBA_WEB_WS_MESSAGE_MAX + 1];
+  httpd_ws_frame_t frame = {0};
+  zba_mjpeg_stream_opts_t opts;
+
+  if (req->method == HTTP_GET)
+  {
+    // httpd has already answered the handshake, so there's no challenging the client
+    // here. Drop it if it didn't come with credentials.
+    if (ZBA_OK != zba_auth_digest_verify_web(req))
     {
-      break;
+      return ESP_FAIL;
     }
 
-    // Send chunk and free it.  We free it in the subroutine
-    // to give the camera extra time for the next frame.
-    if (ESP_OK != (res = send_and_release_image_chunked(req, &frame)))
+    // Frames go out from the streaming task. Messages from the client come back here.
+    get_stream_opts(req, &opts);
+    if (ZBA_OK != zba_mjpeg_add_ws_client(req, &opts))
     {
-      break;
+      return ESP_FAIL;
     }
+    return ESP_OK;
   }
 
-  if (res != ESP_OK)
+  // Get the length, then the message.
+  if (ESP_OK != httpd_ws_recv_frame(req, &frame, 0)) return ESP_FAIL;
+  if (frame.len > ZBA_WEB_WS_MESSAGE_MAX)
   {
-    httpd_resp_send_500(req);
+    ZBA_ERR("WebSocket message too long (%u)", frame.len);
+    return ESP_FAIL;
   }
+  frame.payload = (uint8_t *)payload;
+  if (frame.len && (ESP_OK != httpd_ws_recv_frame(req, &frame, frame.len))) return ESP_FAIL;
+  payload[frame.len] = 0;
 
-  // Make sure frame is released
-  if (frame)
+  switch (frame.type)
   {
-    zba_camera_release_frame(frame);
-    frame = NULL;
+    case HTTPD_WS_TYPE_TEXT:
+      return ws_video_text(req, payload);
+    case HTTPD_WS_TYPE_PING:
+      // Only the streaming task writes to the socket, so it sends the pong.
+      zba_mjpeg_ws_send(httpd_req_to_sockfd(req), HTTPD_WS_TYPE_PONG, payload, frame.len);
+      return ESP_OK;
+    case HTTPD_WS_TYPE_CLOSE:
+      // Closing the session closes the client.
+      return ESP_FAIL;
+    default:
+      return ESP_OK;
   }
-
-  return res;
 }
 
-esp_err_t send_and_release_image(httpd_req_t *req, camera_fb_t **framePtr)
+esp_err_t send_and_release_image(httpd_req_t *req, zba_frame_t **framePtr)
 {
   esp_err_t res      = ESP_OK;
-  camera_fb_t *frame = *framePtr;
+  zba_frame_t *frame = *framePtr;
   if (!frame) return ESP_FAIL;
+  camera_fb_t *fb = frame->fb;
 
-  if (frame->format == PIXFORMAT_JPEG)
+  if (fb->format == PIXFORMAT_JPEG)
   {
     if (ESP_OK == (res = httpd_resp_set_type(req, "image/jpeg")))
     {
       if (ESP_OK ==
           (res = httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=image.jpg")))
       {
-        res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+        res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
       }
     }
   }
@@ -323,8 +496,10 @@ esp_err_t send_and_release_image(httpd_req_t *req, camera_fb_t **framePtr)
   {
     uint8_t *buf   = NULL;
     size_t buf_len = 0;
-    bool converted = frame2bmp(frame, &buf, &buf_len);
+    bool converted = frame2bmp(fb, &buf, &buf_len);
     zba_camera_release_frame(frame);
+    frame     = NULL;
+    *framePtr = NULL;
 
     for (;;)
     {
@@ -359,7 +534,7 @@ esp_err_t send_and_release_image(httpd_req_t *req, camera_fb_t **framePtr)
   if (frame)
   {
     zba_camera_release_frame(frame);
-    frame = NULL;
+    *framePtr = NULL;
   }
 
   return res;
@@ -367,8 +542,9 @@ esp_err_t send_and_release_image(httpd_req_t *req, camera_fb_t **framePtr)
 
 esp_err_t image_handler(httpd_req_t *req)
 {
-  camera_fb_t *frame = NULL;
+  zba_frame_t *frame = NULL;
   esp_err_t res      = ESP_OK;
+  zba_roi_t roi      = {0};
 
   // Check authorization. Bail if not authorized.
   // zba_auth_basic_check_web challenges the client, so next request may be authenticated.
@@ -378,20 +554,12 @@ esp_err_t image_handler(httpd_req_t *req)
     return ESP_OK;
   }
 
-  // Retry up to 3 consecutive times if we fail to get a frame.
-  int retries = 3;
-  while (retries && !frame)
+  // The streams own the camera, so take the next fresh frame from their capture and
+  // crop it here - the sensor window is theirs.
+  frame = zba_mjpeg_grab_frame(kImageWaitMs);
+  if (frame && get_roi_param(req, &roi))
   {
-    frame = zba_camera_capture_frame();
-    // SO... this is a hack. Even with camera grab latest, I still get a stale frame
-    // when doing onesies. That's no good. So measure once, capture twice.
-    if (frame && (retries == 3))
-    {
-      zba_camera_release_frame(frame);
-      frame = zba_camera_capture_frame();
-    }
-
-    retries--;
+    frame = zba_camera_crop_frame(frame, &roi);
   }
 
   if (!frame)
@@ -400,7 +568,21 @@ esp_err_t image_handler(httpd_req_t *req)
   }
   else
   {
-    res = send_and_release_image(req, &frame);
+    struct timeval timestamp = frame->fb->timestamp;
+    size_t frame_len         = frame->fb->len;
+    int64_t send_start       = zba_now();
+    zba_trace_frame_send_start(&timestamp);
+    if (ESP_OK == (res = send_and_release_image(req, &frame)))
+    {
+      zba_trace_frame_send_end(&timestamp);
+      zba_metrics_inc(&frames_sent_metric);
+      zba_metrics_add(&bytes_sent_metric, frame_len);
+      zba_metrics_observe(&send_usec_metric, (uint32_t)(zba_now() - send_start));
+    }
+    else
+    {
+      zba_metrics_inc(&send_errors_metric);
+    }
   }
 
   if (ESP_OK != res)
@@ -417,15 +599,3 @@ esp_err_t image_handler(httpd_req_t *req)
   return res;
 }
 
-esp_err_t favicon_handler(httpd_req_t *req)
-{
-  httpd_resp_set_type(req, "image/png");
-  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-  return httpd_resp_send(req, (const char *)favicon_16x16, sizeof(favicon_16x16));
-}
-
-esp_err_t logo_handler(httpd_req_t *req)
-{
-  httpd_resp_set_type(req, "image/svg+xml");
-  return httpd_resp_sendstr(req, kZebralLogo);
-}
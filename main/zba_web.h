@@ -9,6 +9,13 @@ extern "C"
 #endif
 
   DECLARE_ZBA_MODULE(zba_web);
+
+/// Most sockets the web server keeps open. Video viewers hold one each for as long as
+/// they watch (up to ZBA_MJPEG_MAX_CLIENTS), and past this the least recently used
+/// session is closed to make room. httpd needs 3 more of CONFIG_LWIP_MAX_SOCKETS, and
+/// RTSP 2 plus one per session.
+#define ZBA_WEB_MAX_OPEN_SOCKETS 8
+
   /// initialize the camera web server
   zba_err_t zba_web_init();
   /// deinitialize the camera web server
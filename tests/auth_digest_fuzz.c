@@ -0,0 +1,123 @@
+// Fuzzes zba_auth_parse_digest(), which parses Authorization headers from anyone who
+// can reach the device. Every field it finds has to be inside the header.
+//
+// With clang it's a libFuzzer target (ZBA_LIBFUZZER). Otherwise main() below mutates
+// the sample headers at random:  auth_digest_fuzz [iterations] [seed]
+// Either way it's best built with AddressSanitizer, which the CMake project does when
+// the compiler has it, and each input is copied to a buffer of its exact size so reads
+// past the end are caught.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "auth_digest_headers.h"
+#include "zba_auth_digest.h"
+
+/// Largest input tried - bigger than the device ever reads
+#define FUZZ_MAX_INPUT 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  zba_auth_digest_t digest;
+  char *header = malloc(size ? size : 1);
+  if (!header) abort();
+  memcpy(header, data, size);
+
+  if (zba_auth_parse_digest(header, size, &digest))
+  {
+    const zba_auth_slice_t *fields = (const zba_auth_slice_t *)&digest;
+    for (size_t i = 0; i < sizeof(digest) / sizeof(fields[0]); ++i)
+    {
+      if (!fields[i].ptr) continue;
+      if ((fields[i].ptr < header) || (fields[i].ptr + fields[i].len > header + size))
+      {
+        fprintf(stderr, "Field %zu is outside the header\n", i);
+        abort();
+      }
+    }
+  }
+  free(header);
+  return 0;
+}
+
+#ifndef ZBA_LIBFUZZER
+
+static uint32_t fuzz_state;
+
+/// xorshift32 - the same run every time for a seed
+static uint32_t fuzz_rand()
+{
+  fuzz_state ^= fuzz_state << 13;
+  fuzz_state ^= fuzz_state >> 17;
+  fuzz_state ^= fuzz_state << 5;
+  return fuzz_state;
+}
+
+/// A byte that's likely to matter to the parser, or any at all
+static uint8_t fuzz_byte()
+{
+  static const char kSpecial[] = "\"\\,= \t";
+  return (fuzz_rand() % 2) ? (uint8_t)kSpecial[fuzz_rand() % (sizeof(kSpecial) - 1)]
+                           : (uint8_t)fuzz_rand();
+}
+
+/// Makes a few random edits to a sample header
+static size_t fuzz_mutate(uint8_t *buf)
+{
+  const char *sample = kDigestHeaders[fuzz_rand() % kNumDigestHeaders].header;
+  size_t len         = strlen(sample);
+  memcpy(buf, sample, len);
+
+  int edits = 1 + fuzz_rand() % 8;
+  while (edits--)
+  {
+    size_t pos = len ? fuzz_rand() % len : 0;
+    switch (fuzz_rand() % 4)
+    {
+      case 0:  // Change a byte
+        if (len) buf[pos] = fuzz_byte();
+        break;
+      case 1:  // Drop one
+        if (len)
+        {
+          memmove(buf + pos, buf + pos + 1, len - pos - 1);
+          len--;
+        }
+        break;
+      case 2:  // Add one
+        if (len < FUZZ_MAX_INPUT)
+        {
+          memmove(buf + pos + 1, buf + pos, len - pos);
+          buf[pos] = fuzz_byte();
+          len++;
+        }
+        break;
+      case 3:  // Cut it short
+        len = pos;
+        break;
+    }
+  }
+  return len;
+}
+
+int main(int argc, char **argv)
+{
+  uint8_t buf[FUZZ_MAX_INPUT];
+  long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+  fuzz_state      = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x5eed;
+  if (!fuzz_state) fuzz_state = 1;
+
+  for (int i = 0; i < kNumDigestHeaders; ++i)
+  {
+    LLVMFuzzerTestOneInput((const uint8_t *)kDigestHeaders[i].header,
+                           strlen(kDigestHeaders[i].header));
+  }
+  for (long i = 0; i < iterations; ++i)
+  {
+    LLVMFuzzerTestOneInput(buf, fuzz_mutate(buf));
+  }
+  printf("%ld inputs, no faults\n", iterations + kNumDigestHeaders);
+  return 0;
+}
+
+#endif  // ZBA_LIBFUZZER
@@ -0,0 +1,35 @@
+// Authorization headers as clients send them, for the zba_auth_digest fuzzer and benchmark.
+#ifndef ZEBRAL_ESP32CAM_TESTS_AUTH_DIGEST_HEADERS_H_
+#define ZEBRAL_ESP32CAM_TESTS_AUTH_DIGEST_HEADERS_H_
+
+typedef struct
+{
+  const char *name;    ///< What sends it
+  const char *header;  ///< Authorization value
+} auth_digest_header_t;
+
+// clang-format off
+static const auth_digest_header_t kDigestHeaders[] = {
+    {"browser",
+     "Digest username=\"admin\", realm=\"Zebral\", nonce=\"7d3f9a0c5b2e41d8a6f0c3b9e2d1a4f7\", "
+     "uri=\"/stream?fps=15\", algorithm=MD5, response=\"3c1e8b7a0f4d2c9e6b5a1d8f7e3c0b2a\", "
+     "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\", qop=auth, nc=00000001, "
+     "cnonce=\"0a4f113b9c8d7e6f\""},
+    {"rfc2069",
+     "Digest username=\"admin\", realm=\"Zebral\", nonce=\"7d3f9a0c5b2e41d8a6f0c3b9e2d1a4f7\", "
+     "uri=\"/\", response=\"3c1e8b7a0f4d2c9e6b5a1d8f7e3c0b2a\", "
+     "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\""},
+    {"rtsp",
+     "Digest username=\"admin\", realm=\"Zebral\", nonce=\"7d3f9a0c5b2e41d8a6f0c3b9e2d1a4f7\", "
+     "uri=\"rtsp://192.168.1.50:554/stream/trackID=0\", "
+     "response=\"3c1e8b7a0f4d2c9e6b5a1d8f7e3c0b2a\""},
+    {"odd",
+     "digest  username=\"ad\\\"min\",realm=Zebral ,\tnonce=\"7d3f9a0c5b2e41d8a6f0c3b9e2d1a4f7\","
+     "uri=\"/a?b=c,d e\", x-unknown=\"ignored, really\", "
+     "response=3c1e8b7a0f4d2c9e6b5a1d8f7e3c0b2a"},
+};
+// clang-format on
+
+static const int kNumDigestHeaders = sizeof(kDigestHeaders) / sizeof(kDigestHeaders[0]);
+
+#endif  // ZEBRAL_ESP32CAM_TESTS_AUTH_DIGEST_HEADERS_H_
@@ -0,0 +1,81 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+// UART0 is whatever fd zba_host_set_uart_fd() was given, usually a pty.
+#ifndef ZEBRAL_ESP32CAM_HOST_DRIVER_UART_H_
+#define ZEBRAL_ESP32CAM_HOST_DRIVER_UART_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef int uart_port_t;
+
+#define UART_NUM_0 0
+
+  typedef enum
+  {
+    UART_DATA_8_BITS = 3
+  } uart_word_length_t;
+
+  typedef enum
+  {
+    UART_PARITY_DISABLE = 0
+  } uart_parity_t;
+
+  typedef enum
+  {
+    UART_STOP_BITS_1 = 1
+  } uart_stop_bits_t;
+
+  typedef enum
+  {
+    UART_HW_FLOWCTRL_DISABLE = 0
+  } uart_hw_flowcontrol_t;
+
+  typedef struct
+  {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+  } uart_config_t;
+
+  typedef enum
+  {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR
+  } uart_event_type_t;
+
+  typedef struct
+  {
+    uart_event_type_t type;
+    size_t size;
+  } uart_event_t;
+
+  /// The queue posts a UART_DATA event whenever the fd has input.
+  esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                                int queue_size, QueueHandle_t* uart_queue, int intr_alloc_flags);
+  esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config);
+  esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num,
+                         int cts_io_num);
+  esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate);
+  esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size);
+  int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait);
+  esp_err_t uart_flush_input(uart_port_t uart_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_DRIVER_UART_H_
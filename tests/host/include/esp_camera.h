@@ -0,0 +1,52 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_CAMERA_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_CAMERA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "esp_err.h"
+
+typedef enum
+{
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_YUV420,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+  PIXFORMAT_RGB888,
+  PIXFORMAT_RAW,
+  PIXFORMAT_RGB444,
+  PIXFORMAT_RGB555
+} pixformat_t;
+
+typedef enum
+{
+  CAMERA_GRAB_WHEN_EMPTY,
+  CAMERA_GRAB_LATEST
+} camera_grab_mode_t;
+
+typedef enum
+{
+  CAMERA_FB_IN_PSRAM,
+  CAMERA_FB_IN_DRAM
+} camera_fb_location_t;
+
+typedef struct
+{
+  int framesize;
+  uint8_t quality;
+} camera_status_t;
+
+typedef struct
+{
+  uint8_t* buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+  struct timeval timestamp;
+} camera_fb_t;
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_CAMERA_H_
@@ -0,0 +1,13 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_ERR_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NO_MEM        0x101
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_ERR_H_
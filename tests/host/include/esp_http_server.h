@@ -0,0 +1,22 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_HTTP_SERVER_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_HTTP_SERVER_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+typedef void* httpd_handle_t;
+typedef struct httpd_req httpd_req_t;
+
+typedef enum
+{
+  HTTPD_WS_TYPE_CONTINUE = 0x0,
+  HTTPD_WS_TYPE_TEXT     = 0x1,
+  HTTPD_WS_TYPE_BINARY   = 0x2,
+  HTTPD_WS_TYPE_CLOSE    = 0x8,
+  HTTPD_WS_TYPE_PING     = 0x9,
+  HTTPD_WS_TYPE_PONG     = 0xA
+} httpd_ws_type_t;
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_HTTP_SERVER_H_
@@ -0,0 +1,26 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_LOG_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_LOG_H_
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /// Writes a log line where the device would - see zba_host_set_uart_fd()
+  void zba_host_log(char level, const char* tag, const char* fmt, ...)
+      __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, ...) zba_host_log('E', tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) zba_host_log('W', tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) zba_host_log('I', tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) zba_host_log('D', tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) zba_host_log('V', tag, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_LOG_H_
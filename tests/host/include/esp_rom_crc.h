@@ -0,0 +1,19 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_ROM_CRC_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /// CRC-32 as the ROM does it - with crc 0, the same as zlib's crc32()
+  uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_ROM_CRC_H_
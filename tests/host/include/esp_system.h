@@ -0,0 +1,7 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_SYSTEM_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_SYSTEM_H_
+
+#include "esp_err.h"
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_SYSTEM_H_
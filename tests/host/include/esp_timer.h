@@ -0,0 +1,19 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_TIMER_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /// usec since the process started
+  int64_t esp_timer_get_time();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_TIMER_H_
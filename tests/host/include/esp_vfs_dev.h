@@ -0,0 +1,27 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_ESP_VFS_DEV_H_
+#define ZEBRAL_ESP32CAM_HOST_ESP_VFS_DEV_H_
+
+#include "esp_vfs.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef enum
+  {
+    ESP_LINE_ENDINGS_CRLF,
+    ESP_LINE_ENDINGS_CR,
+    ESP_LINE_ENDINGS_LF
+  } esp_line_endings_t;
+
+  /// On the host UART0 is a pty, and CRLF is its ONLCR output processing.
+  /// Only CRLF and LF are supported.
+  int esp_vfs_dev_uart_port_set_tx_line_endings(int uart_num, esp_line_endings_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_ESP_VFS_DEV_H_
@@ -0,0 +1,24 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+// There's one thread, so tasks run where they're created and locks are no-ops.
+#ifndef ZEBRAL_ESP32CAM_HOST_FREERTOS_H_
+#define ZEBRAL_ESP32CAM_HOST_FREERTOS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE            0
+#define pdTRUE             1
+#define pdPASS             1
+#define portMAX_DELAY      0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define portTICK_RATE_MS   portTICK_PERIOD_MS
+#define portNUM_PROCESSORS 2
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define tskIDLE_PRIORITY   0
+#define configMAX_PRIORITIES 25
+
+#endif  // ZEBRAL_ESP32CAM_HOST_FREERTOS_H_
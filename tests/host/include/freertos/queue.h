@@ -0,0 +1,23 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_FREERTOS_QUEUE_H_
+#define ZEBRAL_ESP32CAM_HOST_FREERTOS_QUEUE_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef struct zba_host_queue* QueueHandle_t;
+
+  /// Only the UART event queue exists - see driver/uart.h
+  BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait);
+  BaseType_t xQueueReset(QueueHandle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_FREERTOS_QUEUE_H_
@@ -0,0 +1,36 @@
+// Host stand-in for the IDF header - just what the host tests build against.
+#ifndef ZEBRAL_ESP32CAM_HOST_FREERTOS_TASK_H_
+#define ZEBRAL_ESP32CAM_HOST_FREERTOS_TASK_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef void* TaskHandle_t;
+  typedef void (*TaskFunction_t)(void*);
+
+  typedef enum
+  {
+    eRunning,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted
+  } eTaskState;
+
+  /// Tasks aren't started - the host tests call the task function themselves.
+  BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth,
+                         void* context, UBaseType_t priority, TaskHandle_t* handle);
+  /// Nothing to do - task functions end with it, and then return
+  void vTaskDelete(TaskHandle_t task);
+  eTaskState eTaskGetState(TaskHandle_t task);
+  void vTaskDelay(TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_HOST_FREERTOS_TASK_H_
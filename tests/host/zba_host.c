@@ -0,0 +1,202 @@
+#include "zba_host.h"
+#include <driver/uart.h>
+#include <errno.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <esp_vfs_dev.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/// The UART event queue - there's only the one
+struct zba_host_queue
+{
+  int unused;
+};
+
+static int uart_fd = -1;
+static struct zba_host_queue uart_queue;
+
+void zba_host_set_uart_fd(int fd)
+{
+  uart_fd = fd;
+}
+
+void zba_host_log(char level, const char *tag, const char *fmt, ...)
+{
+  char line[512];
+  va_list args;
+
+  // Logs share the UART with everything else, as they do on the device.
+  int len = snprintf(line, sizeof(line), "%c (%lld) %s: ", level,
+                     (long long)(esp_timer_get_time() / 1000), tag);
+  va_start(args, fmt);
+  len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+  va_end(args);
+  len = (len < (int)sizeof(line) - 1) ? len : (int)sizeof(line) - 2;
+  line[len++] = '\n';
+
+  if ((uart_fd < 0) || (write(uart_fd, line, len) != len))
+  {
+    fwrite(line, 1, len, stderr);
+  }
+}
+
+int64_t esp_timer_get_time()
+{
+  static int64_t start = 0;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t usec = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  if (!start) start = usec;
+  return usec - start;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+  crc = ~crc;
+  while (len--)
+  {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+int esp_vfs_dev_uart_port_set_tx_line_endings(int uart_num, esp_line_endings_t mode)
+{
+  struct termios tio;
+
+  if ((uart_num != UART_NUM_0) || (mode == ESP_LINE_ENDINGS_CR)) return -1;
+  if (tcgetattr(uart_fd, &tio) != 0) return -1;
+  if (mode == ESP_LINE_ENDINGS_CRLF)
+  {
+    tio.c_oflag |= OPOST | ONLCR;
+  }
+  else
+  {
+    tio.c_oflag &= ~ONLCR;
+  }
+  return (tcsetattr(uart_fd, TCSADRAIN, &tio) == 0) ? 0 : -1;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *queue, int intr_alloc_flags)
+{
+  (void)rx_buffer_size;
+  (void)tx_buffer_size;
+  (void)queue_size;
+  (void)intr_alloc_flags;
+  if ((uart_num != UART_NUM_0) || (uart_fd < 0)) return ESP_FAIL;
+  *queue = &uart_queue;
+  return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+  (void)uart_config;
+  return (uart_num == UART_NUM_0) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num,
+                       int cts_io_num)
+{
+  (void)tx_io_num;
+  (void)rx_io_num;
+  (void)rts_io_num;
+  (void)cts_io_num;
+  return (uart_num == UART_NUM_0) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate)
+{
+  // A pty's rate is just for show.
+  (void)baudrate;
+  return (uart_num == UART_NUM_0) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size)
+{
+  int available = 0;
+  if ((uart_num != UART_NUM_0) || (ioctl(uart_fd, FIONREAD, &available) != 0)) return ESP_FAIL;
+  *size = (size_t)available;
+  return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+  (void)ticks_to_wait;
+  if (uart_num != UART_NUM_0) return -1;
+  return (int)read(uart_fd, buf, length);
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+  if (uart_num != UART_NUM_0) return ESP_FAIL;
+  tcflush(uart_fd, TCIFLUSH);
+  return ESP_OK;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+  struct pollfd pfd = {.fd = uart_fd, .events = POLLIN};
+  uart_event_t *event = (uart_event_t *)item;
+
+  if (queue != &uart_queue) return pdFALSE;
+  int timeout = (ticks_to_wait == portMAX_DELAY) ? -1 : (int)ticks_to_wait;
+  if (poll(&pfd, 1, timeout) <= 0) return pdFALSE;
+  if (pfd.revents & (POLLHUP | POLLERR))
+  {
+    // Whoever was driving the test has gone.
+    exit(0);
+  }
+  event->type = UART_DATA;
+  event->size = 0;
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  (void)queue;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                       void *context, UBaseType_t priority, TaskHandle_t *handle)
+{
+  (void)task;
+  (void)name;
+  (void)stack_depth;
+  (void)context;
+  (void)priority;
+  if (handle) *handle = NULL;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  (void)task;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+  (void)task;
+  return eDeleted;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  usleep(ticks * 1000);
+}
@@ -0,0 +1,20 @@
+#ifndef ZEBRAL_ESP32CAM_ZBA_HOST_H_
+#define ZEBRAL_ESP32CAM_ZBA_HOST_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /// Host stand-ins for the bits of IDF the firmware's portable modules use, so they can be
+  /// built and run by the host tests.
+  ///
+  /// UART0 (driver reads, the VFS's line endings and the log) is fd - a pty slave, so its
+  /// ONLCR output processing does what the VFS's CRLF line endings do on the device.
+  void zba_host_set_uart_fd(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ZEBRAL_ESP32CAM_ZBA_HOST_H_
@@ -0,0 +1,151 @@
+// Device side of the packet loopback test - see packet_loopback.py, which runs it.
+//
+// The serial stream's reader and the packet code run as they do on the device, on a
+// pty standing in for UART0. The pty starts out turning \n into \r\n, like the VFS
+// does by default, so zba_util_init() has to turn that off for packets to get through.
+// Commands and the camera are fakes.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include "zba_host.h"
+#include "zba_mjpeg.h"
+
+// The reader and its state are private to the stream module.
+#include "../main/zba_stream.c"
+
+/// Bytes in the fake frame - enough for several FRAME_DATA packets
+#define LOOPBACK_FRAME_SIZE 10000
+
+static const char *kPassword = "secret";
+
+static uint8_t frame_data[LOOPBACK_FRAME_SIZE];
+static camera_fb_t frame_fb;
+static zba_frame_t frame;
+
+void zba_commands_stream_init(zba_cmd_stream_t *cmd_stream, int fd)
+{
+  memset(cmd_stream, 0, sizeof(*cmd_stream));
+  cmd_stream->fd       = fd;
+  cmd_stream->out.type = (fd == ZBA_INVALID_FD) ? ZBA_CMD_OUT_LOG : ZBA_CMD_OUT_FD;
+}
+
+void zba_commands_stream_init_text(zba_cmd_stream_t *cmd_stream, char *text, size_t size)
+{
+  zba_commands_stream_init(cmd_stream, ZBA_INVALID_FD);
+  cmd_stream->authed        = true;
+  cmd_stream->out.type      = ZBA_CMD_OUT_TEXT;
+  cmd_stream->out.text      = text;
+  cmd_stream->out.text_size = size;
+  text[0]                   = 0;
+}
+
+/// Whole lines to the text, as the real one does, or straight out to the fd
+static void loopback_print(zba_cmd_stream_t *cmd_stream, const char *fmt, ...)
+{
+  char line[128];
+  va_list args;
+
+  va_start(args, fmt);
+  size_t len = ZBA_MIN((size_t)vsnprintf(line, sizeof(line), fmt, args), sizeof(line) - 1);
+  va_end(args);
+
+  zba_cmd_out_t *out = &cmd_stream->out;
+  if (out->type == ZBA_CMD_OUT_FD)
+  {
+    line[len++] = '\n';
+    if (write(cmd_stream->fd, line, len) != (ssize_t)len) exit(1);
+  }
+  else if (out->len + len + 1 < out->text_size)
+  {
+    memcpy(out->text + out->len, line, len);
+    out->text[out->len + len]     = '\n';
+    out->text[out->len + len + 1] = 0;
+    out->len += len + 1;
+  }
+}
+
+/// "login <password>", "lines <count>" and "echo <text>". Anything else fails.
+zba_err_t zba_commands_process(const char *buffer, zba_cmd_stream_t *cmd_stream)
+{
+  if (0 == strncmp(buffer, "login ", 6))
+  {
+    if (0 != strcmp(buffer + 6, kPassword)) return ZBA_CONFIG_NOT_AUTHED;
+    cmd_stream->authed = true;
+    loopback_print(cmd_stream, "Logged in.");
+    return ZBA_OK;
+  }
+  if (0 == strncmp(buffer, "lines ", 6))
+  {
+    int count = atoi(buffer + 6);
+    for (int i = 0; i < count; ++i)
+    {
+      loopback_print(cmd_stream, "line %03d of %03d", i + 1, count);
+    }
+    return ZBA_OK;
+  }
+  if (0 == strncmp(buffer, "echo ", 5))
+  {
+    loopback_print(cmd_stream, "%s", buffer + 5);
+    return ZBA_OK;
+  }
+  return ZBA_INVALID_ARG;
+}
+
+zba_frame_t *zba_mjpeg_grab_frame(uint32_t timeout_ms)
+{
+  (void)timeout_ms;
+  return &frame;
+}
+
+void zba_frame_release(zba_frame_t *released)
+{
+  (void)released;
+}
+
+int main(int argc, char **argv)
+{
+  struct termios tio;
+
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s <pty fd>\n", argv[0]);
+    return 2;
+  }
+
+  // Raw, apart from the output processing the VFS does by default.
+  int fd = atoi(argv[1]);
+  if (tcgetattr(fd, &tio) != 0)
+  {
+    perror("tcgetattr");
+    return 2;
+  }
+  cfmakeraw(&tio);
+  tio.c_oflag |= OPOST | ONLCR;
+  tcsetattr(fd, TCSANOW, &tio);
+  zba_host_set_uart_fd(fd);
+
+  // Every byte value, 0x0A and 0xA5 included.
+  for (size_t i = 0; i < sizeof(frame_data); ++i)
+  {
+    frame_data[i] = (uint8_t)(i * 7);
+  }
+  frame_fb.buf    = frame_data;
+  frame_fb.len    = sizeof(frame_data);
+  frame_fb.width  = 160;
+  frame_fb.height = 120;
+  frame_fb.format = PIXFORMAT_JPEG;
+  frame.fb        = &frame_fb;
+
+  if (ZBA_OK != zba_util_init()) return 1;
+
+  stream_state.fd           = fd;
+  stream_state.uart_queue   = zba_util_get_uart_queue();
+  stream_state.parser.state = ZBA_PACKET_IDLE;
+  zba_commands_stream_init(&stream_state.cmd_stream, fd);
+
+  // Runs until the driver closes its end.
+  stream_reader_task(&stream_state);
+  return 0;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Runs tools/zba_serial.py against the firmware's packet code over a pty.
+
+Usage: packet_loopback.py PACKET_LOOPBACK_BINARY
+
+The binary (packet_loopback.c) runs the serial stream reader and zba_packet on the pty's
+slave end, which starts out adding \\r before each \\n as the UART VFS does by default.
+This drives the master end with zba_serial.Link. Needs pyserial for zba_serial to import.
+"""
+import os
+import select
+import struct
+import subprocess
+import sys
+import termios
+import time
+
+try:
+    import zba_serial
+except ImportError as e:
+    print("Skipping: %s" % e)
+    sys.exit(77)
+
+FRAME_SIZE = 10000  # LOOPBACK_FRAME_SIZE in packet_loopback.c
+
+
+class PtySerial:
+    """Just enough of serial.Serial for zba_serial.Link, on a pty master."""
+
+    def __init__(self, fd, timeout=0.1):
+        self.fd = fd
+        self.timeout = timeout
+        self.baudrate = zba_serial.DEFAULT_BAUD
+
+    @property
+    def in_waiting(self):
+        readable, _, _ = select.select([self.fd], [], [], 0)
+        return 4096 if readable else 0
+
+    def read(self, count):
+        readable, _, _ = select.select([self.fd], [], [], self.timeout)
+        try:
+            return os.read(self.fd, count) if readable else b""
+        except OSError:
+            # EIO once the device side has gone.
+            time.sleep(self.timeout)
+            return b""
+
+    def write(self, data):
+        while data:
+            data = data[os.write(self.fd, data):]
+
+    def flush(self):
+        termios.tcdrain(self.fd)
+
+    def reset_input_buffer(self):
+        while self.in_waiting:
+            self.read(4096)
+
+    def close(self):
+        os.close(self.fd)
+
+
+def check(condition, what):
+    if not condition:
+        raise AssertionError(what)
+    print("ok - " + what)
+
+
+def run(link):
+    check(link.ping(b"ping"), "ping")
+    # Any 0x0A in a reply would have come back as 0D 0A, and failed its CRC.
+    check(link.ping(bytes(range(255))), "ping with binary in it")
+
+    result, output = link.command("lines 40")
+    expected = "".join("line %03d of 040\n" % (i + 1) for i in range(40))
+    check(result == 0 and output == expected, "command output past 256 bytes, newlines intact")
+
+    result, _ = link.command("nonsense")
+    check(result != 0, "failing command")
+
+    with_frame = False
+    try:
+        link.frame()
+    except zba_serial.PacketError:
+        with_frame = True
+    check(with_frame, "frame needs a login")
+
+    # Text lines and packets share the stream, and text isn't touched either.
+    link.serial.write(b"echo between packets\n")
+    deadline = time.monotonic() + link.timeout
+    while b"between packets\n" not in link.pending and time.monotonic() < deadline:
+        link.pending += link.serial.read(4096)
+    check(b"between packets\n" in link.pending, "text command")
+    check(link.ping(b"after text\n"), "ping after a text command")
+
+    result, output = link.command("login secret")
+    check(result == 0 and output == "Logged in.\n", "login")
+
+    width, height, pixformat, data = link.frame()
+    expected = bytes((i * 7) & 0xFF for i in range(FRAME_SIZE))
+    check((width, height) == (160, 120) and data == expected, "frame")
+
+    link.set_baud(921600)
+    check(link.ping(b"\n\n"), "ping after a baud change")
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+
+    master, slave = os.openpty()
+    device = subprocess.Popen([sys.argv[1], str(slave)], pass_fds=[slave])
+    os.close(slave)
+
+    link = zba_serial.Link.__new__(zba_serial.Link)
+    link.serial = PtySerial(master)
+    link.timeout = 2.0
+    link.next_id = 1
+    link.pending = bytearray()
+    try:
+        # Wait for the device side to be listening before talking to it.
+        deadline = time.monotonic() + 5.0
+        while b"Read task started." not in link.pending:
+            if time.monotonic() > deadline or device.poll() is not None:
+                sys.exit("Device side didn't start")
+            link.pending += link.serial.read(4096)
+        link.pending.clear()
+        run(link)
+    except (AssertionError, zba_serial.PacketError) as e:
+        sys.exit("FAILED: %s" % e)
+    finally:
+        link.close()
+        try:
+            device.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            device.kill()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,228 @@
+// Checks the RTP/JPEG packetizer (zba_rtp_jpeg.c) against RFC 2435, on JPEGs built
+// here: the RTP and JPEG header fields, fragment offsets, the Q=255 tables in the
+// first packet only, the restart marker header and the marker bit.
+#include <stdio.h>
+#include <string.h>
+#include "zba_rtp_jpeg.h"
+
+#define TEST_SCAN_LEN   3000
+#define TEST_MAX_PACKET 400
+#define TEST_MAX_COUNT  32
+
+#define CHECK(cond)                                                    \
+  do                                                                   \
+  {                                                                    \
+    if (!(cond))                                                       \
+    {                                                                  \
+      fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                      \
+    }                                                                  \
+  } while (0)
+
+static int failures = 0;
+
+static const uint32_t kTimestamp = 0x12345678;
+static const uint32_t kSsrc      = 0xcafef00d;
+
+/// Packets as sent, copied out of the packetizer's buffer
+typedef struct
+{
+  uint8_t data[TEST_MAX_COUNT][ZBA_RTP_MAX_PACKET];
+  size_t len[TEST_MAX_COUNT];
+  int count;
+  int stop_after;  ///< Refuse packets after this many, 0 for never
+} test_packets_t;
+
+static bool test_send(uint8_t *packet, size_t len, void *context)
+{
+  test_packets_t *packets = (test_packets_t *)context;
+  if (packets->count == TEST_MAX_COUNT) return false;
+
+  // The headroom is the sender's to write.
+  memset(packet - ZBA_RTP_HEADROOM, 0x24, ZBA_RTP_HEADROOM);
+  memcpy(packets->data[packets->count], packet, len);
+  packets->len[packets->count++] = len;
+  return (packets->stop_after == 0) || (packets->count < packets->stop_after);
+}
+
+static size_t test_put_segment(uint8_t *out, uint8_t marker, const uint8_t *body, size_t len)
+{
+  out[0] = 0xff;
+  out[1] = marker;
+  out[2] = (uint8_t)((len + 2) >> 8);
+  out[3] = (uint8_t)(len + 2);
+  memcpy(out + 4, body, len);
+  return 4 + len;
+}
+
+/// Builds a 160x120 baseline JPEG. Returns its length.
+static size_t test_build_jpeg(uint8_t *jpeg, uint8_t sof_marker, uint8_t luma_sampling,
+                              int qtables, uint16_t restart_interval, const uint8_t *scan)
+{
+  uint8_t dqt[2 * 65];
+  const uint8_t sof[] = {8, 0, 120, 0, 160, 3, 1, luma_sampling, 0, 2, 0x11, 1, 3, 0x11, 1};
+  const uint8_t dri[] = {(uint8_t)(restart_interval >> 8), (uint8_t)restart_interval};
+  const uint8_t sos[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+  size_t len          = 0;
+
+  for (int t = 0; t < 2; ++t)
+  {
+    dqt[t * 65] = (uint8_t)t;  // 8-bit, table t
+    for (int i = 0; i < 64; ++i)
+    {
+      dqt[t * 65 + 1 + i] = (uint8_t)(1 + i + t * 100);
+    }
+  }
+
+  jpeg[len++] = 0xff;
+  jpeg[len++] = 0xd8;
+  len += test_put_segment(jpeg + len, 0xdb, dqt, qtables * 65);
+  len += test_put_segment(jpeg + len, sof_marker, sof, sizeof(sof));
+  if (restart_interval)
+  {
+    len += test_put_segment(jpeg + len, 0xdd, dri, sizeof(dri));
+  }
+  len += test_put_segment(jpeg + len, 0xda, sos, sizeof(sos));
+  memcpy(jpeg + len, scan, TEST_SCAN_LEN);
+  len += TEST_SCAN_LEN;
+  jpeg[len++] = 0xff;
+  jpeg[len++] = 0xd9;
+  // The driver can leave padding after EOI.
+  memset(jpeg + len, 0, 7);
+  return len + 7;
+}
+
+static uint32_t test_get24(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static uint32_t test_get32(const uint8_t *p)
+{
+  return (test_get24(p) << 8) | p[3];
+}
+
+/// Packetizes a JPEG and checks every packet. chroma_table is the table id expected in
+/// the second half of the tables.
+static void test_packets(const uint8_t *jpeg_data, size_t jpeg_len, const uint8_t *scan,
+                         uint8_t type, uint16_t restart_interval, int chroma_table)
+{
+  static test_packets_t packets;
+  static uint8_t reassembled[TEST_SCAN_LEN];
+  zba_rtp_jpeg_t jpeg;
+  uint16_t seq    = 0xfffe;  // Goes round part way through
+  uint32_t offset = 0;
+
+  memset(&packets, 0, sizeof(packets));
+  CHECK(zba_rtp_jpeg_parse(jpeg_data, jpeg_len, &jpeg));
+  CHECK((jpeg.width == 160) && (jpeg.height == 120));
+  CHECK(jpeg.type == type);
+  CHECK(jpeg.restart_interval == restart_interval);
+  CHECK(jpeg.scan_len == TEST_SCAN_LEN);
+
+  CHECK(zba_rtp_jpeg_send(&jpeg, &seq, kTimestamp, kSsrc, TEST_MAX_PACKET, test_send, &packets));
+  CHECK(packets.count > 2);
+  CHECK(seq == (uint16_t)(0xfffe + packets.count));
+
+  for (int i = 0; i < packets.count; ++i)
+  {
+    const uint8_t *p = packets.data[i];
+    bool last        = (i == packets.count - 1);
+    CHECK(packets.len[i] <= TEST_MAX_PACKET);
+
+    // RTP header
+    CHECK(p[0] == 0x80);
+    CHECK(p[1] == (ZBA_RTP_JPEG_PAYLOAD_TYPE | (last ? 0x80 : 0)));
+    CHECK(((p[2] << 8) | p[3]) == (uint16_t)(0xfffe + i));
+    CHECK(test_get32(p + 4) == kTimestamp);
+    CHECK(test_get32(p + 8) == kSsrc);
+
+    // Main JPEG header
+    const uint8_t *h = p + 12;
+    CHECK(h[0] == 0);
+    CHECK(test_get24(h + 1) == offset);
+    CHECK(h[4] == type);
+    CHECK(h[5] == 255);
+    CHECK((h[6] == 160 / 8) && (h[7] == 120 / 8));
+    h += 8;
+
+    if (restart_interval)
+    {
+      CHECK(((h[0] << 8) | h[1]) == restart_interval);
+      CHECK((h[2] == 0xff) && (h[3] == 0xff));
+      h += 4;
+    }
+
+    // Quantization tables, in the first packet only
+    if (offset == 0)
+    {
+      CHECK((h[0] == 0) && (h[1] == 0));
+      CHECK(((h[2] << 8) | h[3]) == 128);
+      for (int q = 0; q < 64; ++q)
+      {
+        CHECK(h[4 + q] == 1 + q);
+        CHECK(h[4 + 64 + q] == 1 + q + chroma_table * 100);
+      }
+      h += 4 + 128;
+    }
+
+    size_t chunk = packets.len[i] - (h - p);
+    CHECK(offset + chunk <= TEST_SCAN_LEN);
+    if (offset + chunk > TEST_SCAN_LEN) return;
+    memcpy(reassembled + offset, h, chunk);
+    offset += chunk;
+  }
+  CHECK(offset == TEST_SCAN_LEN);
+  CHECK(0 == memcmp(reassembled, scan, TEST_SCAN_LEN));
+}
+
+int main()
+{
+  static uint8_t scan[TEST_SCAN_LEN];
+  static uint8_t jpeg[TEST_SCAN_LEN + 512];
+  static test_packets_t packets;
+  zba_rtp_jpeg_t parsed;
+  uint16_t seq = 0;
+  size_t len;
+
+  for (size_t i = 0; i < sizeof(scan); ++i)
+  {
+    scan[i] = (uint8_t)(i * 13 + 1);
+    if (scan[i] == 0xff) scan[i] = 0;  // No markers in the scan
+  }
+
+  // 4:2:0, and 4:2:2 with restart markers
+  len = test_build_jpeg(jpeg, 0xc0, 0x22, 2, 0, scan);
+  test_packets(jpeg, len, scan, 1, 0, 1);
+  len = test_build_jpeg(jpeg, 0xc0, 0x21, 2, 8, scan);
+  test_packets(jpeg, len, scan, 64, 8, 1);
+
+  // One table does for both
+  len = test_build_jpeg(jpeg, 0xc0, 0x22, 1, 0, scan);
+  test_packets(jpeg, len, scan, 1, 0, 0);
+
+  // Sending stops when the sender says so
+  len = test_build_jpeg(jpeg, 0xc0, 0x22, 2, 0, scan);
+  memset(&packets, 0, sizeof(packets));
+  packets.stop_after = 2;
+  CHECK(zba_rtp_jpeg_parse(jpeg, len, &parsed));
+  CHECK(!zba_rtp_jpeg_send(&parsed, &seq, kTimestamp, kSsrc, TEST_MAX_PACKET, test_send,
+                           &packets));
+  CHECK((packets.count == 2) && (seq == 2));
+
+  // What RTP/JPEG can't carry
+  len = test_build_jpeg(jpeg, 0xc2, 0x22, 2, 0, scan);
+  CHECK(!zba_rtp_jpeg_parse(jpeg, len, &parsed));
+  len = test_build_jpeg(jpeg, 0xc0, 0x11, 2, 0, scan);
+  CHECK(!zba_rtp_jpeg_parse(jpeg, len, &parsed));
+  len = test_build_jpeg(jpeg, 0xc0, 0x22, 2, 0, scan);
+  CHECK(!zba_rtp_jpeg_parse(jpeg, len - 9 - TEST_SCAN_LEN - 2, &parsed));
+
+  if (failures)
+  {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("rtp_jpeg: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Gzips web assets into a C table for zba_assets.h.
+
+Usage: gen_assets.py --root res --out zba_assets_data.c URI:FILE[:auth] ...
+
+Each asset is gzipped at maximum compression with a zeroed timestamp, so the same
+input always produces the same output, and gets a strong ETag from a hash of it.
+"""
+import argparse
+import gzip
+import hashlib
+import os
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--root", required=True, help="Directory the asset files are in")
+    parser.add_argument("--out", required=True, help="C file to write")
+    parser.add_argument("assets", nargs="+", help="URI:FILE, with :auth to require login")
+    args = parser.parse_args()
+
+    arrays = []
+    entries = []
+    for index, spec in enumerate(args.assets):
+        parts = spec.split(":")
+        if len(parts) not in (2, 3) or (len(parts) == 3 and parts[2] != "auth"):
+            parser.error("bad asset %r" % spec)
+        uri, name = parts[0], parts[1]
+        auth = len(parts) == 3
+        ext = os.path.splitext(name)[1].lower()
+        if ext not in CONTENT_TYPES:
+            parser.error("no content type for %r" % name)
+
+        with open(os.path.join(args.root, name), "rb") as f:
+            raw = f.read()
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(raw).hexdigest()[:16]
+
+        arrays.append("// %s - %u bytes, %u gzipped\nstatic const uint8_t kAsset%u[] = {\n%s\n};\n"
+                      % (name, len(raw), len(packed), index, c_bytes(packed)))
+        entries.append('    {"%s", "%s", "\\"%s\\"", %s, kAsset%u, sizeof(kAsset%u)},'
+                       % (uri, CONTENT_TYPES[ext], etag, "true" if auth else "false", index,
+                          index))
+
+    with open(args.out, "w") as f:
+        f.write("// Generated by tools/gen_assets.py from res/ - don't edit.\n")
+        f.write('#include "zba_assets.h"\n\n')
+        f.write("\n".join(arrays))
+        f.write("\nconst zba_asset_t kAssets[] = {\n%s\n};\n" % "\n".join(entries))
+        f.write("const size_t kAssetCount = sizeof(kAssets) / sizeof(kAssets[0]);\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Talks to the camera over its serial port with binary packets (see main/zba_packet.h).
+
+Usage: zba_serial.py --port /dev/ttyUSB0 [--password PWD] [--baud 2000000] ACTION ...
+
+  ping               Checks the link
+  cmd TEXT           Runs a command and prints its output
+  frame FILE         Captures a frame and saves it
+
+--baud switches the link to a faster rate first. The device goes back to 115200 when
+it resets. Log lines from the device are skipped while waiting for replies.
+Needs pyserial.
+"""
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+SYNC = b"\xa5\x5a"
+HEADER = struct.Struct("<BHH")  # type, id, len - after the sync bytes
+CRC = struct.Struct("<I")
+
+PING = 0x01
+COMMAND = 0x02
+FRAME = 0x03
+BAUD = 0x04
+REPLY = 0x80
+FRAME_DATA = 0x85
+ERR = 0xFF
+
+MAX_PAYLOAD = 2048
+DEFAULT_BAUD = 115200
+
+
+class PacketError(Exception):
+    pass
+
+
+class Link:
+    def __init__(self, port, baud=DEFAULT_BAUD, timeout=5.0):
+        self.serial = serial.Serial(port, baud, timeout=0.1)
+        self.timeout = timeout
+        self.next_id = 1
+        self.pending = bytearray()
+
+    def close(self):
+        self.serial.close()
+
+    def send(self, packet_type, payload=b""):
+        packet_id = self.next_id
+        self.next_id = (self.next_id % 0xFFFF) + 1
+        body = HEADER.pack(packet_type, packet_id, len(payload)) + payload
+        self.serial.write(SYNC + body + CRC.pack(zlib.crc32(body)))
+        return packet_id
+
+    def _fill(self, count, deadline):
+        while len(self.pending) < count:
+            if time.monotonic() > deadline:
+                raise PacketError("timed out")
+            self.pending += self.serial.read(max(count - len(self.pending), self.serial.in_waiting))
+
+    def receive(self, packet_id):
+        """Returns (type, payload) of the next good packet for packet_id."""
+        deadline = time.monotonic() + self.timeout
+        while True:
+            # Anything before the sync bytes is log text.
+            self._fill(len(SYNC) + HEADER.size, deadline)
+            start = self.pending.find(SYNC)
+            if start < 0:
+                del self.pending[:-1]
+                continue
+            del self.pending[:start]
+            self._fill(len(SYNC) + HEADER.size, deadline)
+
+            packet_type, reply_id, length = HEADER.unpack_from(self.pending, len(SYNC))
+            if length > MAX_PAYLOAD:
+                del self.pending[:1]
+                continue
+            total = len(SYNC) + HEADER.size + length + CRC.size
+            self._fill(total, deadline)
+            body = bytes(self.pending[len(SYNC):total - CRC.size])
+            (crc,) = CRC.unpack_from(self.pending, total - CRC.size)
+            if crc != zlib.crc32(body):
+                # Sync bytes that turned up in text, or a damaged packet - look again after them.
+                del self.pending[:1]
+                continue
+            del self.pending[:total]
+            if reply_id != packet_id:
+                continue
+
+            payload = body[HEADER.size:]
+            if packet_type == ERR:
+                raise PacketError("device error 0x%X" % CRC.unpack(payload)[0])
+            return packet_type, payload
+
+    def request(self, packet_type, payload=b""):
+        reply_type, reply = self.receive(self.send(packet_type, payload))
+        if reply_type != packet_type | REPLY:
+            raise PacketError("unexpected reply 0x%02X" % reply_type)
+        return reply
+
+    def ping(self, payload=b"ping"):
+        return self.request(PING, payload) == payload
+
+    def command(self, text):
+        """Returns (result, output)."""
+        reply = self.request(COMMAND, text.encode())
+        (result,) = struct.unpack_from("<I", reply)
+        return result, reply[4:].decode(errors="replace")
+
+    def frame(self):
+        """Returns (width, height, pixformat, data)."""
+        packet_id = self.send(FRAME)
+        reply_type, reply = self.receive(packet_id)
+        if reply_type != FRAME | REPLY:
+            raise PacketError("unexpected reply 0x%02X" % reply_type)
+        size, width, height, pixformat = struct.unpack("<IHHB", reply)
+
+        data = bytearray(size)
+        received = 0
+        while received < size:
+            reply_type, reply = self.receive(packet_id)
+            if reply_type != FRAME_DATA:
+                raise PacketError("unexpected reply 0x%02X" % reply_type)
+            (offset,) = struct.unpack_from("<I", reply)
+            if offset != received:
+                raise PacketError("frame data out of order")
+            data[offset:offset + len(reply) - 4] = reply[4:]
+            received += len(reply) - 4
+        return width, height, pixformat, bytes(data)
+
+    def set_baud(self, baud):
+        self.request(BAUD, struct.pack("<I", baud))
+        # The device switches once its reply has gone.
+        self.serial.flush()
+        time.sleep(0.05)
+        self.serial.baudrate = baud
+        self.serial.reset_input_buffer()
+        self.pending.clear()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="Serial port of the camera")
+    parser.add_argument("--password", help="Device password, to log in first")
+    parser.add_argument("--baud", type=int, help="Rate to switch the link to")
+    parser.add_argument("--timeout", type=float, default=5.0, help="Seconds to wait for a reply")
+    parser.add_argument("action", choices=["ping", "cmd", "frame"])
+    parser.add_argument("arg", nargs="?", help="Command text, or file to save a frame to")
+    args = parser.parse_args()
+
+    link = Link(args.port, timeout=args.timeout)
+    try:
+        if args.password is not None:
+            result, output = link.command("login " + args.password)
+            if result:
+                sys.exit("Login failed: " + output.strip())
+        if args.baud:
+            link.set_baud(args.baud)
+
+        if args.action == "ping":
+            start = time.monotonic()
+            ok = link.ping()
+            print("%s in %.1f ms" % ("ok" if ok else "bad echo", (time.monotonic() - start) * 1000))
+        elif args.action == "cmd":
+            result, output = link.command(args.arg or "")
+            sys.stdout.write(output)
+            if result:
+                sys.exit("Command failed: 0x%X" % result)
+        elif args.action == "frame":
+            if not args.arg:
+                sys.exit("frame needs a file to save to")
+            start = time.monotonic()
+            width, height, pixformat, data = link.frame()
+            elapsed = time.monotonic() - start
+            with open(args.arg, "wb") as f:
+                f.write(data)
+            print("%dx%d format %d, %d bytes in %.2f s" % (width, height, pixformat, len(data),
+                                                           elapsed))
+    except PacketError as e:
+        sys.exit("Error: %s" % e)
+    finally:
+        link.close()
+
+
+if __name__ == "__main__":
+    main()